@@ -0,0 +1,530 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include <core/update_args.h>
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "state_tree_group.h"
+#include "static_dispatch.h"
+#include "game_state.h"
+#include "benchmark.h"
+
+using namespace ngen::StateSystem;
+using ngen::Benchmark::BenchmarkState;
+using ngen::Benchmark::doNotOptimize;
+
+// Number of distinct system names registered for the synthetic trees, every name maps to BenchGameSystem
+static const size_t kBenchSystemTypes = 64;
+
+// Game system performing a trivial amount of work, so the benchmarks measure the cost of dispatch
+class BenchGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem, public ngen::IPostUpdateGameSystem,
+                        public ngen::IRecyclableGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(BenchGameSystem)
+
+public:
+    BenchGameSystem() : counter(0) {}
+
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() { counter++; }
+    virtual void onDeactivate() { counter++; }
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) { counter++; }
+    virtual void onPostUpdate(const ngen::UpdateArgs &updateArgs) { counter++; }
+
+    virtual void onReset() { counter = 0; }
+
+    size_t counter;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(BenchGameSystem)
+
+class BenchUpdateArgs : public ngen::UpdateArgs {
+public:
+    BenchUpdateArgs() { deltaTime = 1.0f / 60.0f; }
+
+    virtual bool requestState(const char *name) const { return false; }
+};
+
+//! \brief Retrieves the name used for the specified synthetic system type.
+static std::string getSystemName(size_t type) {
+    return "BenchSystem" + std::to_string(type % kBenchSystemTypes);
+}
+
+//! \brief Registers every synthetic system name with the supplied factory.
+static void registerBenchSystems(ngen::GameSystemFactory &factory) {
+    for (size_t loop = 0; loop < kBenchSystemTypes; ++loop) {
+        factory.registerClass(&BenchGameSystem::__ngen__creator, ngen::GameSystemHash::compute(getSystemName(loop).c_str()));
+    }
+}
+
+//! \brief Allows the factory to keep deleted instances of every synthetic system for reuse.
+static void enableRecycling(ngen::GameSystemFactory &factory) {
+    for (size_t loop = 0; loop < kBenchSystemTypes; ++loop) {
+        factory.setRecycleLimit(ngen::GameSystemHash::compute(getSystemName(loop).c_str()), 1 << 16);
+    }
+}
+
+//! \brief Builds an image containing a complete tree of the specified shape.
+//! \param image [out] -
+//!        Receives the binary image.
+//! \param depth [in] -
+//!        Number of levels below the root state.
+//! \param fanOut [in] -
+//!        Number of children owned by each non-leaf state.
+//! \param systemsPerState [in] -
+//!        Number of game systems owned by each state.
+//! \return The number of states within the tree.
+static size_t buildBenchTree(std::vector<uint8_t> &image, int64_t depth, int64_t fanOut, int64_t systemsPerState) {
+    StateTreeBuilder builder;
+
+    // States are generated breadth first, so each level follows the previous one
+    std::vector<size_t> level(1, builder.addState("state_0"));
+    size_t stateCount = 1;
+
+    for (int64_t loop = 0; loop < depth; ++loop) {
+        std::vector<size_t> next;
+
+        for (auto parent : level) {
+            for (int64_t child = 0; child < fanOut; ++child) {
+                next.push_back(builder.addState(("state_" + std::to_string(stateCount++)).c_str(), parent));
+            }
+        }
+
+        level.swap(next);
+    }
+
+    for (size_t state = 0; state < stateCount; ++state) {
+        for (int64_t system = 0; system < systemsPerState; ++system) {
+            builder.addSystem(state, getSystemName(state * systemsPerState + system).c_str());
+        }
+    }
+
+    // The first leaf is the default state
+    builder.setDefaultState(stateCount - level.size());
+    builder.build(image);
+
+    return stateCount;
+}
+
+//! \brief Walks from a state to the leaf reached by always following the last child.
+static GameState* getLastLeaf(GameState *state) {
+    while (state->getChildCount()) {
+        state = state->getChild(state->getChildCount() - 1);
+    }
+
+    return state;
+}
+
+// Arguments: depth, fan out, systems per state
+static void StateTree_Update(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, state.getArgument(0), state.getArgument(1), state.getArgument(2));
+
+    StateTree stateTree;
+    stateTree.load(factory, image.data(), image.size());
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+
+    BenchUpdateArgs updateArgs;
+
+    while (state.keepRunning()) {
+        stateTree.onUpdate(updateArgs);
+        stateTree.onPostUpdate(updateArgs);
+    }
+
+    state.setItemsProcessed(state.getIterations() * stateTree.getActiveState()->getBranchSystemCount() * 2);
+    stateTree.onDestroy();
+}
+
+NGEN_BENCHMARK(StateTree_Update)->args({ 2, 4, 4 })->args({ 4, 4, 8 })->args({ 8, 2, 8 })->args({ 4, 4, 32 });
+
+// Arguments: depth, fan out, systems per state
+static void StateTree_UpdateStatic(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, state.getArgument(0), state.getArgument(1), state.getArgument(2));
+
+    StateTree stateTree;
+    stateTree.load(factory, image.data(), image.size());
+
+    const StaticDispatch dispatch{ GameSystemTypeList<BenchGameSystem>() };
+    stateTree.setStaticDispatch(&dispatch);
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+
+    BenchUpdateArgs updateArgs;
+
+    while (state.keepRunning()) {
+        stateTree.onUpdate(updateArgs);
+        stateTree.onPostUpdate(updateArgs);
+    }
+
+    state.setItemsProcessed(state.getIterations() * stateTree.getActiveState()->getBranchSystemCount() * 2);
+    stateTree.onDestroy();
+}
+
+NGEN_BENCHMARK(StateTree_UpdateStatic)->args({ 2, 4, 4 })->args({ 4, 4, 8 })->args({ 8, 2, 8 })->args({ 4, 4, 32 });
+
+// Arguments: number of instances, each instance is a tree of depth 2 with a fan out of 4 and 8 systems per state
+static void StateTree_UpdateInstances(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, 2, 4, 8);
+
+    std::vector<std::unique_ptr<StateTree>> treeList;
+
+    for (int64_t loop = 0; loop < state.getArgument(0); ++loop) {
+        treeList.emplace_back(new StateTree);
+        treeList.back()->load(factory, image.data(), image.size());
+
+        ngen::InitArgs initArgs;
+        treeList.back()->onInitialize(initArgs);
+        treeList.back()->commitStateChange();
+    }
+
+    BenchUpdateArgs updateArgs;
+
+    while (state.keepRunning()) {
+        for (auto &stateTree : treeList) {
+            stateTree->onUpdate(updateArgs);
+            stateTree->onPostUpdate(updateArgs);
+        }
+    }
+
+    state.setItemsProcessed(state.getIterations() * treeList.size() * treeList.front()->getActiveState()->getBranchSystemCount() * 2);
+
+    for (auto &stateTree : treeList) {
+        stateTree->onDestroy();
+    }
+}
+
+NGEN_BENCHMARK(StateTree_UpdateInstances)->args({ 16 })->args({ 256 });
+
+// Arguments: number of instances, matching StateTree_UpdateInstances
+static void StateTreeGroup_Update(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, 2, 4, 8);
+
+    StateTreeGroup group;
+    group.load(factory, image.data(), image.size());
+
+    for (int64_t loop = 0; loop < state.getArgument(0); ++loop) {
+        ngen::InitArgs initArgs;
+        group.createInstance()->onInitialize(initArgs);
+    }
+
+    BenchUpdateArgs updateArgs;
+
+    while (state.keepRunning()) {
+        group.onUpdate(updateArgs);
+        group.onPostUpdate(updateArgs);
+    }
+
+    state.setItemsProcessed(state.getIterations() * group.getInstanceCount() * group.getInstance(0)->getActiveState()->getBranchSystemCount() * 2);
+
+    for (size_t loop = 0; loop < group.getInstanceCount(); ++loop) {
+        group.getInstance(loop)->onDestroy();
+    }
+}
+
+NGEN_BENCHMARK(StateTreeGroup_Update)->args({ 16 })->args({ 256 });
+
+// Arguments: depth, distance from the leaves to the common ancestor of the transition
+static void StateTree_Transition(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, state.getArgument(0), 2, 4);
+
+    StateTree stateTree;
+    stateTree.load(factory, image.data(), image.size());
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+
+    // The second leaf lies on the opposite side of the ancestor found by walking up from the first
+    GameState *leafA = stateTree.getActiveState();
+    GameState *ancestor = leafA;
+
+    for (int64_t loop = 0; loop < state.getArgument(1) && ancestor->getParent(); ++loop) {
+        ancestor = ancestor->getParent();
+    }
+
+    GameState *leafB = getLastLeaf(ancestor);
+    GameState *targets[] = { leafB, leafA };
+
+    size_t index = 0;
+    while (state.keepRunning()) {
+        stateTree.requestState(targets[index]);
+        stateTree.commitStateChange();
+        index ^= 1;
+    }
+
+    state.setItemsProcessed(state.getIterations());
+    stateTree.onDestroy();
+}
+
+NGEN_BENCHMARK(StateTree_Transition)->args({ 8, 1 })->args({ 8, 2 })->args({ 8, 4 })->args({ 8, 8 });
+
+// Arguments: depth, distance from the leaves to the common ancestor of the transition, transition budget (us)
+static void StateTree_TransitionIncremental(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, state.getArgument(0), 2, 4);
+
+    StateTree stateTree;
+    stateTree.load(factory, image.data(), image.size());
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+    stateTree.setTransitionBudget(uint32_t(state.getArgument(2)));
+
+    GameState *leafA = stateTree.getActiveState();
+    GameState *ancestor = leafA;
+
+    for (int64_t loop = 0; loop < state.getArgument(1) && ancestor->getParent(); ++loop) {
+        ancestor = ancestor->getParent();
+    }
+
+    GameState *leafB = getLastLeaf(ancestor);
+    GameState *targets[] = { leafB, leafA };
+
+    // Each iteration is a single commit, a new transition is requested once the previous one completes
+    size_t index = 0;
+    while (state.keepRunning()) {
+        if (!stateTree.getTransitionState()) {
+            stateTree.requestState(targets[index]);
+            index ^= 1;
+        }
+
+        stateTree.commitStateChange();
+    }
+
+    state.setItemsProcessed(state.getIterations());
+    stateTree.onDestroy();
+}
+
+NGEN_BENCHMARK(StateTree_TransitionIncremental)->args({ 8, 8, 1 })->args({ 8, 8, 5 });
+
+// Arguments: depth, fan out
+static void StateTree_FindState(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+
+    std::vector<uint8_t> image;
+    const size_t stateCount = buildBenchTree(image, state.getArgument(0), state.getArgument(1), 0);
+
+    StateTree stateTree;
+    stateTree.load(factory, image.data(), image.size());
+
+    std::vector<SystemHash> hashList;
+    for (size_t loop = 0; loop < stateCount; ++loop) {
+        hashList.push_back(StateTree::computeHash(("state_" + std::to_string(loop)).c_str()));
+    }
+
+    size_t index = 0;
+    while (state.keepRunning()) {
+        doNotOptimize(stateTree.findState(hashList[index]));
+        index = index + 1 < hashList.size() ? index + 1 : 0;
+    }
+
+    state.setItemsProcessed(state.getIterations());
+}
+
+NGEN_BENCHMARK(StateTree_FindState)->args({ 2, 4 })->args({ 5, 4 })->args({ 10, 2 });
+
+// Arguments: depth, fan out
+static void StateTree_FindStateName(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+
+    std::vector<uint8_t> image;
+    const size_t stateCount = buildBenchTree(image, state.getArgument(0), state.getArgument(1), 0);
+
+    StateTree stateTree;
+    stateTree.load(factory, image.data(), image.size());
+
+    std::vector<std::string> nameList;
+    for (size_t loop = 0; loop < stateCount; ++loop) {
+        nameList.push_back("state_" + std::to_string(loop));
+    }
+
+    size_t index = 0;
+    while (state.keepRunning()) {
+        doNotOptimize(stateTree.findState(nameList[index].c_str()));
+        index = index + 1 < nameList.size() ? index + 1 : 0;
+    }
+
+    state.setItemsProcessed(state.getIterations());
+}
+
+NGEN_BENCHMARK(StateTree_FindStateName)->args({ 2, 4 })->args({ 5, 4 });
+
+//! \brief Measures getSystem from either the deepest leaf or its parent, for every system within the branch.
+static void measureGetSystem(BenchmarkState &state, bool fromLeaf) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, state.getArgument(0), 2, state.getArgument(1));
+
+    StateTree stateTree;
+    stateTree.load(factory, image.data(), image.size());
+
+    GameState *leaf = getLastLeaf(stateTree.getState(0));
+    GameState *source = fromLeaf ? leaf : leaf->getParent();
+
+    // Look up each system within the branch visible from the source state
+    std::vector<ngen::GameSystemHash::Type> hashList;
+    for (GameState *scan = source; scan; scan = scan->getParent()) {
+        for (size_t loop = 0; loop < scan->getSystemCount(); ++loop) {
+            hashList.push_back(scan->getSystemInstance(loop)->hash);
+        }
+    }
+
+    size_t index = 0;
+    while (state.keepRunning()) {
+        doNotOptimize(source->getSystem(hashList[index]));
+        index = index + 1 < hashList.size() ? index + 1 : 0;
+    }
+
+    state.setItemsProcessed(state.getIterations());
+}
+
+// Arguments: depth, systems per state
+static void GameState_GetSystem(BenchmarkState &state) {
+    measureGetSystem(state, true);
+}
+
+NGEN_BENCHMARK(GameState_GetSystem)->args({ 2, 4 })->args({ 4, 8 })->args({ 8, 8 });
+
+// Arguments: depth, systems per state
+static void GameState_GetSystemScan(BenchmarkState &state) {
+    measureGetSystem(state, false);
+}
+
+NGEN_BENCHMARK(GameState_GetSystemScan)->args({ 2, 4 })->args({ 4, 8 })->args({ 8, 8 });
+
+static void GameSystemFactory_CreateDelete(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    const ngen::GameSystemHash::Type hash = ngen::GameSystemHash::compute(getSystemName(0).c_str());
+
+    while (state.keepRunning()) {
+        ngen::GameSystemInstance instance;
+
+        factory.createInstance(instance, hash);
+        factory.deleteInstance(instance);
+    }
+
+    state.setItemsProcessed(state.getIterations());
+}
+
+NGEN_BENCHMARK(GameSystemFactory_CreateDelete);
+
+static void GameSystemFactory_CreateDeleteRecycled(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+    enableRecycling(factory);
+
+    const ngen::GameSystemHash::Type hash = ngen::GameSystemHash::compute(getSystemName(0).c_str());
+
+    while (state.keepRunning()) {
+        ngen::GameSystemInstance instance;
+
+        factory.createInstance(instance, hash);
+        factory.deleteInstance(instance);
+    }
+
+    state.setItemsProcessed(state.getIterations());
+}
+
+NGEN_BENCHMARK(GameSystemFactory_CreateDeleteRecycled);
+
+// Arguments: depth, fan out, systems per state
+static void StateTree_Load(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildBenchTree(image, state.getArgument(0), state.getArgument(1), state.getArgument(2));
+
+    StateTree stateTree;
+
+    while (state.keepRunning()) {
+        state.pauseTiming();
+        stateTree.unload();
+        state.resumeTiming();
+
+        stateTree.load(factory, image.data(), image.size());
+    }
+
+    state.setItemsProcessed(state.getIterations() * stateTree.getStateCount());
+}
+
+NGEN_BENCHMARK(StateTree_Load)->args({ 4, 4, 4 })->args({ 6, 4, 8 });
+
+// Arguments: depth, fan out, systems per state
+static void StateTree_LoadRecycled(BenchmarkState &state) {
+    ngen::GameSystemFactory factory;
+    registerBenchSystems(factory);
+    enableRecycling(factory);
+
+    std::vector<uint8_t> source;
+    buildBenchTree(source, state.getArgument(0), state.getArgument(1), state.getArgument(2));
+
+    std::vector<uint8_t> image;
+    StateTree stateTree;
+
+    while (state.keepRunning()) {
+        // Unloading the previous tree returns its systems to the factory, where the next load finds them
+        state.pauseTiming();
+        stateTree.unload();
+        image = source;
+        state.resumeTiming();
+
+        stateTree.load(factory, image.data(), image.size());
+    }
+
+    state.setItemsProcessed(state.getIterations() * stateTree.getStateCount());
+}
+
+NGEN_BENCHMARK(StateTree_LoadRecycled)->args({ 4, 4, 4 })->args({ 6, 4, 8 });
@@ -0,0 +1,329 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <regex>
+#include <thread>
+
+#include "benchmark.h"
+
+namespace ngen {
+    namespace Benchmark {
+        // Runs are repeated with an increasing number of iterations until they take at least this long
+        static const double kDefaultMinimumTime = 0.5;
+        static const size_t kMaximumIterations = 1000000000;
+
+        // Measurements taken for a single benchmark and argument set
+        struct BenchmarkResult {
+            std::string name;
+            size_t iterations;
+            double realTime;            // Nanoseconds per iteration
+            double cpuTime;             // Nanoseconds per iteration
+            double itemsPerSecond;      // 0 if the benchmark did not report the items it processed
+        };
+
+        //! \brief Retrieves the list of registered benchmarks.
+        static std::vector<std::unique_ptr<Benchmark>>& getRegistry() {
+            static std::vector<std::unique_ptr<Benchmark>> registry;
+            return registry;
+        }
+
+        BenchmarkState::BenchmarkState(size_t iterations, const std::vector<int64_t> &arguments)
+        : m_arguments(arguments)
+        , m_iterations(iterations)
+        , m_remaining(iterations)
+        , m_itemsProcessed(0)
+        , m_started(false)
+        , m_timing(false)
+        , m_cpuStart(0)
+        , m_realTime(0.0)
+        , m_cpuTime(0.0)
+        {
+            //
+        }
+
+        //! \brief Determines whether or not another iteration of the timed loop should be executed.
+        //!
+        //! The timer is started by the first call and stopped once every iteration has been executed.
+        //! \return <em>True</em> if the loop should continue otherwise <em>false</em>.
+        bool BenchmarkState::keepRunning() {
+            if (!m_started) {
+                m_started = true;
+                resumeTiming();
+            }
+
+            if (!m_remaining) {
+                pauseTiming();
+                return false;
+            }
+
+            m_remaining--;
+            return true;
+        }
+
+        //! \brief Stops the timer, the work performed until resumeTiming is called is not measured.
+        void BenchmarkState::pauseTiming() {
+            if (m_timing) {
+                m_realTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_realStart).count();
+                m_cpuTime += double(std::clock() - m_cpuStart) / CLOCKS_PER_SEC;
+                m_timing = false;
+            }
+        }
+
+        //! \brief Restarts the timer after a call to pauseTiming.
+        void BenchmarkState::resumeTiming() {
+            if (!m_timing) {
+                m_realStart = std::chrono::steady_clock::now();
+                m_cpuStart = std::clock();
+                m_timing = true;
+            }
+        }
+
+        Benchmark::Benchmark(const char *name, BenchmarkFunction function)
+        : m_name(name)
+        , m_function(function)
+        {
+            //
+        }
+
+        //! \brief Adds a set of arguments the benchmark is to be run with.
+        //! \param arguments [in] -
+        //!        The argument values, retrieved through BenchmarkState::getArgument.
+        //! \return This benchmark, so further argument sets may be chained.
+        Benchmark* Benchmark::args(std::initializer_list<int64_t> arguments) {
+            m_argumentList.emplace_back(arguments);
+            return this;
+        }
+
+        //! \brief Retrieves the name of the benchmark.
+        const std::string& Benchmark::getName() const {
+            return m_name;
+        }
+
+        //! \brief Retrieves the function that performs the benchmark.
+        BenchmarkFunction Benchmark::getFunction() const {
+            return m_function;
+        }
+
+        //! \brief Retrieves each set of arguments the benchmark is run with.
+        const std::vector<std::vector<int64_t>>& Benchmark::getArgumentList() const {
+            return m_argumentList;
+        }
+
+        //! \brief Adds a benchmark to the list of benchmarks executed by runBenchmarks.
+        //! \param name [in] -
+        //!        The name of the benchmark.
+        //! \param function [in] -
+        //!        The function that performs the benchmark.
+        //! \return The registered benchmark, used to supply its argument sets.
+        Benchmark* registerBenchmark(const char *name, BenchmarkFunction function) {
+            getRegistry().emplace_back(new Benchmark(name, function));
+            return getRegistry().back().get();
+        }
+
+        //! \brief Runs a benchmark with an increasing number of iterations until the measurement is long enough.
+        static BenchmarkResult runBenchmark(const Benchmark &benchmark, const std::vector<int64_t> &arguments, const std::string &name, double minimumTime) {
+            size_t iterations = 1;
+
+            for (;;) {
+                BenchmarkState state(iterations, arguments);
+                benchmark.getFunction()(state);
+
+                const double realTime = state.getRealTime();
+
+                if (realTime >= minimumTime || iterations >= kMaximumIterations) {
+                    BenchmarkResult result;
+
+                    result.name = name;
+                    result.iterations = iterations;
+                    result.realTime = realTime * 1e9 / double(iterations);
+                    result.cpuTime = state.getCpuTime() * 1e9 / double(iterations);
+                    result.itemsPerSecond = realTime > 0.0 ? double(state.getItemsProcessed()) / realTime : 0.0;
+
+                    return result;
+                }
+
+                // Predict the number of iterations required, growing by at most 10x per attempt
+                double multiplier = realTime > 0.0 ? (minimumTime * 1.4) / realTime : 10.0;
+                multiplier = std::min(std::max(multiplier, 2.0), 10.0);
+
+                iterations = std::min(kMaximumIterations, static_cast<size_t>(double(iterations) * multiplier));
+            }
+        }
+
+        //! \brief Writes the results in the JSON format produced by Google Benchmark, so existing tooling may compare runs.
+        static void writeJson(FILE *output, const std::vector<BenchmarkResult> &results) {
+            char date[64];
+            const std::time_t now = std::time(nullptr);
+            std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+            fprintf(output, "{\n");
+            fprintf(output, "  \"context\": {\n");
+            fprintf(output, "    \"date\": \"%s\",\n", date);
+            fprintf(output, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#if defined(NDEBUG)
+            fprintf(output, "    \"library_build_type\": \"release\"\n");
+#else
+            fprintf(output, "    \"library_build_type\": \"debug\"\n");
+#endif
+            fprintf(output, "  },\n");
+            fprintf(output, "  \"benchmarks\": [\n");
+
+            for (size_t loop = 0; loop < results.size(); ++loop) {
+                const BenchmarkResult &result = results[loop];
+
+                fprintf(output, "    {\n");
+                fprintf(output, "      \"name\": \"%s\",\n", result.name.c_str());
+                fprintf(output, "      \"iterations\": %zu,\n", result.iterations);
+                fprintf(output, "      \"real_time\": %.3f,\n", result.realTime);
+                fprintf(output, "      \"cpu_time\": %.3f,\n", result.cpuTime);
+
+                if (result.itemsPerSecond > 0.0) {
+                    fprintf(output, "      \"items_per_second\": %.3f,\n", result.itemsPerSecond);
+                }
+
+                fprintf(output, "      \"time_unit\": \"ns\"\n");
+                fprintf(output, "    }%s\n", loop + 1 < results.size() ? "," : "");
+            }
+
+            fprintf(output, "  ]\n");
+            fprintf(output, "}\n");
+        }
+
+        //! \brief Writes a single result as a row of the console table.
+        static void writeConsole(const BenchmarkResult &result) {
+            printf("%-48s %12.1f ns %12.1f ns %12zu", result.name.c_str(), result.realTime, result.cpuTime, result.iterations);
+
+            if (result.itemsPerSecond > 0.0) {
+                printf(" %10.3fM items/s", result.itemsPerSecond / 1e6);
+            }
+
+            printf("\n");
+            fflush(stdout);
+        }
+
+        //! \brief Retrieves the value of a command line option of the form --name=value.
+        static const char* getOption(const char *argument, const char *name) {
+            const size_t length = strlen(name);
+            return strncmp(argument, name, length) == 0 && argument[length] == '=' ? argument + length + 1 : nullptr;
+        }
+
+        //! \brief Executes every registered benchmark and reports the results.
+        //!
+        //! The following options are supported:
+        //!
+        //!     --benchmark_filter=<regex>      Only runs benchmarks whose name matches the expression
+        //!     --benchmark_min_time=<seconds>  Minimum duration of the timed loop for each benchmark
+        //!     --benchmark_format=<console|json> Format of the results written to stdout
+        //!     --benchmark_out=<path>          Also writes the results to the specified file as JSON
+        //!
+        //! \return 0 if the benchmarks were run successfully otherwise 1.
+        int runBenchmarks(int argc, char **argv) {
+            std::string filter = ".*";
+            std::string format = "console";
+            const char *outputPath = nullptr;
+            double minimumTime = kDefaultMinimumTime;
+
+            for (int loop = 1; loop < argc; ++loop) {
+                const char *value;
+
+                if ((value = getOption(argv[loop], "--benchmark_filter"))) {
+                    filter = value;
+                } else if ((value = getOption(argv[loop], "--benchmark_min_time"))) {
+                    minimumTime = atof(value);
+                } else if ((value = getOption(argv[loop], "--benchmark_format"))) {
+                    format = value;
+                } else if ((value = getOption(argv[loop], "--benchmark_out"))) {
+                    outputPath = value;
+                } else {
+                    fprintf(stderr, "Unrecognized option: %s\n", argv[loop]);
+                    return 1;
+                }
+            }
+
+            if (format != "console" && format != "json") {
+                fprintf(stderr, "Unsupported format: %s\n", format.c_str());
+                return 1;
+            }
+
+            std::regex expression;
+            try {
+                expression = std::regex(filter);
+            } catch (const std::regex_error&) {
+                fprintf(stderr, "Invalid filter: %s\n", filter.c_str());
+                return 1;
+            }
+
+            const bool console = format == "console";
+            if (console) {
+                printf("%-48s %15s %15s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+            }
+
+            std::vector<BenchmarkResult> results;
+
+            for (auto &benchmark : getRegistry()) {
+                static const std::vector<int64_t> kNoArguments;
+
+                std::vector<std::vector<int64_t>> argumentList = benchmark->getArgumentList();
+                if (argumentList.empty()) {
+                    argumentList.push_back(kNoArguments);
+                }
+
+                for (auto &arguments : argumentList) {
+                    std::string name = benchmark->getName();
+                    for (auto argument : arguments) {
+                        name += "/" + std::to_string(argument);
+                    }
+
+                    if (!std::regex_search(name, expression)) {
+                        continue;
+                    }
+
+                    results.push_back(runBenchmark(*benchmark, arguments, name, minimumTime));
+
+                    if (console) {
+                        writeConsole(results.back());
+                    }
+                }
+            }
+
+            if (!console) {
+                writeJson(stdout, results);
+            }
+
+            if (outputPath) {
+                FILE *output = fopen(outputPath, "w");
+                if (!output) {
+                    fprintf(stderr, "Unable to write: %s\n", outputPath);
+                    return 1;
+                }
+
+                writeJson(output, results);
+                fclose(output);
+            }
+
+            return 0;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    return ngen::Benchmark::runBenchmarks(argc, argv);
+}
@@ -0,0 +1,157 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_BENCHMARK_H
+#define NGEN_STATE_SYSTEM_BENCHMARK_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace Benchmark {
+        //! \brief Controls the timed loop of a single benchmark run.
+        //!
+        //! The benchmark function performs any setup, then repeats the code being measured while keepRunning
+        //! returns true. Only the time spent inside the loop is measured, pauseTiming and resumeTiming may be used
+        //! to exclude work that must be repeated each iteration.
+        class BenchmarkState {
+        public:
+            BenchmarkState(size_t iterations, const std::vector<int64_t> &arguments);
+
+            bool keepRunning();
+
+            void pauseTiming();
+            void resumeTiming();
+
+            int64_t getArgument(size_t index) const;
+            size_t getIterations() const;
+
+            void setItemsProcessed(uint64_t items);
+            uint64_t getItemsProcessed() const;
+
+            double getRealTime() const;
+            double getCpuTime() const;
+
+        private:
+            const std::vector<int64_t> &m_arguments;
+
+            size_t m_iterations;
+            size_t m_remaining;
+            uint64_t m_itemsProcessed;
+            bool m_started;
+            bool m_timing;
+
+            std::chrono::steady_clock::time_point m_realStart;
+            std::clock_t m_cpuStart;
+
+            double m_realTime;      // Accumulated wall clock time (in seconds)
+            double m_cpuTime;       // Accumulated processor time (in seconds)
+        };
+
+        typedef void (*BenchmarkFunction)(BenchmarkState &state);
+
+        //! \brief A registered benchmark function along with each set of arguments it is run with.
+        class Benchmark {
+        public:
+            Benchmark(const char *name, BenchmarkFunction function);
+
+            Benchmark* args(std::initializer_list<int64_t> arguments);
+
+            const std::string& getName() const;
+            BenchmarkFunction getFunction() const;
+            const std::vector<std::vector<int64_t>>& getArgumentList() const;
+
+        private:
+            std::string m_name;
+            BenchmarkFunction m_function;
+            std::vector<std::vector<int64_t>> m_argumentList;
+        };
+
+        Benchmark* registerBenchmark(const char *name, BenchmarkFunction function);
+        int runBenchmarks(int argc, char **argv);
+
+        //! \brief Prevents the compiler from discarding a value that is computed but never used.
+        template <typename TType> inline void doNotOptimize(const TType &value) {
+#if defined(__GNUC__) || defined(__clang__)
+            asm volatile("" : : "r,m"(value) : "memory");
+#else
+            static volatile const TType *sink;
+            sink = &value;
+#endif
+        }
+
+        //! \brief Retrieves the number of times the timed loop is executed.
+        //! \return The number of iterations for this run.
+        inline size_t BenchmarkState::getIterations() const {
+            return m_iterations;
+        }
+
+        //! \brief Retrieves the argument at the specified index.
+        //! \param index [in] -
+        //!        Index of the argument to be retrieved.
+        //! \return The value of the argument, or 0 if the benchmark was not supplied that many arguments.
+        inline int64_t BenchmarkState::getArgument(size_t index) const {
+            return index < m_arguments.size() ? m_arguments[index] : 0;
+        }
+
+        //! \brief Specifies the total number of items processed by the run, used to report a throughput.
+        //! \param items [in] -
+        //!        The number of items processed across every iteration.
+        inline void BenchmarkState::setItemsProcessed(uint64_t items) {
+            m_itemsProcessed = items;
+        }
+
+        //! \brief Retrieves the total number of items processed by the run.
+        //! \return The number of items processed across every iteration.
+        inline uint64_t BenchmarkState::getItemsProcessed() const {
+            return m_itemsProcessed;
+        }
+
+        //! \brief Retrieves the wall clock time spent within the timed loop.
+        //! \return The elapsed time (in seconds).
+        inline double BenchmarkState::getRealTime() const {
+            return m_realTime;
+        }
+
+        //! \brief Retrieves the processor time spent within the timed loop.
+        //! \return The processor time consumed by the process (in seconds).
+        inline double BenchmarkState::getCpuTime() const {
+            return m_cpuTime;
+        }
+    }
+}
+
+#define NGEN_BENCHMARK_CONCAT_INNER(a, b) a##b
+#define NGEN_BENCHMARK_CONCAT(a, b) NGEN_BENCHMARK_CONCAT_INNER(a, b)
+
+// Registers a benchmark function, argument sets may be appended eg. NGEN_BENCHMARK(function)->args({ 1, 2 });
+#define NGEN_BENCHMARK(function)                                                        \
+    static ngen::Benchmark::Benchmark *NGEN_BENCHMARK_CONCAT(__ngen__benchmark, __LINE__) = \
+        ngen::Benchmark::registerBenchmark(#function, function)
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_BENCHMARK_H
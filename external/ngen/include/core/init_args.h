@@ -20,14 +20,22 @@
 ////////////////////////////////////////////////////////////////////////////
 
 namespace ngen {
+    struct MemoryPool;
+
     namespace StateSystem {
         class GameState;
         class StateTree;
     }
 
     struct InitArgs {
+        InitArgs() : stateTree(nullptr), gameState(nullptr), memory(nullptr) {}
+
         ngen::StateSystem::StateTree    *stateTree;
         ngen::StateSystem::GameState    *gameState;
+
+        // Pool the system should use for its own allocations, including those made later within onActivate.
+        // When supplied by a state tree each allocation is charged to the system and its state (may be nullptr).
+        ngen::MemoryPool                *memory;
     };
 }
 
@@ -0,0 +1,71 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_CORE_MEMORY_POOL_H
+#define NGEN_CORE_MEMORY_POOL_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    //! \brief Interface used to supply memory to objects created by the engine.
+    //!
+    //! Implementations may be general purpose heaps or linear arenas, in the latter case release may do nothing
+    //! and the memory is returned once the arena itself is released.
+    struct MemoryPool {
+        virtual void* allocate(size_t size, size_t alignment) = 0;
+        virtual void release(void *memory) = 0;
+    };
+
+    //! \brief MemoryPool implementation that allocates each block from the global heap.
+    //!
+    //! Each block is over-allocated so it may be aligned as requested, the address returned by the heap is
+    //! stored immediately before the aligned block so it can be recovered when the block is released.
+    struct HeapMemoryPool : public MemoryPool {
+        void* allocate(size_t size, size_t alignment) {
+            if (alignment < alignof(void*)) {
+                alignment = alignof(void*);
+            }
+
+            uint8_t *memory = static_cast<uint8_t*>(::operator new(size + alignment + sizeof(void*), std::nothrow));
+            if (!memory) {
+                return nullptr;
+            }
+
+            const uintptr_t address = reinterpret_cast<uintptr_t>(memory + sizeof(void*));
+            void **aligned = reinterpret_cast<void**>((address + alignment - 1) & ~uintptr_t(alignment - 1));
+
+            aligned[-1] = memory;
+            return aligned;
+        }
+
+        void release(void *memory) {
+            if (memory) {
+                ::operator delete(static_cast<void**>(memory)[-1]);
+            }
+        }
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_CORE_MEMORY_POOL_H
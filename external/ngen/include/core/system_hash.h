@@ -20,6 +20,7 @@
 ////////////////////////////////////////////////////////////////////////////
 
 #include <cstddef>
+#include <type_traits>
 
 
 ////////////////////////////////////////////////////////////////////////////
@@ -29,11 +30,14 @@ namespace ngen {
     // and state names within the state tree. So we don't need anything super crypto as we're unlikely to
     // have that many strings.
     // More information: https://en.wikipedia.org/wiki/Fowler%E2%80%93Noll%E2%80%93Vo_hash_function
+    //
+    // compute is constexpr, so hashes of string literals may be evaluated at compile time. The result is
+    // identical to hashing the same string at runtime.
     template <typename TType, TType TPrime> class TSystemHash {
     public:
         typedef TType Type;
 
-        static inline TType compute(const char * const data) noexcept {
+        static constexpr TType compute(const char * const data) noexcept {
             TType hash = 0;
 
             if (data) {
@@ -45,9 +49,28 @@ namespace ngen {
 
             return hash;
         }
+
+        //! \brief Determines whether or not every value within a list of hashes is unique.
+        //!
+        //! This may be used within a static_assert to detect collisions within a set of names at compile time.
+        template <size_t TCount> static constexpr bool isUnique(const TType (&hashes)[TCount]) noexcept {
+            for (size_t loop = 0; loop < TCount; ++loop) {
+                for (size_t other = loop + 1; other < TCount; ++other) {
+                    if (hashes[loop] == hashes[other]) {
+                        return false;
+                    }
+                }
+            }
+
+            return true;
+        }
     };
 }
 
+// Evaluates the hash of a string literal at compile time, regardless of the context the macro is used in.
+#define NGEN_CONSTANT_HASH(hashType, name)                                              \
+    (std::integral_constant<hashType::Type, hashType::compute(name)>::value)
+
 ////////////////////////////////////////////////////////////////////////////
 
 #endif //NGEN_CORE_SYSTEM_HASH_H
@@ -19,14 +19,30 @@
 
 ////////////////////////////////////////////////////////////////////////////
 
+#include <cstdint>
+
+////////////////////////////////////////////////////////////////////////////
+
 namespace ngen {
     struct IUpdateArgs {
-        virtual bool requestState(const char *name) = 0;
+        // Requests are const as systems receive the arguments by const reference during their update.
+        virtual bool requestState(const char *name) const = 0;
+
+        // Requests a state using the hash of its name, eg. requestStateId("main_state"_state), avoiding the
+        // cost of hashing the name on every request. Implementations that cannot look up a state by its hash
+        // reject the request.
+        virtual bool requestStateId(uint64_t stateId) const { return false; }
     };
 
     //! \brief Structure containing parameters and methods accessible during each frame update.
     struct UpdateArgs : public IUpdateArgs {
+        UpdateArgs() : deltaTime(0.0f), interpolation(0.0f) {}
+
         float deltaTime;
+
+        // Fraction of a fixed timestep that has accumulated but not yet been stepped, in the range [0, 1).
+        // Only set during the variable rate update of a state tree that has a fixed timestep.
+        float interpolation;
     };
 }
 
@@ -9,6 +9,12 @@
 #include "iupdate_game_system.h"
 #include "game_system_instance.h"
 #include "ipost_update_game_system.h"
+#include "ischeduled_game_system.h"
+#include "iprepared_game_system.h"
+#include "ifixed_update_game_system.h"
+#include "iserializable_game_system.h"
+#include "irecyclable_game_system.h"
+#include "ireloadable_game_system.h"
 
 #include "game_system_creator.h"
 #include "game_system_factory.h"
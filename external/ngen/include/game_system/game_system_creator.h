@@ -5,15 +5,42 @@
 #ifndef NGEN_GAME_SYSTEM_CREATOR_H
 #define NGEN_GAME_SYSTEM_CREATOR_H
 
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#include <core/memory_pool.h>
+#include <core/system_hash.h>
+
 #include "game_system_instance.h"
 
 namespace ngen {
+    struct InitArgs;
     struct IUpdateGameSystem;
     struct IPostUpdateGameSystem;
+    struct IScheduledGameSystem;
+    struct IPreparedGameSystem;
+    struct IFixedUpdateGameSystem;
+    struct ISerializableGameSystem;
+    struct IRecyclableGameSystem;
+    struct IReloadableGameSystem;
 
     struct IGameSystemCreator {
-        virtual bool createInstance(/* MemoryPool &memory, */ GameSystemInstance &instance) = 0;
-        virtual void deleteInstance(/* MemoryPool &memory, */ GameSystemInstance &instance) = 0;
+        virtual size_t getInstanceSize() const = 0;
+        virtual size_t getInstanceAlignment() const = 0;
+
+        virtual bool createInstance(MemoryPool &memory, GameSystemInstance &instance) = 0;
+        virtual void deleteInstance(MemoryPool &memory, GameSystemInstance &instance) = 0;
+
+        // Fills in the interfaces of an instance from its gameSystem, which must be an object of the creator's type
+        virtual void bindInstance(GameSystemInstance &instance) = 0;
+
+        // Whether instances implement IRecyclableGameSystem, resetInstance returns them to their constructed state
+        virtual bool isRecyclable() const = 0;
+        virtual void resetInstance(GameSystemInstance &instance) = 0;
+
+        // Invokes IReloadableGameSystem::onReload when implemented by the instance, see StateTree::reload
+        virtual void reloadInstance(GameSystemInstance &instance, const InitArgs &initArgs) = 0;
     };
 
     //! \brief When implementing a GameSystem for use within the application, developers must use the
@@ -38,27 +65,122 @@ namespace ngen {
             return nullptr;
         }
 
+        static IScheduledGameSystem* asScheduled(IScheduledGameSystem *instance) {
+            return instance;
+        }
+
+        static IScheduledGameSystem* asScheduled(...) {
+            return nullptr;
+        }
+
+        static IPreparedGameSystem* asPrepared(IPreparedGameSystem *instance) {
+            return instance;
+        }
+
+        static IPreparedGameSystem* asPrepared(...) {
+            return nullptr;
+        }
+
+        static IFixedUpdateGameSystem* asFixedUpdateable(IFixedUpdateGameSystem *instance) {
+            return instance;
+        }
+
+        static IFixedUpdateGameSystem* asFixedUpdateable(...) {
+            return nullptr;
+        }
+
+        static ISerializableGameSystem* asSerializable(ISerializableGameSystem *instance) {
+            return instance;
+        }
+
+        static ISerializableGameSystem* asSerializable(...) {
+            return nullptr;
+        }
+
+        static IRecyclableGameSystem* asRecyclable(IRecyclableGameSystem *instance) {
+            return instance;
+        }
+
+        static IRecyclableGameSystem* asRecyclable(...) {
+            return nullptr;
+        }
+
+        static IReloadableGameSystem* asReloadable(IReloadableGameSystem *instance) {
+            return instance;
+        }
+
+        static IReloadableGameSystem* asReloadable(...) {
+            return nullptr;
+        }
+
     public:
-        bool createInstance(GameSystemInstance &instanceInfo) {
-            TType *instance = new TType();  // TODO: Use memory pool
+        size_t getInstanceSize() const {
+            return sizeof(TType);
+        }
+
+        size_t getInstanceAlignment() const {
+            return alignof(TType);
+        }
+
+        bool createInstance(MemoryPool &memory, GameSystemInstance &instanceInfo) {
+            void *block = memory.allocate(sizeof(TType), alignof(TType));
+            if (!block) {
+                return false;
+            }
+
+            instanceInfo.gameSystem = new (block) TType();
+            bindInstance(instanceInfo);
+
+            return true;
+        }
+
+        void bindInstance(GameSystemInstance &instanceInfo) {
+            TType *instance = static_cast<TType*>(instanceInfo.gameSystem);
 
-            instanceInfo.gameSystem = instance;
             instanceInfo.updateSystem = asUpdateable(instance);
             instanceInfo.postUpdateSystem = asPostUpdateable(instance);
+            instanceInfo.scheduledSystem = asScheduled(instance);
+            instanceInfo.preparedSystem = asPrepared(instance);
+            instanceInfo.fixedUpdateSystem = asFixedUpdateable(instance);
+            instanceInfo.serializableSystem = asSerializable(instance);
             instanceInfo.creator = this;
-
-            return (nullptr != instance);
         }
 
-        void deleteInstance(GameSystemInstance &instanceInfo) {
+        void deleteInstance(MemoryPool &memory, GameSystemInstance &instanceInfo) {
             if (instanceInfo.gameSystem) {
                 TType *instance = static_cast<TType*>(instanceInfo.gameSystem);
-                delete instance;
+
+                instance->~TType();
+                memory.release(instance);
 
                 instanceInfo.creator = nullptr;
                 instanceInfo.gameSystem = nullptr;
                 instanceInfo.updateSystem = nullptr;
                 instanceInfo.postUpdateSystem = nullptr;
+                instanceInfo.scheduledSystem = nullptr;
+                instanceInfo.preparedSystem = nullptr;
+                instanceInfo.fixedUpdateSystem = nullptr;
+                instanceInfo.serializableSystem = nullptr;
+            }
+        }
+
+        bool isRecyclable() const {
+            return std::is_base_of<IRecyclableGameSystem, TType>::value;
+        }
+
+        void resetInstance(GameSystemInstance &instanceInfo) {
+            IRecyclableGameSystem *instance = asRecyclable(static_cast<TType*>(instanceInfo.gameSystem));
+
+            if (instance) {
+                instance->onReset();
+            }
+        }
+
+        void reloadInstance(GameSystemInstance &instanceInfo, const InitArgs &initArgs) {
+            IReloadableGameSystem *instance = asReloadable(static_cast<TType*>(instanceInfo.gameSystem));
+
+            if (instance) {
+                instance->onReload(initArgs);
             }
         }
     };
@@ -66,12 +188,25 @@ namespace ngen {
 
 #define NGEN_DECLARE_GAME_SYSTEM(className)                                             \
         public:                                                                         \
-            static ngen::GameSystemCreator<className>     __ngen__creator;
+            static ngen::GameSystemCreator<className>     __ngen__creator;              \
+            static constexpr ngen::GameSystemHash::Type __ngen__hash() {                \
+                return ngen::GameSystemHash::compute(#className);                       \
+            }
 
 #define NGEN_IMPLEMENT_GAME_SYSTEM(className)                                           \
     ngen::GameSystemCreator<className> className::__ngen__creator;
 
 #define NGEN_REGISTER_GAME_SYSTEM(registry, classname)                                  \
-    registry.registerClass(&classname::__ngen__creator, ngen::GameSystemHash::compute(#classname))
+    registry.registerClass(&classname::__ngen__creator, NGEN_CONSTANT_HASH(ngen::GameSystemHash, #classname))
+
+// Registers a game system whose onUpdate is invoked once every 'interval' frames, see StateTree for details
+#define NGEN_REGISTER_GAME_SYSTEM_INTERVAL(registry, classname, interval)               \
+    (registry.registerClass(&classname::__ngen__creator, NGEN_CONSTANT_HASH(ngen::GameSystemHash, #classname)) && \
+     registry.setUpdateInterval(NGEN_CONSTANT_HASH(ngen::GameSystemHash, #classname), interval))
+
+// Registers a game system whose onInitialize may run on a worker thread, see StateTree for details
+#define NGEN_REGISTER_GAME_SYSTEM_INDEPENDENT(registry, classname)                      \
+    (registry.registerClass(&classname::__ngen__creator, NGEN_CONSTANT_HASH(ngen::GameSystemHash, #classname)) && \
+     registry.setIndependentInitialize(NGEN_CONSTANT_HASH(ngen::GameSystemHash, #classname), true))
 
 #endif //NGEN_GAME_SYSTEM_CREATOR_H
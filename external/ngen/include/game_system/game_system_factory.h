@@ -5,9 +5,14 @@
 #ifndef NGEN_GAME_SYSTEM_FACTORY_H
 #define NGEN_GAME_SYSTEM_FACTORY_H
 
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <core/memory_pool.h>
 
 #include "game_system_hash.h"
+#include "game_system_instance.h"
 
 
 namespace ngen {
@@ -21,11 +26,47 @@ namespace ngen {
 
         bool registerClass(IGameSystemCreator *creator, GameSystemHash::Type hash);
 
+        bool getInstanceLayout(GameSystemHash::Type hash, size_t &size, size_t &alignment) const;
+
         void deleteInstance(GameSystemInstance &instance);
         bool createInstance(GameSystemInstance &instance, GameSystemHash::Type hash);
 
+        void deleteInstance(MemoryPool &memory, GameSystemInstance &instance);
+        bool createInstance(MemoryPool &memory, GameSystemInstance &instance, GameSystemHash::Type hash);
+
+        bool setUpdateInterval(GameSystemHash::Type hash, uint32_t interval);
+        uint32_t getUpdateInterval(GameSystemHash::Type hash) const;
+
+        bool setIndependentInitialize(GameSystemHash::Type hash, bool independent);
+        bool getIndependentInitialize(GameSystemHash::Type hash) const;
+
+        bool setRecycleLimit(GameSystemHash::Type hash, size_t limit);
+        bool isRecycled(GameSystemHash::Type hash) const;
+        size_t getRecycledCount(GameSystemHash::Type hash) const;
+        void releaseRecycled();
+
     private:
-        std::unordered_map<GameSystemHash::Type, IGameSystemCreator*>  m_systemMap;
+        GameSystemFactory(const GameSystemFactory&) = delete;
+        GameSystemFactory& operator=(const GameSystemFactory&) = delete;
+
+        // Slot within the open addressing table of registered systems
+        struct CreatorEntry {
+            GameSystemHash::Type hash;                  // 0 marks an empty slot
+            IGameSystemCreator *creator;
+            uint32_t updateInterval;                    // Number of frames between each call to onUpdate
+            bool independentInitialize;                 // onInitialize may run alongside that of other systems
+            size_t liveCount;                           // Instances created and not yet deleted
+            size_t recycleLimit;                        // Largest number of instances kept for reuse, 0 disables recycling
+            std::vector<IGameSystem*> freeList;         // Deleted instances waiting to be handed out again
+        };
+
+        CreatorEntry* findEntry(GameSystemHash::Type hash) const;
+        void trimFreeList(CreatorEntry &entry, size_t count);
+
+        std::vector<CreatorEntry> m_creatorTable;   // Capacity is a power of two, at most half the slots are used
+        size_t m_creatorCount;
+        size_t m_tableShift;                        // Shift applied to the scrambled hash to produce a slot index
+        HeapMemoryPool m_heapMemory;                // Used when the caller does not supply a memory pool
     };
 }
 
@@ -13,6 +13,13 @@
 
 namespace ngen {
     typedef TSystemHash<uint64_t, 16777619> GameSystemHash;
+
+    namespace literals {
+        //! \brief Computes the hash of a game system name at compile time, eg. "PhysicsSystem"_system.
+        constexpr GameSystemHash::Type operator"" _system(const char *name, size_t) noexcept {
+            return GameSystemHash::compute(name);
+        }
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////
@@ -15,6 +15,10 @@ namespace ngen {
     struct IUpdateGameSystem;
     struct IGameSystemCreator;
     struct IPostUpdateGameSystem;
+    struct IScheduledGameSystem;
+    struct IPreparedGameSystem;
+    struct IFixedUpdateGameSystem;
+    struct ISerializableGameSystem;
 
     struct GameSystemInstance {
         GameSystemInstance()
@@ -22,6 +26,10 @@ namespace ngen {
         , gameSystem(nullptr)
         , updateSystem(nullptr)
         , postUpdateSystem(nullptr)
+        , scheduledSystem(nullptr)
+        , preparedSystem(nullptr)
+        , fixedUpdateSystem(nullptr)
+        , serializableSystem(nullptr)
         , creator(nullptr)
         {}
 
@@ -29,6 +37,10 @@ namespace ngen {
         IGameSystem *gameSystem;
         IUpdateGameSystem *updateSystem;
         IPostUpdateGameSystem *postUpdateSystem;
+        IScheduledGameSystem *scheduledSystem;
+        IPreparedGameSystem *preparedSystem;
+        IFixedUpdateGameSystem *fixedUpdateSystem;
+        ISerializableGameSystem *serializableSystem;
         IGameSystemCreator *creator;
     };
 }
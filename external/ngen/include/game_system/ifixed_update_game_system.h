@@ -0,0 +1,38 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_CORE_IFIXED_UPDATE_GAME_SYSTEM_H
+#define NGEN_CORE_IFIXED_UPDATE_GAME_SYSTEM_H
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    struct UpdateArgs;
+
+    //! \brief Interface that is implemented by game systems that must be stepped at a fixed rate.
+    //!
+    //! When the state tree has a fixed timestep, onFixedUpdate is invoked zero or more times each frame before
+    //! the variable rate update, the delta time supplied is always the fixed timestep. The variable rate phase
+    //! receives the fraction of a step that remains within UpdateArgs::interpolation.
+    //!
+    struct IFixedUpdateGameSystem {
+        virtual void onFixedUpdate(const UpdateArgs &updateArgs) = 0;
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_CORE_IFIXED_UPDATE_GAME_SYSTEM_H
@@ -0,0 +1,37 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_CORE_IPREPARED_GAME_SYSTEM_H
+#define NGEN_CORE_IPREPARED_GAME_SYSTEM_H
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    //! \brief Interface that is implemented by game systems that perform expensive work before they are activated.
+    //!
+    //! onPrepare is invoked each time the state containing the system is about to become active, before onActivate
+    //! is called. When the state tree performs asynchronous transitions onPrepare is invoked on a background
+    //! thread while the current state continues to update, so it must not access systems outside of the incoming
+    //! branch. The system is considered ready once onPrepare returns.
+    //!
+    struct IPreparedGameSystem {
+        virtual void onPrepare() = 0;
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_CORE_IPREPARED_GAME_SYSTEM_H
@@ -0,0 +1,37 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef NGEN_CORE_IRECYCLABLE_GAME_SYSTEM_H
+#define NGEN_CORE_IRECYCLABLE_GAME_SYSTEM_H
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    //! \brief Interface that is implemented by game systems whose instances may be reused by the factory.
+    //!
+    //! When recycling is enabled for the system (see GameSystemFactory::setRecycleLimit), a deleted instance is not
+    //! destroyed. onReset is invoked after onDestroy and must return the object to the state of a newly constructed
+    //! instance, the object is then handed out by the next request to create the system.
+    //!
+    struct IRecyclableGameSystem {
+        virtual void onReset() = 0;
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_CORE_IRECYCLABLE_GAME_SYSTEM_H
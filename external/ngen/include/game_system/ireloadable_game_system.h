@@ -0,0 +1,41 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef NGEN_CORE_IRELOADABLE_GAME_SYSTEM_H
+#define NGEN_CORE_IRELOADABLE_GAME_SYSTEM_H
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    struct InitArgs;
+
+    //! \brief Interface that is implemented by game systems that must follow their state through a reload.
+    //!
+    //! When a state tree is given a new definition, the game systems whose state and type are unchanged are kept
+    //! while the records of the states are replaced. onReload is invoked on each kept system within a state that has
+    //! been initialized, before the active branch is entered again. The supplied arguments describe the system within
+    //! the new definition, any GameState obtained from the previous InitArgs must be replaced as its memory may be
+    //! released once the reload completes.
+    //!
+    struct IReloadableGameSystem {
+        virtual void onReload(const ngen::InitArgs &initArgs) = 0;
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_CORE_IRELOADABLE_GAME_SYSTEM_H
@@ -0,0 +1,88 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_CORE_ISCHEDULED_GAME_SYSTEM_H
+#define NGEN_CORE_ISCHEDULED_GAME_SYSTEM_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+
+#include "game_system_hash.h"
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    //! \brief Describes the data accessed by a game system during its update, used to decide which systems may
+    //! be processed concurrently.
+    //!
+    //! Resources are identified by a hash value chosen by the title (typically the hash of a component or
+    //! subsystem name). Two systems conflict if one of them writes a resource the other reads or writes.
+    //! A system may also request to run after another system, identified by the hash of its class name.
+    struct GameSystemDependencies {
+        static const size_t kMaximumDependencies = 8;
+
+        GameSystemDependencies()
+        : readCount(0)
+        , writeCount(0)
+        , afterCount(0)
+        {}
+
+        bool read(GameSystemHash::Type resource) {
+            return add(reads, readCount, resource);
+        }
+
+        bool write(GameSystemHash::Type resource) {
+            return add(writes, writeCount, resource);
+        }
+
+        bool runAfter(GameSystemHash::Type system) {
+            return add(after, afterCount, system);
+        }
+
+        GameSystemHash::Type reads[kMaximumDependencies];
+        GameSystemHash::Type writes[kMaximumDependencies];
+        GameSystemHash::Type after[kMaximumDependencies];
+
+        size_t readCount;
+        size_t writeCount;
+        size_t afterCount;
+
+    private:
+        static bool add(GameSystemHash::Type *list, size_t &count, GameSystemHash::Type value) {
+            if (count < kMaximumDependencies) {
+                list[count++] = value;
+                return true;
+            }
+
+            return false;
+        }
+    };
+
+    //! \brief Interface that is implemented by game systems that may be updated concurrently with other systems.
+    //!
+    //! Game systems that do not implement this interface are always updated in isolation, after every system
+    //! that precedes them and before every system that follows them.
+    //!
+    struct IScheduledGameSystem {
+        virtual void getDependencies(GameSystemDependencies &dependencies) const = 0;
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_CORE_ISCHEDULED_GAME_SYSTEM_H
@@ -0,0 +1,45 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef NGEN_CORE_ISERIALIZABLE_GAME_SYSTEM_H
+#define NGEN_CORE_ISERIALIZABLE_GAME_SYSTEM_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    //! \brief Interface that is implemented by game systems whose runtime state may be captured and restored.
+    //!
+    //! When a state tree snapshot is taken, each serializable system reports the number of bytes it requires and
+    //! then writes its payload directly into the space reserved for it within the snapshot buffer. On restore the
+    //! system receives a pointer to the same bytes within the caller's buffer, the payload is not copied beforehand.
+    //! Payloads are aligned to 16 bytes. A restored system does not receive onInitialize or onActivate, so anything
+    //! those calls establish that must survive a restore has to be part of the payload.
+    //!
+    struct ISerializableGameSystem {
+        virtual size_t getSnapshotSize() const = 0;
+        virtual void onSnapshot(void *data, size_t size) const = 0;
+        virtual bool onRestore(const void *data, size_t size) = 0;
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_CORE_ISERIALIZABLE_GAME_SYSTEM_H
@@ -20,10 +20,15 @@
 
 ////////////////////////////////////////////////////////////////////////////
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <type_traits>
 
 #include "game_system/game_system_hash.h"
+#include "game_system/game_system_instance.h"
 #include "state_tree.h"
+#include "system_profiler.h"
 
 
 ////////////////////////////////////////////////////////////////////////////
@@ -34,10 +39,25 @@ namespace ngen {
     struct IGameSystem;
     struct IUpdateGameSystem;
     struct IPostUpdateGameSystem;
+    struct IFixedUpdateGameSystem;
 
     namespace StateSystem {
+        class StateTreeImage;
+
+        //! \brief Entry within the open addressing table each leaf state uses to look up systems by hash.
+        struct GameSystemLookup {
+            GameSystemHash::Type hash;      // 0 marks an empty slot
+            ngen::IGameSystem *system;
+        };
+
         //! \brief Represents a single state within the running titles state tree.
+        //!
+        //! GameState objects are not allocated individually, each tree builds a single list of them from the records
+        //! of its binary state tree image (see StateTreeImage).
         class GameState {
+            friend class StateTreeImage;
+            friend class StateTree;
+
         public:
             GameState();
             ~GameState();
@@ -50,10 +70,14 @@ namespace ngen {
 
             void onUpdate(const ngen::UpdateArgs &updateArgs);
             void onPostUpdate(const ngen::UpdateArgs &updateArgs);
+            void onFixedUpdate(const ngen::UpdateArgs &updateArgs);
 
             ngen::IGameSystem* getSystem(GameSystemHash::Type hash) const;
+            template <typename TType> TType* getSystem() const;
+            ngen::GameSystemInstance* getSystemInstance(size_t index) const;
 
             GameState* getParent() const;
+            GameState* getChild(size_t index) const;
 
             SystemHash getId() const;
             size_t getChildCount() const;
@@ -62,26 +86,131 @@ namespace ngen {
 
             bool checkParentHierarchy(const GameState *state) const;
 
+            void bindSystems();
+            void bindHierarchy();
+
+            size_t getDepth() const;
+            size_t getBranchSystemCount() const;
+            size_t getBranchUpdateCount() const;
+            size_t getBranchPostUpdateCount() const;
+            size_t getBranchFixedUpdateCount() const;
+            void bindBranch(ngen::IGameSystem **systemList, ngen::IUpdateGameSystem **updateList, ngen::IPostUpdateGameSystem **postUpdateList);
+            void bindFixedBranch(ngen::IFixedUpdateGameSystem **fixedUpdateList);
+            void bindLookup(GameSystemLookup *table, size_t capacity);
+            void bindProfileHashes(GameSystemHash::Type *systemHashList, GameSystemHash::Type *updateHashList, GameSystemHash::Type *postUpdateHashList);
+
+            static size_t getLookupCapacity(size_t systemCount);
+            static size_t findHash(const GameSystemHash::Type *hashList, size_t count, GameSystemHash::Type hash);
+
+            static uint32_t getGeneration();
+
         private:
+            static void advanceGeneration();
+
+            // Advanced whenever a state tree replaces its state records, see CachedSystem
+            static std::atomic<uint32_t> s_generation;
+
+            GameState*                      m_stateList;        // First state of the list containing this state
             GameState*                      m_parent;
-            GameState**                     m_childList;
+            const uint32_t*                 m_childList;        // Index of each child within m_stateList (within the image)
             ngen::GameSystemInstance*       m_systemList;
+            const GameSystemHash::Type*     m_systemHashList;   // Parallel to m_systemList, scanned by getSystem
+            ngen::IGameSystem**             m_gameSystemList;   // Parallel to m_systemList, used for activation
             ngen::IUpdateGameSystem**       m_updateList;
             ngen::IPostUpdateGameSystem**   m_postUpdateList;
 
+            // Leaf states hold a flattened copy of every system list from the root down to themselves
+            ngen::IGameSystem**             m_branchSystemList;
+            ngen::IUpdateGameSystem**       m_branchUpdateList;
+            ngen::IPostUpdateGameSystem**   m_branchPostUpdateList;
+            ngen::IFixedUpdateGameSystem**  m_branchFixedUpdateList;
+            GameSystemLookup*               m_branchLookup;     // Systems of the whole branch, keyed by hash
+            size_t                          m_branchLookupMask;
+            // Hash of each entry within the branch lists, identifies the system within profile samples. The lists are
+            // owned by the state tree and only bound within profiling builds.
+            const GameSystemHash::Type*     m_branchSystemHashList;
+            const GameSystemHash::Type*     m_branchUpdateHashList;
+            const GameSystemHash::Type*     m_branchPostUpdateHashList;
+
             SystemHash         m_id;
             size_t             m_childCount;
             size_t             m_updateCount;
             size_t             m_postUpdateCount;
             size_t             m_systemCount;
+            size_t             m_depth;                 // Number of parents above this state
+            size_t             m_branchSystemCount;     // Number of systems from the root down to (and including) this state
+            size_t             m_branchUpdateCount;
+            size_t             m_branchPostUpdateCount;
+            size_t             m_branchFixedUpdateCount;
+            bool               m_branchBound;
         };
 
+        //! \brief Caches the result of a typed system look-up, intended to be held by the system performing the look-up.
+        //!
+        //! The look-up is only repeated when a different state is supplied, or once any state tree has been reloaded,
+        //! so resolving another system each frame costs two comparisons. A reload may place new state records at the
+        //! address of released ones, which is why the state alone does not identify the cached result. As game
+        //! systems are destroyed along with the state tree, a cache held by a system never outlives the systems it
+        //! references.
+        template <typename TType> class CachedSystem {
+        public:
+            CachedSystem() : m_state(nullptr), m_system(nullptr), m_generation(0) {}
+
+            //! \brief Retrieves the system of the cached type that is visible from the specified state.
+            //! \param state [in] -
+            //!        The state the look-up is performed from.
+            //! \return The system instance or nullptr if the state does not contain a system of the cached type.
+            TType* get(const GameState *state) {
+                const uint32_t generation = GameState::getGeneration();
+
+                if (state != m_state || generation != m_generation) {
+                    m_system = state ? state->getSystem<TType>() : nullptr;
+                    m_state = state;
+                    m_generation = generation;
+                }
+
+                return m_system;
+            }
+
+        private:
+            const GameState *m_state;
+            TType *m_system;
+            uint32_t m_generation;
+        };
+
+        //! \brief Retrieves the game system of the specified type, the hash of the class name is computed at compile time.
+        //!
+        //! The type must have been declared with NGEN_DECLARE_GAME_SYSTEM and registered under its class name.
+        //! \return The system instance or nullptr if neither this state nor its parents contain a system of the type.
+        template <typename TType> inline TType* GameState::getSystem() const {
+            return static_cast<TType*>(getSystem(std::integral_constant<GameSystemHash::Type, TType::__ngen__hash()>::value));
+        }
+
+        //! \brief Retrieves the number of times state records have been replaced by a reload, across every state tree.
+        //! \return The current generation, any look-up cached under a different generation must be repeated.
+        inline uint32_t GameState::getGeneration() {
+            return s_generation.load(std::memory_order_acquire);
+        }
+
+        //! \brief Marks every look-up cached from the current state records as stale.
+        inline void GameState::advanceGeneration() {
+            s_generation.fetch_add(1, std::memory_order_acq_rel);
+        }
+
         //! \brief Retrieves the parent game state.
         //! \return The parent GameState instance or nullptr if there is no parent.
         inline GameState* GameState::getParent() const {
             return m_parent;
         }
 
+        //! \brief Retrieves the child state at the specified index.
+        //! \param index [in] -
+        //!        Index of the child state to be retrieved, must be less than getChildCount().
+        //! \return The child state at the specified index.
+        inline GameState* GameState::getChild(size_t index) const {
+            return m_stateList + m_childList[index];
+        }
+
         //! \brief  Retrieves the unique identifier associated with the game state.
         //! \return The identifier of the game state, this is typically a hash value generated from its name.
         inline SystemHash GameState::getId() const {
@@ -94,12 +223,32 @@ namespace ngen {
             return m_updateCount;
         }
 
+        //! \brief Retrieves the depth of the game state within the tree.
+        //! \return The number of parent states above this state, root states have a depth of 0.
+        inline size_t GameState::getDepth() const {
+            return m_depth;
+        }
+
+        //! \brief Retrieves the number of systems contained within this state and all of its parents.
+        //! \return The number of systems from the root of the tree down to this state, valid once bindHierarchy has been invoked.
+        inline size_t GameState::getBranchSystemCount() const {
+            return m_branchSystemCount;
+        }
+
         //! \brief Retrieves the number of systems contained within the game state.
         //! \return The number of systems within the game state.
         inline size_t GameState::getSystemCount() const {
             return m_systemCount;
         }
 
+        //! \brief Retrieves the game system instance at the specified index within the game state.
+        //! \param index [in] -
+        //!        Index of the game system instance to be retrieved, must be less than getSystemCount().
+        //! \return The game system instance at the specified index.
+        inline ngen::GameSystemInstance* GameState::getSystemInstance(size_t index) const {
+            return m_systemList + index;
+        }
+
         //! \brief Retrieves the number of child states within the game state.
         //! \return The number of child states referenced by the game state.
         inline size_t GameState::getChildCount() const {
@@ -0,0 +1,147 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_JOB_SCHEDULER_H
+#define NGEN_STATE_SYSTEM_JOB_SCHEDULER_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Describes a set of jobs along with the ordering constraints between them.
+        //!
+        //! Jobs are identified by their index, an edge from one job to another guarantees the first job has
+        //! completed before the second job begins. The graph must not contain any cycles.
+        class JobGraph {
+        public:
+            JobGraph();
+            ~JobGraph();
+
+            void reset(size_t jobCount);
+            void addEdge(size_t from, size_t to);
+            void finalize();
+
+            size_t getJobCount() const;
+            size_t getEdgeCount() const;
+
+            uint32_t getDependencyCount(size_t job) const;
+            const uint32_t* getSuccessors(size_t job, size_t &count) const;
+
+        private:
+            struct Edge {
+                uint32_t from;
+                uint32_t to;
+            };
+
+            size_t m_jobCount;
+
+            std::vector<Edge> m_edgeList;               // Edges added since the last reset
+            std::vector<uint32_t> m_dependencyList;     // Number of incoming edges for each job
+            std::vector<uint32_t> m_successorStart;     // Index of the first successor for each job (jobCount + 1 entries)
+            std::vector<uint32_t> m_successorList;      // Successors of every job, grouped by job
+        };
+
+        //! \brief Executes job graphs on a pool of worker threads.
+        //!
+        //! Each worker owns a queue of jobs that are ready to run. Workers take jobs from the back of their own
+        //! queue and, once it is empty, steal from the front of the queues owned by other workers. The thread that
+        //! calls execute also participates in processing and execute does not return until every job in the graph
+        //! has completed, so it acts as a barrier between successive graphs.
+        class JobScheduler {
+        public:
+            typedef void (*JobFunction)(void *context, size_t job);
+
+            explicit JobScheduler(size_t workerCount);
+            ~JobScheduler();
+
+            void execute(const JobGraph &graph, JobFunction function, void *context);
+
+            size_t getWorkerCount() const;
+
+        private:
+            JobScheduler(const JobScheduler&) = delete;
+            JobScheduler& operator=(const JobScheduler&) = delete;
+
+            struct JobQueue {
+                std::mutex lock;
+                std::deque<uint32_t> jobs;
+            };
+
+            void workerMain(size_t queueIndex);
+            void processJobs(size_t queueIndex);
+
+            void push(size_t queueIndex, uint32_t job);
+            bool pop(size_t queueIndex, uint32_t &job);
+            bool steal(size_t queueIndex, uint32_t &job);
+
+            std::vector<std::thread> m_workerList;
+            std::vector<std::unique_ptr<JobQueue>> m_queueList;    // One queue per worker, plus one for the caller
+
+            std::mutex m_executeLock;           // Serializes calls to execute
+            std::mutex m_lock;
+            std::condition_variable m_wake;     // Signalled when work becomes available or on shutdown
+            std::condition_variable m_idle;     // Signalled when a worker finishes processing a graph
+
+            const JobGraph *m_graph;
+            JobFunction m_function;
+            void *m_context;
+
+            std::unique_ptr<std::atomic<uint32_t>[]> m_pendingList;
+            size_t m_pendingCapacity;
+
+            std::atomic<size_t> m_remaining;
+            uint64_t m_generation;
+            size_t m_busyCount;
+            bool m_active;
+            bool m_shutdown;
+        };
+
+        //! \brief Retrieves the number of jobs within the graph.
+        //! \return The number of jobs within the graph.
+        inline size_t JobGraph::getJobCount() const {
+            return m_jobCount;
+        }
+
+        //! \brief Retrieves the number of edges within the graph.
+        //! \return The number of edges within the graph.
+        inline size_t JobGraph::getEdgeCount() const {
+            return m_edgeList.size();
+        }
+
+        //! \brief Retrieves the number of worker threads owned by the scheduler.
+        //! \return The number of worker threads, the thread calling execute is not included.
+        inline size_t JobScheduler::getWorkerCount() const {
+            return m_workerList.size();
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_JOB_SCHEDULER_H
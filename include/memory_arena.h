@@ -0,0 +1,92 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_MEMORY_ARENA_H
+#define NGEN_STATE_SYSTEM_MEMORY_ARENA_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+
+#include <core/memory_pool.h>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Linear allocator that places every allocation within a single contiguous block of memory.
+        //!
+        //! Allocations are placed one after another in the order they are requested and cannot be released
+        //! individually, the whole block is returned to the heap in a single operation when the arena is reset.
+        class MemoryArena : public ngen::MemoryPool {
+        public:
+            static const size_t kBlockAlignment = 64;
+
+            MemoryArena();
+            ~MemoryArena();
+
+            bool reserve(size_t size, size_t alignment = kBlockAlignment);
+            void reset();
+
+            void* allocate(size_t size, size_t alignment);
+            void release(void *memory);
+
+            size_t getCapacity() const;
+            size_t getUsed() const;
+
+            bool contains(const void *memory) const;
+
+            static size_t alignSize(size_t size, size_t alignment);
+
+        private:
+            MemoryArena(const MemoryArena&) = delete;
+            MemoryArena& operator=(const MemoryArena&) = delete;
+
+            uint8_t    *m_block;        // Address returned by the heap
+            uint8_t    *m_base;         // Aligned start of the arena
+            size_t      m_capacity;
+            size_t      m_used;
+        };
+
+        //! \brief Retrieves the number of bytes available within the arena.
+        //! \return The size of the arena (in bytes).
+        inline size_t MemoryArena::getCapacity() const {
+            return m_capacity;
+        }
+
+        //! \brief Retrieves the number of bytes that have been allocated from the arena.
+        //! \return The number of bytes consumed by allocations, including any alignment padding.
+        inline size_t MemoryArena::getUsed() const {
+            return m_used;
+        }
+
+        //! \brief Rounds a size up to the next multiple of the specified alignment.
+        //! \param size [in] -
+        //!        The size to be aligned.
+        //! \param alignment [in] -
+        //!        The required alignment, must be a power of two.
+        //! \return The aligned size.
+        inline size_t MemoryArena::alignSize(size_t size, size_t alignment) {
+            return (size + alignment - 1) & ~(alignment - 1);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_MEMORY_ARENA_H
@@ -0,0 +1,130 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef NGEN_STATE_SYSTEM_MEMORY_TRACKER_H
+#define NGEN_STATE_SYSTEM_MEMORY_TRACKER_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include <core/memory_pool.h>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Determines what happens when the memory allocated within a state exceeds its budget.
+        enum class MemoryBudgetPolicy : uint8_t {
+            Report,         // Allocations succeed, the state is passed to the budget handler at the next check
+            Fail,           // Allocations that would exceed the budget return nullptr
+        };
+
+        //! \brief Memory statistics of a single game system or of a state and its descendants.
+        struct MemoryUsage {
+            size_t used;            // Number of bytes currently allocated
+            size_t peak;            // Largest number of bytes allocated at once, since the peak was last reset
+            size_t blockCount;      // Number of blocks currently allocated
+            size_t failedCount;     // Number of allocations refused because a budget would be exceeded
+        };
+
+        //! \brief Accumulates the memory allocated by the systems of a state and of every state below it.
+        //!
+        //! Each account adds the allocations it receives to its parent, so the usage of an account always covers
+        //! the whole subtree. Accounts may be updated from any thread.
+        class StateMemoryAccount {
+        public:
+            StateMemoryAccount();
+
+            void bind(StateMemoryAccount *parent);
+            void reset(size_t used, size_t blockCount);
+
+            bool acquire(size_t size);
+            void release(size_t size);
+
+            void setBudget(size_t budget, MemoryBudgetPolicy policy);
+            size_t getBudget() const;
+            MemoryBudgetPolicy getPolicy() const;
+
+            MemoryUsage getUsage() const;
+            void resetPeak();
+
+        private:
+            StateMemoryAccount(const StateMemoryAccount&) = delete;
+            StateMemoryAccount& operator=(const StateMemoryAccount&) = delete;
+
+            void rollback(const StateMemoryAccount *last, size_t size);
+
+            StateMemoryAccount *m_parent;
+            std::atomic<size_t> m_used;
+            std::atomic<size_t> m_peak;
+            std::atomic<size_t> m_blockCount;
+            std::atomic<size_t> m_failedCount;
+            size_t m_budget;                    // Zero if the state does not have a budget
+            MemoryBudgetPolicy m_policy;
+        };
+
+        //! \brief Memory pool handed to a single game system, each allocation is charged to the system and to the
+        //!        account of the state containing it.
+        //!
+        //! Blocks are obtained from a backing pool, a small header placed before each block records its size so
+        //! the memory is returned to the accounts when the block is released. Allocations may be made from any
+        //! thread.
+        class TrackedMemoryPool : public ngen::MemoryPool {
+        public:
+            TrackedMemoryPool();
+
+            void bind(ngen::MemoryPool *pool, StateMemoryAccount *account);
+
+            void* allocate(size_t size, size_t alignment);
+            void release(void *memory);
+
+            MemoryUsage getUsage() const;
+            void resetPeak();
+
+        private:
+            TrackedMemoryPool(const TrackedMemoryPool&) = delete;
+            TrackedMemoryPool& operator=(const TrackedMemoryPool&) = delete;
+
+            ngen::MemoryPool *m_pool;
+            StateMemoryAccount *m_account;
+            std::atomic<size_t> m_used;
+            std::atomic<size_t> m_peak;
+            std::atomic<size_t> m_blockCount;
+            std::atomic<size_t> m_failedCount;
+        };
+
+        //! \brief Retrieves the budget of the state.
+        //! \return The budget in bytes, or zero if the state does not have a budget.
+        inline size_t StateMemoryAccount::getBudget() const {
+            return m_budget;
+        }
+
+        //! \brief Retrieves the action taken when the budget of the state is exceeded.
+        //! \return The policy applied to the budget.
+        inline MemoryBudgetPolicy StateMemoryAccount::getPolicy() const {
+            return m_policy;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_MEMORY_TRACKER_H
@@ -0,0 +1,168 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_STATE_RECORDER_H
+#define NGEN_STATE_SYSTEM_STATE_RECORDER_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        class StateTree;
+
+        static const uint32_t kStateRecordMagic = 0x5052474e;       // 'NGRP'
+        static const uint32_t kStateRecordVersion = 1;
+
+        //! \brief Type of each record within a state log, the type is stored as a single byte before the record.
+        //!
+        //! The log begins with a StateRecordHeader, the records follow without padding and use the byte order of
+        //! the machine that wrote them:
+        //!
+        //!     Update          float deltaTime
+        //!     PostUpdate      float deltaTime
+        //!     Commit          (no data)
+        //!     Request         uint8 internal, uint64 state, uint64 source, int32 priority
+        //!     Transition      uint64 source, uint64 target
+        enum class StateRecordType : uint8_t {
+            Update = 1,         // StateTree::onUpdate was invoked
+            PostUpdate,         // StateTree::onPostUpdate was invoked
+            Commit,             // StateTree::commitStateChange was invoked by the caller of the tree
+            Request,            // A state change was requested
+            Transition,         // The active state changed
+        };
+
+        //! \brief Header found at the start of every state log.
+        struct StateRecordHeader {
+            uint32_t magic;
+            uint32_t version;
+        };
+
+        //! \brief Streams the frames processed by a state tree, along with the requests and transitions they caused,
+        //!        into a compact binary log.
+        //!
+        //! Records are appended to a buffer in memory, full buffers are handed to a background thread which writes
+        //! them to the file so the thread processing the tree does not wait on the disk. Requests may be recorded
+        //! from any thread.
+        //!
+        //! A request is internal when it was made by a game system while the tree was being processed, such
+        //! requests are made again when the log is replayed and are recorded for inspection only. The source of a
+        //! request is the hash of the system that made it, or zero if it is unknown. See StateReplay.
+        class StateRecorder {
+        public:
+            StateRecorder();
+            ~StateRecorder();
+
+            bool open(const char *path);
+            void close();
+
+            bool isOpen() const;
+
+            void recordUpdate(float deltaTime);
+            void recordPostUpdate(float deltaTime);
+            void recordCommit();
+            void recordRequest(uint64_t state, uint64_t source, int32_t priority, bool internal);
+            void recordTransition(uint64_t source, uint64_t target);
+
+            size_t getRecordCount() const;
+
+            static const size_t kBufferSize = 64 * 1024;
+
+        private:
+            StateRecorder(const StateRecorder&) = delete;
+            StateRecorder& operator=(const StateRecorder&) = delete;
+
+            void append(StateRecordType type, const void *data, size_t length);
+            void writerMain();
+
+            FILE *m_file;
+
+            mutable std::mutex m_lock;
+            std::condition_variable m_wake;                     // Signalled when a buffer is queued or on shutdown
+            std::vector<uint8_t> m_buffer;                      // Buffer currently receiving records
+            std::vector<std::vector<uint8_t>> m_writeQueue;     // Full buffers waiting to be written
+            std::vector<std::vector<uint8_t>> m_freeList;       // Written buffers, kept so their memory is reused
+            std::thread m_writer;
+            size_t m_recordCount;
+            bool m_shutdown;
+        };
+
+        //! \brief Determines whether or not the recorder has a log file open.
+        //! \return <em>True</em> if a log file is open otherwise <em>false</em>.
+        inline bool StateRecorder::isOpen() const {
+            return nullptr != m_file;
+        }
+
+        //! \brief Feeds a state log back into a state tree, as fast as the tree is able to process it.
+        //!
+        //! The tree must have been loaded from the same definition and initialized, and must be driven by the
+        //! replay alone. Frames are replayed with the recorded delta time and requests made from outside the tree
+        //! are made again at the same point, while requests made by game systems are left to the systems
+        //! themselves. After each frame the active state is compared with the state the log expects, any
+        //! difference is counted as a divergence.
+        //!
+        //! Logs captured with asynchronous transitions enabled depend on the timing of the background thread and
+        //! may not replay exactly.
+        class StateReplay {
+        public:
+            StateReplay();
+            ~StateReplay();
+
+            bool open(const char *path);
+            bool load(const void *data, size_t length);
+            void close();
+
+            bool run(StateTree &stateTree);
+
+            size_t getFrameCount() const;
+            size_t getDivergenceCount() const;
+
+        private:
+            StateReplay(const StateReplay&) = delete;
+            StateReplay& operator=(const StateReplay&) = delete;
+
+            std::vector<uint8_t> m_data;
+            size_t m_frameCount;            // Number of update records within the log
+            size_t m_divergenceCount;       // Number of frames whose outcome differed during the last run
+        };
+
+        //! \brief Retrieves the number of frames within the loaded log.
+        //! \return The number of calls to onUpdate that were recorded.
+        inline size_t StateReplay::getFrameCount() const {
+            return m_frameCount;
+        }
+
+        //! \brief Retrieves the number of operations whose outcome differed from the log during the last run.
+        //! \return The number of divergences, zero if the replay matched the log exactly.
+        inline size_t StateReplay::getDivergenceCount() const {
+            return m_divergenceCount;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_STATE_RECORDER_H
@@ -0,0 +1,95 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_STATE_REQUEST_QUEUE_H
+#define NGEN_STATE_SYSTEM_STATE_REQUEST_QUEUE_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        class GameState;
+
+        //! \brief A request to change the active state of a StateTree.
+        struct StateRequest {
+            GameState *state;
+            int32_t priority;       // Requests with a higher priority take precedence
+            uint64_t order;         // Position of the request within the frame, later requests take precedence
+        };
+
+        //! \brief Determines whether a request takes precedence over another, when both are made before the same commit.
+        //! \return <em>True</em> if the request has a higher priority, or an equal priority and a later order.
+        inline bool takesPrecedence(const StateRequest &request, const StateRequest &other) {
+            return request.priority > other.priority || (request.priority == other.priority && request.order >= other.order);
+        }
+
+        //! \brief Bounded queue of state requests that may be pushed from any thread.
+        //!
+        //! Any number of threads may push requests, while only the thread committing state changes may pop
+        //! them. Each slot carries a sequence number that tells producers when it is free and the consumer when
+        //! it has been written, so neither side waits on the other. A request whose producer has claimed a slot
+        //! but not yet written it stops the consumer, the remaining requests are then popped by the next commit.
+        //!
+        //! Only the request taking precedence matters to the consumer, so once the queue is full further requests
+        //! are merged into a single overflow slot that keeps the one taking precedence, and a push never fails.
+        //! The queue is only lock-free until it fills: the overflow slot is guarded by a spin lock, so while the
+        //! queue is full producers (and the consumer reaching the overflow slot) wait on one another to merge
+        //! their request. The slot holds a whole request, which is wider than a single atomic word.
+        class StateRequestQueue {
+        public:
+            StateRequestQueue();
+
+            void push(const StateRequest &request);
+            bool pop(StateRequest &request);
+
+            void clear();
+
+            // Number of requests held before they are merged into the overflow slot, must be a power of two
+            static const size_t kCapacity = 64;
+
+        private:
+            StateRequestQueue(const StateRequestQueue&) = delete;
+            StateRequestQueue& operator=(const StateRequestQueue&) = delete;
+
+            struct Slot {
+                std::atomic<uint64_t> sequence;     // Equals the position when free, position + 1 once written
+                StateRequest request;
+            };
+
+            void pushOverflow(const StateRequest &request);
+            bool popOverflow(StateRequest &request);
+
+            Slot m_slotList[kCapacity];
+
+            std::atomic_flag m_overflowLock;        // Guards the overflow request
+            std::atomic<bool> m_overflowUsed;       // Set while the overflow request is waiting to be popped
+            StateRequest m_overflowRequest;         // The request taking precedence among those made while full
+
+            std::atomic<uint64_t> m_tail;   // Position of the next slot to be claimed by a producer
+            uint64_t m_head;                // Position of the next slot to be read, only used by the consumer
+        };
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_STATE_REQUEST_QUEUE_H
@@ -0,0 +1,181 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#ifndef NGEN_STATE_SYSTEM_STATE_SNAPSHOT_H
+#define NGEN_STATE_SYSTEM_STATE_SNAPSHOT_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        static const uint32_t kStateSnapshotMagic = 0x4e53474e;       // 'NGSN'
+        static const uint32_t kStateSnapshotVersion = 2;
+        static const size_t kStateSnapshotAlignment = 16;
+
+        //! \brief Header found at the start of every state tree snapshot.
+        //!
+        //! A snapshot is a single flat block of memory that contains no pointers, it is laid out as follows:
+        //!
+        //!     StateSnapshotHeader
+        //!     StateSnapshotEntry  [systemCount]   - One entry for each system, in the order of the tree's system list
+        //!     StateSnapshotTier   [tieredCount]   - One entry for each system with an update interval, in the same order
+        //!     uint8_t             [stateCount]    - Non-zero for each state whose systems have been initialized
+        //!     Payloads                            - Written by each ISerializableGameSystem, aligned to 16 bytes
+        //!
+        //! States are referenced by their identifier, so a snapshot may be restored into any tree loaded from the
+        //! same definition.
+        struct StateSnapshotHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t snapshotSize;      // Total size of the snapshot in bytes (including this header)
+
+            uint32_t stateCount;
+            uint32_t systemCount;
+
+            uint64_t activeState;       // Identifier of the active state, 0 if no state was active
+            uint64_t pendingState;      // Identifier of the state waiting activation, 0 if there was none
+            int32_t pendingPriority;
+            uint32_t tieredCount;       // Number of systems with an update interval
+
+            uint64_t pendingOrder;      // Order of the request that chose the pending state
+            uint64_t requestSequence;   // Order given to the next request
+
+            double fixedAccumulator;    // Time that had not yet been consumed by a fixed step
+        };
+
+        //! \brief Describes the payload of a single game system within a snapshot.
+        struct StateSnapshotEntry {
+            uint64_t hash;              // Hash of the game system the payload belongs to
+            uint64_t offset;            // Offset of the payload from the start of the snapshot, 0 if there is none
+            uint64_t size;              // Size of the payload in bytes, 0 if the system is not serializable
+        };
+
+        //! \brief Progress of a system with an update interval towards its next update.
+        struct StateSnapshotTier {
+            uint32_t counter;           // Frames counted since the system was last updated
+            float elapsed;              // Time accumulated since the system was last updated
+        };
+
+        //! \brief Provides read-only access to a snapshot produced by StateTree::snapshot.
+        //!
+        //! The snapshot is used in place, the memory must remain valid while the object is in use.
+        class StateSnapshot {
+        public:
+            StateSnapshot();
+
+            bool open(const void *data, size_t length);
+
+            const StateSnapshotHeader* getHeader() const;
+
+            size_t getSystemCount() const;
+            const StateSnapshotEntry& getEntry(size_t index) const;
+            const void* getSystemData(size_t index) const;
+            size_t getSystemSize(size_t index) const;
+            size_t getPayloadSize() const;
+
+            size_t getTierCount() const;
+            const StateSnapshotTier& getTier(size_t index) const;
+
+            bool isStateInitialized(size_t index) const;
+
+            static size_t getTableSize(size_t stateCount, size_t systemCount, size_t tieredCount);
+            static size_t alignPayload(size_t value);
+
+        private:
+            const uint8_t *m_data;
+            const StateSnapshotEntry *m_entryList;
+            const StateSnapshotTier *m_tierList;
+            const uint8_t *m_initializedList;
+        };
+
+        //! \brief Rounds the supplied value up to the alignment of a snapshot payload.
+        //! \param value [in] -
+        //!        The offset or size to be aligned.
+        //! \return The supplied value rounded up to a multiple of kStateSnapshotAlignment.
+        inline size_t StateSnapshot::alignPayload(size_t value) {
+            return (value + kStateSnapshotAlignment - 1) & ~(kStateSnapshotAlignment - 1);
+        }
+
+        //! \brief Retrieves the header of the snapshot.
+        //! \return The header of the snapshot or nullptr if no snapshot is open.
+        inline const StateSnapshotHeader* StateSnapshot::getHeader() const {
+            return reinterpret_cast<const StateSnapshotHeader*>(m_data);
+        }
+
+        //! \brief Retrieves the number of game systems described by the snapshot.
+        //! \return The number of entries within the snapshot.
+        inline size_t StateSnapshot::getSystemCount() const {
+            return m_data ? getHeader()->systemCount : 0;
+        }
+
+        //! \brief Retrieves the entry describing a single game system.
+        //! \param index [in] -
+        //!        Index of the system within the tree's system list, must be less than getSystemCount().
+        //! \return The entry describing the system.
+        inline const StateSnapshotEntry& StateSnapshot::getEntry(size_t index) const {
+            return m_entryList[index];
+        }
+
+        //! \brief Retrieves the payload written by a single game system.
+        //! \param index [in] -
+        //!        Index of the system within the tree's system list, must be less than getSystemCount().
+        //! \return Pointer to the payload within the snapshot or nullptr if the system did not write one.
+        inline const void* StateSnapshot::getSystemData(size_t index) const {
+            return m_entryList[index].size ? m_data + m_entryList[index].offset : nullptr;
+        }
+
+        //! \brief Retrieves the size of the payload written by a single game system.
+        //! \param index [in] -
+        //!        Index of the system within the tree's system list, must be less than getSystemCount().
+        //! \return Size of the payload in bytes, 0 if the system is not serializable.
+        inline size_t StateSnapshot::getSystemSize(size_t index) const {
+            return size_t(m_entryList[index].size);
+        }
+
+        //! \brief Retrieves the number of systems with an update interval described by the snapshot.
+        //! \return The number of tier entries within the snapshot.
+        inline size_t StateSnapshot::getTierCount() const {
+            return m_data ? getHeader()->tieredCount : 0;
+        }
+
+        //! \brief Retrieves the progress of a single system with an update interval.
+        //! \param index [in] -
+        //!        Index of the system amongst those with an update interval, must be less than getTierCount().
+        //! \return The entry describing the progress of the system.
+        inline const StateSnapshotTier& StateSnapshot::getTier(size_t index) const {
+            return m_tierList[index];
+        }
+
+        //! \brief Determines whether or not the systems of a state had been initialized when the snapshot was taken.
+        //! \param index [in] -
+        //!        Index of the state within the tree's state list.
+        //! \return <em>True</em> if the state was initialized otherwise <em>false</em>.
+        inline bool StateSnapshot::isStateInitialized(size_t index) const {
+            return m_data && index < getHeader()->stateCount && m_initializedList[index];
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_STATE_SNAPSHOT_H
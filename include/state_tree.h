@@ -19,22 +19,46 @@
 
 ////////////////////////////////////////////////////////////////////////////
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <core/system_hash.h>
 
+#include "job_scheduler.h"
+#include "memory_arena.h"
+#include "memory_tracker.h"
+#include "state_request_queue.h"
+#include "state_tree_image.h"
+#include "system_profiler.h"
+
 ////////////////////////////////////////////////////////////////////////////
 
 namespace ngen {
     struct InitArgs;
     struct UpdateArgs;
+    struct IGameSystem;
     struct GameSystemInstance;
+    struct IUpdateGameSystem;
+    struct IPostUpdateGameSystem;
+    struct IFixedUpdateGameSystem;
+    struct IPreparedGameSystem;
 
     class GameSystemFactory;
+    struct MemoryPool;
 
     namespace StateSystem {
         class GameState;
+        class StateTreeGroup;
+        class StateRecorder;
+        class StaticDispatch;
+        class TieredUpdateSystem;
+        struct GameSystemLookup;
+        struct StateTreeTables;
 
         typedef uint64_t SystemHash;
 
@@ -44,44 +68,316 @@ namespace ngen {
         //! must not contain any child ndodes).
         //! Control may switch to another leaf node using the changeState method. After a request is made, the change
         //! is not immediate. Instead it is cached until the end of the frames processing, this means if multiple
-        //! state changes are requested within a single frame only the last issued state change will take effect.
+        //! state changes are requested within a single frame only one of them will take effect. The request with
+        //! the highest priority is chosen and between requests of equal priority the last request wins.
+        //!
+        //! Requests may be made from any thread, they are placed within a lock-free queue that is drained by
+        //! commitStateChange. When systems are updated through a JobScheduler, the requests made by each system
+        //! are ordered by the position of the system within the branch rather than the time they were made, so
+        //! the outcome matches serial processing.
+        //!
+        //! The tree itself is loaded from a binary image (see StateTreeImage), the image is read in place so loading
+        //! consists of mapping the image, building the game state records from it and the creation of the game
+        //! system instances.
+        //!
+        //! Systems implementing IPreparedGameSystem are prepared before they are activated. When asynchronous
+        //! transitions are enabled, preparation runs on a background thread while the current state continues to
+        //! update and the switch takes place during the first commit after every incoming system is ready.
+        //!
+        //! When a transition budget is given, the onDeactivate and onActivate calls of a state change are spread
+        //! across as many commits as needed to keep each within the budget. The calls keep the order of an immediate
+        //! change, and while the change is in progress only the systems shared by both branches are updated. A state
+        //! requested during the change redirects it from the point it has reached.
+        //!
+        //! Systems registered with an update interval (see NGEN_REGISTER_GAME_SYSTEM_INTERVAL) are only updated once
+        //! every interval frames, receiving the time elapsed since their previous update as the delta time. Systems
+        //! sharing an interval are spread evenly across the frames of the interval, which keeps the cost of each
+        //! frame level.
+        //!
+        //! Systems implementing IFixedUpdateGameSystem are stepped at the rate given to setFixedTimestep, running
+        //! zero or more steps at the start of each update. The remaining fraction of a step is passed to the update
+        //! systems as UpdateArgs::interpolation so they may blend between the results of the last two steps.
+        //!
+        //! A StateRecorder may be attached to capture each frame along with the requests and transitions it caused,
+        //! the log can later be fed back into a tree by StateReplay to reproduce a session.
+        //!
+        //! The runtime state of an initialized tree may be captured with snapshot, which writes the active and pending
+        //! states along with the payload of every system implementing ISerializableGameSystem into a single flat
+        //! buffer. restore returns the tree to that point, only the systems that differ between the current branch and
+        //! the captured branch are deactivated and activated.
+        //!
+        //! A loaded tree may be given a new definition with reload, which keeps the game systems whose state and
+        //! type are unchanged and only re-activates the part of the active branch that differs. Kept systems that
+        //! refer to their state implement IReloadableGameSystem to be given the state within the new definition.
+        //!
+        //! Each system receives its own memory pool through InitArgs::memory. Allocations made through the pool are
+        //! charged to the system and to the state containing it, the usage and high-water mark of each system and
+        //! of each state (including its descendants) may be queried. A state may be given a budget, which is either
+        //! reported to the budget handler once the state has been initialized or entered, or enforced by refusing
+        //! the allocations that would exceed it. Memory a system obtains from elsewhere is not accounted for.
+        //!
+        //! By default onInitialize initializes every system within the tree. When deferred initialization is enabled,
+        //! the systems of a state are instead initialized the first time the state or one of its descendants is
+        //! entered, parents before children. prefetchState may be used to initialize a branch ahead of time, for
+        //! example while a loading screen is displayed. Systems within states that were never initialized do not
+        //! receive onDestroy.
+        //!
+        //! When a scheduler is supplied, systems registered with NGEN_REGISTER_GAME_SYSTEM_INDEPENDENT are
+        //! initialized on the worker threads before the remaining systems are initialized in order on the calling
+        //! thread. Such systems must not access other systems from within onInitialize.
+        //!
+        //! The tables derived from the tree definition (the state index and common ancestor tables) do not
+        //! reference the image, so trees created by a StateTreeGroup share a single copy of them.
         class StateTree {
-            typedef std::vector<GameState*> StateList;
-            typedef StateList::iterator StateIterator;
+            friend class StateTreeGroup;
 
         public:
             StateTree();
             ~StateTree();
 
+            bool load(ngen::GameSystemFactory &factory, const void *data, size_t length);
+            bool loadFile(ngen::GameSystemFactory &factory, const char *path);
+            bool reload(const void *data, size_t length);
+            bool reloadFile(const char *path);
+            void unload();
+
             void onDestroy();
             void onInitialize(ngen::InitArgs &initArgs);
 
+            void setDeferredInitialize(bool enabled);
+            bool getDeferredInitialize() const;
+
+            bool prefetchState(GameState *state);
+            bool prefetchState(const char *name);
+            bool isInitialized(const GameState *state) const;
+
+            size_t getSnapshotSize() const;
+            bool snapshot(void *buffer, size_t length, size_t *written = nullptr);
+            bool restore(const void *data, size_t length);
+
             void onUpdate(const ngen::UpdateArgs &updateArgs);
             void onPostUpdate(const ngen::UpdateArgs &updateArgs);
 
+            void setFixedTimestep(float timestep, uint32_t maximumSteps = 4);
+            float getFixedTimestep() const;
+            uint32_t getMaximumFixedSteps() const;
+            float getInterpolation() const;
+
             size_t getSystemCount() const;
             size_t getStateCount() const;
 
+            const MemoryArena& getSystemMemory() const;
+
+            // Invoked when the memory allocated within a state exceeds its budget
+            typedef void (*BudgetHandler)(void *context, const GameState *state, const MemoryUsage &usage, size_t budget);
+
+            void setMemoryPool(ngen::MemoryPool *pool);
+            MemoryUsage getSystemMemoryUsage(const GameSystemInstance *instance) const;
+            MemoryUsage getStateMemoryUsage(const GameState *state) const;
+            bool setMemoryBudget(const GameState *state, size_t budget, MemoryBudgetPolicy policy = MemoryBudgetPolicy::Report);
+            size_t getMemoryBudget(const GameState *state) const;
+            void setBudgetHandler(BudgetHandler handler, void *context);
+            void resetMemoryPeaks();
+
+            void setScheduler(JobScheduler *scheduler);
+            JobScheduler* getScheduler() const;
+
+            void setRecorder(StateRecorder *recorder);
+            StateRecorder* getRecorder() const;
+
+            void setStaticDispatch(const StaticDispatch *dispatch);
+            const StaticDispatch* getStaticDispatch() const;
+
+            GameState* getState(size_t index) const;
+            GameState* getActiveState() const;
+
+            // The systems of the active branch called during one phase of the frame, in the order they are called
+            template <typename TSystem> struct BranchSpan {
+                TSystem *const *systemList;
+                const GameSystemHash::Type *hashList;   // Hash of each system, nullptr unless profiling is enabled
+                size_t count;
+            };
+
+            BranchSpan<ngen::IUpdateGameSystem> getActiveUpdateSpan() const;
+            BranchSpan<ngen::IPostUpdateGameSystem> getActivePostUpdateSpan() const;
+
+            bool requestState(GameState *state, int32_t priority = 0);
+            bool requestState(const char *name, int32_t priority = 0);
+            bool requestState(std::nullptr_t, int32_t priority = 0);
+            bool requestStateId(SystemHash hash, int32_t priority = 0);
+
             void commitStateChange();
 
-            GameState* findState(const char *name);
+            void setAsyncTransitions(bool enabled);
+            bool getAsyncTransitions() const;
+
+            void setTransitionBudget(uint32_t microseconds);
+            uint32_t getTransitionBudget() const;
+
+            GameState* getTransitionState() const;
+            float getTransitionProgress() const;
+
+            GameState* findState(const char *name) const;
+            GameState* findState(SystemHash hash) const;
 
-            static SystemHash computeHash(const char *name);
+            GameState* getCommonAncestor(GameState *stateA, GameState *stateB) const;
+
+            static constexpr SystemHash computeHash(const char *name) noexcept;
             static GameState* findCommonAncestor(GameState *stateA, GameState *stateB);
 
+            // Trees with no more than this number of leaves store the common ancestor of every pair of leaves
+            static const size_t kMaximumTransitionLeaves = 64;
+
         private:
+            StateTree(const StateTree&) = delete;
+            StateTree& operator=(const StateTree&) = delete;
+
+            // A run of consecutive systems within the batched update lists, updated by a single function call
+            struct UpdateBatch {
+                void (*function)(ngen::IUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs);
+                size_t first;
+                size_t count;
+            };
+
+            struct PostUpdateBatch {
+                void (*function)(ngen::IPostUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs);
+                size_t first;
+                size_t count;
+            };
+
+            bool loadShared(ngen::GameSystemFactory &factory, const void *data, size_t length, const std::shared_ptr<const StateTreeTables> &tables);
+
+            bool prepareImage();
+            bool applyReload(StateTreeImage &image);
+            ngen::MemoryPool& findSystemMemory(const ngen::IGameSystem *system);
+            void releaseUnusedMemory();
+            void bindMemory();
+            void checkBudgets(const GameState *state);
+            ngen::MemoryPool* getTrackedPool(const GameSystemInstance *instance) const;
+            void bindTiers();
+            void unbindTiers();
+            void resetTiers(const GameState *state, const GameState *root);
+            void bindBranches();
+            void buildStateIndex(StateTreeTables &tables) const;
+            void buildAncestorTable(StateTreeTables &tables) const;
+
+            float onFixedUpdate(const ngen::UpdateArgs &frameArgs);
+
+            void gatherStates(std::vector<GameState*> &stateList) const;
+            void initializeBranch(GameState *state);
+            void initializeStates(GameState *const *stateList, size_t stateCount);
+            static void initializeJob(void *context, size_t job);
+
+            void resolveRequests();
+            void changeState(GameState *state, GameState *root);
+            void prepareTransition();
+            void waitTransition();
+            size_t getActiveSystemCount() const;
+            void beginTransition(GameState *state);
+            bool stepTransition(std::chrono::steady_clock::time_point deadline);
+            void gatherBranch(const GameState *leaf, size_t first, size_t last, std::vector<GameSystemInstance*> &list) const;
+
+            void buildBatches();
+            void buildSchedule();
+            void dispatch(const JobGraph &graph, JobScheduler::JobFunction function, void *context);
+            static void buildGraph(const GameState *leaf, bool postUpdate, std::vector<GameSystemInstance*> &schedule, JobGraph &graph);
+            static void updateJob(void *context, size_t job);
+            static void postUpdateJob(void *context, size_t job);
+
             ngen::GameSystemFactory *m_systemFactory;
 
             ngen::StateSystem::GameState *m_activeState;       // The currently active game state
             ngen::StateSystem::GameState *m_pendingState;      // The state currently waiting activation
-            StateList m_stateList;          // Flat list of game states
+            int32_t m_pendingPriority;                          // Priority of the request that chose the pending state
+            uint64_t m_pendingOrder;                            // Order of the request that chose the pending state
+
+            StateRequestQueue m_requestQueue;                   // Requests made since the last commit
+            std::atomic<uint64_t> m_requestSequence;            // Order given to the next request
+            ngen::StateSystem::GameState *m_stateList;         // Flat list of game states (owned by m_image)
+
+            GameSystemInstance *m_systemList;   // All game systems in the state tree (owned by m_image)
+            StateTreeImage m_image;             // Binary image containing the state tree definition
+            MemoryArena m_systemMemory;         // Single block containing every game system object
+
+            std::vector<std::unique_ptr<MemoryArena>> m_reloadMemory;   // Blocks holding systems created by a reload
+
+            ngen::HeapMemoryPool m_heapMemory;                                  // Default source of tracked allocations
+            ngen::MemoryPool *m_memoryPool;                                     // Source of the blocks allocated by systems
+            std::vector<std::unique_ptr<TrackedMemoryPool>> m_systemPools;      // Pool given to each system, parallel to m_systemList
+            std::unique_ptr<StateMemoryAccount[]> m_stateAccounts;              // Memory allocated within each state and its descendants
+            std::vector<uint8_t> m_budgetReported;                              // Non-zero for each state passed to the budget handler
+            BudgetHandler m_budgetHandler;
+            void *m_budgetContext;
+
+            std::unique_ptr<TieredUpdateSystem[]> m_tieredList;    // Stand-ins for systems updated less than every frame
+            size_t m_tieredCount;
+            std::vector<TieredUpdateSystem*> m_systemTiers;        // Stand-in of each system, parallel to m_systemList
+
+            std::vector<IGameSystem*> m_branchSystemList;                   // Flattened system lists for each leaf
+            std::vector<IUpdateGameSystem*> m_branchUpdateList;             // Flattened update lists for each leaf
+            std::vector<IPostUpdateGameSystem*> m_branchPostUpdateList;     // Flattened post-update lists for each leaf
+            std::vector<IFixedUpdateGameSystem*> m_branchFixedUpdateList;   // Flattened fixed update lists for each leaf
+            std::vector<GameSystemLookup> m_branchLookupList;               // System look-up tables for each leaf
+            std::vector<GameSystemHash::Type> m_branchSystemHashList;       // Hash of each entry of m_branchSystemList (profiling builds)
+            std::vector<GameSystemHash::Type> m_branchUpdateHashList;       // Hash of each entry of m_branchUpdateList (profiling builds)
+            std::vector<GameSystemHash::Type> m_branchPostUpdateHashList;   // Hash of each entry of m_branchPostUpdateList (profiling builds)
+
+            std::shared_ptr<const StateTreeTables> m_tables;    // State index and common ancestor tables
+
+            JobScheduler *m_scheduler;                              // Optional scheduler used to update systems concurrently
+            StateRecorder *m_recorder;                              // Optional recorder receiving each frame processed
+
+            const StaticDispatch *m_staticDispatch;                 // Optional batch functions for known system types
+            GameState *m_batchState;                                // The leaf state the batches were built for
+            std::vector<IUpdateGameSystem*> m_batchUpdateList;      // Update systems of the active branch
+            std::vector<IPostUpdateGameSystem*> m_batchPostUpdateList;
+            std::vector<UpdateBatch> m_updateBatchList;
+            std::vector<PostUpdateBatch> m_postUpdateBatchList;
+            GameState *m_scheduledState;                            // The leaf state the job graphs were built for
+            std::vector<GameSystemInstance*> m_updateSchedule;      // Update systems of the active branch, one per job
+            std::vector<GameSystemInstance*> m_postUpdateSchedule;  // Post-update systems of the active branch, one per job
+            JobGraph m_updateGraph;
+            JobGraph m_postUpdateGraph;
+
+            bool m_deferredInitialize;                  // Initialize the systems of a state when it is first entered
+            bool m_treeInitialized;                     // Set between onInitialize and onDestroy
+            std::vector<uint8_t> m_initializedList;     // Non-zero for each state whose systems have been initialized
 
-            GameSystemInstance *m_systemList;   // All game systems in the state tree
+            float m_fixedTimestep;              // Duration of a fixed step, zero when fixed stepping is disabled
+            uint32_t m_maximumFixedSteps;       // Largest number of fixed steps run within a single frame
+            double m_fixedAccumulator;          // Time elapsed that has not yet been consumed by a fixed step
+
+            bool m_asyncTransitions;                                // Prepare incoming systems on a background thread
+            GameState *m_transitionState;                           // The state being prepared for activation
+            std::vector<ngen::IPreparedGameSystem*> m_prepareList;  // Incoming systems that must be prepared
+            std::atomic<size_t> m_preparedCount;                    // Number of systems within the list that are ready
+            std::thread m_transitionThread;                         // Thread preparing the current transition
+
+            uint32_t m_transitionBudget;                            // Microseconds given to each commit of an incremental transition
+            GameState *m_incrementalState;                          // The state being entered by an incremental transition
+            GameState *m_incrementalSource;                         // The state that was active when the transition began
+            GameState *m_incrementalRoot;                           // Deepest state whose systems stay active throughout the transition
+            std::vector<GameSystemInstance*> m_incrementalList;     // Systems to be deactivated followed by those to be activated
+            size_t m_incrementalExitCount;                          // Number of entries at the start of the list to be deactivated
+            size_t m_incrementalIndex;                              // Next entry of the list to be processed
+            size_t m_activeCount;                                   // Number of systems from the root of the active branch that are active
+            uint64_t m_incrementalStart;                            // Profiler time the incremental transition began (profiling builds)
 
             size_t m_defaultState;          // Game state to be used when the state tree is first initialized
+            size_t m_stateCount;            // Total number of game states in the state tree
             size_t m_systemCount;           // Total number of game systems in the state tree
         };
 
+        //! \brief  Given a null terminated string, this method computes a hash value.
+        //!
+        //! The hash may be evaluated at compile time when the name is a string literal (see the _state literal).
+        //! \param  name [in] -
+        //!         Null terminated string whose hash value is to be computed.
+        //! \return The hash value computed from the supplied string.
+        inline constexpr SystemHash StateTree::computeHash(const char * const name) noexcept {
+            return ngen::TSystemHash<SystemHash, 16777619>::compute(name);
+        }
+
         //! \brief Retrieves the total number of game systems that exist within the state tree.
         //! \return The total number of game systems in the state tree.
         inline size_t StateTree::getSystemCount() const {
@@ -91,7 +387,83 @@ namespace ngen {
         //! \brief Retrieves the number of game states within the state tree.
         //! \return The number of game states within the state tree.
         inline size_t StateTree::getStateCount() const {
-            return m_stateList.size();
+            return m_stateCount;
+        }
+
+        //! \brief Retrieves the memory arena containing the game system objects owned by the state tree.
+        //! \return The arena the game systems were allocated from.
+        inline const MemoryArena& StateTree::getSystemMemory() const {
+            return m_systemMemory;
+        }
+
+        //! \brief Retrieves the recorder receiving the frames processed by the state tree.
+        //! \return The recorder attached to the state tree or nullptr if the tree is not being recorded.
+        inline StateRecorder* StateTree::getRecorder() const {
+            return m_recorder;
+        }
+
+        //! \brief Retrieves the table of batch functions used to update the active branch.
+        //! \return The table used by the state tree or nullptr if every system is called through its interface.
+        inline const StaticDispatch* StateTree::getStaticDispatch() const {
+            return m_staticDispatch;
+        }
+
+        //! \brief Determines whether or not the systems of a state are initialized when the state is first entered.
+        //! \return <em>True</em> if initialization is deferred otherwise <em>false</em>.
+        inline bool StateTree::getDeferredInitialize() const {
+            return m_deferredInitialize;
+        }
+
+        //! \brief Retrieves the duration of a single fixed step.
+        //! \return The fixed timestep in seconds, or zero if fixed stepping is disabled.
+        inline float StateTree::getFixedTimestep() const {
+            return m_fixedTimestep;
+        }
+
+        //! \brief Retrieves the largest number of fixed steps that may be run within a single frame.
+        //! \return The maximum number of fixed steps per frame.
+        inline uint32_t StateTree::getMaximumFixedSteps() const {
+            return m_maximumFixedSteps;
+        }
+
+        //! \brief Retrieves the scheduler used to update game systems concurrently.
+        //! \return The scheduler used by the state tree or nullptr if systems are updated on the calling thread.
+        inline JobScheduler* StateTree::getScheduler() const {
+            return m_scheduler;
+        }
+
+        //! \brief Determines whether or not state changes prepare the incoming systems on a background thread.
+        //! \return <em>True</em> if asynchronous transitions are enabled otherwise <em>false</em>.
+        inline bool StateTree::getAsyncTransitions() const {
+            return m_asyncTransitions;
+        }
+
+        //! \brief Retrieves the number of microseconds each commit may spend on an incremental transition.
+        //! \return The transition budget, or zero if state changes are made within a single commit.
+        inline uint32_t StateTree::getTransitionBudget() const {
+            return m_transitionBudget;
+        }
+
+        //! \brief Retrieves the state that is being prepared by an asynchronous transition or entered by an incremental one.
+        //! \return The state that becomes active once the transition completes or nullptr if no transition is in progress.
+        inline GameState* StateTree::getTransitionState() const {
+            return m_transitionState ? m_transitionState : m_incrementalState;
+        }
+
+        //! \brief Retrieves the currently active game state.
+        //!
+        //! During an incremental transition this is the outgoing state until its systems have been deactivated, and
+        //! the incoming state from then on.
+        //! \return The active game state or nullptr if no state is active.
+        inline GameState* StateTree::getActiveState() const {
+            return m_activeState;
+        }
+    }
+
+    namespace literals {
+        //! \brief Computes the identifier of a state name at compile time, eg. "main_state"_state.
+        constexpr StateSystem::SystemHash operator"" _state(const char *name, size_t) noexcept {
+            return StateSystem::StateTree::computeHash(name);
         }
     }
 }
@@ -0,0 +1,78 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_STATE_TREE_BUILDER_H
+#define NGEN_STATE_SYSTEM_STATE_TREE_BUILDER_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstdint>
+#include <vector>
+
+#include "game_system/game_system_hash.h"
+#include "state_tree.h"
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Produces binary state tree images that may be loaded by the StateTree.
+        //!
+        //! Titles normally convert their JSON state tree definitions offline, however the builder allows images
+        //! to be generated at runtime by tools and tests. States must be added before any of their children.
+        class StateTreeBuilder {
+        public:
+            static const size_t kNoParent = size_t(-1);
+
+            StateTreeBuilder();
+            ~StateTreeBuilder();
+
+            size_t addState(const char *name, size_t parent = kNoParent);
+            size_t addState(SystemHash id, size_t parent = kNoParent);
+
+            bool addSystem(size_t state, const char *name);
+            bool addSystem(size_t state, GameSystemHash::Type hash);
+
+            bool setDefaultState(size_t state);
+
+            size_t getStateCount() const;
+
+            bool build(std::vector<uint8_t> &image) const;
+
+        private:
+            struct StateDesc {
+                SystemHash id;
+                size_t parent;
+                std::vector<size_t> children;
+                std::vector<GameSystemHash::Type> systems;
+            };
+
+            std::vector<StateDesc> m_stateList;
+            size_t m_defaultState;
+        };
+
+        //! \brief Retrieves the number of states that have been added to the builder.
+        //! \return The number of states added to the builder.
+        inline size_t StateTreeBuilder::getStateCount() const {
+            return m_stateList.size();
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_STATE_TREE_BUILDER_H
@@ -0,0 +1,135 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_STATE_TREE_GROUP_H
+#define NGEN_STATE_SYSTEM_STATE_TREE_GROUP_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "job_scheduler.h"
+#include "state_tree.h"
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    struct UpdateArgs;
+
+    class GameSystemFactory;
+
+    namespace StateSystem {
+        struct StateTreeTables;
+
+        //! \brief Runs many independent state trees that were created from the same definition.
+        //!
+        //! Every instance reads the state records, hierarchy and system lists from the single read-only definition
+        //! held by the group, and owns only its game systems and the state and pointer lists bound to them. The
+        //! tables derived from the definition are also built once and shared. Rather than updating each tree in turn, the group gathers
+        //! the instances whose active leaf is the same and updates them together one system at a time, so each
+        //! system type is called for every instance before the next type is reached. The arguments given to each
+        //! system make state requests on the instance that owns it. Systems belonging to different instances must
+        //! not share mutable data, as instances within a batch may be updated in any order and batches may run
+        //! concurrently when a scheduler is supplied. Instances that cannot be batched,
+        //! such as those with an incremental transition in progress, those given a new definition by
+        //! StateTree::reload, or those that use fixed steps, static dispatch, a recorder or a scheduler of their
+        //! own, are processed through StateTree on the calling thread once every batch has completed.
+        class StateTreeGroup {
+        public:
+            StateTreeGroup();
+            ~StateTreeGroup();
+
+            bool load(ngen::GameSystemFactory &factory, const void *data, size_t length);
+            void unload();
+
+            StateTree* createInstance();
+            void destroyInstance(StateTree *stateTree);
+
+            size_t getInstanceCount() const;
+            StateTree* getInstance(size_t index) const;
+
+            void setScheduler(JobScheduler *scheduler);
+            JobScheduler* getScheduler() const;
+
+            void onUpdate(const ngen::UpdateArgs &updateArgs);
+            void onPostUpdate(const ngen::UpdateArgs &updateArgs);
+
+            // Largest number of instances updated by a single job
+            static const size_t kMaximumBatchInstances = 16;
+
+        private:
+            StateTreeGroup(const StateTreeGroup&) = delete;
+            StateTreeGroup& operator=(const StateTreeGroup&) = delete;
+
+            // Range of m_activeList whose instances share the same active state
+            struct Batch {
+                size_t first;
+                size_t count;
+            };
+
+            bool isBatchable(const StateTree &stateTree) const;
+
+            void buildBatches();
+            void dispatch(const ngen::UpdateArgs &updateArgs, bool postUpdate);
+
+            static void updateBatch(void *context, size_t batch);
+            static void postUpdateBatch(void *context, size_t batch);
+
+            ngen::GameSystemFactory *m_systemFactory;
+
+            std::vector<uint64_t> m_definition;                 // The image every instance is created from, and reads from
+            size_t m_definitionLength;                          // Size of the image (in bytes)
+            size_t m_stateCount;                                // Number of states within the image
+            std::shared_ptr<const StateTreeTables> m_tables;    // Tables shared by every instance
+
+            std::vector<std::unique_ptr<StateTree>> m_instanceList;
+
+            JobScheduler *m_scheduler;              // Optional scheduler used to update batches concurrently
+            std::vector<size_t> m_stateStart;       // First entry within m_activeList for each state index
+            std::vector<StateTree*> m_activeList;   // Instances that are batched, ordered by the index of their active state
+            std::vector<Batch> m_batchList;
+            std::vector<StateTree*> m_serialList;   // Instances processed through StateTree rather than a batch
+            JobGraph m_batchGraph;
+        };
+
+        //! \brief Retrieves the number of state trees created by the group.
+        //! \return The number of state trees within the group.
+        inline size_t StateTreeGroup::getInstanceCount() const {
+            return m_instanceList.size();
+        }
+
+        //! \brief Retrieves the state tree at the specified index within the group.
+        //! \param index [in] -
+        //!        Index of the state tree to be retrieved.
+        //! \return The state tree at the specified index or nullptr if the index is out of range.
+        inline StateTree* StateTreeGroup::getInstance(size_t index) const {
+            return index < m_instanceList.size() ? m_instanceList[index].get() : nullptr;
+        }
+
+        //! \brief Retrieves the scheduler used to update batches concurrently.
+        //! \return The scheduler used by the group or nullptr if batches are updated on the calling thread.
+        inline JobScheduler* StateTreeGroup::getScheduler() const {
+            return m_scheduler;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_STATE_TREE_GROUP_H
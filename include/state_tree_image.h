@@ -0,0 +1,134 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_STATE_TREE_IMAGE_H
+#define NGEN_STATE_SYSTEM_STATE_TREE_IMAGE_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    struct GameSystemInstance;
+    struct IGameSystem;
+    struct IUpdateGameSystem;
+    struct IPostUpdateGameSystem;
+
+    namespace StateSystem {
+        class GameState;
+
+        static const uint32_t kStateTreeImageMagic = 0x5453474e;      // 'NGST'
+        static const uint32_t kStateTreeImageVersion = 10;            // Only changes along with the authored records
+
+        // Parent index stored for the states at the root of the tree
+        static const uint32_t kStateTreeImageNoParent = 0xffffffff;
+
+        //! \brief Header found at the start of every binary state tree image.
+        //!
+        //! A state tree image holds the authored definition of a tree as plain records, states refer to each other
+        //! and to their systems by index so the image contains no pointers and is never modified. The image is
+        //! laid out as follows, each section is aligned to 8 bytes:
+        //!
+        //!     StateTreeImageHeader
+        //!     StateTreeImageState  [stateCount]
+        //!     uint32_t             [childCount]   - Index of each child state, referenced by the state records
+        //!     GameSystemHash::Type [systemCount]  - Hash of each system, the systems of a state are contiguous
+        //!
+        //! States are stored with parents before their children, and the systems of each state follow those of the
+        //! previous state.
+        struct StateTreeImageHeader {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t imageSize;         // Total size of the image in bytes (including this header)
+
+            uint32_t stateCount;
+            uint32_t childCount;
+            uint32_t systemCount;
+            uint32_t defaultState;      // Index of the state activated when the tree is initialized
+
+            uint64_t stateOffset;
+            uint64_t childOffset;
+            uint64_t systemOffset;
+        };
+
+        //! \brief Definition of a single state within a binary state tree image.
+        struct StateTreeImageState {
+            uint64_t id;                // Identifier of the state, typically the hash of its name
+            uint32_t parent;            // Index of the parent state, or kStateTreeImageNoParent
+            uint32_t firstChild;        // Index of the first entry within the child section
+            uint32_t childCount;
+            uint32_t firstSystem;       // Index of the first entry within the system section
+            uint32_t systemCount;
+            uint32_t reserved;
+        };
+
+        //! \brief Holds a binary state tree image along with the game state records built from it.
+        //!
+        //! The image may either be memory mapped from a file or use a block of memory supplied by the caller, in
+        //! the latter case the memory must remain valid until the image is released. The image itself is only
+        //! read, so a single block may be used by any number of trees. Each tree builds its own GameState and
+        //! GameSystemInstance records, along with the per-state system lists, which refer to the child and hash
+        //! sections of the image in place.
+        class StateTreeImage {
+        public:
+            StateTreeImage();
+            ~StateTreeImage();
+
+            bool map(const char *path);
+            bool adopt(const void *data, size_t length);
+            void release();
+
+            bool createRecords();
+            void swap(StateTreeImage &other);
+
+            const StateTreeImageHeader* getHeader() const;
+
+            GameState* getStateList() const;
+            GameSystemInstance* getSystemList() const;
+
+            static bool validate(const void *data, size_t length);
+
+        private:
+            StateTreeImage(const StateTreeImage&) = delete;
+            StateTreeImage& operator=(const StateTreeImage&) = delete;
+
+            const uint8_t  *m_data;
+            size_t          m_length;
+            bool            m_mapped;       // True if m_data was mapped by us and must be unmapped on release
+
+            std::unique_ptr<GameState[]> m_stateList;                       // Built by createRecords
+            std::unique_ptr<GameSystemInstance[]> m_systemList;
+            std::unique_ptr<ngen::IGameSystem*[]> m_gameSystemList;          // Parallel to m_systemList
+            std::unique_ptr<ngen::IUpdateGameSystem*[]> m_updateList;        // Update list of each state, parallel to m_systemList
+            std::unique_ptr<ngen::IPostUpdateGameSystem*[]> m_postUpdateList;
+        };
+
+        //! \brief Retrieves the header of the currently held image.
+        //! \return The header of the image or nullptr if no image is held.
+        inline const StateTreeImageHeader* StateTreeImage::getHeader() const {
+            return reinterpret_cast<const StateTreeImageHeader*>(m_data);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_STATE_TREE_IMAGE_H
@@ -0,0 +1,125 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_STATIC_DISPATCH_H
+#define NGEN_STATE_SYSTEM_STATIC_DISPATCH_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <vector>
+
+#include <game_system/game_system.h>
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Compile-time list of game system types, used to build a StaticDispatch table.
+        template <typename... TTypes> struct GameSystemTypeList {};
+
+        //! \brief Invokes onUpdate for a consecutive run of systems within an update list.
+        typedef void (*UpdateBatchFunction)(ngen::IUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs);
+
+        //! \brief Invokes onPostUpdate for a consecutive run of systems within a post-update list.
+        typedef void (*PostUpdateBatchFunction)(ngen::IPostUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs);
+
+        //! \brief Batch functions generated for a single game system type.
+        struct StaticDispatchEntry {
+            const ngen::IGameSystemCreator *creator;    // Identifies the type, see NGEN_DECLARE_GAME_SYSTEM
+            UpdateBatchFunction update;                 // nullptr if the type does not implement IUpdateGameSystem
+            PostUpdateBatchFunction postUpdate;         // nullptr if the type does not implement IPostUpdateGameSystem
+        };
+
+        //! \brief Table of update functions generated for a list of game system types known at compile time.
+        //!
+        //! Each function calls the update method of its type directly rather than through the interface, so the
+        //! compiler is able to inline the method into the loop. The state tree groups consecutive systems of the
+        //! same type within the active branch into a single call (see StateTree::setStaticDispatch), systems of
+        //! other types continue to be called through their interface.
+        //!
+        //!     static const StaticDispatch dispatch{ GameSystemTypeList<PhysicsSystem, AnimationSystem>() };
+        //!     stateTree.setStaticDispatch(&dispatch);
+        //!
+        //! Every type within the list must have been declared with NGEN_DECLARE_GAME_SYSTEM.
+        class StaticDispatch {
+        public:
+            template <typename... TTypes> explicit StaticDispatch(GameSystemTypeList<TTypes...>);
+
+            const StaticDispatchEntry* find(const ngen::IGameSystemCreator *creator) const;
+
+            size_t getTypeCount() const;
+
+        private:
+            template <typename TType> static StaticDispatchEntry createEntry();
+
+            template <typename TType> static void updateBatch(ngen::IUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs);
+            template <typename TType> static void postUpdateBatch(ngen::IPostUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs);
+
+            template <typename TType> static UpdateBatchFunction getUpdateBatch(ngen::IUpdateGameSystem *) { return &updateBatch<TType>; }
+            template <typename TType> static UpdateBatchFunction getUpdateBatch(...) { return nullptr; }
+
+            template <typename TType> static PostUpdateBatchFunction getPostUpdateBatch(ngen::IPostUpdateGameSystem *) { return &postUpdateBatch<TType>; }
+            template <typename TType> static PostUpdateBatchFunction getPostUpdateBatch(...) { return nullptr; }
+
+            std::vector<StaticDispatchEntry> m_entryList;
+        };
+
+        //! \brief Builds the table for the supplied list of types.
+        template <typename... TTypes> inline StaticDispatch::StaticDispatch(GameSystemTypeList<TTypes...>)
+        : m_entryList({ createEntry<TTypes>()... })
+        {
+            //
+        }
+
+        //! \brief Retrieves the number of game system types within the table.
+        //! \return The number of types the table was built for.
+        inline size_t StaticDispatch::getTypeCount() const {
+            return m_entryList.size();
+        }
+
+        //! \brief Generates the batch functions for a single type.
+        //! \return The entry describing the type.
+        template <typename TType> inline StaticDispatchEntry StaticDispatch::createEntry() {
+            StaticDispatchEntry entry;
+
+            entry.creator = &TType::__ngen__creator;
+            entry.update = getUpdateBatch<TType>(static_cast<TType*>(nullptr));
+            entry.postUpdate = getPostUpdateBatch<TType>(static_cast<TType*>(nullptr));
+
+            return entry;
+        }
+
+        //! \brief Invokes onUpdate for a run of systems of the same type, the call is bound at compile time.
+        template <typename TType> inline void StaticDispatch::updateBatch(ngen::IUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs) {
+            for (size_t loop = 0; loop < count; ++loop) {
+                static_cast<TType*>(systemList[loop])->TType::onUpdate(updateArgs);
+            }
+        }
+
+        //! \brief Invokes onPostUpdate for a run of systems of the same type, the call is bound at compile time.
+        template <typename TType> inline void StaticDispatch::postUpdateBatch(ngen::IPostUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs) {
+            for (size_t loop = 0; loop < count; ++loop) {
+                static_cast<TType*>(systemList[loop])->TType::onPostUpdate(updateArgs);
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_STATIC_DISPATCH_H
@@ -0,0 +1,132 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_SYSTEM_PROFILER_H
+#define NGEN_STATE_SYSTEM_SYSTEM_PROFILER_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "game_system/game_system_hash.h"
+
+// Instrumentation of the dispatch loops is only compiled when the NGEN_ENABLE_PROFILING build option is set
+#if !defined(NGEN_STATE_SYSTEM_PROFILING)
+#define NGEN_STATE_SYSTEM_PROFILING 0
+#endif
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief The phase of the game system life-cycle a profile sample was recorded for.
+        enum class ProfilePhase : uint32_t {
+            Update,
+            PostUpdate,
+            Activate,
+            Deactivate,
+
+            // Spans recorded by the state tree itself, the hash identifies a state rather than a game system
+            TreeUpdate,                     // Update of the active branch
+            TreePostUpdate,                 // Post-update of the active branch
+            Transition,                     // A single state change made by commitStateChange
+            TreeFixedUpdate,                // A single fixed step of the active branch
+        };
+
+        //! \brief Timing of a single call made into a game system, or of a span recorded by the state tree.
+        struct ProfileSample {
+            GameSystemHash::Type hash;      // Hash of the game system that was called, or the identifier of a state
+            uint64_t start;                 // Time the call began (nanoseconds, see SystemProfiler::now)
+            uint64_t duration;              // Time spent within the call (nanoseconds)
+            uint64_t source;                // Transitions only, identifier of the state that was left (0 if none)
+            uint64_t ancestor;              // Transitions only, identifier of the common ancestor (0 if none)
+            ProfilePhase phase;
+            uint32_t thread;                // Index of the thread that made the call, in order of first use
+        };
+
+        //! \brief Records the time spent within each game system call made by the state tree.
+        //!
+        //! Each thread that records samples owns a fixed size ring buffer, so recording never takes a lock. The
+        //! buffers are drained by collect, which may be called from any thread while samples are being recorded.
+        //! Samples are dropped (and counted) if a buffer fills before it is collected.
+        //!
+        //! Recording is disabled by default and must be enabled at runtime with setEnabled. When the library is
+        //! built without NGEN_ENABLE_PROFILING the dispatch loops contain no instrumentation at all.
+        class SystemProfiler {
+        public:
+            static const size_t kBufferCapacity = 4096;     // Samples held per thread, must be a power of two
+
+            static void setEnabled(bool enabled);
+            static bool isEnabled();
+
+            static constexpr bool isCompiled();
+
+            static uint64_t now();
+            static void record(GameSystemHash::Type hash, ProfilePhase phase, uint64_t start, uint64_t source = 0, uint64_t ancestor = 0);
+
+            static size_t collect(std::vector<ProfileSample> &samples);
+            static uint64_t getDroppedCount();
+            static void reset();
+
+        private:
+            static std::atomic<bool> s_enabled;
+        };
+
+        //! \brief Determines whether or not samples are currently being recorded.
+        //! \return <em>True</em> if recording is enabled otherwise <em>false</em>.
+        inline bool SystemProfiler::isEnabled() {
+            return s_enabled.load(std::memory_order_relaxed);
+        }
+
+        //! \brief Determines whether or not the dispatch loops were built with instrumentation.
+        //! \return <em>True</em> if the library was built with NGEN_ENABLE_PROFILING otherwise <em>false</em>.
+        inline constexpr bool SystemProfiler::isCompiled() {
+            return NGEN_STATE_SYSTEM_PROFILING != 0;
+        }
+
+        //! \brief Retrieves the current time used to timestamp samples.
+        //! \return The current value of the steady clock (in nanoseconds).
+        inline uint64_t SystemProfiler::now() {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+    }
+}
+
+// Hooks used by the dispatch loops, these expand to nothing unless profiling has been compiled in.
+#if NGEN_STATE_SYSTEM_PROFILING
+#define NGEN_PROFILE_DISPATCH()                                                         \
+    const bool __ngen__profiling = ngen::StateSystem::SystemProfiler::isEnabled()
+#define NGEN_PROFILE_BEGIN()                                                            \
+    const uint64_t __ngen__start = __ngen__profiling ? ngen::StateSystem::SystemProfiler::now() : 0
+#define NGEN_PROFILE_END(hash, phase)                                                   \
+    do { if (__ngen__profiling) ngen::StateSystem::SystemProfiler::record(hash, phase, __ngen__start); } while (0)
+#define NGEN_PROFILE_END_TRANSITION(state, source, ancestor)                            \
+    do { if (__ngen__profiling) ngen::StateSystem::SystemProfiler::record(state, ngen::StateSystem::ProfilePhase::Transition, __ngen__start, source, ancestor); } while (0)
+#else
+#define NGEN_PROFILE_DISPATCH() (void)0
+#define NGEN_PROFILE_BEGIN() (void)0
+#define NGEN_PROFILE_END(hash, phase) (void)0
+#define NGEN_PROFILE_END_TRANSITION(state, source, ancestor) (void)0
+#endif
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_SYSTEM_PROFILER_H
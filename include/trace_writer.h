@@ -0,0 +1,87 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef NGEN_STATE_SYSTEM_TRACE_WRITER_H
+#define NGEN_STATE_SYSTEM_TRACE_WRITER_H
+
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "system_profiler.h"
+
+
+////////////////////////////////////////////////////////////////////////////
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Streams the samples recorded by SystemProfiler into a trace file.
+        //!
+        //! The file uses the Chrome trace event format, which may be viewed within chrome://tracing or Perfetto.
+        //! Each sample becomes a complete event on the timeline of the thread that recorded it. Events are written
+        //! as they are flushed, typically once per frame, through a buffered file so the trace may be captured
+        //! over long sessions. The file is only valid once the writer has been closed.
+        //!
+        //! Systems and states are identified by their hash, names may be supplied with setName so the timeline
+        //! is readable.
+        class TraceWriter {
+        public:
+            TraceWriter();
+            ~TraceWriter();
+
+            bool open(const char *path);
+            void close();
+
+            bool isOpen() const;
+
+            void setName(uint64_t hash, const char *name);
+
+            size_t flush();
+            size_t write(const ProfileSample *samples, size_t count);
+
+        private:
+            TraceWriter(const TraceWriter&) = delete;
+            TraceWriter& operator=(const TraceWriter&) = delete;
+
+            void writeName(uint64_t hash);
+            void writeThread(uint32_t thread);
+
+            FILE *m_file;
+            uint64_t m_origin;                  // Time the trace was opened, event times are relative to this
+            bool m_firstEvent;
+
+            std::unordered_map<uint64_t, std::string> m_nameMap;
+            std::vector<bool> m_threadList;     // Threads whose name has been written to the trace
+            std::vector<ProfileSample> m_sampleList;
+            std::vector<char> m_buffer;         // Buffer supplied to the file stream
+        };
+
+        //! \brief Determines whether or not the writer has a trace file open.
+        //! \return <em>True</em> if a trace file is open otherwise <em>false</em>.
+        inline bool TraceWriter::isOpen() const {
+            return nullptr != m_file;
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////
+
+#endif //NGEN_STATE_SYSTEM_TRACE_WRITER_H
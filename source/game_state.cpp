@@ -14,23 +14,54 @@
 // limitations under the License.
 //
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
 #include <game_system/game_system.h>
 #include <core/init_args.h>
 #include "game_state.h"
 
 namespace ngen {
     namespace StateSystem {
+        //! \brief Computes the first slot examined within a system look-up table for the supplied hash.
+        static inline size_t lookupSlot(GameSystemHash::Type hash, size_t mask) {
+            return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+        }
+
+        std::atomic<uint32_t> GameState::s_generation(0);
+
         GameState::GameState()
-        : m_parent(nullptr)
+        : m_stateList(nullptr)
+        , m_parent(nullptr)
         , m_childList(nullptr)
         , m_systemList(nullptr)
+        , m_systemHashList(nullptr)
+        , m_gameSystemList(nullptr)
         , m_updateList(nullptr)
         , m_postUpdateList(nullptr)
+        , m_branchSystemList(nullptr)
+        , m_branchUpdateList(nullptr)
+        , m_branchPostUpdateList(nullptr)
+        , m_branchFixedUpdateList(nullptr)
+        , m_branchLookup(nullptr)
+        , m_branchLookupMask(0)
+        , m_branchSystemHashList(nullptr)
+        , m_branchUpdateHashList(nullptr)
+        , m_branchPostUpdateHashList(nullptr)
         , m_id(0)
         , m_childCount(0)
         , m_updateCount(0)
         , m_postUpdateCount(0)
         , m_systemCount(0)
+        , m_depth(0)
+        , m_branchSystemCount(0)
+        , m_branchUpdateCount(0)
+        , m_branchPostUpdateCount(0)
+        , m_branchFixedUpdateCount(0)
+        , m_branchBound(false)
         {
             //
         }
@@ -47,29 +78,25 @@ namespace ngen {
 
             // Invoke onInitialize for all contained system objects (in forward order)
             for (size_t loop = 0; loop < m_systemCount; ++loop) {
-                m_systemList[loop].gameSystem->onInitialize(initArgs);
+                m_gameSystemList[loop]->onInitialize(initArgs);
             }
 
             // Invoke onInitialize for all child states
             for (size_t loop = 0; loop < m_childCount; ++loop) {
-                m_childList[loop]->onInitialize(initArgs);
+                getChild(loop)->onInitialize(initArgs);
             }
         }
 
         //! \brief Invoked when the game state is about to be removed from the running title.
         void GameState::onDestroy() {
             // Invoke onDestroy for all child states (in reverse order)
-            if (m_childCount) {
-                for (GameState **ptr = &m_childList[m_childCount]; ptr >= m_childList; --ptr) {
-                    (*ptr)->onDestroy();
-                }
+            for (size_t loop = m_childCount; loop > 0; --loop) {
+                getChild(loop - 1)->onDestroy();
             }
 
             // Invoke onDestroy for all contained system objects (in reverse order)
-            if (m_systemCount) {
-                for (GameSystemInstance *ptr = &m_systemList[m_systemCount - 1]; ptr >= m_systemList; --ptr) {
-                    ptr->gameSystem->onDestroy();
-                }
+            for (size_t loop = m_systemCount; loop > 0; --loop) {
+                m_gameSystemList[loop - 1]->onDestroy();
             }
         }
 
@@ -77,12 +104,27 @@ namespace ngen {
         //! \param root [in] -
         //!        The game state at the root of the state switch, activation will not be passed up-to the root state.
         void GameState::onEnter(const GameState *root) {
+            if (m_branchBound && (!root || root->m_depth < m_depth)) {
+                // The systems belonging to the root (and its parents) form the start of our flattened list
+                const size_t first = root ? root->m_branchSystemCount : 0;
+
+                NGEN_PROFILE_DISPATCH();
+
+                for (size_t loop = first; loop < m_branchSystemCount; ++loop) {
+                    NGEN_PROFILE_BEGIN();
+                    m_branchSystemList[loop]->onActivate();
+                    NGEN_PROFILE_END(m_branchSystemHashList[loop], ProfilePhase::Activate);
+                }
+
+                return;
+            }
+
             if (m_parent && m_parent != root) {
                 m_parent->onEnter(root);
             }
 
             for (size_t loop = 0; loop < m_systemCount; ++loop) {
-                m_systemList[loop].gameSystem->onActivate();
+                m_gameSystemList[loop]->onActivate();
             }
         }
 
@@ -90,11 +132,24 @@ namespace ngen {
         //! \oaram root [in] -
         //!        The game state at the root of the state switch, de-activation will not be passed up-to the root state.
         void GameState::onExit(const GameState *root) {
-            if (m_systemCount) {
-                // Invoke onDeactivate for all contained system objects in reverse order
-                for (GameSystemInstance* ptr = &m_systemList[m_systemCount - 1]; ptr >= m_systemList; --ptr) {
-                    ptr->gameSystem->onDeactivate();
+            if (m_branchBound && (!root || root->m_depth < m_depth)) {
+                const size_t first = root ? root->m_branchSystemCount : 0;
+
+                NGEN_PROFILE_DISPATCH();
+
+                // Invoke onDeactivate in reverse order, from this state back up to the root of the state switch
+                for (size_t loop = m_branchSystemCount; loop > first; --loop) {
+                    NGEN_PROFILE_BEGIN();
+                    m_branchSystemList[loop - 1]->onDeactivate();
+                    NGEN_PROFILE_END(m_branchSystemHashList[loop - 1], ProfilePhase::Deactivate);
                 }
+
+                return;
+            }
+
+            // Invoke onDeactivate for all contained system objects in reverse order
+            for (size_t loop = m_systemCount; loop > 0; --loop) {
+                m_gameSystemList[loop - 1]->onDeactivate();
             }
 
             if (m_parent && m_parent != root) {
@@ -106,8 +161,19 @@ namespace ngen {
         //! \param updateArgs [in] -
         //!        Details about the current frame being processed.
         void GameState::onUpdate(const ngen::UpdateArgs &updateArgs) {
-            // TODO: As an optimisation, we may just include all parent systems in our own local list.
-            // TODO: This will help reduce cache misses. But for now, we'll pass the call up.
+            if (m_branchBound) {
+                NGEN_PROFILE_DISPATCH();
+
+                // The flattened list already contains our parents systems, in root to leaf order
+                for (size_t loop = 0; loop < m_branchUpdateCount; ++loop) {
+                    NGEN_PROFILE_BEGIN();
+                    m_branchUpdateList[loop]->onUpdate(updateArgs);
+                    NGEN_PROFILE_END(m_branchUpdateHashList[loop], ProfilePhase::Update);
+                }
+
+                return;
+            }
+
             if (m_parent) {
                 m_parent->onUpdate(updateArgs);
             }
@@ -121,6 +187,18 @@ namespace ngen {
         //! \param updateArgs [in] -
         //!        Details about the current frame being processed.
         void GameState::onPostUpdate(const ngen::UpdateArgs &updateArgs) {
+            if (m_branchBound) {
+                NGEN_PROFILE_DISPATCH();
+
+                for (size_t loop = 0; loop < m_branchPostUpdateCount; ++loop) {
+                    NGEN_PROFILE_BEGIN();
+                    m_branchPostUpdateList[loop]->onPostUpdate(updateArgs);
+                    NGEN_PROFILE_END(m_branchPostUpdateHashList[loop], ProfilePhase::PostUpdate);
+                }
+
+                return;
+            }
+
             if (m_parent) {
                 m_parent->onPostUpdate(updateArgs);
             }
@@ -130,19 +208,331 @@ namespace ngen {
             }
         }
 
+        //! \brief Called for each fixed timestep that has elapsed while the game state is active.
+        //!
+        //! Only leaf states hold a fixed update list, as only leaf states may become active.
+        //! \param updateArgs [in] -
+        //!        Details about the step being processed, the delta time is the fixed timestep.
+        void GameState::onFixedUpdate(const ngen::UpdateArgs &updateArgs) {
+            for (size_t loop = 0; loop < m_branchFixedUpdateCount; ++loop) {
+                m_branchFixedUpdateList[loop]->onFixedUpdate(updateArgs);
+            }
+        }
+
         //! \brief  Retrieves the game system associated with the supplied hash value.
         //! \param  hash [in] -
         //!         The hashed value associated with the game system to be retrieved.
         //! \return The IGameSystem instance associated with the supplied hash value or nullptr if one could not be found.
         ngen::IGameSystem* GameState::getSystem(GameSystemHash::Type hash) const {
-            // We're just performing a linear look-up, could be improved in the future but we're not performance critical
+            // Leaf states hold a table covering every system in their branch, where a system type appears more
+            // than once the entry belonging to the deepest state is stored.
+            if (m_branchLookup) {
+                for (size_t slot = lookupSlot(hash, m_branchLookupMask); m_branchLookup[slot].hash; slot = (slot + 1) & m_branchLookupMask) {
+                    if (m_branchLookup[slot].hash == hash) {
+                        return m_branchLookup[slot].system;
+                    }
+                }
+
+                return nullptr;
+            }
+
+            // Other states scan the hash array of each level, starting with our own systems
+            for (const GameState *state = this; state; state = state->m_parent) {
+                const size_t index = findHash(state->m_systemHashList, state->m_systemCount, hash);
+                if (index < state->m_systemCount) {
+                    return state->m_gameSystemList[index];
+                }
+            }
+
+            return nullptr;
+        }
+
+        //! \brief Finds the first occurrence of a hash value within a list of hashes.
+        //!
+        //! The comparison is vectorized where the target supports it, four hashes are compared at once with AVX2
+        //! and two with SSE2.
+        //! \param hashList [in] -
+        //!        The list of hashes to be searched.
+        //! \param count [in] -
+        //!        The number of hashes within the list.
+        //! \param hash [in] -
+        //!        The hash value to be found.
+        //! \return Index of the matching hash, or count if the list does not contain the hash.
+        size_t GameState::findHash(const GameSystemHash::Type *hashList, size_t count, GameSystemHash::Type hash) {
+            size_t loop = 0;
+
+#if defined(__AVX2__)
+            const __m256i key = _mm256_set1_epi64x(static_cast<long long>(hash));
+
+            for (; loop + 4 <= count; loop += 4) {
+                const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hashList + loop));
+                const int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(values, key)));
+
+                if (mask) {
+                    return loop + ((mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3);
+                }
+            }
+#elif defined(__SSE2__) || defined(_M_X64)
+            const __m128i key = _mm_set1_epi64x(static_cast<long long>(hash));
+
+            for (; loop + 2 <= count; loop += 2) {
+                // SSE2 has no 64-bit compare, so both 32-bit halves of a lane must match
+                __m128i equal = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hashList + loop)), key);
+                equal = _mm_and_si128(equal, _mm_shuffle_epi32(equal, _MM_SHUFFLE(2, 3, 0, 1)));
+
+                const int mask = _mm_movemask_pd(_mm_castsi128_pd(equal));
+                if (mask) {
+                    return loop + ((mask & 1) ? 0 : 1);
+                }
+            }
+#endif
+
+            for (; loop < count; ++loop) {
+                if (hashList[loop] == hash) {
+                    return loop;
+                }
+            }
+
+            return count;
+        }
+
+        //! \brief Computes the number of entries required by the look-up table of a branch.
+        //! \param systemCount [in] -
+        //!        The number of systems within the branch.
+        //! \return The table capacity, a power of two that keeps the table no more than half full (0 if there are no systems).
+        size_t GameState::getLookupCapacity(size_t systemCount) {
+            if (!systemCount) {
+                return 0;
+            }
+
+            size_t capacity = 1;
+            while (capacity < systemCount * 2) {
+                capacity <<= 1;
+            }
+
+            return capacity;
+        }
+
+        //! \brief Builds the system, update and post-update lists from the game systems owned by this state.
+        //!
+        //! This must be invoked once the game system instances have been created, the lists themselves are built
+        //! along with the state records and have been reserved with enough space for every system in the state.
+        void GameState::bindSystems() {
+            m_updateCount = 0;
+            m_postUpdateCount = 0;
+
             for (size_t loop = 0; loop < m_systemCount; ++loop) {
-                if (m_systemList[loop].hash == hash) {
-                    return m_systemList[loop].gameSystem;
+                m_gameSystemList[loop] = m_systemList[loop].gameSystem;
+
+                if (m_systemList[loop].updateSystem) {
+                    m_updateList[m_updateCount++] = m_systemList[loop].updateSystem;
+                }
+
+                if (m_systemList[loop].postUpdateSystem) {
+                    m_postUpdateList[m_postUpdateCount++] = m_systemList[loop].postUpdateSystem;
+                }
+            }
+        }
+
+        //! \brief Retrieves the number of systems expecting an update within this state and all of its parents.
+        //! \return The number of update systems from the root of the tree down to this state.
+        size_t GameState::getBranchUpdateCount() const {
+            size_t count = 0;
+
+            for (const GameState *state = this; state; state = state->m_parent) {
+                count += state->m_updateCount;
+            }
+
+            return count;
+        }
+
+        //! \brief Retrieves the number of systems expecting a post-update within this state and all of its parents.
+        //! \return The number of post-update systems from the root of the tree down to this state.
+        size_t GameState::getBranchPostUpdateCount() const {
+            size_t count = 0;
+
+            for (const GameState *state = this; state; state = state->m_parent) {
+                count += state->m_postUpdateCount;
+            }
+
+            return count;
+        }
+
+        //! \brief Retrieves the number of systems stepped at a fixed rate within this state and all of its parents.
+        //! \return The number of fixed update systems from the root of the tree down to this state.
+        size_t GameState::getBranchFixedUpdateCount() const {
+            size_t count = 0;
+
+            for (const GameState *state = this; state; state = state->m_parent) {
+                for (size_t loop = 0; loop < state->m_systemCount; ++loop) {
+                    if (state->m_systemList[loop].fixedUpdateSystem) {
+                        count++;
+                    }
+                }
+            }
+
+            return count;
+        }
+
+        //! \brief Computes the depth and branch system count of the state, the parent state must already be bound.
+        void GameState::bindHierarchy() {
+            m_depth = m_parent ? m_parent->m_depth + 1 : 0;
+            m_branchSystemCount = (m_parent ? m_parent->m_branchSystemCount : 0) + m_systemCount;
+        }
+
+        //! \brief Fills the supplied lists with every system from the root of the tree down to this state.
+        //!
+        //! Once bound, onUpdate and onPostUpdate perform a single linear sweep over the lists rather than passing
+        //! the call up through the parent states, and onEnter and onExit only visit the span of the system list
+        //! below the root of the state switch. bindSystems and bindHierarchy must have been invoked on this state
+        //! and all of its parents before the branch is bound.
+        //! \param systemList [in] -
+        //!        Storage for getBranchSystemCount() pointers, this must remain valid while the state is in use.
+        //! \param updateList [in] -
+        //!        Storage for getBranchUpdateCount() pointers, this must remain valid while the state is in use.
+        //! \param postUpdateList [in] -
+        //!        Storage for getBranchPostUpdateCount() pointers, this must remain valid while the state is in use.
+        void GameState::bindBranch(ngen::IGameSystem **systemList, ngen::IUpdateGameSystem **updateList, ngen::IPostUpdateGameSystem **postUpdateList) {
+            m_branchUpdateCount = getBranchUpdateCount();
+            m_branchPostUpdateCount = getBranchPostUpdateCount();
+            m_branchSystemList = systemList;
+            m_branchUpdateList = updateList;
+            m_branchPostUpdateList = postUpdateList;
+            m_branchBound = true;
+
+            // Walk up the hierarchy filling the lists from the back, so the root systems end up at the front
+            size_t systemIndex = m_branchSystemCount;
+            size_t updateIndex = m_branchUpdateCount;
+            size_t postUpdateIndex = m_branchPostUpdateCount;
+
+            for (const GameState *state = this; state; state = state->m_parent) {
+                systemIndex -= state->m_systemCount;
+                updateIndex -= state->m_updateCount;
+                postUpdateIndex -= state->m_postUpdateCount;
+
+                for (size_t loop = 0; loop < state->m_systemCount; ++loop) {
+                    systemList[systemIndex + loop] = state->m_gameSystemList[loop];
+                }
+
+                for (size_t loop = 0; loop < state->m_updateCount; ++loop) {
+                    updateList[updateIndex + loop] = state->m_updateList[loop];
+                }
+
+                for (size_t loop = 0; loop < state->m_postUpdateCount; ++loop) {
+                    postUpdateList[postUpdateIndex + loop] = state->m_postUpdateList[loop];
+                }
+            }
+        }
+
+        //! \brief Fills the supplied list with every system stepped at a fixed rate, from the root of the tree down to
+        //!        this state.
+        //!
+        //! Fixed update systems are rare, so the state records do not reserve a list for them and the branch list is
+        //! gathered from the system instances directly. bindBranch must have been invoked beforehand.
+        //! \param fixedUpdateList [in] -
+        //!        Storage for getBranchFixedUpdateCount() pointers, this must remain valid while the state is in use.
+        void GameState::bindFixedBranch(ngen::IFixedUpdateGameSystem **fixedUpdateList) {
+            m_branchFixedUpdateCount = getBranchFixedUpdateCount();
+            m_branchFixedUpdateList = fixedUpdateList;
+
+            size_t fixedUpdateIndex = m_branchFixedUpdateCount;
+
+            for (const GameState *state = this; state; state = state->m_parent) {
+                for (size_t loop = state->m_systemCount; loop > 0; --loop) {
+                    ngen::IFixedUpdateGameSystem *system = state->m_systemList[loop - 1].fixedUpdateSystem;
+
+                    if (system) {
+                        fixedUpdateList[--fixedUpdateIndex] = system;
+                    }
+                }
+            }
+        }
+
+        //! \brief Fills the supplied lists with the hash of each entry within the branch lists.
+        //!
+        //! The hashes are used to identify the systems within profile samples, only the flattened branch lists
+        //! are instrumented. The state tree only binds the hashes within profiling builds, the members exist in every
+        //! build so the layout of the state does not depend on the build options. bindBranch must have been invoked
+        //! before the hashes are bound.
+        //! \param systemHashList [in] -
+        //!        Storage for getBranchSystemCount() hashes, this must remain valid while the state is in use.
+        //! \param updateHashList [in] -
+        //!        Storage for getBranchUpdateCount() hashes, this must remain valid while the state is in use.
+        //! \param postUpdateHashList [in] -
+        //!        Storage for getBranchPostUpdateCount() hashes, this must remain valid while the state is in use.
+        void GameState::bindProfileHashes(GameSystemHash::Type *systemHashList, GameSystemHash::Type *updateHashList, GameSystemHash::Type *postUpdateHashList) {
+            m_branchSystemHashList = systemHashList;
+            m_branchUpdateHashList = updateHashList;
+            m_branchPostUpdateHashList = postUpdateHashList;
+
+            size_t systemIndex = m_branchSystemCount;
+            size_t updateIndex = m_branchUpdateCount;
+            size_t postUpdateIndex = m_branchPostUpdateCount;
+
+            // The update lists were built from the systems in order, so the hashes can be recovered the same way
+            for (const GameState *state = this; state; state = state->m_parent) {
+                systemIndex -= state->m_systemCount;
+                updateIndex -= state->m_updateCount;
+                postUpdateIndex -= state->m_postUpdateCount;
+
+                size_t updateCount = 0;
+                size_t postUpdateCount = 0;
+
+                for (size_t loop = 0; loop < state->m_systemCount; ++loop) {
+                    const GameSystemInstance &instance = state->m_systemList[loop];
+
+                    systemHashList[systemIndex + loop] = instance.hash;
+
+                    if (instance.updateSystem) {
+                        updateHashList[updateIndex + updateCount++] = instance.hash;
+                    }
+
+                    if (instance.postUpdateSystem) {
+                        postUpdateHashList[postUpdateIndex + postUpdateCount++] = instance.hash;
+                    }
+                }
+            }
+        }
+
+        //! \brief Fills the supplied table with every system from the root of the tree down to this state.
+        //!
+        //! Once bound, getSystem resolves a hash with a single probe sequence rather than scanning each level of the
+        //! hierarchy. The hierarchy is walked from this state upwards, so where a hash appears more than once the
+        //! system belonging to the deepest state is kept, matching the behaviour of the per-level scan.
+        //! \param table [in] -
+        //!        Storage for the table, this must remain valid while the state is in use.
+        //! \param capacity [in] -
+        //!        Number of entries within the table, as returned by getLookupCapacity(getBranchSystemCount()).
+        void GameState::bindLookup(GameSystemLookup *table, size_t capacity) {
+            if (!capacity) {
+                return;
+            }
+
+            const size_t mask = capacity - 1;
+
+            for (size_t loop = 0; loop < capacity; ++loop) {
+                table[loop].hash = 0;
+                table[loop].system = nullptr;
+            }
+
+            for (const GameState *state = this; state; state = state->m_parent) {
+                for (size_t loop = 0; loop < state->m_systemCount; ++loop) {
+                    const GameSystemHash::Type hash = state->m_systemHashList[loop];
+
+                    size_t slot = lookupSlot(hash, mask);
+                    while (table[slot].hash && table[slot].hash != hash) {
+                        slot = (slot + 1) & mask;
+                    }
+
+                    if (!table[slot].hash) {
+                        table[slot].hash = hash;
+                        table[slot].system = state->m_gameSystemList[loop];
+                    }
                 }
             }
 
-            return m_parent ? m_parent->getSystem(hash) : nullptr;
+            m_branchLookup = table;
+            m_branchLookupMask = mask;
         }
 
         //! \brief Determines whether or not the specified state exists within our parent branch of the state tree.
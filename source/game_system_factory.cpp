@@ -14,18 +14,41 @@
 // limitations under the License.
 //
 
+
 #include <game_system/game_system_factory.h>
 #include <game_system/game_system_creator.h>
 
 namespace ngen {
     // NOTE: This class implementation should probably be inside a separate GameSystem library.
 
-    GameSystemFactory::GameSystemFactory() {
+    static const size_t kInitialTableSize = 16;
+
+    //! \brief Computes the first slot examined within the creator table for the supplied hash.
+    //!
+    //! The hash is scrambled with a multiplicative (Fibonacci) hash, the top bits of the result are used as they
+    //! are the best distributed.
+    static inline size_t creatorSlot(GameSystemHash::Type hash, size_t shift) {
+        return static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    //! \brief Clears the pointers held by an instance, as if the system had been deleted.
+    static inline void clearInstance(GameSystemInstance &instance) {
+        const GameSystemHash::Type hash = instance.hash;
+
+        instance = GameSystemInstance();
+        instance.hash = hash;
+    }
+
+    GameSystemFactory::GameSystemFactory()
+    : m_creatorTable(kInitialTableSize)
+    , m_creatorCount(0)
+    , m_tableShift(60)
+    {
         //
     }
 
     GameSystemFactory::~GameSystemFactory() {
-        //
+        releaseRecycled();
     }
 
     //! \brief Registers a new game system object with the factory.
@@ -33,48 +56,265 @@ namespace ngen {
     //! \param hash [in] Identifier associated with the game system being registered.
     //! \returns True if the object was registered successfully otherwise false.
     bool GameSystemFactory::registerClass(IGameSystemCreator *creator, GameSystemHash::Type hash) {
-        if (creator) {
-            if (hash) {
-                auto current = m_systemMap.find(hash);
-                if (current == m_systemMap.end()) {
-                    if (m_systemMap.insert({hash, creator}).second) {
-                        return true;
+        if (!creator || !hash || findEntry(hash)) {
+            return false;
+        }
+
+        // Keep at least half of the slots empty, so probe sequences remain short
+        if (2 * (m_creatorCount + 1) > m_creatorTable.size()) {
+            std::vector<CreatorEntry> previous(2 * m_creatorTable.size());
+            previous.swap(m_creatorTable);
+            m_tableShift--;
+
+            for (auto &entry : previous) {
+                if (entry.hash) {
+                    size_t slot = creatorSlot(entry.hash, m_tableShift);
+
+                    while (m_creatorTable[slot].hash) {
+                        slot = (slot + 1) & (m_creatorTable.size() - 1);
                     }
+
+                    m_creatorTable[slot] = std::move(entry);
                 }
             }
         }
 
+        size_t slot = creatorSlot(hash, m_tableShift);
+
+        while (m_creatorTable[slot].hash) {
+            slot = (slot + 1) & (m_creatorTable.size() - 1);
+        }
+
+        CreatorEntry &entry = m_creatorTable[slot];
+
+        entry.hash = hash;
+        entry.creator = creator;
+        entry.updateInterval = 1;
+        entry.independentInitialize = false;
+        entry.liveCount = 0;
+        entry.recycleLimit = 0;
+
+        m_creatorCount++;
+        return true;
+    }
+
+    //! \brief Retrieves the table entry of a registered game system.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \returns The entry of the game system or nullptr if it has not been registered.
+    GameSystemFactory::CreatorEntry* GameSystemFactory::findEntry(GameSystemHash::Type hash) const {
+        if (!hash) {
+            return nullptr;
+        }
+
+        for (size_t slot = creatorSlot(hash, m_tableShift); m_creatorTable[slot].hash; slot = (slot + 1) & (m_creatorTable.size() - 1)) {
+            if (m_creatorTable[slot].hash == hash) {
+                return const_cast<CreatorEntry*>(&m_creatorTable[slot]);
+            }
+        }
+
+        return nullptr;
+    }
+
+    //! \brief Retrieves the memory requirements of the specified game system.
+    //!
+    //! Instances of recycled systems are allocated by the factory, see isRecycled.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \param size [out] - Receives the size (in bytes) of an instance of the game system.
+    //! \param alignment [out] - Receives the alignment required by an instance of the game system.
+    //! \returns True if the game system has been registered otherwise false.
+    bool GameSystemFactory::getInstanceLayout(GameSystemHash::Type hash, size_t &size, size_t &alignment) const {
+        const CreatorEntry *entry = findEntry(hash);
+
+        if (entry) {
+            size = entry->creator->getInstanceSize();
+            alignment = entry->creator->getInstanceAlignment();
+            return true;
+        }
+
         return false;
     }
 
     //! \brief Deletes a game system instance that was previously created with this factory object.
     //! \param instance [in-out] Object that contains details about the system object to be deleted.
     void GameSystemFactory::deleteInstance(GameSystemInstance &instance) {
-        auto creator = m_systemMap.find(instance.hash);
+        deleteInstance(m_heapMemory, instance);
+    }
 
-        if (creator != m_systemMap.end()) {
-            creator->second->deleteInstance(instance);
-        } else {
+    //! \brief Creates an instance of the specified game system, memory for the instance is taken from the heap.
+    //! \param instance [in-out] Object that will receive information about the created instance.
+    //! \param hash [in] - Identifier associated with the game system to be created.
+    //! \returns True if the factory successfully created the game system otherwise false.
+    bool GameSystemFactory::createInstance(GameSystemInstance &instance, GameSystemHash::Type hash) {
+        return createInstance(m_heapMemory, instance, hash);
+    }
+
+    //! \brief Deletes a game system instance that was previously created with this factory object.
+    //!
+    //! An instance of a recycled system is reset and kept for reuse while its free list has room.
+    //! \param memory [in] The memory pool the instance was allocated from, unused for recycled systems.
+    //! \param instance [in-out] Object that contains details about the system object to be deleted.
+    void GameSystemFactory::deleteInstance(MemoryPool &memory, GameSystemInstance &instance) {
+        CreatorEntry *entry = findEntry(instance.hash);
+
+        if (!entry || !instance.gameSystem) {
             // Log error
+            return;
+        }
+
+        entry->liveCount--;
+
+        if (!entry->recycleLimit) {
+            entry->creator->deleteInstance(memory, instance);
+            return;
+        }
+
+        if (entry->freeList.size() < entry->recycleLimit) {
+            entry->creator->resetInstance(instance);
+            entry->freeList.push_back(instance.gameSystem);
+            clearInstance(instance);
+        } else {
+            entry->creator->deleteInstance(m_heapMemory, instance);
         }
     }
 
     //! \brief Creates an instance of the specified game system.
+    //!
+    //! Instances of recycled systems are taken from the free list when one is available, otherwise they are
+    //! allocated from the factory's own heap so they may be kept once deleted.
+    //! \param memory [in] The memory pool the instance is to be allocated from, unused for recycled systems.
     //! \param instance [in-out] Object that will receive information about the created instance.
     //! \param hash [in] - Identifier associated with the game system to be created.
     //! \returns True if the factory successfully created the game system otherwise false.
-    bool GameSystemFactory::createInstance(GameSystemInstance &instance, GameSystemHash::Type hash) {
-        auto creator = m_systemMap.find(hash);
+    bool GameSystemFactory::createInstance(MemoryPool &memory, GameSystemInstance &instance, GameSystemHash::Type hash) {
+        CreatorEntry *entry = findEntry(hash);
 
-        if (creator != m_systemMap.end()) {
-            if (creator->second->createInstance(instance)) {
-                instance.hash = hash;
-                return true;
-            }
+        if (!entry) {
+            // Log error
+            return false;
         }
 
-        // Log error
+        if (!entry->freeList.empty()) {
+            instance.gameSystem = entry->freeList.back();
+            entry->freeList.pop_back();
+            entry->creator->bindInstance(instance);
+        } else if (!entry->creator->createInstance(entry->recycleLimit ? m_heapMemory : memory, instance)) {
+            return false;
+        }
 
-        return false;
+        instance.hash = hash;
+        entry->liveCount++;
+
+        return true;
+    }
+
+    //! \brief Specifies how many deleted instances of a game system are kept for reuse.
+    //!
+    //! Only systems implementing IRecyclableGameSystem may be recycled. Recycling may only be enabled or disabled
+    //! while no instance of the system exists, as recycled instances are allocated by the factory rather than the
+    //! caller's memory pool. The limit of a recycled system may be changed at any time.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \param limit [in] - Largest number of instances kept, 0 disables recycling.
+    //! \returns True if the limit was applied otherwise false.
+    bool GameSystemFactory::setRecycleLimit(GameSystemHash::Type hash, size_t limit) {
+        CreatorEntry *entry = findEntry(hash);
+
+        if (!entry || (limit && !entry->creator->isRecyclable())) {
+            return false;
+        }
+
+        if (entry->liveCount && !entry->recycleLimit != !limit) {
+            return false;
+        }
+
+        entry->recycleLimit = limit;
+        trimFreeList(*entry, limit);
+
+        return true;
+    }
+
+    //! \brief Specifies how often the systems of a registered type are updated by a state tree.
+    //!
+    //! The interval belongs to this factory's registration, other factories registering the same type are unaffected.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \param interval [in] - Number of frames between each call to onUpdate, values below 1 are treated as 1.
+    //! \returns True if the interval was applied, false if the system has not been registered.
+    bool GameSystemFactory::setUpdateInterval(GameSystemHash::Type hash, uint32_t interval) {
+        CreatorEntry *entry = findEntry(hash);
+
+        if (!entry) {
+            return false;
+        }
+
+        entry->updateInterval = interval ? interval : 1;
+        return true;
+    }
+
+    //! \brief Retrieves how often the systems of a registered type are updated by a state tree.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \returns The number of frames between each call to onUpdate, 1 if the system has not been registered.
+    uint32_t GameSystemFactory::getUpdateInterval(GameSystemHash::Type hash) const {
+        const CreatorEntry *entry = findEntry(hash);
+        return entry ? entry->updateInterval : 1;
+    }
+
+    //! \brief Specifies whether onInitialize of a registered type neither reads nor writes state shared with other systems.
+    //!
+    //! The setting belongs to this factory's registration, other factories registering the same type are unaffected.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \param independent [in] - True if instances may be initialized on a worker thread alongside other systems.
+    //! \returns True if the setting was applied, false if the system has not been registered.
+    bool GameSystemFactory::setIndependentInitialize(GameSystemHash::Type hash, bool independent) {
+        CreatorEntry *entry = findEntry(hash);
+
+        if (!entry) {
+            return false;
+        }
+
+        entry->independentInitialize = independent;
+        return true;
+    }
+
+    //! \brief Determines whether instances of a registered type may be initialized on a worker thread.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \returns True if the system was registered as independent otherwise false.
+    bool GameSystemFactory::getIndependentInitialize(GameSystemHash::Type hash) const {
+        const CreatorEntry *entry = findEntry(hash);
+        return entry && entry->independentInitialize;
+    }
+
+    //! \brief Determines whether or not deleted instances of a game system are kept for reuse.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \returns True if the system is recycled, in which case its instances do not use the caller's memory pool.
+    bool GameSystemFactory::isRecycled(GameSystemHash::Type hash) const {
+        const CreatorEntry *entry = findEntry(hash);
+        return entry && entry->recycleLimit;
+    }
+
+    //! \brief Retrieves the number of instances of a game system that are waiting to be reused.
+    //! \param hash [in] - Identifier associated with the game system.
+    //! \returns The number of instances within the free list of the system.
+    size_t GameSystemFactory::getRecycledCount(GameSystemHash::Type hash) const {
+        const CreatorEntry *entry = findEntry(hash);
+        return entry ? entry->freeList.size() : 0;
+    }
+
+    //! \brief Destroys every instance waiting to be reused, the recycle limits are unchanged.
+    void GameSystemFactory::releaseRecycled() {
+        for (auto &entry : m_creatorTable) {
+            trimFreeList(entry, 0);
+        }
+    }
+
+    //! \brief Destroys instances within a free list until no more than the specified number remain.
+    //! \param entry [in] The entry whose free list is to be trimmed.
+    //! \param count [in] The number of instances to be kept.
+    void GameSystemFactory::trimFreeList(CreatorEntry &entry, size_t count) {
+        while (entry.freeList.size() > count) {
+            GameSystemInstance instance;
+            instance.gameSystem = entry.freeList.back();
+
+            entry.creator->deleteInstance(m_heapMemory, instance);
+            entry.freeList.pop_back();
+        }
     }
 }
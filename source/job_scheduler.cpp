@@ -0,0 +1,290 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "job_scheduler.h"
+
+namespace ngen {
+    namespace StateSystem {
+        JobGraph::JobGraph()
+        : m_jobCount(0)
+        {
+            //
+        }
+
+        JobGraph::~JobGraph() {
+            //
+        }
+
+        //! \brief Removes all edges from the graph and prepares it to receive the specified number of jobs.
+        //! \param jobCount [in] -
+        //!        The number of jobs contained within the graph.
+        void JobGraph::reset(size_t jobCount) {
+            m_jobCount = jobCount;
+
+            m_edgeList.clear();
+            m_dependencyList.assign(jobCount, 0);
+            m_successorStart.assign(jobCount + 1, 0);
+            m_successorList.clear();
+        }
+
+        //! \brief Specifies that one job must complete before another job may begin.
+        //! \param from [in] -
+        //!        Index of the job that must complete first.
+        //! \param to [in] -
+        //!        Index of the job that depends upon the first job.
+        void JobGraph::addEdge(size_t from, size_t to) {
+            if (from < m_jobCount && to < m_jobCount && from != to) {
+                m_edgeList.push_back({ static_cast<uint32_t>(from), static_cast<uint32_t>(to) });
+            }
+        }
+
+        //! \brief Builds the successor lists for each job, must be invoked once all edges have been added.
+        void JobGraph::finalize() {
+            m_dependencyList.assign(m_jobCount, 0);
+            m_successorStart.assign(m_jobCount + 1, 0);
+            m_successorList.resize(m_edgeList.size());
+
+            for (auto &edge : m_edgeList) {
+                m_dependencyList[edge.to]++;
+                m_successorStart[edge.from + 1]++;
+            }
+
+            for (size_t loop = 0; loop < m_jobCount; ++loop) {
+                m_successorStart[loop + 1] += m_successorStart[loop];
+            }
+
+            std::vector<uint32_t> cursor(m_successorStart.begin(), m_successorStart.end() - 1);
+            for (auto &edge : m_edgeList) {
+                m_successorList[cursor[edge.from]++] = edge.to;
+            }
+        }
+
+        //! \brief Retrieves the number of jobs that must complete before the specified job may begin.
+        //! \param job [in] -
+        //!        Index of the job whose dependencies are to be retrieved.
+        //! \return The number of jobs the specified job depends upon.
+        uint32_t JobGraph::getDependencyCount(size_t job) const {
+            return m_dependencyList[job];
+        }
+
+        //! \brief Retrieves the jobs that depend upon the specified job.
+        //! \param job [in] -
+        //!        Index of the job whose successors are to be retrieved.
+        //! \param count [out] -
+        //!        Receives the number of successors.
+        //! \return Pointer to the list of successor job indices.
+        const uint32_t* JobGraph::getSuccessors(size_t job, size_t &count) const {
+            count = m_successorStart[job + 1] - m_successorStart[job];
+            return m_successorList.data() + m_successorStart[job];
+        }
+
+        JobScheduler::JobScheduler(size_t workerCount)
+        : m_graph(nullptr)
+        , m_function(nullptr)
+        , m_context(nullptr)
+        , m_pendingCapacity(0)
+        , m_remaining(0)
+        , m_generation(0)
+        , m_busyCount(0)
+        , m_active(false)
+        , m_shutdown(false)
+        {
+            for (size_t loop = 0; loop <= workerCount; ++loop) {
+                m_queueList.emplace_back(new JobQueue());
+            }
+
+            for (size_t loop = 0; loop < workerCount; ++loop) {
+                m_workerList.emplace_back(&JobScheduler::workerMain, this, loop);
+            }
+        }
+
+        JobScheduler::~JobScheduler() {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_shutdown = true;
+            }
+
+            m_wake.notify_all();
+
+            for (auto &worker : m_workerList) {
+                worker.join();
+            }
+        }
+
+        //! \brief Executes every job within the supplied graph, returning once all jobs have completed.
+        //! \param graph [in] -
+        //!        The graph describing the jobs to be executed, finalize must have been invoked on the graph.
+        //! \param function [in] -
+        //!        Function invoked for each job, this may be called concurrently from multiple threads.
+        //! \param context [in] -
+        //!        User data supplied to each invocation of the job function.
+        void JobScheduler::execute(const JobGraph &graph, JobFunction function, void *context) {
+            const size_t jobCount = graph.getJobCount();
+
+            if (!jobCount || !function) {
+                return;
+            }
+
+            std::lock_guard<std::mutex> executeLock(m_executeLock);
+
+            if (m_pendingCapacity < jobCount) {
+                m_pendingList.reset(new std::atomic<uint32_t>[jobCount]);
+                m_pendingCapacity = jobCount;
+            }
+
+            // The caller uses the final queue, jobs with no dependencies are spread across all queues
+            const size_t callerQueue = m_workerList.size();
+            size_t nextQueue = 0;
+
+            m_remaining.store(jobCount, std::memory_order_relaxed);
+
+            for (size_t loop = 0; loop < jobCount; ++loop) {
+                const uint32_t dependencies = graph.getDependencyCount(loop);
+
+                m_pendingList[loop].store(dependencies, std::memory_order_relaxed);
+
+                if (!dependencies) {
+                    push(nextQueue, static_cast<uint32_t>(loop));
+                    nextQueue = (nextQueue + 1) % m_queueList.size();
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+
+                m_graph = &graph;
+                m_function = function;
+                m_context = context;
+                m_active = true;
+                m_generation++;
+            }
+
+            m_wake.notify_all();
+
+            processJobs(callerQueue);
+
+            // Wait for all workers to leave the graph before it is released by the caller
+            std::unique_lock<std::mutex> lock(m_lock);
+
+            m_active = false;
+            m_idle.wait(lock, [this]() { return 0 == m_busyCount; });
+
+            m_graph = nullptr;
+            m_function = nullptr;
+            m_context = nullptr;
+        }
+
+        //! \brief Entry point for each worker thread.
+        //! \param queueIndex [in] -
+        //!        Index of the queue owned by the worker.
+        void JobScheduler::workerMain(size_t queueIndex) {
+            uint64_t generation = 0;
+
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+
+                    m_wake.wait(lock, [&]() { return m_shutdown || (m_active && m_generation != generation); });
+
+                    if (m_shutdown) {
+                        return;
+                    }
+
+                    generation = m_generation;
+                    m_busyCount++;
+                }
+
+                processJobs(queueIndex);
+
+                {
+                    std::lock_guard<std::mutex> lock(m_lock);
+                    m_busyCount--;
+                }
+
+                m_idle.notify_all();
+            }
+        }
+
+        //! \brief Processes jobs from the current graph until every job has completed.
+        //! \param queueIndex [in] -
+        //!        Index of the queue owned by the calling thread.
+        void JobScheduler::processJobs(size_t queueIndex) {
+            while (m_remaining.load(std::memory_order_acquire)) {
+                uint32_t job;
+
+                if (!pop(queueIndex, job) && !steal(queueIndex, job)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+
+                m_function(m_context, job);
+
+                // Successors are queued before the job is marked complete, so the remaining count cannot reach
+                // zero while work is still outstanding.
+                size_t successorCount;
+                const uint32_t *successors = m_graph->getSuccessors(job, successorCount);
+
+                for (size_t loop = 0; loop < successorCount; ++loop) {
+                    if (1 == m_pendingList[successors[loop]].fetch_sub(1, std::memory_order_acq_rel)) {
+                        push(queueIndex, successors[loop]);
+                    }
+                }
+
+                m_remaining.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+
+        //! \brief Adds a job that is ready to run to the specified queue.
+        void JobScheduler::push(size_t queueIndex, uint32_t job) {
+            JobQueue &queue = *m_queueList[queueIndex];
+
+            std::lock_guard<std::mutex> lock(queue.lock);
+            queue.jobs.push_back(job);
+        }
+
+        //! \brief Takes the most recently added job from the specified queue.
+        bool JobScheduler::pop(size_t queueIndex, uint32_t &job) {
+            JobQueue &queue = *m_queueList[queueIndex];
+
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.jobs.empty()) {
+                return false;
+            }
+
+            job = queue.jobs.back();
+            queue.jobs.pop_back();
+            return true;
+        }
+
+        //! \brief Takes the oldest job from any queue other than the one specified.
+        bool JobScheduler::steal(size_t queueIndex, uint32_t &job) {
+            const size_t queueCount = m_queueList.size();
+
+            for (size_t loop = 1; loop < queueCount; ++loop) {
+                JobQueue &queue = *m_queueList[(queueIndex + loop) % queueCount];
+
+                std::lock_guard<std::mutex> lock(queue.lock);
+                if (!queue.jobs.empty()) {
+                    job = queue.jobs.front();
+                    queue.jobs.pop_front();
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    }
+}
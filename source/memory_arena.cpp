@@ -0,0 +1,104 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <new>
+
+#include "memory_arena.h"
+
+namespace ngen {
+    namespace StateSystem {
+        MemoryArena::MemoryArena()
+        : m_block(nullptr)
+        , m_base(nullptr)
+        , m_capacity(0)
+        , m_used(0)
+        {
+            //
+        }
+
+        MemoryArena::~MemoryArena() {
+            reset();
+        }
+
+        //! \brief Allocates the block of memory used by the arena, any previous block is released.
+        //! \param size [in] -
+        //!        The number of bytes required by the arena.
+        //! \param alignment [in] -
+        //!        Alignment of the start of the block, must be a power of two.
+        //! \return <em>True</em> if the block was allocated successfully otherwise <em>false</em>.
+        bool MemoryArena::reserve(size_t size, size_t alignment) {
+            reset();
+
+            if (!size) {
+                return true;
+            }
+
+            m_block = static_cast<uint8_t*>(::operator new(size + alignment, std::nothrow));
+            if (!m_block) {
+                return false;
+            }
+
+            m_base = reinterpret_cast<uint8_t*>(alignSize(reinterpret_cast<uintptr_t>(m_block), alignment));
+            m_capacity = size;
+
+            return true;
+        }
+
+        //! \brief Returns the block of memory to the heap, all allocations made from the arena become invalid.
+        void MemoryArena::reset() {
+            ::operator delete(m_block);
+
+            m_block = nullptr;
+            m_base = nullptr;
+            m_capacity = 0;
+            m_used = 0;
+        }
+
+        //! \brief Allocates memory from the arena.
+        //! \param size [in] -
+        //!        The number of bytes to be allocated.
+        //! \param alignment [in] -
+        //!        The alignment required by the allocation, must be a power of two.
+        //! \return Pointer to the allocated memory or nullptr if the arena does not have enough space available.
+        void* MemoryArena::allocate(size_t size, size_t alignment) {
+            if (!m_base) {
+                return nullptr;
+            }
+
+            const size_t offset = alignSize(reinterpret_cast<uintptr_t>(m_base) + m_used, alignment) - reinterpret_cast<uintptr_t>(m_base);
+            if (offset > m_capacity || m_capacity - offset < size) {
+                return nullptr;
+            }
+
+            m_used = offset + size;
+            return m_base + offset;
+        }
+
+        //! \brief Individual allocations cannot be released, the memory is returned when the arena is reset.
+        void MemoryArena::release(void *) {
+            //
+        }
+
+        //! \brief Determines whether or not the supplied address lies within the arena.
+        //! \param memory [in] -
+        //!        The address to be checked.
+        //! \return <em>True</em> if the address was allocated from this arena otherwise <em>false</em>.
+        bool MemoryArena::contains(const void *memory) const {
+            const uint8_t *address = static_cast<const uint8_t*>(memory);
+            return m_base && address >= m_base && address < m_base + m_capacity;
+        }
+    }
+}
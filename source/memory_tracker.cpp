@@ -0,0 +1,244 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "memory_tracker.h"
+#include "memory_arena.h"
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Placed immediately before each block returned by TrackedMemoryPool.
+        struct TrackedBlockHeader {
+            size_t size;        // Size requested by the caller
+            size_t offset;      // Distance from the start of the underlying allocation to the block
+        };
+
+        //! \brief Raises a peak value so that it is at least the supplied value.
+        static inline void raisePeak(std::atomic<size_t> &peak, size_t value) {
+            size_t current = peak.load(std::memory_order_relaxed);
+
+            while (current < value && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+            }
+        }
+
+        StateMemoryAccount::StateMemoryAccount()
+        : m_parent(nullptr)
+        , m_used(0)
+        , m_peak(0)
+        , m_blockCount(0)
+        , m_failedCount(0)
+        , m_budget(0)
+        , m_policy(MemoryBudgetPolicy::Report)
+        {
+        }
+
+        //! \brief Specifies the account of the parent state, which receives every allocation made within this account.
+        //! \param parent [in] -
+        //!        The account of the parent state, or nullptr for the root of a tree.
+        void StateMemoryAccount::bind(StateMemoryAccount *parent) {
+            m_parent = parent;
+        }
+
+        //! \brief Replaces the usage held by the account, the peak and failure count restart from the new values.
+        //! \param used [in] -
+        //!        Number of bytes currently allocated within the subtree.
+        //! \param blockCount [in] -
+        //!        Number of blocks currently allocated within the subtree.
+        void StateMemoryAccount::reset(size_t used, size_t blockCount) {
+            m_used.store(used, std::memory_order_relaxed);
+            m_peak.store(used, std::memory_order_relaxed);
+            m_blockCount.store(blockCount, std::memory_order_relaxed);
+            m_failedCount.store(0, std::memory_order_relaxed);
+        }
+
+        //! \brief Charges an allocation to this account and to each of its parents.
+        //! \param  size [in] -
+        //!         Size of the allocation (in bytes).
+        //! \return <em>True</em> if the allocation was accepted, <em>false</em> if it would exceed a budget with the
+        //!         Fail policy, in which case no account is charged.
+        bool StateMemoryAccount::acquire(size_t size) {
+            for (StateMemoryAccount *account = this; account; account = account->m_parent) {
+                const size_t used = account->m_used.fetch_add(size, std::memory_order_relaxed) + size;
+
+                if (account->m_budget && MemoryBudgetPolicy::Fail == account->m_policy && used > account->m_budget) {
+                    account->m_failedCount.fetch_add(1, std::memory_order_relaxed);
+                    account->m_used.fetch_sub(size, std::memory_order_relaxed);
+                    rollback(account, size);
+                    return false;
+                }
+            }
+
+            // Peaks are only raised once every budget has accepted the allocation
+            for (StateMemoryAccount *account = this; account; account = account->m_parent) {
+                account->m_blockCount.fetch_add(1, std::memory_order_relaxed);
+                raisePeak(account->m_peak, account->m_used.load(std::memory_order_relaxed));
+            }
+
+            return true;
+        }
+
+        //! \brief Returns an allocation to this account and to each of its parents.
+        //! \param size [in] -
+        //!        Size of the allocation (in bytes).
+        void StateMemoryAccount::release(size_t size) {
+            for (StateMemoryAccount *account = this; account; account = account->m_parent) {
+                account->m_used.fetch_sub(size, std::memory_order_relaxed);
+                account->m_blockCount.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+        //! \brief Removes a refused allocation from the accounts that had already been charged.
+        //! \param last [in] -
+        //!        The account that refused the allocation, accounts from this one up to (excluding) it are restored.
+        //! \param size [in] -
+        //!        Size of the allocation (in bytes).
+        void StateMemoryAccount::rollback(const StateMemoryAccount *last, size_t size) {
+            for (StateMemoryAccount *account = this; account != last; account = account->m_parent) {
+                account->m_used.fetch_sub(size, std::memory_order_relaxed);
+            }
+        }
+
+        //! \brief Specifies the largest number of bytes the systems of the state and its descendants should allocate.
+        //! \param budget [in] -
+        //!        The budget in bytes, zero removes the budget.
+        //! \param policy [in] -
+        //!        The action taken when the budget is exceeded.
+        void StateMemoryAccount::setBudget(size_t budget, MemoryBudgetPolicy policy) {
+            m_budget = budget;
+            m_policy = policy;
+        }
+
+        //! \brief Retrieves the memory statistics of the account.
+        //! \return The statistics of the state and every state below it.
+        MemoryUsage StateMemoryAccount::getUsage() const {
+            MemoryUsage usage;
+
+            usage.used = m_used.load(std::memory_order_relaxed);
+            usage.peak = m_peak.load(std::memory_order_relaxed);
+            usage.blockCount = m_blockCount.load(std::memory_order_relaxed);
+            usage.failedCount = m_failedCount.load(std::memory_order_relaxed);
+
+            return usage;
+        }
+
+        //! \brief Lowers the peak to the number of bytes currently allocated.
+        void StateMemoryAccount::resetPeak() {
+            m_peak.store(m_used.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+
+        TrackedMemoryPool::TrackedMemoryPool()
+        : m_pool(nullptr)
+        , m_account(nullptr)
+        , m_used(0)
+        , m_peak(0)
+        , m_blockCount(0)
+        , m_failedCount(0)
+        {
+        }
+
+        //! \brief Specifies where blocks are obtained from and which account they are charged to.
+        //!
+        //! The backing pool must not be changed while blocks are allocated, as they are released back to it.
+        //! \param pool [in] -
+        //!        The pool providing the memory for each block.
+        //! \param account [in] -
+        //!        The account of the state containing the system, or nullptr if allocations are not charged to a state.
+        void TrackedMemoryPool::bind(ngen::MemoryPool *pool, StateMemoryAccount *account) {
+            m_pool = pool;
+            m_account = account;
+        }
+
+        //! \brief Allocates a block of memory and charges it to the system and its state.
+        //! \param  size [in] -
+        //!         Size of the block (in bytes).
+        //! \param  alignment [in] -
+        //!         Required alignment of the block, must be a power of two.
+        //! \return The allocated block or nullptr if the memory is not available or a budget would be exceeded.
+        void* TrackedMemoryPool::allocate(size_t size, size_t alignment) {
+            if (!m_pool) {
+                return nullptr;
+            }
+
+            if (alignment < alignof(TrackedBlockHeader)) {
+                alignment = alignof(TrackedBlockHeader);
+            }
+
+            if (m_account && !m_account->acquire(size)) {
+                m_failedCount.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            const size_t offset = MemoryArena::alignSize(sizeof(TrackedBlockHeader), alignment);
+            uint8_t *memory = static_cast<uint8_t*>(m_pool->allocate(size + offset, alignment));
+
+            if (!memory) {
+                if (m_account) {
+                    m_account->release(size);
+                }
+
+                return nullptr;
+            }
+
+            TrackedBlockHeader *header = reinterpret_cast<TrackedBlockHeader*>(memory + offset) - 1;
+            header->size = size;
+            header->offset = offset;
+
+            raisePeak(m_peak, m_used.fetch_add(size, std::memory_order_relaxed) + size);
+            m_blockCount.fetch_add(1, std::memory_order_relaxed);
+
+            return memory + offset;
+        }
+
+        //! \brief Returns a block allocated by this pool.
+        //! \param memory [in] -
+        //!        The block to be released, may be nullptr.
+        void TrackedMemoryPool::release(void *memory) {
+            if (!memory) {
+                return;
+            }
+
+            const TrackedBlockHeader *header = static_cast<const TrackedBlockHeader*>(memory) - 1;
+            const size_t size = header->size;
+
+            m_used.fetch_sub(size, std::memory_order_relaxed);
+            m_blockCount.fetch_sub(1, std::memory_order_relaxed);
+
+            if (m_account) {
+                m_account->release(size);
+            }
+
+            m_pool->release(static_cast<uint8_t*>(memory) - header->offset);
+        }
+
+        //! \brief Retrieves the memory statistics of the system using the pool.
+        //! \return The statistics of the blocks allocated through this pool.
+        MemoryUsage TrackedMemoryPool::getUsage() const {
+            MemoryUsage usage;
+
+            usage.used = m_used.load(std::memory_order_relaxed);
+            usage.peak = m_peak.load(std::memory_order_relaxed);
+            usage.blockCount = m_blockCount.load(std::memory_order_relaxed);
+            usage.failedCount = m_failedCount.load(std::memory_order_relaxed);
+
+            return usage;
+        }
+
+        //! \brief Lowers the peak to the number of bytes currently allocated.
+        void TrackedMemoryPool::resetPeak() {
+            m_peak.store(m_used.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+    }
+}
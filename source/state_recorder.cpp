@@ -0,0 +1,417 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstring>
+
+#include <core/update_args.h>
+
+#include "state_recorder.h"
+#include "state_tree.h"
+#include "game_state.h"
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Arguments supplied to the state tree while a log is replayed, requests are passed to the tree.
+        struct ReplayUpdateArgs : public ngen::UpdateArgs {
+            explicit ReplayUpdateArgs(StateTree &tree) : stateTree(tree) {}
+
+            virtual bool requestState(const char *name) const {
+                return stateTree.requestState(name);
+            }
+
+            virtual bool requestStateId(uint64_t stateId) const {
+                return stateTree.requestStateId(stateId);
+            }
+
+            StateTree &stateTree;
+        };
+
+        //! \brief Retrieves the number of bytes following the type of a record.
+        //! \param type [in] -
+        //!        The type of the record.
+        //! \return The size of the record data or zero if the type is unknown.
+        static size_t getRecordSize(StateRecordType type) {
+            switch (type) {
+                case StateRecordType::Update:       return sizeof(float);
+                case StateRecordType::PostUpdate:   return sizeof(float);
+                case StateRecordType::Commit:       return 0;
+                case StateRecordType::Request:      return sizeof(uint8_t) + sizeof(uint64_t) * 2 + sizeof(int32_t);
+                case StateRecordType::Transition:   return sizeof(uint64_t) * 2;
+            }
+
+            return 0;
+        }
+
+        StateRecorder::StateRecorder()
+        : m_file(nullptr)
+        , m_recordCount(0)
+        , m_shutdown(false)
+        {
+            //
+        }
+
+        StateRecorder::~StateRecorder() {
+            close();
+        }
+
+        //! \brief Creates a log file, any previously open log is closed.
+        //! \param path [in] -
+        //!        Path to the file the log is written to.
+        //! \return <em>True</em> if the file was created successfully otherwise <em>false</em>.
+        bool StateRecorder::open(const char *path) {
+            close();
+
+            if (!path) {
+                return false;
+            }
+
+            m_file = fopen(path, "wb");
+            if (!m_file) {
+                return false;
+            }
+
+            const StateRecordHeader header = { kStateRecordMagic, kStateRecordVersion };
+
+            m_buffer.reserve(kBufferSize);
+            m_buffer.assign(reinterpret_cast<const uint8_t*>(&header), reinterpret_cast<const uint8_t*>(&header + 1));
+            m_recordCount = 0;
+            m_shutdown = false;
+
+            m_writer = std::thread(&StateRecorder::writerMain, this);
+            return true;
+        }
+
+        //! \brief Writes any outstanding records and closes the log file.
+        void StateRecorder::close() {
+            if (!m_file) {
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+
+                if (!m_buffer.empty()) {
+                    m_writeQueue.push_back(std::move(m_buffer));
+                    m_buffer.clear();
+                }
+
+                m_shutdown = true;
+            }
+
+            m_wake.notify_one();
+            m_writer.join();
+
+            fclose(m_file);
+
+            m_file = nullptr;
+            m_freeList.clear();
+        }
+
+        //! \brief Records a call to StateTree::onUpdate.
+        //! \param deltaTime [in] -
+        //!        The delta time supplied to the tree.
+        void StateRecorder::recordUpdate(float deltaTime) {
+            append(StateRecordType::Update, &deltaTime, sizeof(deltaTime));
+        }
+
+        //! \brief Records a call to StateTree::onPostUpdate.
+        //! \param deltaTime [in] -
+        //!        The delta time supplied to the tree.
+        void StateRecorder::recordPostUpdate(float deltaTime) {
+            append(StateRecordType::PostUpdate, &deltaTime, sizeof(deltaTime));
+        }
+
+        //! \brief Records a call to StateTree::commitStateChange made by the caller of the tree.
+        void StateRecorder::recordCommit() {
+            append(StateRecordType::Commit, nullptr, 0);
+        }
+
+        //! \brief Records a request for a state change.
+        //! \param state [in] -
+        //!        Identifier of the requested state.
+        //! \param source [in] -
+        //!        Hash of the game system that made the request, or zero if it is unknown.
+        //! \param priority [in] -
+        //!        Priority of the request.
+        //! \param internal [in] -
+        //!        <em>True</em> if the request was made while the tree was being processed.
+        void StateRecorder::recordRequest(uint64_t state, uint64_t source, int32_t priority, bool internal) {
+            uint8_t data[sizeof(uint8_t) + sizeof(uint64_t) * 2 + sizeof(int32_t)];
+
+            data[0] = internal ? 1 : 0;
+            memcpy(data + 1, &state, sizeof(state));
+            memcpy(data + 1 + sizeof(uint64_t), &source, sizeof(source));
+            memcpy(data + 1 + sizeof(uint64_t) * 2, &priority, sizeof(priority));
+
+            append(StateRecordType::Request, data, sizeof(data));
+        }
+
+        //! \brief Records a change of the active state.
+        //! \param source [in] -
+        //!        Identifier of the state that was left, or zero if no state was active.
+        //! \param target [in] -
+        //!        Identifier of the state that became active.
+        void StateRecorder::recordTransition(uint64_t source, uint64_t target) {
+            const uint64_t data[2] = { source, target };
+            append(StateRecordType::Transition, data, sizeof(data));
+        }
+
+        //! \brief Retrieves the number of records written since the log was opened.
+        //! \return The number of records within the log.
+        size_t StateRecorder::getRecordCount() const {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_recordCount;
+        }
+
+        //! \brief Appends a record to the current buffer, the buffer is queued for writing once it is full.
+        //! \param type [in] -
+        //!        The type of the record.
+        //! \param data [in] -
+        //!        The data following the type.
+        //! \param length [in] -
+        //!        Size of the data (in bytes).
+        void StateRecorder::append(StateRecordType type, const void *data, size_t length) {
+            if (!m_file) {
+                return;
+            }
+
+            bool queued = false;
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+
+                const uint8_t *bytes = static_cast<const uint8_t*>(data);
+
+                m_buffer.push_back(static_cast<uint8_t>(type));
+                m_buffer.insert(m_buffer.end(), bytes, bytes + length);
+                m_recordCount++;
+
+                if (m_buffer.size() >= kBufferSize) {
+                    m_writeQueue.push_back(std::move(m_buffer));
+
+                    if (m_freeList.empty()) {
+                        m_buffer = std::vector<uint8_t>();
+                        m_buffer.reserve(kBufferSize);
+                    } else {
+                        m_buffer = std::move(m_freeList.back());
+                        m_freeList.pop_back();
+                    }
+
+                    queued = true;
+                }
+            }
+
+            if (queued) {
+                m_wake.notify_one();
+            }
+        }
+
+        //! \brief Entry point for the thread that writes queued buffers to the log file.
+        void StateRecorder::writerMain() {
+            std::vector<std::vector<uint8_t>> writeList;
+
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+
+                    // Return the buffers written by the previous pass, so append does not need to allocate
+                    for (auto &buffer : writeList) {
+                        buffer.clear();
+                        m_freeList.push_back(std::move(buffer));
+                    }
+
+                    writeList.clear();
+
+                    m_wake.wait(lock, [this]() { return m_shutdown || !m_writeQueue.empty(); });
+
+                    if (m_writeQueue.empty()) {
+                        return;
+                    }
+
+                    writeList.swap(m_writeQueue);
+                }
+
+                for (auto &buffer : writeList) {
+                    fwrite(buffer.data(), 1, buffer.size(), m_file);
+                }
+            }
+        }
+
+        StateReplay::StateReplay()
+        : m_frameCount(0)
+        , m_divergenceCount(0)
+        {
+            //
+        }
+
+        StateReplay::~StateReplay() {
+            //
+        }
+
+        //! \brief Reads a state log from a file.
+        //! \param path [in] -
+        //!        Path to the file containing the log.
+        //! \return <em>True</em> if the log was read successfully otherwise <em>false</em>.
+        bool StateReplay::open(const char *path) {
+            close();
+
+            FILE *file = path ? fopen(path, "rb") : nullptr;
+            if (!file) {
+                return false;
+            }
+
+            std::vector<uint8_t> data;
+            uint8_t block[16 * 1024];
+            size_t length;
+
+            while ((length = fread(block, 1, sizeof(block), file)) > 0) {
+                data.insert(data.end(), block, block + length);
+            }
+
+            fclose(file);
+
+            return load(data.data(), data.size());
+        }
+
+        //! \brief Takes a copy of a state log held in memory.
+        //!
+        //! Every record is checked, so a log that is truncated or corrupt is rejected before it is replayed.
+        //! \param data [in] -
+        //!        Memory containing the log.
+        //! \param length [in] -
+        //!        Size of the log (in bytes).
+        //! \return <em>True</em> if the log is valid otherwise <em>false</em>.
+        bool StateReplay::load(const void *data, size_t length) {
+            close();
+
+            StateRecordHeader header;
+
+            if (!data || length < sizeof(header)) {
+                return false;
+            }
+
+            memcpy(&header, data, sizeof(header));
+
+            if (kStateRecordMagic != header.magic || kStateRecordVersion != header.version) {
+                return false;
+            }
+
+            const uint8_t *bytes = static_cast<const uint8_t*>(data);
+            size_t frameCount = 0;
+
+            for (size_t offset = sizeof(header); offset < length; ) {
+                const StateRecordType type = static_cast<StateRecordType>(bytes[offset]);
+                const size_t size = getRecordSize(type);
+
+                if ((!size && StateRecordType::Commit != type) || length - offset - 1 < size) {
+                    return false;
+                }
+
+                if (StateRecordType::Update == type) {
+                    frameCount++;
+                }
+
+                offset += 1 + size;
+            }
+
+            m_data.assign(bytes, bytes + length);
+            m_frameCount = frameCount;
+
+            return true;
+        }
+
+        //! \brief Releases the log held by the replay.
+        void StateReplay::close() {
+            m_data.clear();
+            m_frameCount = 0;
+        }
+
+        //! \brief Replays the loaded log into the supplied state tree.
+        //! \param stateTree [in] -
+        //!        The state tree to be driven by the log.
+        //! \return <em>True</em> if the log was replayed otherwise <em>false</em>.
+        bool StateReplay::run(StateTree &stateTree) {
+            m_divergenceCount = 0;
+
+            if (m_data.empty() || !stateTree.getStateCount()) {
+                return false;
+            }
+
+            ReplayUpdateArgs updateArgs(stateTree);
+
+            uint64_t expected = 0;          // Identifier of the state the log expects to be active
+            bool hasExpected = false;
+
+            // Transitions are recorded after the operation that caused them, so each operation checks the outcome
+            // of the previous one before it is performed.
+            auto verify = [&]() {
+                const GameState *activeState = stateTree.getActiveState();
+
+                if (hasExpected && (activeState ? activeState->getId() : 0) != expected) {
+                    m_divergenceCount++;
+                }
+            };
+
+            const uint8_t *bytes = m_data.data();
+
+            for (size_t offset = sizeof(StateRecordHeader); offset < m_data.size(); ) {
+                const StateRecordType type = static_cast<StateRecordType>(bytes[offset]);
+                const uint8_t *record = bytes + offset + 1;
+
+                offset += 1 + getRecordSize(type);
+
+                switch (type) {
+                    case StateRecordType::Update:
+                    case StateRecordType::PostUpdate:
+                        verify();
+                        memcpy(&updateArgs.deltaTime, record, sizeof(float));
+
+                        if (StateRecordType::Update == type) {
+                            stateTree.onUpdate(updateArgs);
+                        } else {
+                            stateTree.onPostUpdate(updateArgs);
+                        }
+                        break;
+
+                    case StateRecordType::Commit:
+                        verify();
+                        stateTree.commitStateChange();
+                        break;
+
+                    case StateRecordType::Request:
+                        if (!record[0]) {
+                            uint64_t state;
+                            int32_t priority;
+
+                            memcpy(&state, record + 1, sizeof(state));
+                            memcpy(&priority, record + 1 + sizeof(uint64_t) * 2, sizeof(priority));
+
+                            stateTree.requestStateId(state, priority);
+                        }
+                        break;
+
+                    case StateRecordType::Transition:
+                        memcpy(&expected, record + sizeof(uint64_t), sizeof(expected));
+                        hasExpected = true;
+                        break;
+                }
+            }
+
+            verify();
+            return true;
+        }
+    }
+}
@@ -0,0 +1,137 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <thread>
+#include "state_request_queue.h"
+
+namespace ngen {
+    namespace StateSystem {
+        const size_t StateRequestQueue::kCapacity;
+
+        StateRequestQueue::StateRequestQueue()
+        : m_overflowUsed(false)
+        , m_overflowRequest()
+        , m_tail(0)
+        , m_head(0)
+        {
+            m_overflowLock.clear();
+
+            for (size_t loop = 0; loop < kCapacity; ++loop) {
+                m_slotList[loop].sequence.store(loop, std::memory_order_relaxed);
+            }
+        }
+
+        //! \brief Adds a request to the queue, this may be invoked from any thread.
+        //!
+        //! When the queue is full the request is merged into the overflow slot instead, see takesPrecedence. This
+        //! may then wait on the other producers merging into the overflow slot.
+        //! \param request [in] -
+        //!        The request to be added.
+        void StateRequestQueue::push(const StateRequest &request) {
+            uint64_t position = m_tail.load(std::memory_order_relaxed);
+
+            for (;;) {
+                Slot &slot = m_slotList[position & (kCapacity - 1)];
+
+                const int64_t distance = static_cast<int64_t>(slot.sequence.load(std::memory_order_acquire) - position);
+
+                if (0 == distance) {
+                    // The slot is free, claim it unless another producer got there first
+                    if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        slot.request = request;
+                        slot.sequence.store(position + 1, std::memory_order_release);
+                        return;
+                    }
+                } else if (distance < 0) {
+                    // The slot still holds a request from the previous lap, so the queue is full
+                    pushOverflow(request);
+                    return;
+                } else {
+                    position = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        //! \brief Removes the oldest request from the queue, this may only be invoked by the consuming thread.
+        //! \param request [out] -
+        //!        Receives the request that was removed.
+        //! \return <em>True</em> if a request was removed otherwise <em>false</em>.
+        bool StateRequestQueue::pop(StateRequest &request) {
+            Slot &slot = m_slotList[m_head & (kCapacity - 1)];
+
+            if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) {
+                return popOverflow(request);
+            }
+
+            request = slot.request;
+
+            // Release the slot for the producers on the next lap
+            slot.sequence.store(m_head + kCapacity, std::memory_order_release);
+            m_head++;
+
+            return true;
+        }
+
+        //! \brief Keeps the supplied request within the overflow slot if it takes precedence over the one held there.
+        //! \param request [in] -
+        //!        The request that did not fit within the queue.
+        void StateRequestQueue::pushOverflow(const StateRequest &request) {
+            while (m_overflowLock.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+
+            if (!m_overflowUsed.load(std::memory_order_relaxed) || takesPrecedence(request, m_overflowRequest)) {
+                m_overflowRequest = request;
+                m_overflowUsed.store(true, std::memory_order_relaxed);
+            }
+
+            m_overflowLock.clear(std::memory_order_release);
+        }
+
+        //! \brief Removes the request held within the overflow slot, this may only be invoked by the consuming thread.
+        //! \param request [out] -
+        //!        Receives the request that was removed.
+        //! \return <em>True</em> if a request was removed otherwise <em>false</em>.
+        bool StateRequestQueue::popOverflow(StateRequest &request) {
+            if (!m_overflowUsed.load(std::memory_order_acquire)) {
+                return false;
+            }
+
+            while (m_overflowLock.test_and_set(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+
+            const bool used = m_overflowUsed.load(std::memory_order_relaxed);
+
+            if (used) {
+                request = m_overflowRequest;
+                m_overflowUsed.store(false, std::memory_order_relaxed);
+            }
+
+            m_overflowLock.clear(std::memory_order_release);
+            return used;
+        }
+
+        //! \brief Discards every request within the queue, this may only be invoked by the consuming thread.
+        void StateRequestQueue::clear() {
+            StateRequest request;
+
+            while (pop(request)) {
+                //
+            }
+        }
+    }
+}
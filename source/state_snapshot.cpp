@@ -0,0 +1,101 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include "state_snapshot.h"
+
+namespace ngen {
+    namespace StateSystem {
+        StateSnapshot::StateSnapshot()
+        : m_data(nullptr)
+        , m_entryList(nullptr)
+        , m_tierList(nullptr)
+        , m_initializedList(nullptr)
+        {
+        }
+
+        //! \brief Opens a snapshot for reading, the header and every entry are checked against the supplied length.
+        //! \param  data [in] -
+        //!         Memory containing the snapshot.
+        //! \param  length [in] -
+        //!         Size of the supplied memory block (in bytes).
+        //! \return <em>True</em> if the memory contains a valid snapshot otherwise <em>false</em>.
+        bool StateSnapshot::open(const void *data, size_t length) {
+            m_data = nullptr;
+            m_entryList = nullptr;
+            m_tierList = nullptr;
+            m_initializedList = nullptr;
+
+            if (!data || length < sizeof(StateSnapshotHeader)) {
+                return false;
+            }
+
+            const StateSnapshotHeader &header = *static_cast<const StateSnapshotHeader*>(data);
+
+            if (header.magic != kStateSnapshotMagic || header.version != kStateSnapshotVersion || header.snapshotSize > length) {
+                return false;
+            }
+
+            const size_t tableSize = getTableSize(header.stateCount, header.systemCount, header.tieredCount);
+
+            if (tableSize > header.snapshotSize) {
+                return false;
+            }
+
+            const uint8_t *bytes = static_cast<const uint8_t*>(data);
+            const StateSnapshotEntry *entryList = reinterpret_cast<const StateSnapshotEntry*>(bytes + sizeof(StateSnapshotHeader));
+
+            for (size_t loop = 0; loop < header.systemCount; ++loop) {
+                const StateSnapshotEntry &entry = entryList[loop];
+
+                if (entry.size && (entry.offset < tableSize || entry.offset > header.snapshotSize || entry.size > header.snapshotSize - entry.offset)) {
+                    return false;
+                }
+            }
+
+            m_data = bytes;
+            m_entryList = entryList;
+            m_tierList = reinterpret_cast<const StateSnapshotTier*>(entryList + header.systemCount);
+            m_initializedList = reinterpret_cast<const uint8_t*>(m_tierList + header.tieredCount);
+
+            return true;
+        }
+
+        //! \brief Retrieves the total size of the payloads held within the snapshot.
+        //! \return The sum of each system's payload size (in bytes), excluding padding.
+        size_t StateSnapshot::getPayloadSize() const {
+            size_t total = 0;
+
+            for (size_t loop = 0; loop < getSystemCount(); ++loop) {
+                total += size_t(m_entryList[loop].size);
+            }
+
+            return total;
+        }
+
+        //! \brief Computes the size of the header and tables found before the first payload.
+        //! \param  stateCount [in] -
+        //!         Number of states within the tree.
+        //! \param  systemCount [in] -
+        //!         Number of systems within the tree.
+        //! \param  tieredCount [in] -
+        //!         Number of systems within the tree that have an update interval.
+        //! \return Offset of the first payload (in bytes), aligned to the payload alignment.
+        size_t StateSnapshot::getTableSize(size_t stateCount, size_t systemCount, size_t tieredCount) {
+            return alignPayload(sizeof(StateSnapshotHeader) + sizeof(StateSnapshotEntry) * systemCount + sizeof(StateSnapshotTier) * tieredCount + stateCount);
+        }
+    }
+}
@@ -14,142 +14,2691 @@
 // limitations under the License.
 //
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <utility>
+
 #include <game_system/game_system.h>
 #include <core/init_args.h>
+#include <core/update_args.h>
+
+#include "state_tree.h"
+#include "game_state.h"
+#include "state_recorder.h"
+#include "state_snapshot.h"
+#include "static_dispatch.h"
+
+using GameState = ngen::StateSystem::GameState;
+
+namespace ngen {
+    namespace StateSystem {
+        static const size_t NGEN_MAXIMUM_STATE_CHANGES = 32;
+
+        // Used within the ancestor tables to represent the absence of a state
+        static const uint32_t kNoState = 0xffffffff;
+
+        //! \brief Computes the base 2 logarithm of the supplied value, rounded down.
+        static inline size_t floorLog2(size_t value) {
+            size_t result = 0;
+
+            while (value >>= 1) {
+                result++;
+            }
+
+            return result;
+        }
+
+        //! \brief Tables derived from the definition of a state tree, states are referenced by their index.
+        //!
+        //! As the tables do not contain pointers they may be shared by every tree loaded from the same image.
+        struct StateTreeTables {
+            std::vector<uint32_t> stateIndex;   // Open addressing table of state indices, keyed by state identifier
+            uint32_t stateIndexShift;           // Shift applied to the hashed identifier to produce a slot index
+
+            // Common ancestor look-up, an Euler tour of the tree with a sparse table for range minimum queries
+            std::vector<uint32_t> eulerTour;    // State index at each step of the tour (roots are separated by kNoState)
+            std::vector<int32_t> eulerDepth;    // Depth at each step of the tour (-1 for separators)
+            std::vector<uint32_t> firstVisit;   // First position of each state within the tour
+            std::vector<uint32_t> sparseTable;  // Tour position of the shallowest entry within each power of two range
+            std::vector<uint32_t> leafIndex;    // Index of each state within the leaf table (kNoState for non-leaves)
+            std::vector<uint32_t> leafAncestor; // Common ancestor of every pair of leaves, for small trees
+            size_t leafCount;
+        };
+
+        // Data shared by each job when the active branch is updated through a JobScheduler
+        struct DispatchContext {
+            const StateTree *stateTree;
+            const std::vector<GameSystemInstance*> *schedule;
+            const ngen::UpdateArgs *args;
+            uint64_t orderBase;                 // Request order given to the first job, each job receives the next
+        };
+
+        //! \brief A single independent system initialized by a job.
+        struct InitializeEntry {
+            GameState *state;
+            GameSystemInstance *instance;
+        };
+
+        //! \brief Information shared by every job initializing independent systems.
+        struct InitializeContext {
+            StateTree *stateTree;
+            const InitializeEntry *entryList;
+        };
+
+        // While a job is running, state requests made on its thread are ordered by the position of the job
+        static thread_local const StateTree *t_dispatchTree = nullptr;
+        static thread_local uint64_t t_dispatchOrder = 0;
+        static thread_local GameSystemHash::Type t_dispatchSystem = 0;
+
+        // Tree being processed by the calling thread, used to tell requests made by game systems from those made by
+        // the caller of the tree when recording.
+        static thread_local const StateTree *t_processingTree = nullptr;
+
+        //! \brief Marks the calling thread as processing a state tree for the lifetime of the object.
+        class ProcessingScope {
+        public:
+            explicit ProcessingScope(const StateTree *stateTree) : m_previous(t_processingTree) {
+                t_processingTree = stateTree;
+            }
+
+            ~ProcessingScope() {
+                t_processingTree = m_previous;
+            }
+
+            //! \brief Determines whether or not the tree was already being processed when the scope was entered.
+            bool isNested() const {
+                return m_previous == t_processingTree;
+            }
+
+        private:
+            const StateTree *m_previous;
+        };
+
+        //! \brief Invokes onUpdate through the interface for a run of systems whose type has no batch function.
+        static void virtualUpdateBatch(ngen::IUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs) {
+            for (size_t loop = 0; loop < count; ++loop) {
+                systemList[loop]->onUpdate(updateArgs);
+            }
+        }
+
+        //! \brief Invokes onPostUpdate through the interface for a run of systems whose type has no batch function.
+        static void virtualPostUpdateBatch(ngen::IPostUpdateGameSystem *const *systemList, size_t count, const ngen::UpdateArgs &updateArgs) {
+            for (size_t loop = 0; loop < count; ++loop) {
+                systemList[loop]->onPostUpdate(updateArgs);
+            }
+        }
+
+        //! \brief Appends a system to a batched update list, extending the last batch if it uses the same function.
+        //! \param batchList [in-out] -
+        //!        The batches built so far.
+        //! \param systemList [in-out] -
+        //!        The systems referenced by the batches.
+        //! \param system [in] -
+        //!        The system to be appended.
+        //! \param function [in] -
+        //!        The function used to update the system.
+        template <typename TBatch, typename TSystem, typename TFunction>
+        static void appendBatch(std::vector<TBatch> &batchList, std::vector<TSystem*> &systemList, TSystem *system, TFunction function) {
+            if (batchList.empty() || batchList.back().function != function) {
+                batchList.push_back({ function, systemList.size(), 0 });
+            }
+
+            batchList.back().count++;
+            systemList.push_back(system);
+        }
+
+        //! \brief Finds the common ancestor of two states using the sparse table.
+        //! \param tables [in] -
+        //!        The tables built for the tree containing the states.
+        //! \param indexA [in] -
+        //!        Index of the first state within the tree.
+        //! \param indexB [in] -
+        //!        Index of the second state within the tree.
+        //! \return Index of the common ancestor or kNoState if the states do not share an ancestor.
+        static uint32_t queryAncestor(const StateTreeTables &tables, size_t indexA, size_t indexB) {
+            size_t first = tables.firstVisit[indexA];
+            size_t last = tables.firstVisit[indexB];
+
+            if (first > last) {
+                std::swap(first, last);
+            }
+
+            const size_t tourLength = tables.eulerTour.size();
+            const size_t level = floorLog2(last - first + 1);
+
+            const uint32_t left = tables.sparseTable[level * tourLength + first];
+            const uint32_t right = tables.sparseTable[level * tourLength + last + 1 - (size_t(1) << level)];
+
+            return tables.eulerTour[tables.eulerDepth[right] < tables.eulerDepth[left] ? right : left];
+        }
+
+        //! \brief Arguments whose timing differs from the arguments of the current frame, such as those passed to a
+        //!        system with an update interval or to a fixed step. State requests are passed on to the arguments of
+        //!        the current frame.
+        struct ForwardedUpdateArgs : public ngen::UpdateArgs {
+            ForwardedUpdateArgs(const ngen::UpdateArgs &frameArgs, float elapsed)
+            : args(frameArgs)
+            {
+                deltaTime = elapsed;
+                interpolation = frameArgs.interpolation;
+            }
+
+            virtual bool requestState(const char *name) const {
+                return args.requestState(name);
+            }
+
+            virtual bool requestStateId(uint64_t stateId) const {
+                return args.requestStateId(stateId);
+            }
+
+            const ngen::UpdateArgs &args;
+        };
+
+        //! \brief Takes the place of a system with an update interval within the update lists.
+        //!
+        //! Each call counts a frame and accumulates its delta time, the system itself is only invoked once the
+        //! interval has passed. The counter starts at the phase of the system, which staggers systems that share
+        //! an interval across different frames. The stand-in is reset each time the system is activated, so time
+        //! spent while the system was inactive is not passed on.
+        class TieredUpdateSystem : public ngen::IUpdateGameSystem {
+        public:
+            TieredUpdateSystem() : system(nullptr), instance(nullptr), interval(1), phase(0), counter(0), elapsed(0.0f) {}
+
+            void reset() {
+                counter = phase;
+                elapsed = 0.0f;
+            }
+
+            virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+                elapsed += updateArgs.deltaTime;
+
+                if (++counter < interval) {
+                    return;
+                }
+
+                ForwardedUpdateArgs tieredArgs(updateArgs, elapsed);
+
+                counter = 0;
+                elapsed = 0.0f;
+
+                system->onUpdate(tieredArgs);
+            }
+
+            ngen::IUpdateGameSystem *system;
+            GameSystemInstance *instance;       // The instance whose update system was replaced
+            uint32_t interval;
+            uint32_t phase;
+            uint32_t counter;
+            float elapsed;
+        };
+
+        //! \brief Computes the first slot examined within the state index for the supplied identifier.
+        //!
+        //! The identifier is scrambled with a multiplicative (Fibonacci) hash, the top bits of the result are used
+        //! as they are the best distributed.
+        static inline size_t stateSlot(SystemHash hash, uint32_t shift) {
+            return shift >= 64 ? 0 : static_cast<size_t>((hash * 0x9E3779B97F4A7C15ull) >> shift);
+        }
+
+        //! \brief Determines whether or not two lists of resource hashes share any entries.
+        static bool sharesResource(const GameSystemHash::Type *listA, size_t countA, const GameSystemHash::Type *listB, size_t countB) {
+            for (size_t a = 0; a < countA; ++a) {
+                for (size_t b = 0; b < countB; ++b) {
+                    if (listA[a] == listB[b]) {
+                        return true;
+                    }
+                }
+            }
+
+            return false;
+        }
+
+        StateTree::StateTree()
+        : m_systemFactory(nullptr)
+        , m_activeState(nullptr)
+        , m_pendingState(nullptr)
+        , m_pendingPriority(0)
+        , m_pendingOrder(0)
+        , m_requestSequence(0)
+        , m_stateList(nullptr)
+        , m_systemList(nullptr)
+        , m_memoryPool(&m_heapMemory)
+        , m_budgetHandler(nullptr)
+        , m_budgetContext(nullptr)
+        , m_tieredCount(0)
+        , m_scheduler(nullptr)
+        , m_recorder(nullptr)
+        , m_staticDispatch(nullptr)
+        , m_batchState(nullptr)
+        , m_scheduledState(nullptr)
+        , m_deferredInitialize(false)
+        , m_treeInitialized(false)
+        , m_fixedTimestep(0.0f)
+        , m_maximumFixedSteps(4)
+        , m_fixedAccumulator(0.0)
+        , m_asyncTransitions(false)
+        , m_transitionState(nullptr)
+        , m_preparedCount(0)
+        , m_transitionBudget(0)
+        , m_incrementalState(nullptr)
+        , m_incrementalSource(nullptr)
+        , m_incrementalRoot(nullptr)
+        , m_incrementalExitCount(0)
+        , m_incrementalIndex(0)
+        , m_activeCount(0)
+        , m_incrementalStart(0)
+        , m_defaultState(0)
+        , m_stateCount(0)
+        , m_systemCount(0)
+        {
+            //
+        }
+
+        StateTree::~StateTree() {
+            unload();
+        }
+
+        //! \brief Loads the state tree from a binary image held in memory.
+        //! \param factory [in] -
+        //!        The factory used to create the game systems referenced by the state tree.
+        //! \param data [in] -
+        //!        Memory containing the binary image, the image is read in place so the memory must remain valid
+        //!        until the state tree is unloaded. The image is not modified, so it may be used by other trees.
+        //! \param length [in] -
+        //!        Size of the supplied memory block (in bytes).
+        //! \return <em>True</em> if the state tree was loaded successfully otherwise <em>false</em>.
+        bool StateTree::load(ngen::GameSystemFactory &factory, const void *data, size_t length) {
+            unload();
+
+            m_systemFactory = &factory;
+
+            if (!m_image.adopt(data, length)) {
+                return false;
+            }
+
+            return prepareImage();
+        }
+
+        //! \brief Loads the state tree from a binary image, using tables already built for the same definition.
+        //! \param factory [in] -
+        //!        The factory used to create the game systems referenced by the state tree.
+        //! \param data [in] -
+        //!        Memory containing the binary image, this must remain valid until the state tree is unloaded.
+        //! \param length [in] -
+        //!        Size of the supplied memory block (in bytes).
+        //! \param tables [in] -
+        //!        Tables built by a tree loaded from the same image, or nullptr to build new tables.
+        //! \return <em>True</em> if the state tree was loaded successfully otherwise <em>false</em>.
+        bool StateTree::loadShared(ngen::GameSystemFactory &factory, const void *data, size_t length, const std::shared_ptr<const StateTreeTables> &tables) {
+            unload();
+
+            m_systemFactory = &factory;
+            m_tables = tables;
+
+            if (!m_image.adopt(data, length)) {
+                m_tables.reset();
+                return false;
+            }
+
+            return prepareImage();
+        }
+
+        //! \brief Loads the state tree from a binary image file, the file is mapped into memory and read in place.
+        //! \param factory [in] -
+        //!        The factory used to create the game systems referenced by the state tree.
+        //! \param path [in] -
+        //!        Path to the file containing the binary image.
+        //! \return <em>True</em> if the state tree was loaded successfully otherwise <em>false</em>.
+        bool StateTree::loadFile(ngen::GameSystemFactory &factory, const char *path) {
+            unload();
+
+            m_systemFactory = &factory;
+
+            if (!m_image.map(path)) {
+                return false;
+            }
+
+            return prepareImage();
+        }
+
+        //! \brief Releases all game systems and the image containing the state tree.
+        //!
+        //! If the state tree has been initialized, onDestroy must have been invoked before the tree is unloaded.
+        void StateTree::unload() {
+            waitTransition();
+
+            // Systems are destroyed in reverse order of creation, the memory itself is released in one go
+            for (size_t loop = m_systemCount; loop > 0; --loop) {
+                m_systemFactory->deleteInstance(findSystemMemory(m_systemList[loop - 1].gameSystem), m_systemList[loop - 1]);
+            }
+
+            m_systemMemory.reset();
+            m_reloadMemory.clear();
+            m_systemPools.clear();
+            m_stateAccounts.reset();
+            m_budgetReported.clear();
+            m_tieredList.reset();
+            m_tieredCount = 0;
+            m_systemTiers.clear();
+            m_image.release();
+            m_branchSystemList.clear();
+            m_branchUpdateList.clear();
+            m_branchPostUpdateList.clear();
+            m_branchFixedUpdateList.clear();
+            m_branchLookupList.clear();
+            m_initializedList.clear();
+            m_branchSystemHashList.clear();
+            m_branchUpdateHashList.clear();
+            m_branchPostUpdateHashList.clear();
+            m_tables.reset();
+            m_fixedAccumulator = 0.0;
+
+            m_scheduledState = nullptr;
+            m_batchState = nullptr;
+            m_updateSchedule.clear();
+            m_postUpdateSchedule.clear();
+            m_updateGraph.reset(0);
+            m_postUpdateGraph.reset(0);
+
+            m_activeState = nullptr;
+            m_pendingState = nullptr;
+            m_incrementalState = nullptr;
+            m_incrementalRoot = nullptr;
+            m_incrementalList.clear();
+            m_requestQueue.clear();
+            m_stateList = nullptr;
+            m_systemList = nullptr;
+            m_defaultState = 0;
+            m_stateCount = 0;
+            m_systemCount = 0;
+        }
+
+        //! \brief Replaces the definition of a loaded state tree with a new binary image held in memory.
+        //!
+        //! The new image is compared with the current one, game systems are matched by the identifier of the state
+        //! containing them and their type. Matched systems are kept along with their data, only the systems that
+        //! were removed are destroyed and only the systems that were added are created. Within the active branch,
+        //! systems below the deepest state whose system list is unchanged are deactivated and then activated again
+        //! in the new tree. If the active state no longer exists the default state of the new image becomes active,
+        //! and a pending request is dropped if its target no longer exists or is no longer a leaf.
+        //!
+        //! The records of the previous image are released, so a kept system must not hold on to a GameState from
+        //! it. Each kept system within an initialized state that implements IReloadableGameSystem receives onReload
+        //! with its new state before the active branch is entered, and CachedSystem repeats its look-up.
+        //!
+        //! This must be invoked between frames on the thread that processes the state tree. If the image cannot
+        //! be used the tree is left unchanged. The memory of systems kept from previous loads is held until the
+        //! tree is unloaded, or until every system within the allocation has been removed. A tree created by a
+        //! StateTreeGroup no longer shares the definition of the group once reloaded, so the group updates it
+        //! individually rather than as part of a batch.
+        //! \param data [in] -
+        //!        Memory containing the new binary image, this must remain valid until the state tree is unloaded
+        //!        or reloaded again. The memory holding the previous image may be released once this returns.
+        //! \param length [in] -
+        //!        Size of the supplied memory block (in bytes).
+        //! \return <em>True</em> if the new definition was applied otherwise <em>false</em>.
+        bool StateTree::reload(const void *data, size_t length) {
+            StateTreeImage image;
+
+            if (!m_systemFactory || !image.adopt(data, length)) {
+                return false;
+            }
+
+            return applyReload(image);
+        }
+
+        //! \brief Replaces the definition of a loaded state tree with a new binary image file.
+        //! \param path [in] -
+        //!        Path to the file containing the new binary image.
+        //! \return <em>True</em> if the new definition was applied otherwise <em>false</em>.
+        bool StateTree::reloadFile(const char *path) {
+            StateTreeImage image;
+
+            if (!m_systemFactory || !image.map(path)) {
+                return false;
+            }
+
+            return applyReload(image);
+        }
+
+        //! \brief Applies a new definition to the state tree, see reload for details.
+        //! \param image [in] -
+        //!        The new image, this receives the previous image once the definition has been applied.
+        //! \return <em>True</em> if the new definition was applied otherwise <em>false</em>.
+        bool StateTree::applyReload(StateTreeImage &image) {
+            static const size_t kNoSystem = ~size_t(0);
+
+            if (!m_stateCount || !image.createRecords()) {
+                return false;
+            }
+
+            const StateTreeImageHeader &header = *image.getHeader();
+            GameState *stateList = image.getStateList();
+            GameSystemInstance *systemList = image.getSystemList();
+
+            // Match each system with an unclaimed system of the same type, within the state of the same identifier
+            std::vector<size_t> matchList(header.systemCount, kNoSystem);
+            std::vector<uint8_t> keptList(m_systemCount, 0);
+
+            size_t memorySize = 0;
+            size_t memoryAlignment = MemoryArena::kBlockAlignment;
+
+            for (size_t loop = 0; loop < header.stateCount; ++loop) {
+                const GameState &state = stateList[loop];
+                const GameState *previous = findState(state.getId());
+
+                for (size_t index = 0; index < state.getSystemCount(); ++index) {
+                    const GameSystemInstance &instance = *state.getSystemInstance(index);
+                    const size_t systemIndex = size_t(&instance - systemList);
+
+                    for (size_t search = 0; previous && search < previous->getSystemCount(); ++search) {
+                        const size_t match = size_t(previous->getSystemInstance(search) - m_systemList);
+
+                        if (!keptList[match] && m_systemList[match].hash == instance.hash) {
+                            keptList[match] = 1;
+                            matchList[systemIndex] = match;
+                            break;
+                        }
+                    }
+
+                    if (kNoSystem == matchList[systemIndex]) {
+                        size_t size;
+                        size_t alignment;
+
+                        if (!m_systemFactory->getInstanceLayout(instance.hash, size, alignment)) {
+                            return false;
+                        }
+
+                        if (m_systemFactory->isRecycled(instance.hash)) {
+                            continue;
+                        }
+
+                        memorySize = MemoryArena::alignSize(memorySize, alignment) + size;
+                        memoryAlignment = alignment > memoryAlignment ? alignment : memoryAlignment;
+                    }
+                }
+            }
+
+            // Create the new systems before anything is changed, so a failure leaves the tree as it was
+            std::unique_ptr<MemoryArena> memory(new MemoryArena);
+
+            if (memorySize && !memory->reserve(memorySize, memoryAlignment)) {
+                return false;
+            }
+
+            for (size_t loop = 0; loop < header.systemCount; ++loop) {
+                if (kNoSystem != matchList[loop]) {
+                    continue;
+                }
+
+                if (!m_systemFactory->createInstance(*memory, systemList[loop], systemList[loop].hash)) {
+                    for (size_t undo = loop; undo > 0; --undo) {
+                        if (kNoSystem == matchList[undo - 1]) {
+                            m_systemFactory->deleteInstance(*memory, systemList[undo - 1]);
+                        }
+                    }
+
+                    return false;
+                }
+            }
+
+            // A transition being prepared is abandoned and requested again once the new tree is in place, while an
+            // incremental transition is completed so the active branch is whole before it is compared
+            GameState *transition = m_transitionState;
+
+            waitTransition();
+
+            if (m_incrementalState) {
+                stepTransition(std::chrono::steady_clock::time_point::max());
+            }
+
+            resolveRequests();
+
+            if (transition && !m_pendingState) {
+                m_pendingState = transition;
+            }
+
+            const SystemHash pendingId = m_pendingState ? m_pendingState->getId() : 0;
+
+            // The active state is kept if it remains a leaf, otherwise the default state of the new image is used
+            GameState *active = nullptr;
+
+            if (m_activeState) {
+                active = &stateList[header.defaultState];
+
+                for (size_t loop = 0; loop < header.stateCount; ++loop) {
+                    if (stateList[loop].getId() == m_activeState->getId() && !stateList[loop].getChildCount()) {
+                        active = &stateList[loop];
+                        break;
+                    }
+                }
+            }
+
+            // Find the deepest state of the active branch whose systems are unchanged, systems above it stay active
+            GameState *previousRoot = nullptr;
+            GameState *activeRoot = nullptr;
+
+            if (active) {
+                std::vector<GameState*> previousBranch;
+                std::vector<GameState*> activeBranch;
+
+                for (GameState *state = m_activeState; state; state = state->getParent()) {
+                    previousBranch.push_back(state);
+                }
+
+                for (GameState *state = active; state; state = state->getParent()) {
+                    activeBranch.push_back(state);
+                }
+
+                while (!previousBranch.empty() && !activeBranch.empty()) {
+                    GameState *previous = previousBranch.back();
+                    GameState *state = activeBranch.back();
+
+                    bool unchanged = previous->getId() == state->getId() && previous->getSystemCount() == state->getSystemCount();
+
+                    for (size_t index = 0; unchanged && index < state->getSystemCount(); ++index) {
+                        const size_t systemIndex = size_t(state->getSystemInstance(index) - systemList);
+                        unchanged = matchList[systemIndex] == size_t(previous->getSystemInstance(index) - m_systemList);
+                    }
+
+                    if (!unchanged) {
+                        break;
+                    }
+
+                    previousRoot = previous;
+                    activeRoot = state;
+
+                    previousBranch.pop_back();
+                    activeBranch.pop_back();
+                }
+
+                m_activeState->onExit(previousRoot);
+            }
+
+            // Destroy the systems that were removed, the states that contained them are still available
+            std::vector<uint8_t> initializedList(header.stateCount, 0);
+
+            for (size_t loop = m_stateCount; loop > 0; --loop) {
+                const GameState &state = m_stateList[loop - 1];
+                const bool initialized = isInitialized(&state);
+
+                for (size_t index = state.getSystemCount(); index > 0; --index) {
+                    GameSystemInstance &instance = *state.getSystemInstance(index - 1);
+
+                    if (keptList[size_t(&instance - m_systemList)]) {
+                        continue;
+                    }
+
+                    if (initialized) {
+                        instance.gameSystem->onDestroy();
+                    }
+
+                    m_systemFactory->deleteInstance(findSystemMemory(instance.gameSystem), instance);
+                }
+            }
+
+            // States whose systems were initialized before the reload remain initialized
+            for (size_t loop = 0; loop < header.stateCount; ++loop) {
+                const GameState *previous = findState(stateList[loop].getId());
+
+                if (m_treeInitialized) {
+                    initializedList[loop] = m_deferredInitialize ? (previous && isInitialized(previous)) : 1;
+                }
+            }
+
+            unbindTiers();
+
+            // Kept systems keep their memory pool, budgets are carried over by state identifier
+            std::vector<std::unique_ptr<TrackedMemoryPool>> systemPools(header.systemCount);
+            std::vector<std::pair<SystemHash, const StateMemoryAccount*>> budgetList;
+
+            for (size_t loop = 0; loop < header.systemCount; ++loop) {
+                if (kNoSystem != matchList[loop]) {
+                    systemList[loop] = m_systemList[matchList[loop]];
+                    systemPools[loop] = std::move(m_systemPools[matchList[loop]]);
+                }
+            }
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                if (m_stateAccounts[loop].getBudget()) {
+                    budgetList.push_back(std::make_pair(m_stateList[loop].getId(), &m_stateAccounts[loop]));
+                }
+            }
+
+            std::unique_ptr<StateMemoryAccount[]> stateAccounts(std::move(m_stateAccounts));
+
+            // Switch over to the new image, the previous image is released when the caller's object is destroyed
+            m_image.swap(image);
+            GameState::advanceGeneration();
+
+            m_stateList = stateList;
+            m_systemList = systemList;
+            m_stateCount = header.stateCount;
+            m_systemCount = header.systemCount;
+            m_defaultState = header.defaultState;
+
+            m_systemPools.swap(systemPools);
+
+            bindTiers();
+            bindMemory();
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                m_stateList[loop].bindSystems();
+            }
+
+            bindBranches();
+
+            std::shared_ptr<StateTreeTables> tables = std::make_shared<StateTreeTables>();
+
+            buildStateIndex(*tables);
+            buildAncestorTable(*tables);
+
+            m_tables = std::move(tables);
+
+            for (auto &budget : budgetList) {
+                setMemoryBudget(findState(budget.first), budget.second->getBudget(), budget.second->getPolicy());
+            }
+
+            if (memorySize) {
+                m_reloadMemory.push_back(std::move(memory));
+            }
+
+            releaseUnusedMemory();
+
+            m_scheduledState = nullptr;
+            m_batchState = nullptr;
+
+            // A pending request is dropped if its target no longer exists or has gained children
+            GameState *pending = pendingId ? findState(pendingId) : nullptr;
+            m_pendingState = pending && !pending->getChildCount() ? pending : nullptr;
+
+            // Kept systems within initialized states are given their new state, added systems are initialized
+            if (m_treeInitialized) {
+                m_initializedList.swap(initializedList);
+
+                ngen::InitArgs initArgs;
+                initArgs.stateTree = this;
+
+                for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                    GameState &state = m_stateList[loop];
+
+                    if (!m_initializedList[loop]) {
+                        continue;
+                    }
+
+                    initArgs.gameState = &state;
+
+                    for (size_t index = 0; index < state.getSystemCount(); ++index) {
+                        ngen::GameSystemInstance &instance = *state.getSystemInstance(index);
+                        initArgs.memory = getTrackedPool(&instance);
+
+                        if (kNoSystem == matchList[size_t(&instance - m_systemList)]) {
+                            instance.gameSystem->onInitialize(initArgs);
+                        } else {
+                            instance.creator->reloadInstance(instance, initArgs);
+                        }
+                    }
+                }
+            }
+
+            if (active) {
+                initializeBranch(active);
+
+                m_activeState = active;
+                m_activeState->onEnter(activeRoot);
+                resetTiers(active, activeRoot);
+
+                checkBudgets(active);
+            }
+
+            return true;
+        }
+
+        //! \brief Retrieves the memory pool a game system object was allocated from.
+        //! \param system [in] -
+        //!        The game system object.
+        //! \return The pool containing the game system.
+        ngen::MemoryPool& StateTree::findSystemMemory(const ngen::IGameSystem *system) {
+            for (auto &memory : m_reloadMemory) {
+                if (memory->contains(system)) {
+                    return *memory;
+                }
+            }
+
+            return m_systemMemory;
+        }
+
+        //! \brief Creates the memory pool of each game system and the memory account of each state.
+        //!
+        //! Pools already present within m_systemPools are kept, so the systems holding them are unaffected. The
+        //! accounts are rebuilt from the usage of the pools, their peaks restart from the current usage.
+        void StateTree::bindMemory() {
+            m_systemPools.resize(m_systemCount);
+            m_stateAccounts.reset(new StateMemoryAccount[m_stateCount]);
+            m_budgetReported.assign(m_stateCount, 0);
+
+            std::vector<size_t> usedList(m_stateCount, 0);
+            std::vector<size_t> blockList(m_stateCount, 0);
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                GameState &state = m_stateList[loop];
+
+                if (state.getParent()) {
+                    m_stateAccounts[loop].bind(&m_stateAccounts[size_t(state.getParent() - m_stateList)]);
+                }
+
+                for (size_t index = 0; index < state.getSystemCount(); ++index) {
+                    std::unique_ptr<TrackedMemoryPool> &pool = m_systemPools[size_t(state.getSystemInstance(index) - m_systemList)];
+
+                    if (!pool) {
+                        pool.reset(new TrackedMemoryPool);
+                    }
+
+                    pool->bind(m_memoryPool, &m_stateAccounts[loop]);
+
+                    const MemoryUsage usage = pool->getUsage();
+
+                    for (const GameState *parent = &state; parent; parent = parent->getParent()) {
+                        usedList[size_t(parent - m_stateList)] += usage.used;
+                        blockList[size_t(parent - m_stateList)] += usage.blockCount;
+                    }
+                }
+            }
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                m_stateAccounts[loop].reset(usedList[loop], blockList[loop]);
+            }
+        }
+
+        //! \brief Retrieves the memory pool handed to a game system when it is initialized.
+        //! \param instance [in] -
+        //!        The game system instance, which must belong to this tree.
+        //! \return The tracked pool of the system.
+        ngen::MemoryPool* StateTree::getTrackedPool(const GameSystemInstance *instance) const {
+            return m_systemPools[size_t(instance - m_systemList)].get();
+        }
+
+        //! \brief Passes each state from the supplied state up to the root whose budget has been exceeded to the
+        //!        budget handler, a state is only reported once until the peaks are reset.
+        //! \param state [in] -
+        //!        The deepest state to be examined.
+        void StateTree::checkBudgets(const GameState *state) {
+            if (!m_budgetHandler) {
+                return;
+            }
+
+            for (; state; state = state->getParent()) {
+                const size_t index = size_t(state - m_stateList);
+                const StateMemoryAccount &account = m_stateAccounts[index];
+                const MemoryUsage usage = account.getUsage();
+
+                if (account.getBudget() && !m_budgetReported[index] && (usage.peak > account.getBudget() || usage.failedCount)) {
+                    m_budgetReported[index] = 1;
+                    m_budgetHandler(m_budgetContext, state, usage, account.getBudget());
+                }
+            }
+        }
+
+        //! \brief Specifies the pool that provides the memory allocated by game systems through InitArgs::memory.
+        //!
+        //! This must be specified before onInitialize is invoked, it has no effect on a tree that is already
+        //! initialized. Blocks are released back to the pool, so it must not be changed while any are allocated.
+        //! \param pool [in] -
+        //!        The pool providing the memory, or nullptr to allocate from the global heap.
+        void StateTree::setMemoryPool(ngen::MemoryPool *pool) {
+            if (m_treeInitialized) {
+                return;
+            }
+
+            m_memoryPool = pool ? pool : &m_heapMemory;
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                for (size_t index = 0; index < m_stateList[loop].getSystemCount(); ++index) {
+                    m_systemPools[size_t(m_stateList[loop].getSystemInstance(index) - m_systemList)]->bind(m_memoryPool, &m_stateAccounts[loop]);
+                }
+            }
+        }
+
+        //! \brief Retrieves the memory statistics of a single game system.
+        //! \param  instance [in] -
+        //!         The game system instance, see GameState::getSystemInstance.
+        //! \return The statistics of the allocations made through the system's pool, zero if the system does not
+        //!         belong to this tree.
+        MemoryUsage StateTree::getSystemMemoryUsage(const GameSystemInstance *instance) const {
+            if (!instance || size_t(instance - m_systemList) >= m_systemPools.size()) {
+                return MemoryUsage();
+            }
+
+            return m_systemPools[size_t(instance - m_systemList)]->getUsage();
+        }
+
+        //! \brief Retrieves the memory statistics of a state, including every state below it.
+        //! \param  state [in] -
+        //!         The state whose statistics are to be retrieved.
+        //! \return The statistics of the allocations made by the systems within the subtree, zero if the state does
+        //!         not belong to this tree.
+        MemoryUsage StateTree::getStateMemoryUsage(const GameState *state) const {
+            if (!state || size_t(state - m_stateList) >= m_stateCount) {
+                return MemoryUsage();
+            }
+
+            return m_stateAccounts[size_t(state - m_stateList)].getUsage();
+        }
+
+        //! \brief Specifies the largest number of bytes the systems of a state and its descendants should allocate.
+        //!
+        //! With the Report policy the budget is examined once a state has been initialized or entered, a state that
+        //! has exceeded it is passed to the budget handler. With the Fail policy any allocation that would exceed
+        //! the budget returns nullptr, refused allocations are also reported. Budgets are kept by a reload for each
+        //! state that remains in the tree.
+        //! \param  state [in] -
+        //!         The state whose budget is to be specified.
+        //! \param  budget [in] -
+        //!         The budget in bytes, zero removes the budget.
+        //! \param  policy [in] -
+        //!         The action taken when the budget is exceeded.
+        //! \return <em>True</em> if the budget was applied otherwise <em>false</em>.
+        bool StateTree::setMemoryBudget(const GameState *state, size_t budget, MemoryBudgetPolicy policy) {
+            if (!state || size_t(state - m_stateList) >= m_stateCount) {
+                return false;
+            }
+
+            m_stateAccounts[size_t(state - m_stateList)].setBudget(budget, policy);
+            m_budgetReported[size_t(state - m_stateList)] = 0;
+
+            return true;
+        }
+
+        //! \brief Retrieves the budget of a state.
+        //! \param  state [in] -
+        //!         The state whose budget is to be retrieved.
+        //! \return The budget in bytes, or zero if the state does not have a budget.
+        size_t StateTree::getMemoryBudget(const GameState *state) const {
+            if (!state || size_t(state - m_stateList) >= m_stateCount) {
+                return 0;
+            }
+
+            return m_stateAccounts[size_t(state - m_stateList)].getBudget();
+        }
+
+        //! \brief Specifies the function invoked when a state exceeds its memory budget.
+        //! \param handler [in] -
+        //!        The function to be invoked on the thread processing the tree, or nullptr to ignore budgets that
+        //!        use the Report policy.
+        //! \param context [in] -
+        //!        Value passed to the handler.
+        void StateTree::setBudgetHandler(BudgetHandler handler, void *context) {
+            m_budgetHandler = handler;
+            m_budgetContext = context;
+        }
+
+        //! \brief Lowers the peak of every system and state to their current usage, states that exceeded their
+        //!        budget may then be reported again.
+        void StateTree::resetMemoryPeaks() {
+            for (auto &pool : m_systemPools) {
+                pool->resetPeak();
+            }
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                m_stateAccounts[loop].resetPeak();
+            }
+
+            std::fill(m_budgetReported.begin(), m_budgetReported.end(), 0);
+        }
+
+        //! \brief Releases any memory block that no longer contains a game system, following a reload.
+        void StateTree::releaseUnusedMemory() {
+            auto unused = [this](const MemoryArena &memory) {
+                for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                    if (memory.contains(m_systemList[loop].gameSystem)) {
+                        return false;
+                    }
+                }
+
+                return true;
+            };
+
+            if (m_systemMemory.getCapacity() && unused(m_systemMemory)) {
+                m_systemMemory.reset();
+            }
+
+            m_reloadMemory.erase(std::remove_if(m_reloadMemory.begin(), m_reloadMemory.end(), [&unused](const std::unique_ptr<MemoryArena> &memory) {
+                return unused(*memory);
+            }), m_reloadMemory.end());
+        }
+
+        //! \brief Builds the records of the currently held image and creates the game systems it references.
+        //! \return <em>True</em> if the image was prepared successfully otherwise <em>false</em>.
+        bool StateTree::prepareImage() {
+            if (!m_image.createRecords()) {
+                m_image.release();
+                return false;
+            }
+
+            const StateTreeImageHeader &header = *m_image.getHeader();
+
+            m_stateList = m_image.getStateList();
+            m_systemList = m_image.getSystemList();
+            m_stateCount = header.stateCount;
+            m_defaultState = header.defaultState;
+
+            // Compute the size of the block needed to hold every system, they are placed in the same order they
+            // appear within the image which keeps each branch in root to leaf (update) order.
+            size_t memorySize = 0;
+            size_t memoryAlignment = MemoryArena::kBlockAlignment;
+
+            for (size_t loop = 0; loop < header.systemCount; ++loop) {
+                size_t size;
+                size_t alignment;
+
+                if (!m_systemFactory->getInstanceLayout(m_systemList[loop].hash, size, alignment)) {
+                    unload();
+                    return false;
+                }
+
+                // Recycled systems are allocated by the factory, so they may outlive the tree
+                if (m_systemFactory->isRecycled(m_systemList[loop].hash)) {
+                    continue;
+                }
+
+                memorySize = MemoryArena::alignSize(memorySize, alignment) + size;
+                memoryAlignment = alignment > memoryAlignment ? alignment : memoryAlignment;
+            }
+
+            if (!m_systemMemory.reserve(memorySize, memoryAlignment)) {
+                unload();
+                return false;
+            }
+
+            // m_systemCount only covers the systems created so far, so a failure may be unwound by unload()
+            for (; m_systemCount < header.systemCount; ++m_systemCount) {
+                GameSystemInstance &instance = m_systemList[m_systemCount];
+
+                if (!m_systemFactory->createInstance(m_systemMemory, instance, instance.hash)) {
+                    unload();
+                    return false;
+                }
+            }
+
+            bindTiers();
+            bindMemory();
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                m_stateList[loop].bindSystems();
+            }
+
+            bindBranches();
+
+            // Shared tables must have been built for a tree with the same shape
+            if (m_tables && m_tables->firstVisit.size() != m_stateCount) {
+                unload();
+                return false;
+            }
+
+            if (!m_tables) {
+                std::shared_ptr<StateTreeTables> tables = std::make_shared<StateTreeTables>();
+
+                buildStateIndex(*tables);
+                buildAncestorTable(*tables);
+
+                m_tables = std::move(tables);
+            }
+
+            return true;
+        }
+
+        //! \brief Places a stand-in within the update lists for each system that has an update interval.
+        //!
+        //! Systems are assigned a phase in the order they appear within the tree, so the systems sharing an
+        //! interval are divided evenly between the frames of the interval.
+        void StateTree::bindTiers() {
+            size_t tieredCount = 0;
+
+            for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                const GameSystemInstance &instance = m_systemList[loop];
+
+                if (instance.updateSystem && m_systemFactory->getUpdateInterval(instance.hash) > 1) {
+                    tieredCount++;
+                }
+            }
+
+            if (!tieredCount) {
+                return;
+            }
+
+            m_tieredList.reset(new TieredUpdateSystem[tieredCount]);
+            m_tieredCount = tieredCount;
+            m_systemTiers.assign(m_systemCount, nullptr);
+
+            // Number of systems assigned to each interval so far, used to choose the phase of the next system
+            std::vector<std::pair<uint32_t, uint32_t>> phaseList;
+            size_t tieredIndex = 0;
+
+            for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                GameSystemInstance &instance = m_systemList[loop];
+                const uint32_t interval = instance.updateSystem ? m_systemFactory->getUpdateInterval(instance.hash) : 1;
+
+                if (interval <= 1) {
+                    continue;
+                }
+
+                auto phase = std::find_if(phaseList.begin(), phaseList.end(), [interval](const std::pair<uint32_t, uint32_t> &entry) {
+                    return entry.first == interval;
+                });
+
+                if (phase == phaseList.end()) {
+                    phase = phaseList.insert(phaseList.end(), { interval, 0 });
+                }
+
+                TieredUpdateSystem &tiered = m_tieredList[tieredIndex++];
+
+                tiered.system = instance.updateSystem;
+                tiered.instance = &instance;
+                tiered.interval = interval;
+                tiered.phase = phase->second++ % interval;
+                tiered.reset();
+
+                instance.updateSystem = &tiered;
+                m_systemTiers[loop] = &tiered;
+            }
+        }
+
+        //! \brief Restores the update system of each instance that was replaced by a stand-in.
+        void StateTree::unbindTiers() {
+            for (size_t loop = 0; loop < m_tieredCount; ++loop) {
+                m_tieredList[loop].instance->updateSystem = m_tieredList[loop].system;
+            }
+
+            m_tieredList.reset();
+            m_tieredCount = 0;
+            m_systemTiers.clear();
+        }
+
+        //! \brief Restarts the interval of each system with an update interval that is activated by a state change.
+        //! \param state [in] -
+        //!        The leaf state that has been entered.
+        //! \param root [in] -
+        //!        The common ancestor of the previous state and the entered state, systems above it are not affected.
+        void StateTree::resetTiers(const GameState *state, const GameState *root) {
+            if (!m_tieredCount) {
+                return;
+            }
+
+            for (; state && state != root; state = state->getParent()) {
+                for (size_t loop = 0; loop < state->getSystemCount(); ++loop) {
+                    TieredUpdateSystem *tiered = m_systemTiers[size_t(state->getSystemInstance(loop) - m_systemList)];
+
+                    if (tiered) {
+                        tiered->reset();
+                    }
+                }
+            }
+        }
+
+        //! \brief Builds the table used to look up states by their identifier.
+        //!
+        //! The table uses open addressing with linear probing and is kept at most half full, so a look-up usually
+        //! touches a single slot. If multiple states share an identifier the first state in the tree is returned,
+        //! matching the behaviour of a linear search.
+        //! \param tables [out] -
+        //!        Receives the state index.
+        void StateTree::buildStateIndex(StateTreeTables &tables) const {
+            size_t slotCount = 1;
+            uint32_t shift = 64;
+
+            while (slotCount < m_stateCount * 2) {
+                slotCount <<= 1;
+                shift--;
+            }
+
+            tables.stateIndex.assign(slotCount, kNoState);
+            tables.stateIndexShift = shift;
+
+            const size_t mask = slotCount - 1;
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                const SystemHash id = m_stateList[loop].getId();
+
+                for (size_t slot = stateSlot(id, shift); ; slot = (slot + 1) & mask) {
+                    if (kNoState == tables.stateIndex[slot]) {
+                        tables.stateIndex[slot] = static_cast<uint32_t>(loop);
+                        break;
+                    }
+
+                    if (m_stateList[tables.stateIndex[slot]].getId() == id) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        //! \brief Builds the flattened system lists for every leaf state within the tree.
+        //!
+        //! Each leaf receives a contiguous list of the systems from the root of the tree down to itself, so neither
+        //! the per-frame update nor a state switch need to walk the parent hierarchy. Each leaf also receives a hash
+        //! table of the same systems, used by GameState::getSystem. All lists of the same kind share a single
+        //! allocation.
+        void StateTree::bindBranches() {
+            size_t systemCount = 0;
+            size_t updateCount = 0;
+            size_t postUpdateCount = 0;
+            size_t fixedUpdateCount = 0;
+            size_t lookupCount = 0;
+
+            // States are stored with parents before their children, so the hierarchy can be bound in order
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                GameState &state = m_stateList[loop];
+
+                state.bindHierarchy();
+
+                if (!state.getChildCount()) {
+                    systemCount += state.getBranchSystemCount();
+                    updateCount += state.getBranchUpdateCount();
+                    postUpdateCount += state.getBranchPostUpdateCount();
+                    fixedUpdateCount += state.getBranchFixedUpdateCount();
+                    lookupCount += GameState::getLookupCapacity(state.getBranchSystemCount());
+                }
+            }
+
+            m_branchSystemList.resize(systemCount);
+            m_branchUpdateList.resize(updateCount);
+            m_branchPostUpdateList.resize(postUpdateCount);
+            m_branchFixedUpdateList.resize(fixedUpdateCount);
+            m_branchLookupList.resize(lookupCount);
+#if NGEN_STATE_SYSTEM_PROFILING
+            m_branchSystemHashList.resize(systemCount);
+            m_branchUpdateHashList.resize(updateCount);
+            m_branchPostUpdateHashList.resize(postUpdateCount);
+#endif
+
+            size_t systemIndex = 0;
+            size_t updateIndex = 0;
+            size_t postUpdateIndex = 0;
+            size_t fixedUpdateIndex = 0;
+            size_t lookupIndex = 0;
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                GameState &state = m_stateList[loop];
+
+                if (!state.getChildCount()) {
+                    state.bindBranch(m_branchSystemList.data() + systemIndex,
+                                     m_branchUpdateList.data() + updateIndex,
+                                     m_branchPostUpdateList.data() + postUpdateIndex);
+                    state.bindFixedBranch(m_branchFixedUpdateList.data() + fixedUpdateIndex);
+
+#if NGEN_STATE_SYSTEM_PROFILING
+                    state.bindProfileHashes(m_branchSystemHashList.data() + systemIndex,
+                                            m_branchUpdateHashList.data() + updateIndex,
+                                            m_branchPostUpdateHashList.data() + postUpdateIndex);
+#endif
+
+                    systemIndex += state.getBranchSystemCount();
+                    updateIndex += state.getBranchUpdateCount();
+                    postUpdateIndex += state.getBranchPostUpdateCount();
+                    fixedUpdateIndex += state.getBranchFixedUpdateCount();
+
+                    const size_t capacity = GameState::getLookupCapacity(state.getBranchSystemCount());
+                    state.bindLookup(m_branchLookupList.data() + lookupIndex, capacity);
+                    lookupIndex += capacity;
+                }
+            }
+        }
+
+        //! \brief Builds the tables used to find the common ancestor of two states.
+        //!
+        //! The tree is flattened into an Euler tour, the common ancestor of two states is the shallowest state
+        //! visited between the first visit of each state, which the sparse table answers in constant time. Trees
+        //! with few leaves additionally store the ancestor of every pair of leaves, as only leaves may be active.
+        //! \param tables [out] -
+        //!        Receives the common ancestor tables.
+        void StateTree::buildAncestorTable(StateTreeTables &tables) const {
+            tables.eulerTour.clear();
+            tables.eulerDepth.clear();
+            tables.firstVisit.assign(m_stateCount, 0);
+
+            std::vector<std::pair<const GameState*, size_t>> stack;
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                if (m_stateList[loop].getParent()) {
+                    continue;
+                }
+
+                // Separate each root so states in different trees never share an ancestor
+                if (!tables.eulerTour.empty()) {
+                    tables.eulerTour.push_back(kNoState);
+                    tables.eulerDepth.push_back(-1);
+                }
+
+                tables.firstVisit[loop] = static_cast<uint32_t>(tables.eulerTour.size());
+                stack.push_back({ &m_stateList[loop], 0 });
+
+                while (!stack.empty()) {
+                    auto &top = stack.back();
+                    const GameState *state = top.first;
+
+                    tables.eulerTour.push_back(static_cast<uint32_t>(state - m_stateList));
+                    tables.eulerDepth.push_back(static_cast<int32_t>(state->getDepth()));
+
+                    if (top.second < state->getChildCount()) {
+                        const GameState *child = state->getChild(top.second++);
+
+                        tables.firstVisit[child - m_stateList] = static_cast<uint32_t>(tables.eulerTour.size());
+                        stack.push_back({ child, 0 });
+                    } else {
+                        stack.pop_back();
+                    }
+                }
+            }
+
+            // Build the sparse table, level k holds the shallowest entry of each range of length 2^k
+            const size_t tourLength = tables.eulerTour.size();
+            const size_t levels = tourLength ? floorLog2(tourLength) + 1 : 0;
+
+            tables.sparseTable.resize(levels * tourLength);
+
+            for (size_t loop = 0; loop < tourLength; ++loop) {
+                tables.sparseTable[loop] = static_cast<uint32_t>(loop);
+            }
+
+            for (size_t level = 1; level < levels; ++level) {
+                const uint32_t *previous = &tables.sparseTable[(level - 1) * tourLength];
+                uint32_t *current = &tables.sparseTable[level * tourLength];
+                const size_t half = size_t(1) << (level - 1);
+
+                for (size_t loop = 0; loop + (half << 1) <= tourLength; ++loop) {
+                    const uint32_t left = previous[loop];
+                    const uint32_t right = previous[loop + half];
+
+                    current[loop] = tables.eulerDepth[right] < tables.eulerDepth[left] ? right : left;
+                }
+            }
+
+            // Small trees also store the ancestor of every pair of leaves
+            tables.leafIndex.assign(m_stateCount, kNoState);
+            tables.leafCount = 0;
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                if (!m_stateList[loop].getChildCount()) {
+                    tables.leafIndex[loop] = static_cast<uint32_t>(tables.leafCount++);
+                }
+            }
+
+            tables.leafAncestor.clear();
+
+            if (tables.leafCount <= kMaximumTransitionLeaves) {
+                tables.leafAncestor.resize(tables.leafCount * tables.leafCount);
+
+                for (size_t stateA = 0; stateA < m_stateCount; ++stateA) {
+                    if (kNoState == tables.leafIndex[stateA]) {
+                        continue;
+                    }
+
+                    for (size_t stateB = 0; stateB < m_stateCount; ++stateB) {
+                        if (kNoState != tables.leafIndex[stateB]) {
+                            tables.leafAncestor[tables.leafIndex[stateA] * tables.leafCount + tables.leafIndex[stateB]] = queryAncestor(tables, stateA, stateB);
+                        }
+                    }
+                }
+            }
+        }
+
+        //! \brief Invoked when the state tree is ready for use and game systems may be prepared for processing.
+        //! \param initArgs [in] -
+        //!        Initialization information for use by the state tree.
+        void StateTree::onInitialize(ngen::InitArgs &initArgs) {
+            initArgs.stateTree = this;
+
+            if (!m_stateCount) {
+                return;
+            }
+
+            // Any request made before the first commit takes precedence over the default state
+            m_pendingState = &m_stateList[m_defaultState];
+            m_pendingPriority = INT32_MIN;
+            m_pendingOrder = 0;
+
+            m_treeInitialized = true;
+            m_initializedList.assign(m_stateCount, m_deferredInitialize ? 0 : 1);
+
+            if (m_deferredInitialize) {
+                return;
+            }
+
+            // The states are initialized individually so each system receives its own pool
+            std::vector<GameState*> stateList;
+            gatherStates(stateList);
+
+            initializeStates(stateList.data(), stateList.size());
+        }
+
+        //! \brief Lists the states depth first, each root followed by its children, the order GameState::onInitialize
+        //!        would visit them.
+        //! \param stateList [out] -
+        //!        Receives every state within the tree.
+        void StateTree::gatherStates(std::vector<GameState*> &stateList) const {
+            std::vector<GameState*> pending;
+
+            stateList.clear();
+            stateList.reserve(m_stateCount);
+
+            for (size_t loop = m_stateCount; loop > 0; --loop) {
+                if (!m_stateList[loop - 1].getParent()) {
+                    pending.push_back(&m_stateList[loop - 1]);
+                }
+            }
+
+            while (!pending.empty()) {
+                GameState *state = pending.back();
+                pending.pop_back();
+
+                stateList.push_back(state);
+
+                for (size_t loop = state->getChildCount(); loop > 0; --loop) {
+                    pending.push_back(state->getChild(loop - 1));
+                }
+            }
+        }
+
+        //! \brief Specifies whether the systems of a state are initialized when the state is first entered.
+        //!
+        //! This must be specified before onInitialize is invoked, it has no effect on a tree that is already
+        //! initialized.
+        //! \param enabled [in] -
+        //!        <em>True</em> to defer initialization until a state is entered or prefetched.
+        void StateTree::setDeferredInitialize(bool enabled) {
+            if (!m_treeInitialized) {
+                m_deferredInitialize = enabled;
+            }
+        }
+
+        //! \brief Initializes the systems of a state and its parents ahead of the state being entered.
+        //!
+        //! This has no effect if the branch has already been initialized. It must be invoked from the thread that
+        //! processes the state tree.
+        //! \param  state [in] -
+        //!         The state whose branch is to be initialized.
+        //! \return <em>True</em> if the branch is initialized otherwise <em>false</em>.
+        bool StateTree::prefetchState(GameState *state) {
+            if (!state || !m_treeInitialized) {
+                return false;
+            }
+
+            initializeBranch(state);
+            return true;
+        }
+
+        //! \brief Initializes the systems of a state and its parents ahead of the state being entered.
+        //! \param  name [in] -
+        //!         Name of the state whose branch is to be initialized.
+        //! \return <em>True</em> if the branch is initialized otherwise <em>false</em>.
+        bool StateTree::prefetchState(const char *name) {
+            return prefetchState(findState(name));
+        }
+
+        //! \brief Determines whether or not the systems within a state have been initialized.
+        //! \param  state [in] -
+        //!         The state to be examined, only the systems within the state itself are considered.
+        //! \return <em>True</em> if the systems within the state have been initialized otherwise <em>false</em>.
+        bool StateTree::isInitialized(const GameState *state) const {
+            return state && size_t(state - m_stateList) < m_initializedList.size() && m_initializedList[size_t(state - m_stateList)];
+        }
+
+        //! \brief Initializes any state between the root of the tree and the specified state that has not yet been
+        //!        initialized, parents are initialized before their children.
+        //! \param state [in] -
+        //!        The deepest state of the branch to be initialized.
+        void StateTree::initializeBranch(GameState *state) {
+            if (!m_deferredInitialize || m_initializedList.empty()) {
+                return;
+            }
+
+            // Parents are always initialized before their children, so the walk ends at the first initialized state
+            std::vector<GameState*> stateList;
+
+            for (; state && !m_initializedList[size_t(state - m_stateList)]; state = state->getParent()) {
+                stateList.push_back(state);
+            }
+
+            std::reverse(stateList.begin(), stateList.end());
+            initializeStates(stateList.data(), stateList.size());
+        }
+
+        //! \brief Invokes onInitialize for every system within the supplied states.
+        //!
+        //! When a scheduler is available, independent systems are initialized on the scheduler first. The remaining
+        //! systems are then initialized on the calling thread in the order they appear.
+        //! \param stateList [in] -
+        //!        The states to be initialized, parents must appear before their children.
+        //! \param stateCount [in] -
+        //!        Number of states within the list.
+        void StateTree::initializeStates(GameState *const *stateList, size_t stateCount) {
+            std::vector<InitializeEntry> entryList;
+
+            if (m_scheduler) {
+                for (size_t loop = 0; loop < stateCount; ++loop) {
+                    for (size_t index = 0; index < stateList[loop]->getSystemCount(); ++index) {
+                        GameSystemInstance *instance = stateList[loop]->getSystemInstance(index);
+
+                        if (m_systemFactory->getIndependentInitialize(instance->hash)) {
+                            entryList.push_back({ stateList[loop], instance });
+                        }
+                    }
+                }
+            }
+
+            if (!entryList.empty()) {
+                JobGraph graph;
+                graph.reset(entryList.size());
+                graph.finalize();
+
+                InitializeContext context = { this, entryList.data() };
+                m_scheduler->execute(graph, &StateTree::initializeJob, &context);
+            }
+
+            ngen::InitArgs initArgs;
+            initArgs.stateTree = this;
+
+            for (size_t loop = 0; loop < stateCount; ++loop) {
+                GameState *state = stateList[loop];
+
+                initArgs.gameState = state;
+
+                for (size_t index = 0; index < state->getSystemCount(); ++index) {
+                    GameSystemInstance *instance = state->getSystemInstance(index);
+
+                    if (!m_scheduler || !m_systemFactory->getIndependentInitialize(instance->hash)) {
+                        initArgs.memory = getTrackedPool(instance);
+                        instance->gameSystem->onInitialize(initArgs);
+                    }
+                }
+
+                m_initializedList[size_t(state - m_stateList)] = 1;
+            }
+
+            for (size_t loop = 0; loop < stateCount; ++loop) {
+                checkBudgets(stateList[loop]);
+            }
+        }
+
+        //! \brief Job function used to invoke onInitialize for a single independent game system.
+        void StateTree::initializeJob(void *context, size_t job) {
+            const InitializeContext &initialize = *static_cast<const InitializeContext*>(context);
+            const InitializeEntry &entry = initialize.entryList[job];
+
+            ngen::InitArgs initArgs;
+            initArgs.stateTree = initialize.stateTree;
+            initArgs.gameState = entry.state;
+            initArgs.memory = initialize.stateTree->getTrackedPool(entry.instance);
+
+            entry.instance->gameSystem->onInitialize(initArgs);
+        }
+
+        //! \brief Invoked when the game state is about to be removed from the running title.
+        void StateTree::onDestroy() {
+            // Any transition still being prepared is abandoned, its systems are never activated
+            waitTransition();
+
+            // Invoke onExit on currently active branch, part way through an incremental transition only the systems
+            // that are currently active are deactivated
+            if (m_incrementalState) {
+                m_incrementalList.clear();
+                gatherBranch(m_activeState, 0, m_activeCount, m_incrementalList);
+
+                for (size_t loop = m_incrementalList.size(); loop > 0; --loop) {
+                    m_incrementalList[loop - 1]->gameSystem->onDeactivate();
+                }
+
+                m_incrementalState = nullptr;
+                m_incrementalRoot = nullptr;
+                m_incrementalList.clear();
+                m_activeState = nullptr;
+            }
+
+            if (m_activeState) {
+                m_activeState->onExit(nullptr);
+                m_activeState = nullptr;
+            }
+
+            if (m_deferredInitialize && m_initializedList.size() == m_stateCount) {
+                // Walk the depth first order backwards, which matches the order GameState::onDestroy would visit the
+                // states, children before their parents and siblings in reverse order
+                std::vector<GameState*> stateList;
+                gatherStates(stateList);
+
+                for (size_t loop = stateList.size(); loop > 0; --loop) {
+                    GameState &state = *stateList[loop - 1];
+
+                    if (isInitialized(&state)) {
+                        for (size_t index = state.getSystemCount(); index > 0; --index) {
+                            state.getSystemInstance(index - 1)->gameSystem->onDestroy();
+                        }
+                    }
+                }
+            } else {
+                // Invoke onDestroy for all root states, which will pass the call onto their children for us.
+                // Roots are destroyed in reverse order, mirroring onInitialize.
+                for (size_t loop = m_stateCount; loop > 0; --loop) {
+                    if (!m_stateList[loop - 1].getParent()) {
+                        m_stateList[loop - 1].onDestroy();
+                    }
+                }
+            }
+
+            m_treeInitialized = false;
+            m_initializedList.clear();
+
+            // We place this here to prevent someone erroneously preparing another state within the onDestroy process.
+            m_pendingState = nullptr;
+            m_requestQueue.clear();
+        }
+
+        //! \brief Computes the size of the buffer required to hold a snapshot of the tree.
+        //!
+        //! The size depends upon the amount of data each serializable system reports, it should be computed again
+        //! before each snapshot unless the systems are known to write a fixed amount.
+        //! \return The number of bytes required by snapshot, or zero if the tree has not been loaded.
+        size_t StateTree::getSnapshotSize() const {
+            if (!m_systemList) {
+                return 0;
+            }
+
+            size_t total = StateSnapshot::getTableSize(m_stateCount, m_systemCount, m_tieredCount);
+
+            for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                const ngen::ISerializableGameSystem *system = m_systemList[loop].serializableSystem;
+
+                if (system) {
+                    total = StateSnapshot::alignPayload(total + system->getSnapshotSize());
+                }
+            }
+
+            return total;
+        }
+
+        //! \brief Captures the active state, the pending state and the payload of every serializable system.
+        //!
+        //! Each system writes its payload directly into the supplied buffer, which should be aligned to 16 bytes.
+        //! Requests waiting within the queue are resolved first so the pending state reflects them. A state being
+        //! prepared by an asynchronous transition is captured as the pending state, as is the state being entered by
+        //! an incremental transition, in which case the state the transition began from is captured as active. This
+        //! must be invoked from the thread that processes the state tree, between frames.
+        //! \param  buffer [out] -
+        //!         Memory that receives the snapshot, see getSnapshotSize.
+        //! \param  length [in] -
+        //!         Size of the supplied buffer (in bytes).
+        //! \param  written [out] -
+        //!         Optional, receives the number of bytes written to the buffer.
+        //! \return <em>True</em> if the snapshot was written otherwise <em>false</em>.
+        bool StateTree::snapshot(void *buffer, size_t length, size_t *written) {
+            if (!buffer || !m_treeInitialized) {
+                return false;
+            }
+
+            resolveRequests();
+
+            const size_t tableSize = StateSnapshot::getTableSize(m_stateCount, m_systemCount, m_tieredCount);
+
+            if (length < tableSize) {
+                return false;
+            }
+
+            uint8_t *bytes = static_cast<uint8_t*>(buffer);
+            StateSnapshotHeader &header = *reinterpret_cast<StateSnapshotHeader*>(bytes);
+            StateSnapshotEntry *entryList = reinterpret_cast<StateSnapshotEntry*>(bytes + sizeof(StateSnapshotHeader));
+            StateSnapshotTier *tierList = reinterpret_cast<StateSnapshotTier*>(entryList + m_systemCount);
+            uint8_t *initializedList = reinterpret_cast<uint8_t*>(tierList + m_tieredCount);
+
+            // Payloads are placed before any system writes, so a buffer that is too small leaves the systems untouched
+            size_t offset = tableSize;
+
+            for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                const ngen::ISerializableGameSystem *system = m_systemList[loop].serializableSystem;
+                const size_t size = system ? system->getSnapshotSize() : 0;
+
+                entryList[loop].hash = m_systemList[loop].hash;
+                entryList[loop].offset = size ? offset : 0;
+                entryList[loop].size = size;
+
+                if (size) {
+                    if (size > length - offset) {
+                        return false;
+                    }
+
+                    offset = std::min(StateSnapshot::alignPayload(offset + size), length);
+                }
+            }
+
+            for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                if (entryList[loop].size) {
+                    m_systemList[loop].serializableSystem->onSnapshot(bytes + entryList[loop].offset, size_t(entryList[loop].size));
+                }
+            }
+
+            for (size_t loop = 0; loop < m_tieredCount; ++loop) {
+                tierList[loop].counter = m_tieredList[loop].counter;
+                tierList[loop].elapsed = m_tieredList[loop].elapsed;
+            }
+
+            for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                initializedList[loop] = m_initializedList[loop];
+            }
+
+            GameState *active = m_incrementalState ? m_incrementalSource : m_activeState;
+            GameState *pending = getTransitionState() ? getTransitionState() : m_pendingState;
+
+            header.magic = kStateSnapshotMagic;
+            header.version = kStateSnapshotVersion;
+            header.snapshotSize = offset;
+            header.stateCount = uint32_t(m_stateCount);
+            header.systemCount = uint32_t(m_systemCount);
+            header.activeState = active ? active->getId() : 0;
+            header.pendingState = pending ? pending->getId() : 0;
+            header.pendingPriority = getTransitionState() ? INT32_MAX : m_pendingPriority;
+            header.tieredCount = uint32_t(m_tieredCount);
+            header.pendingOrder = m_pendingOrder;
+            header.requestSequence = m_requestSequence.load(std::memory_order_relaxed);
+            header.fixedAccumulator = m_fixedAccumulator;
+
+            if (written) {
+                *written = offset;
+            }
+
+            return true;
+        }
+
+        //! \brief Returns the tree to the point at which a snapshot was taken.
+        //!
+        //! The tree must have been loaded from the same definition and initialized. When initialization is deferred,
+        //! states that had been initialized when the snapshot was taken are initialized first. Each serializable
+        //! system then receives its payload through onRestore, after which the tree moves to the captured active
+        //! state as it would for a state change: the systems that differ between the two branches are deactivated and
+        //! activated, while those shared by both remain active. The progress of systems with an update interval is
+        //! restored once the change has been made. Any transition being prepared and any requests waiting within the
+        //! queue are discarded, while an incremental transition in progress is completed first. This must be
+        //! invoked from the thread that processes the state tree, between frames.
+        //! \param  data [in] -
+        //!         Memory containing the snapshot, payloads are handed to the systems in place.
+        //! \param  length [in] -
+        //!         Size of the supplied memory block (in bytes).
+        //! \return <em>True</em> if the snapshot was restored otherwise <em>false</em>.
+        bool StateTree::restore(const void *data, size_t length) {
+            StateSnapshot snapshot;
+
+            if (!m_treeInitialized || !snapshot.open(data, length)) {
+                return false;
+            }
+
+            const StateSnapshotHeader &header = *snapshot.getHeader();
+
+            if (header.stateCount != m_stateCount || header.systemCount != m_systemCount || header.tieredCount != m_tieredCount) {
+                return false;
+            }
+
+            // Everything is checked before the tree is modified, so a snapshot of another definition is rejected intact
+            for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                const StateSnapshotEntry &entry = snapshot.getEntry(loop);
+
+                if (entry.hash != m_systemList[loop].hash || (entry.size && !m_systemList[loop].serializableSystem)) {
+                    return false;
+                }
+            }
+
+            GameState *active = header.activeState ? findState(SystemHash(header.activeState)) : nullptr;
+            GameState *pending = header.pendingState ? findState(SystemHash(header.pendingState)) : nullptr;
+
+            if ((header.activeState && !active) || (header.pendingState && !pending)) {
+                return false;
+            }
+
+            // Every system of the active branch must be active before the branch is changed
+            waitTransition();
+
+            if (m_incrementalState) {
+                stepTransition(std::chrono::steady_clock::time_point::max());
+            }
+
+            m_requestQueue.clear();
+
+            if (m_deferredInitialize) {
+                // States are stored with parents before their children, so parents are initialized first
+                std::vector<GameState*> stateList;
+
+                for (size_t loop = 0; loop < m_stateCount; ++loop) {
+                    if (snapshot.isStateInitialized(loop) && !m_initializedList[loop]) {
+                        stateList.push_back(&m_stateList[loop]);
+                    }
+                }
+
+                initializeStates(stateList.data(), stateList.size());
+            }
+
+            bool result = true;
+
+            for (size_t loop = 0; loop < m_systemCount; ++loop) {
+                if (snapshot.getSystemSize(loop)) {
+                    result &= m_systemList[loop].serializableSystem->onRestore(snapshot.getSystemData(loop), snapshot.getSystemSize(loop));
+                }
+            }
+
+            if (active != m_activeState) {
+                if (active) {
+                    initializeBranch(active);
+                    changeState(active, getCommonAncestor(m_activeState, active));
+                } else {
+                    m_activeState->onExit(nullptr);
+                    m_activeState = nullptr;
+                }
+            }
+
+            // Requests made by the systems while the branch was changed are superseded by the captured request
+            m_requestQueue.clear();
+
+            for (size_t loop = 0; loop < m_tieredCount; ++loop) {
+                m_tieredList[loop].counter = snapshot.getTier(loop).counter;
+                m_tieredList[loop].elapsed = snapshot.getTier(loop).elapsed;
+            }
+
+            m_pendingState = pending;
+            m_pendingPriority = header.pendingPriority;
+            m_pendingOrder = header.pendingOrder;
+            m_requestSequence.store(header.requestSequence, std::memory_order_relaxed);
+            m_fixedAccumulator = header.fixedAccumulator;
+
+            return result;
+        }
+
+        //! \brief Called each frame the state tree should be processed.
+        //! \param updateArgs [in] -
+        //!        Details about the current frame being processed.
+        void StateTree::onUpdate(const ngen::UpdateArgs &frameArgs) {
+            ProcessingScope scope(this);
+
+            if (m_recorder && !scope.isNested()) {
+                m_recorder->recordUpdate(frameArgs.deltaTime);
+            }
+
+            commitStateChange();
+
+            // When fixed stepping is enabled the update systems also receive the fraction of a step remaining
+            ForwardedUpdateArgs interpolatedArgs(frameArgs, frameArgs.deltaTime);
+            const ngen::UpdateArgs &updateArgs = m_fixedTimestep > 0.0f ? interpolatedArgs : frameArgs;
+
+            if (m_fixedTimestep > 0.0f) {
+                interpolatedArgs.interpolation = onFixedUpdate(frameArgs);
+            }
+
+            if (m_incrementalState) {
+                // Only the systems shared by both branches are updated while an incremental transition is in progress
+                if (m_incrementalRoot) {
+                    m_incrementalRoot->onUpdate(updateArgs);
+                }
+            } else if (m_activeState) {
+                NGEN_PROFILE_DISPATCH();
+                NGEN_PROFILE_BEGIN();
+
+                if (m_scheduler || m_recorder) {
+                    buildSchedule();
+
+                    DispatchContext context = { this, &m_updateSchedule, &updateArgs, m_requestSequence.fetch_add(m_updateSchedule.size()) };
+                    dispatch(m_updateGraph, &StateTree::updateJob, &context);
+                } else if (m_staticDispatch) {
+                    buildBatches();
+
+                    for (auto &batch : m_updateBatchList) {
+                        batch.function(m_batchUpdateList.data() + batch.first, batch.count, updateArgs);
+                    }
+                } else {
+                    m_activeState->onUpdate(updateArgs);
+                }
+
+                NGEN_PROFILE_END(m_activeState->getId(), ProfilePhase::TreeUpdate);
+            }
+
+            commitStateChange();
+        }
+
+        //! \brief Runs every fixed step that has elapsed, including the time of the current frame.
+        //!
+        //! Each step is followed by a commit, so a state change requested during a step takes effect before the
+        //! next one. When more steps are due than the limit allows, the surplus time is discarded rather than
+        //! carried into the following frames, which prevents a slow frame from causing ever more steps.
+        //! \param  frameArgs [in] -
+        //!         Details about the current frame being processed.
+        //! \return The fraction of a step left in the accumulator, used to interpolate between the last two steps.
+        float StateTree::onFixedUpdate(const ngen::UpdateArgs &frameArgs) {
+            const double timestep = m_fixedTimestep;
+
+            m_fixedAccumulator += frameArgs.deltaTime;
+
+            ForwardedUpdateArgs stepArgs(frameArgs, m_fixedTimestep);
+            stepArgs.interpolation = 0.0f;
+
+            uint32_t stepCount = 0;
+
+            while (m_fixedAccumulator >= timestep && stepCount < m_maximumFixedSteps) {
+                // Fixed update lists are only held by leaf states, so no steps are run during an incremental transition
+                if (m_activeState && !m_incrementalState) {
+                    NGEN_PROFILE_DISPATCH();
+                    NGEN_PROFILE_BEGIN();
+
+                    m_activeState->onFixedUpdate(stepArgs);
+
+                    NGEN_PROFILE_END(m_activeState->getId(), ProfilePhase::TreeFixedUpdate);
+                }
+
+                m_fixedAccumulator -= timestep;
+                stepCount++;
+
+                commitStateChange();
+            }
+
+            if (m_fixedAccumulator >= timestep) {
+                m_fixedAccumulator = std::fmod(m_fixedAccumulator, timestep);
+            }
+
+            return float(m_fixedAccumulator / timestep);
+        }
+
+        //! \brief Specifies the rate at which systems implementing IFixedUpdateGameSystem are stepped.
+        //!
+        //! Fixed steps are run at the start of onUpdate, as many as have elapsed up to the supplied limit. The
+        //! update systems then receive the fraction of a step that remains as UpdateArgs::interpolation. Changing
+        //! the timestep discards any partial step that has accumulated.
+        //! \param timestep [in] -
+        //!        Duration of a single step in seconds, a value of zero or less disables fixed stepping.
+        //! \param maximumSteps [in] -
+        //!        The largest number of steps run within a single frame, must be at least one.
+        void StateTree::setFixedTimestep(float timestep, uint32_t maximumSteps) {
+            m_fixedTimestep = timestep > 0.0f ? timestep : 0.0f;
+            m_maximumFixedSteps = maximumSteps ? maximumSteps : 1;
+            m_fixedAccumulator = 0.0;
+        }
 
-#include "state_tree.h"
-#include "game_state.h"
+        //! \brief Retrieves the fraction of a fixed step that has accumulated but not yet been run.
+        //! \return A value within the range [0, 1), or zero if fixed stepping is disabled.
+        float StateTree::getInterpolation() const {
+            return m_fixedTimestep > 0.0f ? float(m_fixedAccumulator / m_fixedTimestep) : 0.0f;
+        }
 
-using GameState = ngen::StateSystem::GameState;
+        //! \brief Called each frame after the main update phase has completed.
+        //! \param updateArgs [in] -
+        //!        Details about the current frame being processed.
+        void StateTree::onPostUpdate(const ngen::UpdateArgs &updateArgs) {
+            ProcessingScope scope(this);
 
-namespace ngen {
-    namespace StateSystem {
-        static const size_t NGEN_MAXIMUM_STATE_CHANGES = 32;
+            if (m_recorder && !scope.isNested()) {
+                m_recorder->recordPostUpdate(updateArgs.deltaTime);
+            }
 
-        StateTree::StateTree()
-        : m_systemFactory(nullptr)
-        , m_activeState(nullptr)
-        , m_pendingState(nullptr)
-        , m_systemList(nullptr)
-        , m_defaultState(0)
-        , m_systemCount(0)
-        {
-            //
+            if (m_incrementalState) {
+                if (m_incrementalRoot) {
+                    m_incrementalRoot->onPostUpdate(updateArgs);
+                }
+            } else if (m_activeState) {
+                NGEN_PROFILE_DISPATCH();
+                NGEN_PROFILE_BEGIN();
+
+                if (m_scheduler || m_recorder) {
+                    buildSchedule();
+
+                    DispatchContext context = { this, &m_postUpdateSchedule, &updateArgs, m_requestSequence.fetch_add(m_postUpdateSchedule.size()) };
+                    dispatch(m_postUpdateGraph, &StateTree::postUpdateJob, &context);
+                } else if (m_staticDispatch) {
+                    buildBatches();
+
+                    for (auto &batch : m_postUpdateBatchList) {
+                        batch.function(m_batchPostUpdateList.data() + batch.first, batch.count, updateArgs);
+                    }
+                } else {
+                    m_activeState->onPostUpdate(updateArgs);
+                }
+
+                NGEN_PROFILE_END(m_activeState->getId(), ProfilePhase::TreePostUpdate);
+            }
+
+            commitStateChange();
         }
 
-        StateTree::~StateTree() {
-            for (size_t loop = 0; loop < m_systemCount; ++loop) {
-                m_systemFactory->deleteInstance(m_systemList[loop]);
+        //! \brief Runs the jobs of an update phase on the scheduler, or in order on the calling thread if there is none.
+        //!
+        //! Without a scheduler this is only used while recording, as the jobs identify the system making each request.
+        //! \param graph [in] -
+        //!        The job graph of the phase.
+        //! \param function [in] -
+        //!        The job function of the phase.
+        //! \param context [in] -
+        //!        The dispatch context passed to each job.
+        void StateTree::dispatch(const JobGraph &graph, JobScheduler::JobFunction function, void *context) {
+            if (m_scheduler) {
+                m_scheduler->execute(graph, function, context);
+                return;
             }
 
-            delete [] m_systemList;
+            for (size_t loop = 0; loop < graph.getJobCount(); ++loop) {
+                function(context, loop);
+            }
         }
 
-        //! \brief Invoked when the state tree is ready for use and game systems may be prepared for processing.
-        //! \param initArgs [in] -
-        //!        Initialization information for use by the state tree.
-        void StateTree::onInitialize(ngen::InitArgs &initArgs) {
-            initArgs.stateTree = this;
+        //! \brief Specifies the recorder that receives the frames, requests and transitions processed by the tree.
+        //!
+        //! While a recorder is attached, the update phases are dispatched through the job lists even without a
+        //! scheduler so each request can be attributed to the system that made it.
+        //! \param recorder [in] -
+        //!        The recorder to be used, or nullptr to stop recording. This must remain valid while in use.
+        void StateTree::setRecorder(StateRecorder *recorder) {
+            m_recorder = recorder;
+        }
+
+        //! \brief Specifies the table of batch functions used to update the active branch without a scheduler.
+        //!
+        //! Consecutive systems within the active branch whose type is within the table are updated by a single call
+        //! to the function generated for their type, the remaining systems are called through their interface. The
+        //! systems are still updated in root to leaf order. Systems with an update interval are always called
+        //! through their interface. Individual systems are not timed by the profiler while batches are in use.
+        //! \param dispatch [in] -
+        //!        The table to be used, or nullptr to call every system through its interface. This must remain
+        //!        valid while in use by the state tree.
+        void StateTree::setStaticDispatch(const StaticDispatch *dispatch) {
+            m_staticDispatch = dispatch;
+            m_batchState = nullptr;
+        }
+
+        //! \brief Builds the batched update lists of the active branch, if they were built for another state.
+        void StateTree::buildBatches() {
+            if (m_batchState == m_activeState) {
+                return;
+            }
+
+            m_batchUpdateList.clear();
+            m_batchPostUpdateList.clear();
+            m_updateBatchList.clear();
+            m_postUpdateBatchList.clear();
+
+            std::vector<const GameState*> branch;
+            for (const GameState *state = m_activeState; state; state = state->getParent()) {
+                branch.push_back(state);
+            }
 
-            m_pendingState = m_stateList[m_defaultState];
+            for (auto state = branch.rbegin(); state != branch.rend(); ++state) {
+                for (size_t loop = 0; loop < (*state)->getSystemCount(); ++loop) {
+                    const GameSystemInstance &instance = *(*state)->getSystemInstance(loop);
+                    const StaticDispatchEntry *entry = m_staticDispatch->find(instance.creator);
 
-            // Invoke onInitialize for all root states, which will pass the call into their children for us.
-            for (auto state : m_stateList) {
-                if (!state->getParent()) {
-                    state->onInitialize(initArgs);
+                    if (instance.updateSystem) {
+                        // Systems with an update interval are reached through their stand-in
+                        const bool tiered = m_tieredCount && m_systemTiers[size_t(&instance - m_systemList)];
+
+                        UpdateBatchFunction function = entry && entry->update && !tiered ? entry->update : &virtualUpdateBatch;
+                        appendBatch(m_updateBatchList, m_batchUpdateList, instance.updateSystem, function);
+                    }
+
+                    if (instance.postUpdateSystem) {
+                        PostUpdateBatchFunction function = entry && entry->postUpdate ? entry->postUpdate : &virtualPostUpdateBatch;
+                        appendBatch(m_postUpdateBatchList, m_batchPostUpdateList, instance.postUpdateSystem, function);
+                    }
                 }
             }
+
+            m_batchState = m_activeState;
         }
 
-        //! \brief Invoked when the game state is about to be removed from the running title.
-        void StateTree::onDestroy() {
-            // Invoke onExit on currently active branch
-            if (m_activeState) {
-                m_activeState->onExit(nullptr);
-                m_activeState = nullptr;
+        //! \brief Specifies the scheduler used to update the systems within the active branch.
+        //!
+        //! When a scheduler is supplied, the update systems of the active branch are executed as a job graph built
+        //! from the dependencies declared through IScheduledGameSystem. The post-update phase does not begin until
+        //! every update job has completed. Supplying nullptr restores serial processing on the calling thread.
+        //! \param scheduler [in] -
+        //!        The scheduler to be used, this must remain valid while it is in use by the state tree.
+        void StateTree::setScheduler(JobScheduler *scheduler) {
+            m_scheduler = scheduler;
+            m_scheduledState = nullptr;
+            m_batchState = nullptr;
+        }
+
+        //! \brief Rebuilds the job graphs if the active state has changed since they were last built.
+        void StateTree::buildSchedule() {
+            if (m_scheduledState != m_activeState) {
+                buildGraph(m_activeState, false, m_updateSchedule, m_updateGraph);
+                buildGraph(m_activeState, true, m_postUpdateSchedule, m_postUpdateGraph);
+
+                m_scheduledState = m_activeState;
+            }
+        }
+
+        //! \brief Builds the job graph for one update phase of the branch ending at the specified leaf.
+        //!
+        //! Jobs are created in the same root to leaf order used for serial processing. An edge is added between two
+        //! systems if one writes a resource the other accesses, or if the later system asked to run after the earlier
+        //! one. Systems that do not implement IScheduledGameSystem act as a barrier and run in isolation.
+        //! \param leaf [in] -
+        //!        The state at the end of the active branch.
+        //! \param postUpdate [in] -
+        //!        True to build the graph for the post-update phase, otherwise the graph is built for the update phase.
+        //! \param schedule [out] -
+        //!        Receives the game system associated with each job.
+        //! \param graph [out] -
+        //!        Receives the job graph.
+        void StateTree::buildGraph(const GameState *leaf, bool postUpdate, std::vector<GameSystemInstance*> &schedule, JobGraph &graph) {
+            std::vector<const GameState*> branch;
+            for (const GameState *state = leaf; state; state = state->getParent()) {
+                branch.push_back(state);
             }
 
-            // Invoke onDestroy for all root states, which will pass the call onto their children for us.
-            for (auto state : m_stateList) {
-                if (!state->getParent()) {
-                    state->onDestroy();
+            schedule.clear();
+            for (auto state = branch.rbegin(); state != branch.rend(); ++state) {
+                for (size_t loop = 0; loop < (*state)->getSystemCount(); ++loop) {
+                    GameSystemInstance *instance = (*state)->getSystemInstance(loop);
+
+                    if (postUpdate ? nullptr != instance->postUpdateSystem : nullptr != instance->updateSystem) {
+                        schedule.push_back(instance);
+                    }
                 }
             }
 
-            // We place this here to prevent someone erroneously preparing another state within the onDestroy process.
-            m_pendingState = nullptr;
-        }
+            const size_t jobCount = schedule.size();
 
-        //! \brief Called each frame the state tree should be processed.
-        //! \param updateArgs [in] -
-        //!        Details about the current frame being processed.
-        void StateTree::onUpdate(const ngen::UpdateArgs &updateArgs) {
-            commitStateChange();
+            std::vector<GameSystemDependencies> dependencies(jobCount);
+            for (size_t loop = 0; loop < jobCount; ++loop) {
+                if (schedule[loop]->scheduledSystem) {
+                    schedule[loop]->scheduledSystem->getDependencies(dependencies[loop]);
+                }
+            }
 
-            if (m_activeState) {
-                m_activeState->onUpdate(updateArgs);
+            graph.reset(jobCount);
+
+            // Index of the most recent system that does not declare its dependencies, if any
+            size_t barrier = jobCount;
+
+            for (size_t job = 0; job < jobCount; ++job) {
+                const size_t first = barrier == jobCount ? 0 : barrier + 1;
+
+                if (barrier != jobCount) {
+                    graph.addEdge(barrier, job);
+                }
+
+                if (!schedule[job]->scheduledSystem) {
+                    for (size_t other = first; other < job; ++other) {
+                        graph.addEdge(other, job);
+                    }
+
+                    barrier = job;
+                    continue;
+                }
+
+                const GameSystemDependencies &current = dependencies[job];
+
+                for (size_t other = first; other < job; ++other) {
+                    const GameSystemDependencies &previous = dependencies[other];
+
+                    if (sharesResource(previous.writes, previous.writeCount, current.reads, current.readCount) ||
+                        sharesResource(previous.writes, previous.writeCount, current.writes, current.writeCount) ||
+                        sharesResource(previous.reads, previous.readCount, current.writes, current.writeCount) ||
+                        sharesResource(&schedule[other]->hash, 1, current.after, current.afterCount)) {
+                        graph.addEdge(other, job);
+                    }
+                }
             }
 
-            commitStateChange();
+            graph.finalize();
         }
 
-        //! \brief Called each frame after the main update phase has completed.
-        //! \param updateArgs [in] -
-        //!        Details about the current frame being processed.
-        void StateTree::onPostUpdate(const ngen::UpdateArgs &updateArgs) {
-            if (m_activeState) {
-                m_activeState->onPostUpdate(updateArgs);
+        //! \brief Job function used to invoke onUpdate for a single game system.
+        void StateTree::updateJob(void *context, size_t job) {
+            const DispatchContext &dispatch = *static_cast<const DispatchContext*>(context);
+            const GameSystemInstance *instance = (*dispatch.schedule)[job];
+
+            t_dispatchTree = dispatch.stateTree;
+            t_dispatchOrder = dispatch.orderBase + job;
+            t_dispatchSystem = instance->hash;
+
+            NGEN_PROFILE_DISPATCH();
+            NGEN_PROFILE_BEGIN();
+            instance->updateSystem->onUpdate(*dispatch.args);
+            NGEN_PROFILE_END(instance->hash, ProfilePhase::Update);
+
+            t_dispatchTree = nullptr;
+        }
+
+        //! \brief Job function used to invoke onPostUpdate for a single game system.
+        void StateTree::postUpdateJob(void *context, size_t job) {
+            const DispatchContext &dispatch = *static_cast<const DispatchContext*>(context);
+            const GameSystemInstance *instance = (*dispatch.schedule)[job];
+
+            t_dispatchTree = dispatch.stateTree;
+            t_dispatchOrder = dispatch.orderBase + job;
+            t_dispatchSystem = instance->hash;
+
+            NGEN_PROFILE_DISPATCH();
+            NGEN_PROFILE_BEGIN();
+            instance->postUpdateSystem->onPostUpdate(*dispatch.args);
+            NGEN_PROFILE_END(instance->hash, ProfilePhase::PostUpdate);
+
+            t_dispatchTree = nullptr;
+        }
+
+        //! \brief Requests a change to the specified state, the change occurs when commitStateChange is invoked.
+        //!
+        //! This method may be invoked from any thread. If multiple requests are made before the change is
+        //! committed, the request with the highest priority takes effect. Between requests of equal priority the
+        //! last request wins, where requests made by systems updated through a JobScheduler are ordered by the
+        //! position of the system within the branch.
+        //! \param state [in] -
+        //!        The state to be activated, this must be a leaf state within the tree.
+        //! \param priority [in] -
+        //!        Priority of the request.
+        //! \return <em>True</em> if the request was accepted, or <em>false</em> if the state is not a leaf state
+        //!         within the tree. A request is never rejected because too many requests have been made.
+        bool StateTree::requestState(GameState *state, int32_t priority) {
+            if (!state || state->getChildCount() || state < m_stateList || state >= m_stateList + m_stateCount) {
+                return false;
             }
 
-            commitStateChange();
+            StateRequest request;
+
+            request.state = state;
+            request.priority = priority;
+            request.order = t_dispatchTree == this ? t_dispatchOrder : m_requestSequence.fetch_add(1, std::memory_order_relaxed);
+
+            m_requestQueue.push(request);
+
+            if (m_recorder) {
+                const bool dispatched = t_dispatchTree == this;
+                m_recorder->recordRequest(state->getId(), dispatched ? t_dispatchSystem : 0, priority, dispatched || t_processingTree == this);
+            }
+
+            return true;
+        }
+
+        //! \brief Requests a change to the state with the specified identifier.
+        //! \param hash [in] -
+        //!        Identifier of the state to be activated (see computeHash and the _state literal).
+        //! \param priority [in] -
+        //!        Priority of the request.
+        //! \return <em>True</em> if the request was accepted, or <em>false</em> if no leaf state has the identifier.
+        bool StateTree::requestStateId(SystemHash hash, int32_t priority) {
+            return requestState(findState(hash), priority);
+        }
+
+        //! \brief Requests a change to the state with the specified name.
+        //! \param name [in] -
+        //!        Name of the state to be activated.
+        //! \param priority [in] -
+        //!        Priority of the request.
+        //! \return <em>True</em> if the request was accepted, or <em>false</em> if no leaf state has the name.
+        bool StateTree::requestState(const char *name, int32_t priority) {
+            return requestState(findState(name), priority);
+        }
+
+        //! \brief Rejects a request for a null state, which would otherwise be ambiguous between the state and
+        //!        name overloads.
+        //! \param priority [in] -
+        //!        Priority of the request.
+        //! \return Always <em>false</em>.
+        bool StateTree::requestState(std::nullptr_t, int32_t priority) {
+            return false;
+        }
+
+        //! \brief Removes the requests waiting within the queue and keeps the one that takes precedence as pending.
+        //!
+        //! A pending state left by an earlier commit competes with the new requests, so a high priority request
+        //! is not displaced while an asynchronous transition is being prepared.
+        void StateTree::resolveRequests() {
+            StateRequest request;
+
+            while (m_requestQueue.pop(request)) {
+                if (!m_pendingState || request.priority > m_pendingPriority ||
+                    (request.priority == m_pendingPriority && request.order >= m_pendingOrder)) {
+                    m_pendingState = request.state;
+                    m_pendingPriority = request.priority;
+                    m_pendingOrder = request.order;
+                }
+            }
         }
 
         //! \brief Switches control to the currently pending state.
+        //!
+        //! While an asynchronous transition is being prepared no other state change takes place, requests made in
+        //! the meantime are processed once the transition has completed. An incremental transition is instead
+        //! redirected by a request made while it is in progress, see setTransitionBudget.
         void StateTree::commitStateChange() {
+            ProcessingScope scope(this);
+
+            if (m_recorder && !scope.isNested()) {
+                m_recorder->recordCommit();
+            }
+
+            // The budget of an incremental transition is measured from the start of the commit
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(m_transitionBudget);
+
+            resolveRequests();
+
+            if (m_transitionState) {
+                if (m_preparedCount.load(std::memory_order_acquire) < m_prepareList.size()) {
+                    return;
+                }
+
+                GameState *transition = m_transitionState;
+
+                waitTransition();
+
+                if (m_transitionBudget) {
+                    beginTransition(transition);
+                } else {
+                    changeState(transition, getCommonAncestor(m_activeState, transition));
+                    resolveRequests();
+                }
+            }
+
             // Some states may request a state change as they become active, so we continually loop until the
             // pending state remains null. However, if we encounter too many state changes we give up in-case
             // the state tree has erroneously defined an infinitely recurring state change.
 
             size_t changeCounter = 0;
 
-            while (m_pendingState && changeCounter < NGEN_MAXIMUM_STATE_CHANGES) {
-                // Cache pending state, as it may be overwritten when we invoke onExit()
-                GameState *pending = m_pendingState;
+            for (;;) {
+                while (m_pendingState && changeCounter < NGEN_MAXIMUM_STATE_CHANGES) {
+                    // Cache pending state, as requests made by onExit() or onEnter() are resolved after the change
+                    GameState *pending = m_pendingState;
+
+                    changeCounter++;
+
+                    m_pendingState = nullptr;
+
+                    if (pending == (m_incrementalState ? m_incrementalState : m_activeState)) {
+                        continue;
+                    }
+
+                    GameState *rootState = getCommonAncestor(m_activeState, pending);
+
+                    // Part way through an incremental transition some systems above the common ancestor may be
+                    // inactive, these are activated again along with the systems below it.
+                    const size_t first = std::min(getActiveSystemCount(), rootState ? rootState->getBranchSystemCount() : 0);
+
+                    initializeBranch(pending);
+
+                    // Gather the systems that must be prepared before they are activated, the hierarchy is walked
+                    // upwards so the list is reversed to restore root to leaf order.
+                    m_prepareList.clear();
+
+                    for (GameState *state = pending; state && state->getBranchSystemCount() > first; state = state->getParent()) {
+                        const size_t base = state->getBranchSystemCount() - state->getSystemCount();
+
+                        for (size_t loop = state->getSystemCount(); loop > 0 && base + loop > first; --loop) {
+                            ngen::IPreparedGameSystem *system = state->getSystemInstance(loop - 1)->preparedSystem;
+                            if (system) {
+                                m_prepareList.push_back(system);
+                            }
+                        }
+                    }
+
+                    std::reverse(m_prepareList.begin(), m_prepareList.end());
+
+                    if (m_asyncTransitions && !m_prepareList.empty() && !m_incrementalState) {
+                        m_transitionState = pending;
+                        m_preparedCount.store(0, std::memory_order_relaxed);
+                        m_transitionThread = std::thread(&StateTree::prepareTransition, this);
+                        return;
+                    }
+
+                    for (auto system : m_prepareList) {
+                        system->onPrepare();
+                    }
+
+                    if (m_transitionBudget || m_incrementalState) {
+                        beginTransition(pending);
+                    } else {
+                        changeState(pending, rootState);
+                        resolveRequests();
+                    }
+                }
+
+                if (!m_incrementalState || !stepTransition(deadline)) {
+                    return;
+                }
+
+                resolveRequests();
+            }
+        }
+
+        //! \brief Deactivates the systems of the active branch and activates those of the specified state.
+        //! \param state [in] -
+        //!        The leaf state that is to become active.
+        //! \param root [in] -
+        //!        The common ancestor of the active state and the new state, systems above this state are unaffected.
+        void StateTree::changeState(GameState *state, GameState *root) {
+            NGEN_PROFILE_DISPATCH();
+            NGEN_PROFILE_BEGIN();
+
+#if NGEN_STATE_SYSTEM_PROFILING
+            const SystemHash source = m_activeState ? m_activeState->getId() : 0;
+#endif
 
-                changeCounter++;
+            if (m_activeState) {
+                // Invoke 'onDeactivate' for all systems that are being terminated
+                m_activeState->onExit(root);
+            }
+
+            if (m_recorder) {
+                m_recorder->recordTransition(m_activeState ? m_activeState->getId() : 0, state->getId());
+            }
+
+            m_activeState = state;
+            state->onEnter(root);
+            resetTiers(state, root);
+
+            checkBudgets(state);
+
+            NGEN_PROFILE_END_TRANSITION(state->getId(), source, root ? root->getId() : 0);
+        }
+
+        //! \brief Retrieves the number of systems from the root of the active branch that are currently active.
+        //! \return The number of active systems, which is less than the size of the branch during an incremental transition.
+        size_t StateTree::getActiveSystemCount() const {
+            if (!m_activeState) {
+                return 0;
+            }
+
+            return m_incrementalState ? m_activeCount : m_activeState->getBranchSystemCount();
+        }
+
+        //! \brief Starts an incremental transition to the specified state, or redirects the one in progress.
+        //!
+        //! The systems that are active form the start of the active branch. Those beyond the point where the branch
+        //! meets the branch of the new state are deactivated in reverse order, then the systems of the new branch
+        //! from that point onwards are activated in order. No callbacks are made here, see stepTransition.
+        //! \param state [in] -
+        //!        The leaf state that is to become active.
+        void StateTree::beginTransition(GameState *state) {
+            const size_t activeCount = getActiveSystemCount();
+
+            GameState *root = getCommonAncestor(m_activeState, state);
+
+            const size_t first = std::min(activeCount, root ? root->getBranchSystemCount() : 0);
+
+            if (!m_incrementalState) {
+                m_incrementalSource = m_activeState;
+#if NGEN_STATE_SYSTEM_PROFILING
+                m_incrementalStart = SystemProfiler::isEnabled() ? SystemProfiler::now() : 0;
+#endif
+            }
+
+            // The branch is gathered from root to leaf, the exits are reversed so the leaf is deactivated first
+            m_incrementalList.clear();
+            gatherBranch(m_activeState, first, activeCount, m_incrementalList);
+            std::reverse(m_incrementalList.begin(), m_incrementalList.end());
+
+            m_incrementalExitCount = m_incrementalList.size();
+            gatherBranch(state, first, state->getBranchSystemCount(), m_incrementalList);
+
+            // Updates are limited to the deepest shared state whose systems all remain active
+            while (root && root->getBranchSystemCount() > first) {
+                root = root->getParent();
+            }
+
+            m_incrementalState = state;
+            m_incrementalRoot = root;
+            m_incrementalIndex = 0;
+            m_activeCount = activeCount;
+        }
+
+        //! \brief Makes the callbacks of the incremental transition in progress until it completes or the deadline passes.
+        //!
+        //! At least one callback is made by each step, so the transition completes however small the budget is.
+        //! \param  deadline [in] -
+        //!         Time after which no further callbacks are made, ignored when the transition budget is zero.
+        //! \return <em>True</em> if the transition has completed otherwise <em>false</em>.
+        bool StateTree::stepTransition(std::chrono::steady_clock::time_point deadline) {
+            NGEN_PROFILE_DISPATCH();
 
-                m_pendingState = nullptr;
+            for (bool first = true; m_incrementalIndex < m_incrementalList.size(); first = false) {
+                if (!first && m_transitionBudget && std::chrono::steady_clock::now() >= deadline) {
+                    return false;
+                }
+
+                GameSystemInstance *instance = m_incrementalList[m_incrementalIndex];
 
-                if (pending != m_activeState) {
-                    GameState *rootState = StateTree::findCommonAncestor(m_activeState, pending);
+                NGEN_PROFILE_BEGIN();
 
-                    if (m_activeState) {
-                        // Invoke 'onDeactivate' for all systems that are being terminated
-                        m_activeState->onExit(rootState);
+                if (m_incrementalIndex < m_incrementalExitCount) {
+                    instance->gameSystem->onDeactivate();
+                    NGEN_PROFILE_END(instance->hash, ProfilePhase::Deactivate);
+                    --m_activeCount;
+                } else {
+                    instance->gameSystem->onActivate();
+                    NGEN_PROFILE_END(instance->hash, ProfilePhase::Activate);
+                    ++m_activeCount;
+
+                    if (m_tieredCount && m_systemTiers[size_t(instance - m_systemList)]) {
+                        m_systemTiers[size_t(instance - m_systemList)]->reset();
                     }
+                }
+
+                // Once the outgoing systems have been deactivated the incoming branch becomes the active one
+                if (++m_incrementalIndex == m_incrementalExitCount) {
+                    m_activeState = m_incrementalState;
+                }
+            }
+
+            m_activeState = m_incrementalState;
 
-                    m_activeState = pending;
-                    pending->onEnter(rootState);
+#if NGEN_STATE_SYSTEM_PROFILING
+            // The sample spans every commit of the transition, from the commit that began it. No sample is recorded
+            // if profiling was enabled part way through.
+            if (m_incrementalStart && SystemProfiler::isEnabled()) {
+                GameState *root = getCommonAncestor(m_incrementalSource, m_activeState);
+
+                SystemProfiler::record(m_activeState->getId(), ProfilePhase::Transition, m_incrementalStart,
+                                       m_incrementalSource ? m_incrementalSource->getId() : 0, root ? root->getId() : 0);
+            }
+#endif
+
+            if (m_recorder && m_incrementalSource != m_activeState) {
+                m_recorder->recordTransition(m_incrementalSource ? m_incrementalSource->getId() : 0, m_activeState->getId());
+            }
+
+            m_incrementalState = nullptr;
+            m_incrementalSource = nullptr;
+            m_incrementalRoot = nullptr;
+            m_incrementalList.clear();
+
+            checkBudgets(m_activeState);
+
+            return true;
+        }
+
+        //! \brief Appends the systems of a branch that lie within a range of positions, in root to leaf order.
+        //! \param leaf [in] -
+        //!        The leaf state at the end of the branch, may be nullptr in which case nothing is appended.
+        //! \param first [in] -
+        //!        Position within the branch of the first system to be appended.
+        //! \param last [in] -
+        //!        Position within the branch following the last system to be appended.
+        //! \param list [out] -
+        //!        The list the systems are appended to.
+        void StateTree::gatherBranch(const GameState *leaf, size_t first, size_t last, std::vector<GameSystemInstance*> &list) const {
+            const size_t start = list.size();
+
+            for (const GameState *state = leaf; state && state->getBranchSystemCount() > first; state = state->getParent()) {
+                const size_t base = state->getBranchSystemCount() - state->getSystemCount();
+
+                for (size_t loop = state->getSystemCount(); loop > 0 && base + loop > first; --loop) {
+                    if (base + loop <= last) {
+                        list.push_back(state->getSystemInstance(loop - 1));
+                    }
                 }
             }
+
+            std::reverse(list.begin() + ptrdiff_t(start), list.end());
+        }
+
+        //! \brief Entry point for the thread that prepares the incoming systems of an asynchronous transition.
+        void StateTree::prepareTransition() {
+            for (auto system : m_prepareList) {
+                system->onPrepare();
+                m_preparedCount.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        //! \brief Waits for the thread preparing the current transition to finish, the transition is then discarded.
+        void StateTree::waitTransition() {
+            if (m_transitionThread.joinable()) {
+                m_transitionThread.join();
+            }
+
+            m_transitionState = nullptr;
+            m_prepareList.clear();
+        }
+
+        //! \brief Specifies whether or not state changes prepare the incoming systems on a background thread.
+        //!
+        //! When enabled, a state change whose incoming systems implement IPreparedGameSystem does not take place
+        //! immediately. The current state continues to update while the systems are prepared, and the change is made
+        //! by the first commitStateChange after every system reports ready. Changes without any systems to prepare
+        //! are always immediate.
+        //! \param enabled [in] -
+        //!        <em>True</em> to enable asynchronous transitions otherwise <em>false</em>.
+        void StateTree::setAsyncTransitions(bool enabled) {
+            m_asyncTransitions = enabled;
+        }
+
+        //! \brief Specifies the time each commit may spend on the callbacks of a state change.
+        //!
+        //! When non-zero, a state change becomes an incremental transition. The onDeactivate calls of the outgoing
+        //! branch (in reverse order) and the onActivate calls of the incoming branch (parents before children) are
+        //! made by successive commits, each of which stops once the budget has been spent, though every commit makes
+        //! at least one call. Until the transition completes only the systems of the deepest state shared by both
+        //! branches are updated, fixed steps are skipped, and getActiveState reports the outgoing state until its
+        //! systems have been deactivated. A request that takes effect during the transition redirects it: the
+        //! systems that are active when the request is committed are treated as the active branch, so nothing is
+        //! deactivated twice and only the systems that differ from the new branch receive callbacks. Asynchronous
+        //! preparation is not used for redirects. Setting the budget to zero completes a transition in progress
+        //! within the next commit.
+        //! \param microseconds [in] -
+        //!        Time each commit may spend on the transition, or zero to make state changes within a single commit.
+        void StateTree::setTransitionBudget(uint32_t microseconds) {
+            m_transitionBudget = microseconds;
+        }
+
+        //! \brief Retrieves the progress of the current asynchronous or incremental transition.
+        //! \return The fraction of incoming systems that have been prepared, or of the callbacks of an incremental
+        //!         transition that have been made, 1 if no transition is in progress.
+        float StateTree::getTransitionProgress() const {
+            if (m_incrementalState) {
+                return float(m_incrementalIndex) / float(m_incrementalList.size());
+            }
+
+            if (!m_transitionState) {
+                return 1.0f;
+            }
+
+            return float(m_preparedCount.load(std::memory_order_acquire)) / float(m_prepareList.size());
         }
 
         //! \brief  Finds the GameState instance associated with the specified name.
         //! \param  name [in] -
         //!         The name of the game state to be retrieved.
         //! \return Pointer to the game state associated with the specified name if one could not be found this method returns nullptr.
-        GameState* StateTree::findState(const char *name) {
-            SystemHash hash = StateTree::computeHash(name);
+        GameState* StateTree::findState(const char *name) const {
+            return findState(StateTree::computeHash(name));
+        }
+
+        //! \brief  Finds the GameState instance associated with the specified identifier.
+        //!
+        //! Callers that request states frequently may compute the hash of the state name once and use this method
+        //! to avoid hashing the name on every request.
+        //! \param  hash [in] -
+        //!         The identifier of the game state to be retrieved, as produced by computeHash.
+        //! \return Pointer to the game state associated with the identifier if one could not be found this method returns nullptr.
+        GameState* StateTree::findState(SystemHash hash) const {
+            if (!m_tables) {
+                return nullptr;
+            }
+
+            const std::vector<uint32_t> &stateIndex = m_tables->stateIndex;
+            const size_t mask = stateIndex.size() - 1;
 
-            for (auto state : m_stateList) {
-                if (state->getId() == hash) {
-                    return state;
+            for (size_t slot = stateSlot(hash, m_tables->stateIndexShift); kNoState != stateIndex[slot]; slot = (slot + 1) & mask) {
+                if (m_stateList[stateIndex[slot]].getId() == hash) {
+                    return &m_stateList[stateIndex[slot]];
                 }
             }
 
             return nullptr;
         }
 
+        //! \brief  Retrieves the game state at the specified index within the state tree.
+        //! \param  index [in] -
+        //!         Index of the game state to be retrieved.
+        //! \return The game state at the specified index or nullptr if the index is out of range.
+        GameState* StateTree::getState(size_t index) const {
+            return index < m_stateCount ? &m_stateList[index] : nullptr;
+        }
+
+        //! \brief Retrieves the flattened update list of the active state.
+        //!
+        //! The list covers every update system from the root of the tree down to the active state, which is what
+        //! onUpdate calls when the systems are not batched, scheduled or part way through an incremental transition.
+        //! \return The update list of the active state, which is empty if no state is active.
+        StateTree::BranchSpan<ngen::IUpdateGameSystem> StateTree::getActiveUpdateSpan() const {
+            BranchSpan<ngen::IUpdateGameSystem> span = { nullptr, nullptr, 0 };
+
+            if (m_activeState) {
+                span.systemList = m_activeState->m_branchUpdateList;
+                span.count = m_activeState->m_branchUpdateCount;
+                span.hashList = m_activeState->m_branchUpdateHashList;
+            }
+
+            return span;
+        }
+
+        //! \brief Retrieves the flattened post-update list of the active state.
+        //! \return The post-update list of the active state, which is empty if no state is active.
+        StateTree::BranchSpan<ngen::IPostUpdateGameSystem> StateTree::getActivePostUpdateSpan() const {
+            BranchSpan<ngen::IPostUpdateGameSystem> span = { nullptr, nullptr, 0 };
+
+            if (m_activeState) {
+                span.systemList = m_activeState->m_branchPostUpdateList;
+                span.count = m_activeState->m_branchPostUpdateCount;
+                span.hashList = m_activeState->m_branchPostUpdateHashList;
+            }
+
+            return span;
+        }
+
+        //! \brief Given two states within this state tree, determines the state where both state branches meet.
+        //!
+        //! This uses the tables built when the tree was loaded so it runs in constant time, states that do not
+        //! belong to the tree are handled by findCommonAncestor.
+        //! \return The root state within the hierarchy that is shared by both supplied states.
+        GameState* StateTree::getCommonAncestor(GameState *stateA, GameState *stateB) const {
+            if (!stateA || !stateB) {
+                return nullptr;
+            }
+
+            if (stateA == stateB) {
+                return stateA;
+            }
+
+            if (stateA < m_stateList || stateA >= m_stateList + m_stateCount || stateB < m_stateList || stateB >= m_stateList + m_stateCount) {
+                return StateTree::findCommonAncestor(stateA, stateB);
+            }
+
+            const StateTreeTables &tables = *m_tables;
+            const size_t indexA = stateA - m_stateList;
+            const size_t indexB = stateB - m_stateList;
+
+            uint32_t ancestor;
+
+            if (!tables.leafAncestor.empty() && kNoState != tables.leafIndex[indexA] && kNoState != tables.leafIndex[indexB]) {
+                ancestor = tables.leafAncestor[tables.leafIndex[indexA] * tables.leafCount + tables.leafIndex[indexB]];
+            } else {
+                ancestor = queryAncestor(tables, indexA, indexB);
+            }
+
+            return kNoState != ancestor ? &m_stateList[ancestor] : nullptr;
+        }
+
         //! \brief Given two states within the state tree, this method determines which other state in the tree is
         //!        the point where both state branches meet.
         //! \return The root state within the hierarchy that is shared by both supplied states.
@@ -177,13 +2726,5 @@ namespace ngen {
 
             return nullptr;
         }
-
-        //! \brief  Given a null terminated string, this method computes a hash value.
-        //! \param  name [in] -
-        //!         Null terminated string whose hash value is to be computed.
-        //! \return The hash value computed from the supplied string.
-        SystemHash StateTree::computeHash(const char * const name) {
-            return ngen::TSystemHash<SystemHash, 16777619>::compute(name);
-        }
     }
 }
@@ -0,0 +1,172 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "state_tree_builder.h"
+#include "state_tree_image.h"
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Rounds the supplied offset up to the next multiple of 8 bytes.
+        static inline uint64_t alignOffset(uint64_t offset) {
+            return (offset + 7) & ~uint64_t(7);
+        }
+
+        StateTreeBuilder::StateTreeBuilder()
+        : m_defaultState(0)
+        {
+            //
+        }
+
+        StateTreeBuilder::~StateTreeBuilder() {
+            //
+        }
+
+        //! \brief Adds a new state to the tree.
+        //! \param name [in] -
+        //!        Name of the state being added.
+        //! \param parent [in] -
+        //!        Index of the parent state, or kNoParent if the state is a root of the tree.
+        //! \return Index of the new state or kNoParent if the state could not be added.
+        size_t StateTreeBuilder::addState(const char *name, size_t parent) {
+            return addState(StateTree::computeHash(name), parent);
+        }
+
+        //! \brief Adds a new state to the tree.
+        //! \param id [in] -
+        //!        Unique identifier of the state being added.
+        //! \param parent [in] -
+        //!        Index of the parent state, or kNoParent if the state is a root of the tree.
+        //! \return Index of the new state or kNoParent if the state could not be added.
+        size_t StateTreeBuilder::addState(SystemHash id, size_t parent) {
+            if (parent != kNoParent && parent >= m_stateList.size()) {
+                return kNoParent;
+            }
+
+            const size_t index = m_stateList.size();
+
+            m_stateList.push_back({ id, parent, {}, {} });
+            if (parent != kNoParent) {
+                m_stateList[parent].children.push_back(index);
+            }
+
+            return index;
+        }
+
+        //! \brief Adds a game system to the specified state, systems are stored in the order they are added.
+        //! \param state [in] -
+        //!        Index of the state that will own the game system.
+        //! \param name [in] -
+        //!        Name of the game system to be added.
+        //! \return <em>True</em> if the system was added otherwise <em>false</em>.
+        bool StateTreeBuilder::addSystem(size_t state, const char *name) {
+            return addSystem(state, GameSystemHash::compute(name));
+        }
+
+        //! \brief Adds a game system to the specified state, systems are stored in the order they are added.
+        //! \param state [in] -
+        //!        Index of the state that will own the game system.
+        //! \param hash [in] -
+        //!        Hash value of the game system to be added.
+        //! \return <em>True</em> if the system was added otherwise <em>false</em>.
+        bool StateTreeBuilder::addSystem(size_t state, GameSystemHash::Type hash) {
+            if (state >= m_stateList.size() || !hash) {
+                return false;
+            }
+
+            m_stateList[state].systems.push_back(hash);
+            return true;
+        }
+
+        //! \brief Specifies the state to be activated when the state tree is initialized.
+        //! \param state [in] -
+        //!        Index of the state to be used as the default.
+        //! \return <em>True</em> if the default state was changed otherwise <em>false</em>.
+        bool StateTreeBuilder::setDefaultState(size_t state) {
+            if (state >= m_stateList.size()) {
+                return false;
+            }
+
+            m_defaultState = state;
+            return true;
+        }
+
+        //! \brief Writes the binary image for the current tree definition.
+        //! \param image [out] -
+        //!        Receives the contents of the binary image.
+        //! \return <em>True</em> if the image was written successfully otherwise <em>false</em>.
+        bool StateTreeBuilder::build(std::vector<uint8_t> &image) const {
+            if (m_stateList.empty()) {
+                return false;
+            }
+
+            size_t childCount = 0;
+            size_t systemCount = 0;
+
+            for (auto &state : m_stateList) {
+                childCount += state.children.size();
+                systemCount += state.systems.size();
+            }
+
+            StateTreeImageHeader header;
+
+            header.magic = kStateTreeImageMagic;
+            header.version = kStateTreeImageVersion;
+            header.stateCount = static_cast<uint32_t>(m_stateList.size());
+            header.childCount = static_cast<uint32_t>(childCount);
+            header.systemCount = static_cast<uint32_t>(systemCount);
+            header.defaultState = static_cast<uint32_t>(m_defaultState);
+
+            header.stateOffset = alignOffset(sizeof(StateTreeImageHeader));
+            header.childOffset = alignOffset(header.stateOffset + m_stateList.size() * sizeof(StateTreeImageState));
+            header.systemOffset = alignOffset(header.childOffset + childCount * sizeof(uint32_t));
+            header.imageSize = alignOffset(header.systemOffset + systemCount * sizeof(GameSystemHash::Type));
+
+            image.assign(static_cast<size_t>(header.imageSize), 0);
+            *reinterpret_cast<StateTreeImageHeader*>(image.data()) = header;
+
+            uint8_t * const data = image.data();
+
+            StateTreeImageState *recordList = reinterpret_cast<StateTreeImageState*>(data + header.stateOffset);
+            uint32_t *childList = reinterpret_cast<uint32_t*>(data + header.childOffset);
+            GameSystemHash::Type *hashList = reinterpret_cast<GameSystemHash::Type*>(data + header.systemOffset);
+
+            size_t childIndex = 0;
+            size_t systemIndex = 0;
+
+            for (size_t loop = 0; loop < m_stateList.size(); ++loop) {
+                const StateDesc &desc = m_stateList[loop];
+                StateTreeImageState &record = recordList[loop];
+
+                record.id = desc.id;
+                record.parent = desc.parent != kNoParent ? static_cast<uint32_t>(desc.parent) : kStateTreeImageNoParent;
+                record.firstChild = static_cast<uint32_t>(childIndex);
+                record.childCount = static_cast<uint32_t>(desc.children.size());
+                record.firstSystem = static_cast<uint32_t>(systemIndex);
+                record.systemCount = static_cast<uint32_t>(desc.systems.size());
+
+                for (auto child : desc.children) {
+                    childList[childIndex++] = static_cast<uint32_t>(child);
+                }
+
+                for (auto hash : desc.systems) {
+                    hashList[systemIndex++] = hash;
+                }
+            }
+
+            return true;
+        }
+    }
+}
@@ -0,0 +1,351 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstring>
+
+#include <game_system/game_system.h>
+#include <core/update_args.h>
+
+#include "state_tree_group.h"
+#include "state_tree_image.h"
+#include "game_state.h"
+
+namespace ngen {
+    namespace StateSystem {
+        // Data shared by each job when the batches are updated through a JobScheduler
+        struct BatchContext {
+            StateTreeGroup *group;
+            const ngen::UpdateArgs *args;
+        };
+
+        //! \brief Arguments given to the systems of a single instance, the timing is taken from the arguments of the
+        //!        frame while state requests are made on the tree of the instance.
+        struct InstanceUpdateArgs : public ngen::UpdateArgs {
+            InstanceUpdateArgs() : stateTree(nullptr) {}
+
+            void bind(StateTree *tree, const ngen::UpdateArgs &frameArgs) {
+                stateTree = tree;
+                deltaTime = frameArgs.deltaTime;
+                interpolation = frameArgs.interpolation;
+            }
+
+            virtual bool requestState(const char *name) const {
+                return stateTree->requestState(name);
+            }
+
+            virtual bool requestStateId(uint64_t stateId) const {
+                return stateTree->requestStateId(stateId);
+            }
+
+            StateTree *stateTree;
+        };
+
+        const size_t StateTreeGroup::kMaximumBatchInstances;
+
+        StateTreeGroup::StateTreeGroup()
+        : m_systemFactory(nullptr)
+        , m_definitionLength(0)
+        , m_stateCount(0)
+        , m_scheduler(nullptr)
+        {
+            //
+        }
+
+        StateTreeGroup::~StateTreeGroup() {
+            unload();
+        }
+
+        //! \brief Specifies the definition used by every state tree created by the group.
+        //!
+        //! Any existing instances are released, onDestroy must have been invoked on each of them beforehand.
+        //! \param factory [in] -
+        //!        The factory used to create the game systems of each instance.
+        //! \param data [in] -
+        //!        Memory containing the binary state tree image, the image is copied so the memory may be released.
+        //! \param length [in] -
+        //!        Size of the supplied memory block (in bytes).
+        //! \return <em>True</em> if the image is valid otherwise <em>false</em>.
+        bool StateTreeGroup::load(ngen::GameSystemFactory &factory, const void *data, size_t length) {
+            unload();
+
+            if (!StateTreeImage::validate(data, length)) {
+                return false;
+            }
+
+            m_systemFactory = &factory;
+            m_definition.resize((length + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+            m_definitionLength = length;
+
+            memcpy(m_definition.data(), data, length);
+
+            m_stateCount = reinterpret_cast<const StateTreeImageHeader*>(m_definition.data())->stateCount;
+            return true;
+        }
+
+        //! \brief Releases every instance along with the definition they were created from.
+        void StateTreeGroup::unload() {
+            m_instanceList.clear();
+            m_activeList.clear();
+            m_batchList.clear();
+            m_serialList.clear();
+
+            m_tables.reset();
+            m_definition.clear();
+            m_definitionLength = 0;
+            m_stateCount = 0;
+            m_systemFactory = nullptr;
+        }
+
+        //! \brief Creates a new state tree from the definition held by the group.
+        //!
+        //! The state tree is loaded but not initialized, the caller is responsible for invoking onInitialize.
+        //! \return The new state tree or nullptr if it could not be created.
+        StateTree* StateTreeGroup::createInstance() {
+            if (!m_systemFactory) {
+                return nullptr;
+            }
+
+            // The image is only read, so every instance loads from the definition held by the group
+            std::unique_ptr<StateTree> instance(new StateTree);
+
+            if (!instance->loadShared(*m_systemFactory, m_definition.data(), m_definitionLength, m_tables)) {
+                return nullptr;
+            }
+
+            m_tables = instance->m_tables;
+            m_instanceList.push_back(std::move(instance));
+
+            return m_instanceList.back().get();
+        }
+
+        //! \brief Releases a state tree created by the group, onDestroy must have been invoked beforehand.
+        //!
+        //! The last instance within the group takes the place of the released instance.
+        //! \param stateTree [in] -
+        //!        The state tree to be released.
+        void StateTreeGroup::destroyInstance(StateTree *stateTree) {
+            for (size_t loop = 0; loop < m_instanceList.size(); ++loop) {
+                if (m_instanceList[loop].get() == stateTree) {
+                    m_instanceList[loop] = std::move(m_instanceList.back());
+                    m_instanceList.pop_back();
+                    return;
+                }
+            }
+        }
+
+        //! \brief Specifies the scheduler used to update the batches of instances.
+        //!
+        //! Each batch is processed as a single job, the update phase of every batch completes before the
+        //! post-update phase begins. Supplying nullptr restores serial processing on the calling thread.
+        //! \param scheduler [in] -
+        //!        The scheduler to be used, this must remain valid while it is in use by the group.
+        void StateTreeGroup::setScheduler(JobScheduler *scheduler) {
+            m_scheduler = scheduler;
+        }
+
+        //! \brief Called each frame the state trees should be processed.
+        //!
+        //! Pending state changes are committed for every instance before and after the update, as they would be
+        //! by StateTree::onUpdate.
+        //! \param updateArgs [in] -
+        //!        Details about the current frame being processed.
+        void StateTreeGroup::onUpdate(const ngen::UpdateArgs &updateArgs) {
+            for (auto &instance : m_instanceList) {
+                instance->commitStateChange();
+            }
+
+            dispatch(updateArgs, false);
+
+            for (auto &instance : m_instanceList) {
+                instance->commitStateChange();
+            }
+        }
+
+        //! \brief Called each frame after the main update phase has completed.
+        //! \param updateArgs [in] -
+        //!        Details about the current frame being processed.
+        void StateTreeGroup::onPostUpdate(const ngen::UpdateArgs &updateArgs) {
+            dispatch(updateArgs, true);
+
+            for (auto &instance : m_instanceList) {
+                instance->commitStateChange();
+            }
+        }
+
+        //! \brief Determines whether or not an instance can be updated as part of a batch.
+        //!
+        //! Batches only call the update lists of the active leaf, so an instance that is part way through an
+        //! incremental transition, or whose updates are not made directly through those lists, is processed by
+        //! StateTree instead. An instance that has been reloaded no longer shares the definition of the group,
+        //! so the index of its active state cannot be compared with those of the other instances.
+        //! \param stateTree [in] -
+        //!        The instance to be checked.
+        //! \return <em>True</em> if the instance can be batched otherwise <em>false</em>.
+        bool StateTreeGroup::isBatchable(const StateTree &stateTree) const {
+            return stateTree.m_tables == m_tables &&
+                   !stateTree.m_incrementalState &&
+                   stateTree.getFixedTimestep() <= 0.0f &&
+                   !stateTree.getStaticDispatch() &&
+                   !stateTree.getRecorder() &&
+                   !stateTree.getScheduler();
+        }
+
+        //! \brief Gathers the instances by their active state and divides them into batches.
+        //!
+        //! Instances are counting sorted by the index of their active state, which keeps the order of instances
+        //! that share a state stable from frame to frame. Instances that cannot be batched are gathered separately.
+        void StateTreeGroup::buildBatches() {
+            const size_t stateCount = m_stateCount;
+
+            m_stateStart.assign(stateCount + 1, 0);
+            m_batchList.clear();
+            m_serialList.clear();
+
+            for (auto &instance : m_instanceList) {
+                StateTree &stateTree = *instance;
+
+                if (!isBatchable(stateTree)) {
+                    m_serialList.push_back(&stateTree);
+                } else if (stateTree.getActiveState()) {
+                    m_stateStart[stateTree.getActiveState() - stateTree.getState(0) + 1]++;
+                }
+            }
+
+            for (size_t loop = 0; loop < stateCount; ++loop) {
+                m_stateStart[loop + 1] += m_stateStart[loop];
+            }
+
+            m_activeList.resize(m_stateStart[stateCount]);
+
+            for (auto &instance : m_instanceList) {
+                StateTree &stateTree = *instance;
+
+                if (stateTree.getActiveState() && isBatchable(stateTree)) {
+                    m_activeList[m_stateStart[stateTree.getActiveState() - stateTree.getState(0)]++] = &stateTree;
+                }
+            }
+
+            // Each entry now holds the end of its range, which is the start of the following state
+            size_t first = 0;
+
+            for (size_t loop = 0; loop < stateCount; ++loop) {
+                const size_t last = m_stateStart[loop];
+
+                for (; first < last; first += kMaximumBatchInstances) {
+                    const size_t count = last - first;
+                    m_batchList.push_back({ first, count < kMaximumBatchInstances ? count : kMaximumBatchInstances });
+                }
+
+                first = last;
+            }
+        }
+
+        //! \brief Processes one phase of the frame for every instance that has an active state.
+        //! \param updateArgs [in] -
+        //!        Details about the current frame being processed.
+        //! \param postUpdate [in] -
+        //!        True to process the post-update phase, otherwise the update phase is processed.
+        void StateTreeGroup::dispatch(const ngen::UpdateArgs &updateArgs, bool postUpdate) {
+            buildBatches();
+
+            BatchContext context = { this, &updateArgs };
+            JobScheduler::JobFunction function = postUpdate ? &StateTreeGroup::postUpdateBatch : &StateTreeGroup::updateBatch;
+
+            if (m_scheduler && !m_batchList.empty()) {
+                if (m_batchGraph.getJobCount() != m_batchList.size()) {
+                    m_batchGraph.reset(m_batchList.size());
+                    m_batchGraph.finalize();
+                }
+
+                m_scheduler->execute(m_batchGraph, function, &context);
+            } else {
+                for (size_t loop = 0; loop < m_batchList.size(); ++loop) {
+                    function(&context, loop);
+                }
+            }
+
+            InstanceUpdateArgs instanceArgs;
+
+            for (StateTree *stateTree : m_serialList) {
+                instanceArgs.bind(stateTree, updateArgs);
+
+                if (postUpdate) {
+                    stateTree->onPostUpdate(instanceArgs);
+                } else {
+                    stateTree->onUpdate(instanceArgs);
+                }
+            }
+        }
+
+        //! \brief Job function used to invoke onUpdate for every instance within a batch.
+        //!
+        //! Every instance shares the same active state, so the update lists have the same length and each entry
+        //! refers to the same system type. The lists are walked in step, one system at a time. Each instance is
+        //! given its own arguments, so a state requested by one of its systems is requested on its own tree.
+        void StateTreeGroup::updateBatch(void *context, size_t batch) {
+            const BatchContext &dispatch = *static_cast<const BatchContext*>(context);
+            const Batch &range = dispatch.group->m_batchList[batch];
+            StateTree * const *treeList = dispatch.group->m_activeList.data() + range.first;
+
+            NGEN_PROFILE_DISPATCH();
+
+            StateTree::BranchSpan<ngen::IUpdateGameSystem> updateList[kMaximumBatchInstances];
+            InstanceUpdateArgs argsList[kMaximumBatchInstances];
+
+            for (size_t loop = 0; loop < range.count; ++loop) {
+                updateList[loop] = treeList[loop]->getActiveUpdateSpan();
+                argsList[loop].bind(treeList[loop], *dispatch.args);
+            }
+
+            const size_t systemCount = updateList[0].count;
+
+            for (size_t system = 0; system < systemCount; ++system) {
+                for (size_t loop = 0; loop < range.count; ++loop) {
+                    NGEN_PROFILE_BEGIN();
+                    updateList[loop].systemList[system]->onUpdate(argsList[loop]);
+                    NGEN_PROFILE_END(updateList[loop].hashList[system], ProfilePhase::Update);
+                }
+            }
+        }
+
+        //! \brief Job function used to invoke onPostUpdate for every instance within a batch.
+        void StateTreeGroup::postUpdateBatch(void *context, size_t batch) {
+            const BatchContext &dispatch = *static_cast<const BatchContext*>(context);
+            const Batch &range = dispatch.group->m_batchList[batch];
+            StateTree * const *treeList = dispatch.group->m_activeList.data() + range.first;
+
+            NGEN_PROFILE_DISPATCH();
+
+            StateTree::BranchSpan<ngen::IPostUpdateGameSystem> postUpdateList[kMaximumBatchInstances];
+            InstanceUpdateArgs argsList[kMaximumBatchInstances];
+
+            for (size_t loop = 0; loop < range.count; ++loop) {
+                postUpdateList[loop] = treeList[loop]->getActivePostUpdateSpan();
+                argsList[loop].bind(treeList[loop], *dispatch.args);
+            }
+
+            const size_t systemCount = postUpdateList[0].count;
+
+            for (size_t system = 0; system < systemCount; ++system) {
+                for (size_t loop = 0; loop < range.count; ++loop) {
+                    NGEN_PROFILE_BEGIN();
+                    postUpdateList[loop].systemList[system]->onPostUpdate(argsList[loop]);
+                    NGEN_PROFILE_END(postUpdateList[loop].hashList[system], ProfilePhase::PostUpdate);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,316 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include <utility>
+
+#include <game_system/game_system.h>
+
+#include "state_tree_image.h"
+#include "game_state.h"
+
+#if defined(_WIN32)
+#include <cstdio>
+#include <cstdlib>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace ngen {
+    namespace StateSystem {
+        static_assert(sizeof(StateTreeImageHeader) == 56, "StateTreeImageHeader is part of the image format");
+        static_assert(sizeof(StateTreeImageState) == 32, "StateTreeImageState is part of the image format");
+
+        StateTreeImage::StateTreeImage()
+        : m_data(nullptr)
+        , m_length(0)
+        , m_mapped(false)
+        {
+            //
+        }
+
+        StateTreeImage::~StateTreeImage() {
+            release();
+        }
+
+        //! \brief Maps the contents of a binary state tree file into memory.
+        //! \param path [in] -
+        //!        Path to the file containing the binary state tree image.
+        //! \return <em>True</em> if the file was mapped successfully otherwise <em>false</em>.
+        bool StateTreeImage::map(const char *path) {
+            release();
+
+            if (!path) {
+                return false;
+            }
+
+#if defined(_WIN32)
+            FILE *file = fopen(path, "rb");
+            if (!file) {
+                return false;
+            }
+
+            fseek(file, 0, SEEK_END);
+            const long length = ftell(file);
+            fseek(file, 0, SEEK_SET);
+
+            if (length > 0) {
+                uint8_t *data = static_cast<uint8_t*>(malloc(static_cast<size_t>(length)));
+                if (data && fread(data, static_cast<size_t>(length), 1, file) == 1) {
+                    m_data = data;
+                    m_length = static_cast<size_t>(length);
+                    m_mapped = true;
+                } else {
+                    free(data);
+                }
+            }
+
+            fclose(file);
+#else
+            const int fd = open(path, O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+
+            struct stat info;
+            if (0 == fstat(fd, &info) && info.st_size > 0) {
+                // The image is only read, so the pages are shared with the page cache until they are released.
+                void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (MAP_FAILED != data) {
+                    m_data = static_cast<const uint8_t*>(data);
+                    m_length = static_cast<size_t>(info.st_size);
+                    m_mapped = true;
+                }
+            }
+
+            close(fd);
+#endif
+
+            if (m_data && !validate(m_data, m_length)) {
+                release();
+            }
+
+            return nullptr != m_data;
+        }
+
+        //! \brief Uses a block of memory containing a binary state tree image in place.
+        //! \param data [in] -
+        //!        Memory containing the image, this is not modified and must outlive this object.
+        //! \param length [in] -
+        //!        Size of the supplied memory block (in bytes).
+        //! \return <em>True</em> if the memory contains a valid image otherwise <em>false</em>.
+        bool StateTreeImage::adopt(const void *data, size_t length) {
+            release();
+
+            if (!validate(data, length)) {
+                return false;
+            }
+
+            m_data = static_cast<const uint8_t*>(data);
+            m_length = length;
+
+            return true;
+        }
+
+        //! \brief Releases the image held by this object along with the records built from it.
+        void StateTreeImage::release() {
+            if (m_data && m_mapped) {
+#if defined(_WIN32)
+                free(const_cast<uint8_t*>(m_data));
+#else
+                munmap(const_cast<uint8_t*>(m_data), m_length);
+#endif
+            }
+
+            m_data = nullptr;
+            m_length = 0;
+            m_mapped = false;
+
+            m_stateList.reset();
+            m_systemList.reset();
+            m_gameSystemList.reset();
+            m_updateList.reset();
+            m_postUpdateList.reset();
+        }
+
+        //! \brief Exchanges the images held by two objects, pointers into either image or their records remain valid.
+        //! \param other [in] -
+        //!        The object whose image is to be exchanged with our own.
+        void StateTreeImage::swap(StateTreeImage &other) {
+            std::swap(m_data, other.m_data);
+            std::swap(m_length, other.m_length);
+            std::swap(m_mapped, other.m_mapped);
+
+            m_stateList.swap(other.m_stateList);
+            m_systemList.swap(other.m_systemList);
+            m_gameSystemList.swap(other.m_gameSystemList);
+            m_updateList.swap(other.m_updateList);
+            m_postUpdateList.swap(other.m_postUpdateList);
+        }
+
+        //! \brief Builds the game state and game system instance records described by the image.
+        //!
+        //! The records only hold the definition, the system pointers are zero until the systems are created and
+        //! each state has been bound (see GameState::bindSystems). The child lists and system hashes of each state
+        //! are read from the image in place.
+        //! \return <em>True</em> if the records were built otherwise <em>false</em>.
+        bool StateTreeImage::createRecords() {
+            if (!m_data || m_stateList) {
+                return false;
+            }
+
+            const StateTreeImageHeader &header = *getHeader();
+
+            const StateTreeImageState *recordList = reinterpret_cast<const StateTreeImageState*>(m_data + header.stateOffset);
+            const uint32_t *childList = reinterpret_cast<const uint32_t*>(m_data + header.childOffset);
+            const GameSystemHash::Type *hashList = reinterpret_cast<const GameSystemHash::Type*>(m_data + header.systemOffset);
+
+            m_stateList.reset(new GameState[header.stateCount]);
+            m_systemList.reset(new GameSystemInstance[header.systemCount]);
+            m_gameSystemList.reset(new IGameSystem*[header.systemCount]());
+            m_updateList.reset(new IUpdateGameSystem*[header.systemCount]());
+            m_postUpdateList.reset(new IPostUpdateGameSystem*[header.systemCount]());
+
+            for (uint32_t loop = 0; loop < header.systemCount; ++loop) {
+                m_systemList[loop].hash = hashList[loop];
+            }
+
+            for (uint32_t loop = 0; loop < header.stateCount; ++loop) {
+                const StateTreeImageState &record = recordList[loop];
+                GameState &state = m_stateList[loop];
+
+                state.m_stateList = m_stateList.get();
+                state.m_parent = record.parent != kStateTreeImageNoParent ? &m_stateList[record.parent] : nullptr;
+                state.m_childList = childList + record.firstChild;
+                state.m_systemList = m_systemList.get() + record.firstSystem;
+                state.m_systemHashList = hashList + record.firstSystem;
+                state.m_gameSystemList = m_gameSystemList.get() + record.firstSystem;
+                state.m_updateList = m_updateList.get() + record.firstSystem;
+                state.m_postUpdateList = m_postUpdateList.get() + record.firstSystem;
+
+                state.m_id = record.id;
+                state.m_childCount = record.childCount;
+                state.m_systemCount = record.systemCount;
+            }
+
+            return true;
+        }
+
+        //! \brief Retrieves the game states built from the image.
+        //! \return Pointer to the first game state, or nullptr if the records have not been built.
+        GameState* StateTreeImage::getStateList() const {
+            return m_stateList.get();
+        }
+
+        //! \brief Retrieves the game system instances built from the image.
+        //! \return Pointer to the first game system instance, or nullptr if the records have not been built.
+        GameSystemInstance* StateTreeImage::getSystemList() const {
+            return m_systemList.get();
+        }
+
+        //! \brief Determines whether or not a block of memory contains a state tree image we can use.
+        //!
+        //! Every index stored within the records is checked, so a corrupt image cannot produce records that refer
+        //! to memory outside of the image.
+        //! \param data [in] -
+        //!        Memory containing the image.
+        //! \param length [in] -
+        //!        Size of the supplied memory block (in bytes).
+        //! \return <em>True</em> if the image is valid otherwise <em>false</em>.
+        bool StateTreeImage::validate(const void *data, size_t length) {
+            if (!data || length < sizeof(StateTreeImageHeader)) {
+                return false;
+            }
+
+            if (reinterpret_cast<uintptr_t>(data) % alignof(StateTreeImageHeader)) {
+                return false;
+            }
+
+            const StateTreeImageHeader &header = *static_cast<const StateTreeImageHeader*>(data);
+
+            if (header.magic != kStateTreeImageMagic || header.version != kStateTreeImageVersion) {
+                return false;
+            }
+
+            if (header.imageSize > length) {
+                return false;
+            }
+
+            if (header.stateCount && header.defaultState >= header.stateCount) {
+                return false;
+            }
+
+            const struct {
+                uint64_t offset;
+                uint64_t size;
+            } sections[] = {
+                    { header.stateOffset, uint64_t(header.stateCount) * sizeof(StateTreeImageState) },
+                    { header.childOffset, uint64_t(header.childCount) * sizeof(uint32_t) },
+                    { header.systemOffset, uint64_t(header.systemCount) * sizeof(GameSystemHash::Type) },
+            };
+
+            for (auto &section : sections) {
+                if (section.offset < sizeof(StateTreeImageHeader) || section.offset % 8) {
+                    return false;
+                }
+
+                if (section.offset > header.imageSize || header.imageSize - section.offset < section.size) {
+                    return false;
+                }
+            }
+
+            const uint8_t *bytes = static_cast<const uint8_t*>(data);
+            const StateTreeImageState *recordList = reinterpret_cast<const StateTreeImageState*>(bytes + header.stateOffset);
+            const uint32_t *childList = reinterpret_cast<const uint32_t*>(bytes + header.childOffset);
+
+            uint64_t systemCount = 0;
+
+            for (uint32_t loop = 0; loop < header.stateCount; ++loop) {
+                const StateTreeImageState &record = recordList[loop];
+
+                // Parents must always precede their children, this prevents a corrupt image from producing cycles.
+                if (record.parent != kStateTreeImageNoParent && record.parent >= loop) {
+                    return false;
+                }
+
+                if (uint64_t(record.firstChild) + record.childCount > header.childCount) {
+                    return false;
+                }
+
+                // The systems of each state follow those of the previous state
+                if (record.firstSystem != systemCount) {
+                    return false;
+                }
+
+                systemCount += record.systemCount;
+
+                // Ensure the child lists agree with the parent references
+                for (uint32_t child = 0; child < record.childCount; ++child) {
+                    const uint32_t index = childList[record.firstChild + child];
+
+                    if (index >= header.stateCount || recordList[index].parent != loop) {
+                        return false;
+                    }
+                }
+            }
+
+            return systemCount == header.systemCount;
+        }
+    }
+}
@@ -0,0 +1,35 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "static_dispatch.h"
+
+namespace ngen {
+    namespace StateSystem {
+        //! \brief Retrieves the batch functions generated for a game system type.
+        //! \param creator [in] -
+        //!        The creator of the game system, see GameSystemInstance::creator.
+        //! \return The entry for the type or nullptr if the type is not within the table.
+        const StaticDispatchEntry* StaticDispatch::find(const ngen::IGameSystemCreator *creator) const {
+            for (auto &entry : m_entryList) {
+                if (entry.creator == creator) {
+                    return &entry;
+                }
+            }
+
+            return nullptr;
+        }
+    }
+}
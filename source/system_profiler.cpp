@@ -0,0 +1,151 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <memory>
+#include <mutex>
+
+#include "system_profiler.h"
+
+namespace ngen {
+    namespace StateSystem {
+        // Single producer, single consumer ring buffer owned by each recording thread
+        struct ProfileBuffer {
+            ProfileBuffer(uint32_t index)
+            : head(0)
+            , tail(0)
+            , dropped(0)
+            , thread(index)
+            {}
+
+            ProfileSample samples[SystemProfiler::kBufferCapacity];
+
+            std::atomic<size_t> head;           // Written by the owning thread
+            std::atomic<size_t> tail;           // Written by collect
+            std::atomic<uint64_t> dropped;
+            uint32_t thread;
+        };
+
+        // Every buffer that has been created, buffers are kept once their thread exits so no samples are lost
+        static std::mutex s_bufferLock;
+        static std::vector<std::unique_ptr<ProfileBuffer>> s_bufferList;
+
+        const size_t SystemProfiler::kBufferCapacity;
+
+        std::atomic<bool> SystemProfiler::s_enabled(false);
+
+        //! \brief Retrieves the buffer owned by the calling thread, creating it on first use.
+        static ProfileBuffer& getThreadBuffer() {
+            static thread_local ProfileBuffer *buffer = nullptr;
+
+            if (!buffer) {
+                std::lock_guard<std::mutex> lock(s_bufferLock);
+
+                s_bufferList.emplace_back(new ProfileBuffer(static_cast<uint32_t>(s_bufferList.size())));
+                buffer = s_bufferList.back().get();
+            }
+
+            return *buffer;
+        }
+
+        //! \brief Enables or disables the recording of samples.
+        //! \param enabled [in] -
+        //!        <em>True</em> to begin recording samples, <em>false</em> to stop.
+        void SystemProfiler::setEnabled(bool enabled) {
+            s_enabled.store(enabled, std::memory_order_relaxed);
+        }
+
+        //! \brief Records the time spent within a single game system call.
+        //! \param hash [in] -
+        //!        Hash of the game system that was called.
+        //! \param phase [in] -
+        //!        The life-cycle phase of the call.
+        //! \param start [in] -
+        //!        Time the call began, as returned by now(). The call is assumed to end when record is invoked.
+        //! \param source [in] -
+        //!        For transitions, the identifier of the state that was left.
+        //! \param ancestor [in] -
+        //!        For transitions, the identifier of the common ancestor of both states.
+        void SystemProfiler::record(GameSystemHash::Type hash, ProfilePhase phase, uint64_t start, uint64_t source, uint64_t ancestor) {
+            const uint64_t end = now();
+
+            ProfileBuffer &buffer = getThreadBuffer();
+
+            const size_t head = buffer.head.load(std::memory_order_relaxed);
+            if (head - buffer.tail.load(std::memory_order_acquire) >= kBufferCapacity) {
+                buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            ProfileSample &sample = buffer.samples[head & (kBufferCapacity - 1)];
+
+            sample.hash = hash;
+            sample.start = start;
+            sample.duration = end - start;
+            sample.source = source;
+            sample.ancestor = ancestor;
+            sample.phase = phase;
+            sample.thread = buffer.thread;
+
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+
+        //! \brief Removes every recorded sample from the per-thread buffers.
+        //! \param samples [out] -
+        //!        The samples are appended to this list, grouped by thread and in the order they were recorded.
+        //! \return The number of samples that were appended.
+        size_t SystemProfiler::collect(std::vector<ProfileSample> &samples) {
+            std::lock_guard<std::mutex> lock(s_bufferLock);
+
+            const size_t previous = samples.size();
+
+            for (auto &buffer : s_bufferList) {
+                const size_t tail = buffer->tail.load(std::memory_order_relaxed);
+                const size_t head = buffer->head.load(std::memory_order_acquire);
+
+                for (size_t loop = tail; loop != head; ++loop) {
+                    samples.push_back(buffer->samples[loop & (kBufferCapacity - 1)]);
+                }
+
+                buffer->tail.store(head, std::memory_order_release);
+            }
+
+            return samples.size() - previous;
+        }
+
+        //! \brief Retrieves the number of samples that were discarded because a buffer was full.
+        //! \return The total number of dropped samples across all threads.
+        uint64_t SystemProfiler::getDroppedCount() {
+            std::lock_guard<std::mutex> lock(s_bufferLock);
+
+            uint64_t dropped = 0;
+            for (auto &buffer : s_bufferList) {
+                dropped += buffer->dropped.load(std::memory_order_relaxed);
+            }
+
+            return dropped;
+        }
+
+        //! \brief Discards every recorded sample and clears the dropped sample count.
+        void SystemProfiler::reset() {
+            std::lock_guard<std::mutex> lock(s_bufferLock);
+
+            for (auto &buffer : s_bufferList) {
+                buffer->tail.store(buffer->head.load(std::memory_order_acquire), std::memory_order_release);
+                buffer->dropped.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+}
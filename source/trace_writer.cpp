@@ -0,0 +1,198 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cinttypes>
+
+#include "trace_writer.h"
+
+namespace ngen {
+    namespace StateSystem {
+        static const size_t kFileBufferSize = 256 * 1024;
+
+        //! \brief Retrieves the category used for events of the specified phase.
+        static const char* getCategory(ProfilePhase phase) {
+            switch (phase) {
+                case ProfilePhase::Update:          return "update";
+                case ProfilePhase::PostUpdate:      return "post_update";
+                case ProfilePhase::Activate:        return "activate";
+                case ProfilePhase::Deactivate:      return "deactivate";
+                case ProfilePhase::TreeUpdate:      return "state_update";
+                case ProfilePhase::TreePostUpdate:  return "state_post_update";
+                case ProfilePhase::Transition:      return "transition";
+                case ProfilePhase::TreeFixedUpdate: return "state_fixed_update";
+            }
+
+            return "unknown";
+        }
+
+        TraceWriter::TraceWriter()
+        : m_file(nullptr)
+        , m_origin(0)
+        , m_firstEvent(true)
+        {
+            //
+        }
+
+        TraceWriter::~TraceWriter() {
+            close();
+        }
+
+        //! \brief Creates a trace file, any previously open trace is closed.
+        //! \param path [in] -
+        //!        Path to the file the trace is written to.
+        //! \return <em>True</em> if the file was created successfully otherwise <em>false</em>.
+        bool TraceWriter::open(const char *path) {
+            close();
+
+            if (!path) {
+                return false;
+            }
+
+            m_file = fopen(path, "w");
+            if (!m_file) {
+                return false;
+            }
+
+            m_buffer.resize(kFileBufferSize);
+            setvbuf(m_file, m_buffer.data(), _IOFBF, m_buffer.size());
+
+            m_origin = SystemProfiler::now();
+            m_firstEvent = true;
+            m_threadList.clear();
+
+            fprintf(m_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+            return true;
+        }
+
+        //! \brief Writes any outstanding samples and completes the trace file.
+        void TraceWriter::close() {
+            if (!m_file) {
+                return;
+            }
+
+            flush();
+
+            fprintf(m_file, "\n]}\n");
+            fclose(m_file);
+
+            m_file = nullptr;
+        }
+
+        //! \brief Associates a readable name with the hash of a game system or state.
+        //! \param hash [in] -
+        //!        The hash of the game system, or identifier of the state.
+        //! \param name [in] -
+        //!        The name displayed for events referencing the hash.
+        void TraceWriter::setName(uint64_t hash, const char *name) {
+            m_nameMap[hash] = name ? name : "";
+        }
+
+        //! \brief Collects the samples recorded since the previous flush and writes them to the trace.
+        //! \return The number of events written.
+        size_t TraceWriter::flush() {
+            m_sampleList.clear();
+            SystemProfiler::collect(m_sampleList);
+
+            return write(m_sampleList.data(), m_sampleList.size());
+        }
+
+        //! \brief Writes a list of samples to the trace.
+        //! \param samples [in] -
+        //!        The samples to be written.
+        //! \param count [in] -
+        //!        The number of samples within the list.
+        //! \return The number of events written.
+        size_t TraceWriter::write(const ProfileSample *samples, size_t count) {
+            if (!m_file) {
+                return 0;
+            }
+
+            for (size_t loop = 0; loop < count; ++loop) {
+                const ProfileSample &sample = samples[loop];
+
+                writeThread(sample.thread);
+
+                // Times are written in microseconds, as expected by the trace event format
+                const double start = (double(int64_t(sample.start - m_origin))) / 1000.0;
+                const double duration = double(sample.duration) / 1000.0;
+
+                fprintf(m_file, "%s\n{\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"cat\":\"%s\",\"name\":",
+                        m_firstEvent ? "" : ",", sample.thread, start, duration, getCategory(sample.phase));
+
+                writeName(sample.hash);
+
+                if (ProfilePhase::Transition == sample.phase) {
+                    fprintf(m_file, ",\"args\":{\"to\":");
+                    writeName(sample.hash);
+                    fprintf(m_file, ",\"from\":");
+                    writeName(sample.source);
+                    fprintf(m_file, ",\"ancestor\":");
+                    writeName(sample.ancestor);
+                    fprintf(m_file, "}}");
+                } else {
+                    fprintf(m_file, ",\"args\":{\"hash\":\"0x%016" PRIx64 "\"}}", sample.hash);
+                }
+
+                m_firstEvent = false;
+            }
+
+            return count;
+        }
+
+        //! \brief Writes the name associated with a hash as a JSON string, the hash is used if no name is known.
+        void TraceWriter::writeName(uint64_t hash) {
+            auto name = m_nameMap.find(hash);
+
+            if (name == m_nameMap.end()) {
+                fprintf(m_file, "\"0x%016" PRIx64 "\"", hash);
+                return;
+            }
+
+            fputc('"', m_file);
+
+            for (char character : name->second) {
+                if (character == '"' || character == '\\') {
+                    fputc('\\', m_file);
+                    fputc(character, m_file);
+                } else if (static_cast<unsigned char>(character) < 0x20) {
+                    fprintf(m_file, "\\u%04x", static_cast<unsigned int>(static_cast<unsigned char>(character)));
+                } else {
+                    fputc(character, m_file);
+                }
+            }
+
+            fputc('"', m_file);
+        }
+
+        //! \brief Writes the metadata event naming a thread, the first time the thread is seen.
+        void TraceWriter::writeThread(uint32_t thread) {
+            if (thread < m_threadList.size() && m_threadList[thread]) {
+                return;
+            }
+
+            if (thread >= m_threadList.size()) {
+                m_threadList.resize(thread + 1, false);
+            }
+
+            m_threadList[thread] = true;
+
+            fprintf(m_file, "%s\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"Thread %u\"}}",
+                    m_firstEvent ? "" : ",", thread, thread);
+
+            m_firstEvent = false;
+        }
+    }
+}
@@ -14,7 +14,13 @@
 // limitations under the License.
 //
 
+#include <vector>
+
+#include <game_system/game_system.h>
+#include "state_tree_builder.h"
+#include "state_tree.h"
 #include "game_state.h"
+#include "test_game_system.h"
 #include "gtest/gtest.h"
 
 TEST(GameState, Construction) {
@@ -50,3 +56,120 @@ TEST(GameState, onUpdate) {
     ngen::StateSystem::GameState gameState;
 
 }
+
+TEST(GameState, BranchUpdateOrder) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPostUpdateGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t middle = builder.addState("middle", root);
+    const size_t leaf = builder.addState("leaf", middle);
+
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.addSystem(middle, "TestPostUpdateGameSystem");
+    builder.addSystem(middle, "TestUpdateGameSystem");
+    builder.addSystem(leaf, "TestUpdateGameSystem");
+    builder.addSystem(leaf, "TestPostUpdateGameSystem");
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::StateSystem::GameState *rootState = stateTree.getState(root);
+    ngen::StateSystem::GameState *middleState = stateTree.getState(middle);
+    ngen::StateSystem::GameState *leafState = stateTree.getState(leaf);
+
+    EXPECT_EQ(3, leafState->getBranchUpdateCount());
+    EXPECT_EQ(2, leafState->getBranchPostUpdateCount());
+
+    const ngen::GameSystemHash::Type updateHash = ngen::GameSystemHash::compute("TestUpdateGameSystem");
+    const ngen::GameSystemHash::Type postUpdateHash = ngen::GameSystemHash::compute("TestPostUpdateGameSystem");
+
+    TestUpdateArgs updateArgs;
+
+    TestUpdateGameSystem::updateOrder.clear();
+    TestPostUpdateGameSystem::postUpdateOrder.clear();
+
+    leafState->onUpdate(updateArgs);
+    leafState->onPostUpdate(updateArgs);
+
+    // Systems must be updated from the root of the branch down to the leaf
+    ASSERT_EQ(3, TestUpdateGameSystem::updateOrder.size());
+    EXPECT_EQ(rootState->getSystem(updateHash), TestUpdateGameSystem::updateOrder[0]);
+    EXPECT_EQ(middleState->getSystem(updateHash), TestUpdateGameSystem::updateOrder[1]);
+    EXPECT_EQ(leafState->getSystem(updateHash), TestUpdateGameSystem::updateOrder[2]);
+
+    ASSERT_EQ(2, TestPostUpdateGameSystem::postUpdateOrder.size());
+    EXPECT_EQ(middleState->getSystem(postUpdateHash), TestPostUpdateGameSystem::postUpdateOrder[0]);
+    EXPECT_EQ(leafState->getSystem(postUpdateHash), TestPostUpdateGameSystem::postUpdateOrder[1]);
+}
+
+TEST(GameState, findHash) {
+    std::vector<ngen::GameSystemHash::Type> hashList;
+    for (ngen::GameSystemHash::Type loop = 0; loop < 11; ++loop) {
+        hashList.push_back(0x0123456700000000ull + loop);
+    }
+
+    // Every position must be found, including those handled after the vectorized loop
+    for (size_t count = 0; count <= hashList.size(); ++count) {
+        for (size_t loop = 0; loop < count; ++loop) {
+            EXPECT_EQ(loop, ngen::StateSystem::GameState::findHash(hashList.data(), count, hashList[loop]));
+        }
+
+        EXPECT_EQ(count, ngen::StateSystem::GameState::findHash(hashList.data(), count, 0x0123456800000000ull));
+    }
+
+    // Only one half of the value matching must not be reported as a match
+    EXPECT_EQ(hashList.size(), ngen::StateSystem::GameState::findHash(hashList.data(), hashList.size(), 0x0000000000000003ull));
+    EXPECT_EQ(hashList.size(), ngen::StateSystem::GameState::findHash(hashList.data(), hashList.size(), 0x0123456700000020ull));
+}
+
+TEST(GameState, TypedSystemLookup) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPostUpdateGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t middle = builder.addState("middle", root);
+    const size_t leaf = builder.addState("leaf", middle);
+    const size_t other = builder.addState("other", root);
+
+    builder.addSystem(root, "TestGameSystem");
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.addSystem(middle, "TestUpdateGameSystem");
+    builder.addSystem(leaf, "TestPostUpdateGameSystem");
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::StateSystem::GameState *rootState = stateTree.getState(root);
+    ngen::StateSystem::GameState *middleState = stateTree.getState(middle);
+    ngen::StateSystem::GameState *leafState = stateTree.getState(leaf);
+    ngen::StateSystem::GameState *otherState = stateTree.getState(other);
+
+    // The leaf table resolves to the deepest system of each type, as the per-level scan does
+    EXPECT_EQ(rootState->getSystemInstance(0)->gameSystem, leafState->getSystem<TestGameSystem>());
+    EXPECT_EQ(middleState->getSystemInstance(0)->gameSystem, leafState->getSystem<TestUpdateGameSystem>());
+    EXPECT_EQ(middleState->getSystemInstance(0)->gameSystem, middleState->getSystem<TestUpdateGameSystem>());
+    EXPECT_EQ(rootState->getSystemInstance(1)->gameSystem, otherState->getSystem<TestUpdateGameSystem>());
+    EXPECT_EQ(leafState->getSystemInstance(0)->gameSystem, leafState->getSystem<TestPostUpdateGameSystem>());
+    EXPECT_EQ(nullptr, otherState->getSystem<TestPostUpdateGameSystem>());
+    EXPECT_EQ(nullptr, leafState->getSystem(ngen::GameSystemHash::compute("MissingSystem")));
+
+    ngen::StateSystem::CachedSystem<TestUpdateGameSystem> cache;
+    EXPECT_EQ(leafState->getSystem<TestUpdateGameSystem>(), cache.get(leafState));
+    EXPECT_EQ(leafState->getSystem<TestUpdateGameSystem>(), cache.get(leafState));
+    EXPECT_EQ(otherState->getSystem<TestUpdateGameSystem>(), cache.get(otherState));
+    EXPECT_EQ(nullptr, cache.get(nullptr));
+}
@@ -5,6 +5,11 @@ NGEN_IMPLEMENT_GAME_SYSTEM(TestGameSystem)
 NGEN_IMPLEMENT_GAME_SYSTEM(TestUpdateGameSystem)
 NGEN_IMPLEMENT_GAME_SYSTEM(TestPostUpdateGameSystem)
 
+std::vector<const TestGameSystem*> TestGameSystem::activateOrder;
+std::vector<const TestGameSystem*> TestGameSystem::deactivateOrder;
+std::vector<const TestUpdateGameSystem*> TestUpdateGameSystem::updateOrder;
+std::vector<const TestPostUpdateGameSystem*> TestPostUpdateGameSystem::postUpdateOrder;
+
 TestGameSystem::TestGameSystem() {
     //
 }
@@ -21,10 +26,12 @@ void TestGameSystem::onInitialize(const ngen::InitArgs &initArgs) {
 }
 
 void TestGameSystem::onActivate() {
+    activateOrder.push_back(this);
 
 }
 
 void TestGameSystem::onDeactivate() {
+    deactivateOrder.push_back(this);
 
 }
 
@@ -52,6 +59,7 @@ void TestUpdateGameSystem::onDeactivate() {
 }
 
 void TestUpdateGameSystem::onUpdate(const ngen::UpdateArgs &updateArgs) {
+    updateOrder.push_back(this);
 
 }
 
@@ -79,5 +87,6 @@ void TestPostUpdateGameSystem::onDeactivate() {
 }
 
 void TestPostUpdateGameSystem::onPostUpdate(const ngen::UpdateArgs &updateArgs) {
+    postUpdateOrder.push_back(this);
 
 }
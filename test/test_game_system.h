@@ -4,7 +4,21 @@
 #ifndef TEST_GAME_SYSTEM
 #define TEST_GAME_SYSTEM
 
+#include <vector>
+
 #include <game_system/game_system.h>
+#include <core/update_args.h>
+
+// UpdateArgs implementation used when driving states directly within the tests
+struct TestUpdateArgs : public ngen::UpdateArgs {
+    TestUpdateArgs() {
+        deltaTime = 0.0f;
+    }
+
+    virtual bool requestState(const char *name) const {
+        return false;
+    }
+};
 
 class TestGameSystem : public ngen::IGameSystem {
     NGEN_DECLARE_GAME_SYSTEM(TestGameSystem)
@@ -19,6 +33,10 @@ public:
 
     virtual void onActivate();
     virtual void onDeactivate();
+
+    // Records the order in which instances were activated and deactivated
+    static std::vector<const TestGameSystem*> activateOrder;
+    static std::vector<const TestGameSystem*> deactivateOrder;
 };
 
 class TestUpdateGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem {
@@ -37,6 +55,9 @@ public:
 
     // IUpdateGameSystem methods
     virtual void onUpdate(const ngen::UpdateArgs &updateArgs);
+
+    // Records the order in which instances received their onUpdate call
+    static std::vector<const TestUpdateGameSystem*> updateOrder;
 };
 
 class TestPostUpdateGameSystem : public ngen::IGameSystem, public ngen::IPostUpdateGameSystem {
@@ -55,6 +76,9 @@ public:
 
     // IPostUpdateGameSystem methods
     virtual void onPostUpdate(const ngen::UpdateArgs &updateArgs);
+
+    // Records the order in which instances received their onPostUpdate call
+    static std::vector<const TestPostUpdateGameSystem*> postUpdateOrder;
 };
 
 #endif //ndef TEST_GAME_SYSTEM
@@ -102,3 +102,145 @@ TEST(GameSystemFactory, PostUpdateCreation) {
     EXPECT_NE(nullptr, instance.postUpdateSystem);
     EXPECT_NE(nullptr, instance.creator);
 }
+
+// This test ensures the factory reports the memory requirements of registered game systems.
+TEST(GameSystemFactory, InstanceLayout) {
+    ngen::GameSystemFactory factory;
+
+    size_t size = 0;
+    size_t alignment = 0;
+
+    EXPECT_FALSE(factory.getInstanceLayout(kTestUpdateHashValue, size, alignment));
+
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+
+    EXPECT_TRUE(factory.getInstanceLayout(kTestUpdateHashValue, size, alignment));
+    EXPECT_EQ(sizeof(TestUpdateGameSystem), size);
+    EXPECT_EQ(alignof(TestUpdateGameSystem), alignment);
+}
+
+// This test ensures instances may be created from a memory pool supplied by the caller.
+TEST(GameSystemFactory, PoolCreation) {
+    ngen::GameSystemFactory factory;
+    ngen::GameSystemInstance instance;
+    ngen::HeapMemoryPool memory;
+
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+
+    EXPECT_TRUE(factory.createInstance(memory, instance, kTestUpdateHashValue));
+    EXPECT_NE(nullptr, instance.gameSystem);
+    EXPECT_NE(nullptr, instance.updateSystem);
+
+    factory.deleteInstance(memory, instance);
+    EXPECT_EQ(nullptr, instance.gameSystem);
+    EXPECT_EQ(nullptr, instance.updateSystem);
+}
+
+// Game system that may be recycled by the factory, counting how many times it has been constructed and reset.
+class TestRecycledGameSystem : public ngen::IGameSystem, public ngen::IRecyclableGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestRecycledGameSystem)
+
+public:
+    TestRecycledGameSystem() : value(0) { constructCount++; }
+
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onReset() {
+        value = 0;
+        resetCount++;
+    }
+
+    int value;
+
+    static size_t constructCount;
+    static size_t resetCount;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestRecycledGameSystem)
+
+size_t TestRecycledGameSystem::constructCount = 0;
+size_t TestRecycledGameSystem::resetCount = 0;
+
+// This test ensures deleted instances of a recycled system are handed out again without being reconstructed.
+TEST(GameSystemFactory, Recycling) {
+    const ngen::GameSystemHash::Type hash = ngen::GameSystemHash::compute("TestRecycledGameSystem");
+
+    ngen::GameSystemFactory factory;
+    ngen::HeapMemoryPool memory;
+
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestRecycledGameSystem);
+
+    // Only systems implementing IRecyclableGameSystem may be recycled
+    EXPECT_FALSE(factory.setRecycleLimit(kTestHashValue, 4));
+    EXPECT_FALSE(factory.setRecycleLimit(kInvalidHashValue, 4));
+    EXPECT_TRUE(factory.setRecycleLimit(hash, 1));
+    EXPECT_TRUE(factory.isRecycled(hash));
+    EXPECT_FALSE(factory.isRecycled(kTestHashValue));
+
+    TestRecycledGameSystem::constructCount = 0;
+    TestRecycledGameSystem::resetCount = 0;
+
+    ngen::GameSystemInstance instanceA;
+    ngen::GameSystemInstance instanceB;
+
+    ASSERT_TRUE(factory.createInstance(memory, instanceA, hash));
+    ASSERT_TRUE(factory.createInstance(memory, instanceB, hash));
+    EXPECT_EQ(2u, TestRecycledGameSystem::constructCount);
+
+    // Recycling may not be disabled while instances exist
+    EXPECT_FALSE(factory.setRecycleLimit(hash, 0));
+
+    ngen::IGameSystem *recycled = instanceA.gameSystem;
+    static_cast<TestRecycledGameSystem*>(recycled)->value = 7;
+
+    factory.deleteInstance(memory, instanceA);
+    factory.deleteInstance(memory, instanceB);
+    EXPECT_EQ(nullptr, instanceA.gameSystem);
+    EXPECT_EQ(nullptr, instanceA.creator);
+    EXPECT_EQ(1u, factory.getRecycledCount(hash));
+    EXPECT_EQ(1u, TestRecycledGameSystem::resetCount);
+
+    ASSERT_TRUE(factory.createInstance(memory, instanceA, hash));
+    EXPECT_EQ(recycled, instanceA.gameSystem);
+    EXPECT_EQ(hash, instanceA.hash);
+    EXPECT_NE(nullptr, instanceA.creator);
+    EXPECT_EQ(0, static_cast<TestRecycledGameSystem*>(instanceA.gameSystem)->value);
+    EXPECT_EQ(2u, TestRecycledGameSystem::constructCount);
+    EXPECT_EQ(0u, factory.getRecycledCount(hash));
+
+    factory.deleteInstance(memory, instanceA);
+    EXPECT_EQ(1u, factory.getRecycledCount(hash));
+
+    factory.releaseRecycled();
+    EXPECT_EQ(0u, factory.getRecycledCount(hash));
+    EXPECT_TRUE(factory.setRecycleLimit(hash, 0));
+}
+
+// This test ensures look-ups remain correct as the table of registered systems grows.
+TEST(GameSystemFactory, ManyRegistrations) {
+    ngen::GameSystemFactory factory;
+
+    for (uint64_t loop = 1; loop <= 100; ++loop) {
+        EXPECT_TRUE(factory.registerClass(&TestUpdateGameSystem::__ngen__creator, loop * 4096));
+    }
+
+    EXPECT_FALSE(factory.registerClass(&TestUpdateGameSystem::__ngen__creator, 4096));
+
+    for (uint64_t loop = 1; loop <= 100; ++loop) {
+        size_t size = 0;
+        size_t alignment = 0;
+
+        EXPECT_TRUE(factory.getInstanceLayout(loop * 4096, size, alignment));
+        EXPECT_EQ(sizeof(TestUpdateGameSystem), size);
+    }
+
+    size_t size = 0;
+    size_t alignment = 0;
+
+    EXPECT_FALSE(factory.getInstanceLayout(4095, size, alignment));
+    EXPECT_FALSE(factory.getInstanceLayout(101 * 4096, size, alignment));
+}
@@ -0,0 +1,410 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "job_scheduler.h"
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+// Game system that may be updated concurrently, each instance records the order it was updated in.
+class TestScheduledGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem, public ngen::IScheduledGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestScheduledGameSystem)
+
+public:
+    TestScheduledGameSystem() : updateIndex(0) {}
+
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+        updateIndex = ++updateCounter;
+    }
+
+    virtual void getDependencies(ngen::GameSystemDependencies &dependencies) const {
+        dependencies.write(ngen::GameSystemHash::compute("shared_resource"));
+    }
+
+    size_t updateIndex;
+
+    static std::atomic<size_t> updateCounter;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestScheduledGameSystem)
+
+std::atomic<size_t> TestScheduledGameSystem::updateCounter(0);
+
+// Game system without dependencies that requests a state change each update, the target depends on creation order.
+class TestRequestGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem, public ngen::IScheduledGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestRequestGameSystem)
+
+public:
+    TestRequestGameSystem() : index(createCounter++) {}
+
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+        // Systems earlier in the branch take longer, so their requests tend to be made last
+        std::this_thread::sleep_for(std::chrono::microseconds(500 * (3 - index % 4)));
+        stateTree->requestState(targets[index]);
+    }
+
+    virtual void getDependencies(ngen::GameSystemDependencies &dependencies) const {}
+
+    size_t index;
+
+    static size_t createCounter;
+    static StateTree *stateTree;
+    static const char *targets[4];
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestRequestGameSystem)
+
+size_t TestRequestGameSystem::createCounter = 0;
+StateTree *TestRequestGameSystem::stateTree = nullptr;
+const char *TestRequestGameSystem::targets[4] = { "c", "d", "c", "b" };
+
+// Game system whose initialization does not depend on any other system.
+class TestIndependentGameSystem : public ngen::IGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestIndependentGameSystem)
+
+public:
+    TestIndependentGameSystem() : state(nullptr) {}
+
+    virtual void onDestroy() {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {
+        state = initArgs.gameState;
+        initializeCounter++;
+    }
+
+    const GameState *state;
+
+    static std::atomic<size_t> initializeCounter;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestIndependentGameSystem)
+
+std::atomic<size_t> TestIndependentGameSystem::initializeCounter(0);
+
+// Game system that records how many independent systems had been initialized before itself.
+class TestDependentGameSystem : public ngen::IGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestDependentGameSystem)
+
+public:
+    TestDependentGameSystem() : independentCount(0) {}
+
+    virtual void onDestroy() {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {
+        independentCount = TestIndependentGameSystem::initializeCounter;
+    }
+
+    size_t independentCount;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestDependentGameSystem)
+
+static void countJob(void *context, size_t job) {
+    static_cast<std::atomic<size_t>*>(context)[job]++;
+}
+
+struct OrderContext {
+    std::atomic<size_t> counter;
+    size_t order[4];
+};
+
+static void orderJob(void *context, size_t job) {
+    OrderContext &order = *static_cast<OrderContext*>(context);
+    order.order[job] = order.counter++;
+}
+
+TEST(JobGraph, Successors) {
+    JobGraph graph;
+
+    graph.reset(3);
+    graph.addEdge(0, 1);
+    graph.addEdge(0, 2);
+    graph.addEdge(1, 2);
+    graph.addEdge(2, 2);        // Self references are ignored
+    graph.addEdge(0, 5);        // Out of range edges are ignored
+    graph.finalize();
+
+    EXPECT_EQ(3, graph.getJobCount());
+    EXPECT_EQ(3, graph.getEdgeCount());
+    EXPECT_EQ(0, graph.getDependencyCount(0));
+    EXPECT_EQ(1, graph.getDependencyCount(1));
+    EXPECT_EQ(2, graph.getDependencyCount(2));
+
+    size_t count;
+    const uint32_t *successors = graph.getSuccessors(0, count);
+    ASSERT_EQ(2, count);
+    EXPECT_EQ(1, successors[0]);
+    EXPECT_EQ(2, successors[1]);
+
+    graph.getSuccessors(2, count);
+    EXPECT_EQ(0, count);
+}
+
+TEST(JobScheduler, ExecuteIndependent) {
+    static const size_t kJobCount = 256;
+
+    JobGraph graph;
+    graph.reset(kJobCount);
+    graph.finalize();
+
+    std::atomic<size_t> counters[kJobCount];
+    for (auto &counter : counters) {
+        counter = 0;
+    }
+
+    JobScheduler scheduler(4);
+    EXPECT_EQ(4, scheduler.getWorkerCount());
+
+    for (size_t loop = 0; loop < 16; ++loop) {
+        scheduler.execute(graph, &countJob, counters);
+    }
+
+    for (auto &counter : counters) {
+        EXPECT_EQ(16, counter);
+    }
+}
+
+TEST(JobScheduler, ExecuteOrdering) {
+    // Diamond shaped graph, job 3 depends upon 1 and 2 which both depend upon 0
+    JobGraph graph;
+    graph.reset(4);
+    graph.addEdge(0, 1);
+    graph.addEdge(0, 2);
+    graph.addEdge(1, 3);
+    graph.addEdge(2, 3);
+    graph.finalize();
+
+    JobScheduler scheduler(3);
+
+    for (size_t loop = 0; loop < 64; ++loop) {
+        OrderContext context;
+        context.counter = 0;
+
+        scheduler.execute(graph, &orderJob, &context);
+
+        EXPECT_EQ(0, context.order[0]);
+        EXPECT_EQ(3, context.order[3]);
+        EXPECT_LT(context.order[0], context.order[1]);
+        EXPECT_LT(context.order[0], context.order[2]);
+    }
+}
+
+TEST(JobScheduler, ExecuteWithoutWorkers) {
+    JobGraph graph;
+    graph.reset(4);
+    graph.addEdge(3, 0);
+    graph.finalize();
+
+    OrderContext context;
+    context.counter = 0;
+
+    JobScheduler scheduler(0);
+    scheduler.execute(graph, &orderJob, &context);
+
+    EXPECT_EQ(4, context.counter);
+    EXPECT_LT(context.order[3], context.order[0]);
+}
+
+TEST(StateTree, ScheduledUpdate) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestScheduledGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+
+    builder.addSystem(root, "TestScheduledGameSystem");
+    builder.addSystem(root, "TestScheduledGameSystem");
+    builder.addSystem(leaf, "TestUpdateGameSystem");
+    builder.addSystem(leaf, "TestScheduledGameSystem");
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    JobScheduler scheduler(4);
+    stateTree.setScheduler(&scheduler);
+    EXPECT_EQ(&scheduler, stateTree.getScheduler());
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    TestUpdateArgs updateArgs;
+
+    TestScheduledGameSystem::updateCounter = 0;
+    TestUpdateGameSystem::updateOrder.clear();
+
+    stateTree.onUpdate(updateArgs);
+    stateTree.onPostUpdate(updateArgs);
+
+    // The systems all write the same resource, so they must still be processed in branch order
+    const TestScheduledGameSystem *first = static_cast<TestScheduledGameSystem*>(stateTree.getState(root)->getSystemInstance(0)->gameSystem);
+    const TestScheduledGameSystem *second = static_cast<TestScheduledGameSystem*>(stateTree.getState(root)->getSystemInstance(1)->gameSystem);
+    const TestScheduledGameSystem *last = static_cast<TestScheduledGameSystem*>(stateTree.getState(leaf)->getSystemInstance(1)->gameSystem);
+
+    EXPECT_EQ(3, TestScheduledGameSystem::updateCounter);
+    EXPECT_EQ(1, first->updateIndex);
+    EXPECT_EQ(2, second->updateIndex);
+    EXPECT_EQ(3, last->updateIndex);
+    EXPECT_EQ(1, TestUpdateGameSystem::updateOrder.size());
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, ScheduledInitialize) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM_INDEPENDENT(factory, TestIndependentGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestDependentGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+    const size_t other = builder.addState("other", root);
+
+    for (size_t state : { root, leaf, other }) {
+        builder.addSystem(state, "TestDependentGameSystem");
+        builder.addSystem(state, "TestIndependentGameSystem");
+        builder.addSystem(state, "TestIndependentGameSystem");
+    }
+
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    JobScheduler scheduler(4);
+    stateTree.setScheduler(&scheduler);
+
+    TestIndependentGameSystem::initializeCounter = 0;
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    // Independent systems are initialized on the scheduler before the remaining systems
+    EXPECT_EQ(6, TestIndependentGameSystem::initializeCounter);
+
+    for (size_t state : { root, leaf, other }) {
+        const GameState *gameState = stateTree.getState(state);
+
+        EXPECT_EQ(6, static_cast<TestDependentGameSystem*>(gameState->getSystemInstance(0)->gameSystem)->independentCount);
+        EXPECT_EQ(gameState, static_cast<TestIndependentGameSystem*>(gameState->getSystemInstance(1)->gameSystem)->state);
+        EXPECT_EQ(gameState, static_cast<TestIndependentGameSystem*>(gameState->getSystemInstance(2)->gameSystem)->state);
+    }
+
+    stateTree.onDestroy();
+
+    // Deferred initialization also initializes the independent systems of each branch on the scheduler
+    TestIndependentGameSystem::initializeCounter = 0;
+
+    stateTree.setDeferredInitialize(true);
+    stateTree.onInitialize(initArgs);
+
+    TestUpdateArgs updateArgs;
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(4, TestIndependentGameSystem::initializeCounter);
+    EXPECT_EQ(4, static_cast<TestDependentGameSystem*>(stateTree.getState(leaf)->getSystemInstance(0)->gameSystem)->independentCount);
+
+    stateTree.onDestroy();
+
+    // The setting belongs to the registration, another factory initializes the same type in order
+    ngen::GameSystemFactory otherFactory;
+    NGEN_REGISTER_GAME_SYSTEM(otherFactory, TestIndependentGameSystem);
+    EXPECT_FALSE(otherFactory.getIndependentInitialize(TestIndependentGameSystem::__ngen__hash()));
+    EXPECT_TRUE(factory.getIndependentInitialize(TestIndependentGameSystem::__ngen__hash()));
+}
+
+TEST(StateTree, ScheduledRequestOrder) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestRequestGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("a", root);
+    builder.addState("b", root);
+    builder.addState("c", root);
+    builder.addState("d", root);
+
+    for (size_t loop = 0; loop < 4; ++loop) {
+        builder.addSystem(root, "TestRequestGameSystem");
+    }
+
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    TestRequestGameSystem::createCounter = 0;
+    TestRequestGameSystem::stateTree = &stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    JobScheduler scheduler(4);
+    stateTree.setScheduler(&scheduler);
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    TestUpdateArgs updateArgs;
+
+    // The systems run concurrently, but the request of the last system in the branch must always win
+    for (size_t loop = 0; loop < 10; ++loop) {
+        ASSERT_TRUE(stateTree.requestState("a"));
+        stateTree.commitStateChange();
+        ASSERT_EQ(stateTree.findState("a"), stateTree.getActiveState());
+
+        stateTree.onUpdate(updateArgs);
+        ASSERT_EQ(stateTree.findState("b"), stateTree.getActiveState());
+    }
+
+    stateTree.onDestroy();
+    TestRequestGameSystem::stateTree = nullptr;
+}
@@ -0,0 +1,107 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <vector>
+
+#include <game_system/game_system.h>
+#include "memory_arena.h"
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+TEST(MemoryArena, Construction) {
+    MemoryArena arena;
+
+    EXPECT_EQ(0, arena.getCapacity());
+    EXPECT_EQ(0, arena.getUsed());
+    EXPECT_EQ(nullptr, arena.allocate(1, 1));
+}
+
+TEST(MemoryArena, Allocate) {
+    MemoryArena arena;
+    ASSERT_TRUE(arena.reserve(256));
+
+    EXPECT_EQ(256, arena.getCapacity());
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(arena.allocate(1, 1)) % MemoryArena::kBlockAlignment);
+
+    void *aligned = arena.allocate(16, 32);
+    ASSERT_NE(nullptr, aligned);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(aligned) % 32);
+    EXPECT_EQ(48, arena.getUsed());
+    EXPECT_TRUE(arena.contains(aligned));
+
+    // The arena must refuse allocations that exceed its capacity
+    EXPECT_EQ(nullptr, arena.allocate(256, 1));
+    EXPECT_NE(nullptr, arena.allocate(208, 1));
+    EXPECT_EQ(nullptr, arena.allocate(1, 1));
+
+    arena.reset();
+    EXPECT_EQ(0, arena.getCapacity());
+    EXPECT_FALSE(arena.contains(aligned));
+}
+
+TEST(MemoryArena, alignSize) {
+    EXPECT_EQ(0, MemoryArena::alignSize(0, 8));
+    EXPECT_EQ(8, MemoryArena::alignSize(1, 8));
+    EXPECT_EQ(8, MemoryArena::alignSize(8, 8));
+    EXPECT_EQ(64, MemoryArena::alignSize(33, 64));
+}
+
+TEST(StateTree, SystemMemory) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPostUpdateGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+
+    builder.addSystem(root, "TestGameSystem");
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.addSystem(leaf, "TestPostUpdateGameSystem");
+    builder.addSystem(leaf, "TestUpdateGameSystem");
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    const MemoryArena &memory = stateTree.getSystemMemory();
+    EXPECT_EQ(memory.getCapacity(), memory.getUsed());
+
+    // Every system lives within the arena, laid out in root to leaf order
+    const void *previous = nullptr;
+    for (size_t state = 0; state < stateTree.getStateCount(); ++state) {
+        for (size_t loop = 0; loop < stateTree.getState(state)->getSystemCount(); ++loop) {
+            const void *system = stateTree.getState(state)->getSystemInstance(loop)->gameSystem;
+
+            EXPECT_TRUE(memory.contains(system));
+            EXPECT_LT(previous, system);
+
+            previous = system;
+        }
+    }
+
+    stateTree.unload();
+    EXPECT_EQ(0, stateTree.getSystemMemory().getCapacity());
+}
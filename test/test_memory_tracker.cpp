@@ -0,0 +1,226 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "memory_tracker.h"
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+// Game system that allocates a block when initialized and another while it is active.
+class TestAllocGameSystem : public ngen::IGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestAllocGameSystem)
+
+public:
+    TestAllocGameSystem() : memory(nullptr), initBlock(nullptr), activeBlock(nullptr), activeFailed(false) {}
+
+    virtual void onDestroy() {
+        memory->release(initBlock);
+        initBlock = nullptr;
+    }
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {
+        memory = initArgs.memory;
+        initBlock = memory->allocate(initSize, 16);
+    }
+
+    virtual void onActivate() {
+        activeBlock = memory->allocate(activeSize, 64);
+        activeFailed = !activeBlock;
+    }
+
+    virtual void onDeactivate() {
+        memory->release(activeBlock);
+        activeBlock = nullptr;
+    }
+
+    ngen::MemoryPool *memory;
+    void *initBlock;
+    void *activeBlock;
+    bool activeFailed;
+
+    static size_t initSize;
+    static size_t activeSize;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestAllocGameSystem)
+
+size_t TestAllocGameSystem::initSize = 100;
+size_t TestAllocGameSystem::activeSize = 1000;
+
+// Records each state passed to the budget handler.
+static void onBudgetExceeded(void *context, const GameState *state, const MemoryUsage &usage, size_t budget) {
+    static_cast<std::vector<const GameState*>*>(context)->push_back(state);
+}
+
+TEST(MemoryTracker, Accounts) {
+    StateMemoryAccount root;
+    StateMemoryAccount child;
+    child.bind(&root);
+
+    ngen::HeapMemoryPool heap;
+    TrackedMemoryPool pool;
+    pool.bind(&heap, &child);
+
+    void *blockA = pool.allocate(200, 32);
+    void *blockB = pool.allocate(50, 1);
+    ASSERT_NE(nullptr, blockA);
+    ASSERT_NE(nullptr, blockB);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(blockA) % 32);
+
+    EXPECT_EQ(250u, pool.getUsage().used);
+    EXPECT_EQ(2u, pool.getUsage().blockCount);
+    EXPECT_EQ(250u, child.getUsage().used);
+    EXPECT_EQ(250u, root.getUsage().used);
+
+    pool.release(blockA);
+    EXPECT_EQ(50u, pool.getUsage().used);
+    EXPECT_EQ(250u, pool.getUsage().peak);
+    EXPECT_EQ(50u, root.getUsage().used);
+    EXPECT_EQ(250u, root.getUsage().peak);
+    EXPECT_EQ(1u, root.getUsage().blockCount);
+
+    pool.resetPeak();
+    child.resetPeak();
+    root.resetPeak();
+    EXPECT_EQ(50u, pool.getUsage().peak);
+    EXPECT_EQ(50u, root.getUsage().peak);
+
+    // A refused allocation leaves every account as it was
+    root.setBudget(100, MemoryBudgetPolicy::Fail);
+    EXPECT_EQ(nullptr, pool.allocate(60, 1));
+    EXPECT_EQ(1u, pool.getUsage().failedCount);
+    EXPECT_EQ(1u, root.getUsage().failedCount);
+    EXPECT_EQ(50u, child.getUsage().used);
+    EXPECT_EQ(50u, child.getUsage().peak);
+    EXPECT_EQ(1u, child.getUsage().blockCount);
+
+    void *blockC = pool.allocate(50, 1);
+    EXPECT_NE(nullptr, blockC);
+    EXPECT_EQ(100u, root.getUsage().used);
+
+    pool.release(blockB);
+    pool.release(blockC);
+    pool.release(nullptr);
+    EXPECT_EQ(0u, root.getUsage().used);
+    EXPECT_EQ(0u, root.getUsage().blockCount);
+}
+
+TEST(MemoryTracker, StateTree) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestAllocGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t a = builder.addState("a", root);
+    const size_t b = builder.addState("b", root);
+
+    builder.addSystem(root, "TestAllocGameSystem");
+    builder.addSystem(a, "TestAllocGameSystem");
+    builder.addSystem(b, "TestAllocGameSystem");
+    builder.addSystem(b, "TestAllocGameSystem");
+    builder.setDefaultState(a);
+
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> reloadImage;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    GameState *rootState = stateTree.findState("root");
+    GameState *stateA = stateTree.findState("a");
+    GameState *stateB = stateTree.findState("b");
+
+    std::vector<const GameState*> reported;
+    stateTree.setBudgetHandler(&onBudgetExceeded, &reported);
+
+    EXPECT_TRUE(stateTree.setMemoryBudget(stateB, 1500));
+    EXPECT_EQ(1500u, stateTree.getMemoryBudget(stateB));
+    EXPECT_EQ(0u, stateTree.getMemoryBudget(stateA));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    EXPECT_EQ(100u, stateTree.getSystemMemoryUsage(stateA->getSystemInstance(0)).used);
+    EXPECT_EQ(100u, stateTree.getStateMemoryUsage(stateA).used);
+    EXPECT_EQ(200u, stateTree.getStateMemoryUsage(stateB).used);
+    EXPECT_EQ(400u, stateTree.getStateMemoryUsage(rootState).used);
+    EXPECT_TRUE(reported.empty());
+
+    stateTree.commitStateChange();
+    EXPECT_EQ(1100u, stateTree.getStateMemoryUsage(stateA).used);
+    EXPECT_EQ(1000u, stateTree.getSystemMemoryUsage(rootState->getSystemInstance(0)).used - 100u);
+    EXPECT_EQ(2400u, stateTree.getStateMemoryUsage(rootState).used);
+
+    // Entering 'b' activates two systems, exceeding its budget
+    stateTree.requestState(stateB);
+    stateTree.commitStateChange();
+    EXPECT_EQ(2200u, stateTree.getStateMemoryUsage(stateB).used);
+    EXPECT_EQ(3400u, stateTree.getStateMemoryUsage(rootState).peak);
+    ASSERT_EQ(1u, reported.size());
+    EXPECT_EQ(stateB, reported[0]);
+
+    // The state is reported once until the peaks are reset
+    stateTree.requestState(stateA);
+    stateTree.commitStateChange();
+    stateTree.requestState(stateB);
+    stateTree.commitStateChange();
+    EXPECT_EQ(1u, reported.size());
+
+    // Leaving 'b' releases its blocks, after which the peak is lowered to the usage of 'a'
+    stateTree.requestState(stateA);
+    stateTree.commitStateChange();
+    stateTree.resetMemoryPeaks();
+    EXPECT_EQ(2400u, stateTree.getStateMemoryUsage(rootState).peak);
+
+    // With the Fail policy the second system of 'b' is refused its block
+    EXPECT_TRUE(stateTree.setMemoryBudget(stateB, 1500, MemoryBudgetPolicy::Fail));
+    stateTree.requestState(stateB);
+    stateTree.commitStateChange();
+
+    TestAllocGameSystem *first = static_cast<TestAllocGameSystem*>(stateB->getSystemInstance(0)->gameSystem);
+    TestAllocGameSystem *second = static_cast<TestAllocGameSystem*>(stateB->getSystemInstance(1)->gameSystem);
+
+    EXPECT_FALSE(first->activeFailed);
+    EXPECT_TRUE(second->activeFailed);
+    EXPECT_EQ(1200u, stateTree.getStateMemoryUsage(stateB).used);
+    EXPECT_EQ(1u, stateTree.getStateMemoryUsage(stateB).failedCount);
+    EXPECT_EQ(1u, stateTree.getSystemMemoryUsage(stateB->getSystemInstance(1)).failedCount);
+    EXPECT_EQ(2u, reported.size());
+
+    // Reloading the same definition keeps the usage of every system and the budgets
+    ASSERT_TRUE(builder.build(reloadImage));
+    ASSERT_TRUE(stateTree.reload(reloadImage.data(), reloadImage.size()));
+
+    stateB = stateTree.findState("b");
+    EXPECT_EQ(1500u, stateTree.getMemoryBudget(stateB));
+    EXPECT_EQ(1200u, stateTree.getStateMemoryUsage(stateB).used);
+    EXPECT_EQ(2400u, stateTree.getStateMemoryUsage(stateTree.findState("root")).used);
+
+    stateTree.onDestroy();
+    EXPECT_EQ(0u, stateTree.getStateMemoryUsage(stateTree.findState("root")).used);
+    EXPECT_EQ(0u, stateTree.getStateMemoryUsage(stateTree.findState("root")).blockCount);
+}
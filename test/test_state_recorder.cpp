@@ -0,0 +1,173 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "state_recorder.h"
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+// Game system that cycles through the leaf states, requesting the next one every few frames.
+class TestCycleGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestCycleGameSystem)
+
+public:
+    TestCycleGameSystem() : frame(0) {}
+
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {
+        stateTree = initArgs.stateTree;
+    }
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+        static const char *targets[] = { "a", "b", "c" };
+
+        if (0 == ++frame % period) {
+            stateTree->requestState(targets[(frame / period) % 3]);
+        }
+    }
+
+    size_t frame;
+    StateTree *stateTree;
+
+    static size_t period;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestCycleGameSystem)
+
+size_t TestCycleGameSystem::period = 4;
+
+// Loads and initializes a tree containing three leaves, with a cycling system at the root.
+static bool createTree(ngen::GameSystemFactory &factory, std::vector<uint8_t> &image, StateTree &stateTree) {
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t a = builder.addState("a", root);
+    builder.addState("b", root);
+    builder.addState("c", root);
+
+    builder.addSystem(root, "TestCycleGameSystem");
+    builder.setDefaultState(a);
+
+    if (!builder.build(image) || !stateTree.load(factory, image.data(), image.size())) {
+        return false;
+    }
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    return true;
+}
+
+// Drives a tree for a number of frames, the caller of the tree makes a request part way through.
+static void runFrames(StateTree &stateTree) {
+    TestUpdateArgs updateArgs;
+
+    for (size_t frame = 0; frame < 20; ++frame) {
+        updateArgs.deltaTime = 0.01f * (frame + 1);
+
+        if (10 == frame) {
+            stateTree.requestState("c", 1);
+            stateTree.commitStateChange();
+        }
+
+        stateTree.onUpdate(updateArgs);
+        stateTree.onPostUpdate(updateArgs);
+    }
+}
+
+TEST(StateRecorder, RecordReplay) {
+    const std::string path = "test_state_recorder.bin";
+
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestCycleGameSystem);
+
+    std::vector<uint8_t> image;
+    SystemHash finalState;
+
+    {
+        StateTree stateTree;
+        ASSERT_TRUE(createTree(factory, image, stateTree));
+
+        StateRecorder recorder;
+        EXPECT_FALSE(recorder.isOpen());
+        ASSERT_TRUE(recorder.open(path.c_str()));
+        EXPECT_TRUE(recorder.isOpen());
+
+        stateTree.setRecorder(&recorder);
+        EXPECT_EQ(&recorder, stateTree.getRecorder());
+
+        runFrames(stateTree);
+
+        finalState = stateTree.getActiveState()->getId();
+
+        // 40 frames, a commit and an external request, 5 requests made by the system and 6 transitions
+        EXPECT_EQ(40 + 2 + 5 + 6, recorder.getRecordCount());
+
+        stateTree.setRecorder(nullptr);
+        stateTree.onDestroy();
+        recorder.close();
+    }
+
+    StateReplay replay;
+    ASSERT_TRUE(replay.open(path.c_str()));
+    EXPECT_EQ(20, replay.getFrameCount());
+
+    {
+        // A tree driven by the log reaches the same states as the recorded session
+        StateTree stateTree;
+        ASSERT_TRUE(createTree(factory, image, stateTree));
+        ASSERT_TRUE(replay.run(stateTree));
+
+        EXPECT_EQ(0, replay.getDivergenceCount());
+        EXPECT_EQ(finalState, stateTree.getActiveState()->getId());
+
+        stateTree.onDestroy();
+    }
+
+    {
+        // Systems that behave differently from the recorded session are detected
+        TestCycleGameSystem::period = 3;
+
+        StateTree stateTree;
+        ASSERT_TRUE(createTree(factory, image, stateTree));
+        ASSERT_TRUE(replay.run(stateTree));
+
+        EXPECT_LT(0, replay.getDivergenceCount());
+
+        stateTree.onDestroy();
+
+        TestCycleGameSystem::period = 4;
+    }
+
+    std::remove(path.c_str());
+
+    // Truncated logs are rejected
+    const uint8_t truncated[] = { 0x4e, 0x47, 0x52, 0x50, 1, 0, 0, 0, uint8_t(StateRecordType::Request), 0 };
+    EXPECT_FALSE(replay.load(truncated, sizeof(truncated)));
+    EXPECT_FALSE(replay.load(truncated, 4));
+}
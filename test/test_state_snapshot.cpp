@@ -0,0 +1,337 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+
+#include <cstring>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "state_snapshot.h"
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+// Game system that counts its updates and lifetime calls, the update count is kept within snapshots.
+class TestSerialGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem, public ngen::ISerializableGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestSerialGameSystem)
+
+public:
+    TestSerialGameSystem() : updateCount(0), initializeCount(0), activateCount(0), deactivateCount(0), restoreCount(0) {}
+
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) { initializeCount++; }
+    virtual void onActivate() { activateCount++; }
+    virtual void onDeactivate() { deactivateCount++; }
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+        updateCount++;
+    }
+
+    virtual size_t getSnapshotSize() const {
+        return sizeof(updateCount);
+    }
+
+    virtual void onSnapshot(void *data, size_t size) const {
+        memcpy(data, &updateCount, sizeof(updateCount));
+    }
+
+    virtual bool onRestore(const void *data, size_t size) {
+        if (size != sizeof(updateCount)) {
+            return false;
+        }
+
+        memcpy(&updateCount, data, sizeof(updateCount));
+        restoreCount++;
+        return true;
+    }
+
+    uint64_t updateCount;
+    size_t initializeCount;
+    size_t activateCount;
+    size_t deactivateCount;
+    size_t restoreCount;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestSerialGameSystem)
+
+// Loads and initializes a tree with two leaves, a serializable system lives in the root and in leaf 'b'.
+static bool createTree(ngen::GameSystemFactory &factory, std::vector<uint8_t> &image, StateTree &stateTree, bool extraSystem = false, bool deferred = false) {
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t a = builder.addState("a", root);
+    const size_t b = builder.addState("b", root);
+
+    builder.addSystem(root, "TestSerialGameSystem");
+    builder.addSystem(a, "TestGameSystem");
+    builder.addSystem(b, "TestSerialGameSystem");
+
+    if (extraSystem) {
+        builder.addSystem(a, "TestUpdateGameSystem");
+    }
+
+    builder.setDefaultState(a);
+
+    if (!builder.build(image) || !stateTree.load(factory, image.data(), image.size())) {
+        return false;
+    }
+
+    ngen::InitArgs initArgs;
+    stateTree.setDeferredInitialize(deferred);
+    stateTree.onInitialize(initArgs);
+
+    return true;
+}
+
+static void runFrames(StateTree &stateTree, size_t count) {
+    TestUpdateArgs updateArgs;
+    updateArgs.deltaTime = 0.01f;
+
+    for (size_t frame = 0; frame < count; ++frame) {
+        stateTree.onUpdate(updateArgs);
+        stateTree.onPostUpdate(updateArgs);
+    }
+}
+
+TEST(StateSnapshot, SnapshotRestore) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestSerialGameSystem);
+
+    std::vector<uint8_t> image;
+    StateTree stateTree;
+    ASSERT_TRUE(createTree(factory, image, stateTree));
+
+    TestSerialGameSystem *rootSystem = static_cast<TestSerialGameSystem*>(stateTree.findState("root")->getSystemInstance(0)->gameSystem);
+    TestSerialGameSystem *leafSystem = static_cast<TestSerialGameSystem*>(stateTree.findState("b")->getSystemInstance(0)->gameSystem);
+
+    runFrames(stateTree, 3);
+    EXPECT_TRUE(stateTree.requestState("b"));
+    runFrames(stateTree, 2);
+    EXPECT_TRUE(stateTree.requestState("a"));
+
+    EXPECT_EQ(5u, rootSystem->updateCount);
+    EXPECT_EQ(2u, leafSystem->updateCount);
+
+    std::vector<uint8_t> buffer(stateTree.getSnapshotSize());
+    size_t written = 0;
+
+    EXPECT_FALSE(stateTree.snapshot(buffer.data(), buffer.size() - kStateSnapshotAlignment));
+    ASSERT_TRUE(stateTree.snapshot(buffer.data(), buffer.size(), &written));
+    EXPECT_EQ(buffer.size(), written);
+
+    StateSnapshot snapshot;
+    ASSERT_TRUE(snapshot.open(buffer.data(), buffer.size()));
+    EXPECT_EQ(StateTree::computeHash("b"), snapshot.getHeader()->activeState);
+    EXPECT_EQ(StateTree::computeHash("a"), snapshot.getHeader()->pendingState);
+    ASSERT_EQ(stateTree.getSystemCount(), snapshot.getSystemCount());
+    EXPECT_EQ(2 * sizeof(uint64_t), snapshot.getPayloadSize());
+
+    for (size_t loop = 0; loop < snapshot.getSystemCount(); ++loop) {
+        const bool serializable = nullptr != snapshot.getSystemData(loop);
+
+        EXPECT_EQ(serializable ? sizeof(uint64_t) : 0, snapshot.getSystemSize(loop));
+        EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(snapshot.getSystemData(loop)) % kStateSnapshotAlignment);
+    }
+
+    runFrames(stateTree, 4);
+    EXPECT_EQ(stateTree.findState("a"), stateTree.getActiveState());
+    EXPECT_EQ(9u, rootSystem->updateCount);
+
+    EXPECT_EQ(1u, leafSystem->activateCount);
+    EXPECT_EQ(1u, leafSystem->deactivateCount);
+
+    // Only the systems that differ between the branches are activated, the root remains active throughout
+    ASSERT_TRUE(stateTree.restore(buffer.data(), buffer.size()));
+    EXPECT_EQ(stateTree.findState("b"), stateTree.getActiveState());
+    EXPECT_EQ(5u, rootSystem->updateCount);
+    EXPECT_EQ(2u, leafSystem->updateCount);
+    EXPECT_EQ(1u, rootSystem->restoreCount);
+    EXPECT_EQ(1u, rootSystem->activateCount);
+    EXPECT_EQ(0u, rootSystem->deactivateCount);
+    EXPECT_EQ(2u, leafSystem->activateCount);
+    EXPECT_EQ(1u, leafSystem->deactivateCount);
+
+    // Restoring the branch that is already active makes no callbacks
+    ASSERT_TRUE(stateTree.restore(buffer.data(), buffer.size()));
+    EXPECT_EQ(2u, leafSystem->activateCount);
+    EXPECT_EQ(1u, leafSystem->deactivateCount);
+
+    // The pending request captured by the snapshot is committed by the next frame
+    runFrames(stateTree, 1);
+    EXPECT_EQ(stateTree.findState("a"), stateTree.getActiveState());
+    EXPECT_EQ(6u, rootSystem->updateCount);
+    EXPECT_EQ(2u, leafSystem->deactivateCount);
+
+    stateTree.onDestroy();
+}
+
+TEST(StateSnapshot, RestoreFreshTree) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestSerialGameSystem);
+
+    std::vector<uint8_t> imageA;
+    std::vector<uint8_t> imageB;
+    std::vector<uint8_t> buffer;
+
+    {
+        StateTree stateTree;
+        ASSERT_TRUE(createTree(factory, imageA, stateTree));
+
+        runFrames(stateTree, 2);
+        stateTree.requestState("b");
+        runFrames(stateTree, 3);
+
+        buffer.resize(stateTree.getSnapshotSize());
+        ASSERT_TRUE(stateTree.snapshot(buffer.data(), buffer.size()));
+
+        stateTree.onDestroy();
+    }
+
+    // Initialization is deferred, so none of the systems have been initialized before the snapshot is restored
+    StateTree stateTree;
+    ASSERT_TRUE(createTree(factory, imageB, stateTree, false, true));
+
+    TestSerialGameSystem *rootSystem = static_cast<TestSerialGameSystem*>(stateTree.findState("root")->getSystemInstance(0)->gameSystem);
+    TestSerialGameSystem *leafSystem = static_cast<TestSerialGameSystem*>(stateTree.findState("b")->getSystemInstance(0)->gameSystem);
+
+    EXPECT_EQ(0u, rootSystem->initializeCount);
+    EXPECT_EQ(0u, leafSystem->initializeCount);
+
+    ASSERT_TRUE(stateTree.restore(buffer.data(), buffer.size()));
+    EXPECT_EQ(stateTree.findState("b"), stateTree.getActiveState());
+
+    // The states initialized within the snapshot are initialized, then the captured branch is entered
+    EXPECT_EQ(1u, rootSystem->initializeCount);
+    EXPECT_EQ(1u, leafSystem->initializeCount);
+    EXPECT_EQ(5u, rootSystem->updateCount);
+    EXPECT_EQ(3u, leafSystem->updateCount);
+    EXPECT_EQ(1u, rootSystem->activateCount);
+    EXPECT_EQ(1u, leafSystem->activateCount);
+
+    runFrames(stateTree, 1);
+    EXPECT_EQ(stateTree.findState("b"), stateTree.getActiveState());
+    EXPECT_EQ(6u, rootSystem->updateCount);
+    EXPECT_EQ(4u, leafSystem->updateCount);
+
+    stateTree.onDestroy();
+}
+
+TEST(StateSnapshot, UpdateIntervals) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM_INTERVAL(factory, TestUpdateGameSystem, 3);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t a = builder.addState("a", root);
+    const size_t b = builder.addState("b", root);
+
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.setDefaultState(a);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    // The snapshot is taken one frame into the interval, with a request for 'b' pending
+    TestUpdateGameSystem::updateOrder.clear();
+    runFrames(stateTree, 1);
+    EXPECT_TRUE(stateTree.requestState("b"));
+
+    std::vector<uint8_t> buffer(stateTree.getSnapshotSize());
+    ASSERT_TRUE(stateTree.snapshot(buffer.data(), buffer.size()));
+
+    StateSnapshot snapshot;
+    ASSERT_TRUE(snapshot.open(buffer.data(), buffer.size()));
+    ASSERT_EQ(1u, snapshot.getTierCount());
+    EXPECT_EQ(1u, snapshot.getTier(0).counter);
+
+    runFrames(stateTree, 1);
+    EXPECT_EQ(0u, TestUpdateGameSystem::updateOrder.size());
+
+    // Two more frames complete the interval from the point of the snapshot
+    ASSERT_TRUE(stateTree.restore(buffer.data(), buffer.size()));
+    runFrames(stateTree, 1);
+    EXPECT_EQ(0u, TestUpdateGameSystem::updateOrder.size());
+    runFrames(stateTree, 1);
+    EXPECT_EQ(1u, TestUpdateGameSystem::updateOrder.size());
+
+    // The captured request keeps its place, so a later request of equal priority still takes precedence
+    ASSERT_TRUE(stateTree.restore(buffer.data(), buffer.size()));
+    EXPECT_TRUE(stateTree.requestState("a"));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.getState(a), stateTree.getActiveState());
+
+    ASSERT_TRUE(stateTree.restore(buffer.data(), buffer.size()));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.getState(b), stateTree.getActiveState());
+
+    stateTree.onDestroy();
+}
+
+TEST(StateSnapshot, Rejected) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestSerialGameSystem);
+
+    std::vector<uint8_t> imageA;
+    std::vector<uint8_t> imageB;
+
+    StateTree stateTree;
+    std::vector<uint8_t> buffer(256);
+    EXPECT_EQ(0u, stateTree.getSnapshotSize());
+    EXPECT_FALSE(stateTree.snapshot(buffer.data(), buffer.size()));
+
+    ASSERT_TRUE(createTree(factory, imageA, stateTree));
+    runFrames(stateTree, 2);
+
+    buffer.resize(stateTree.getSnapshotSize());
+    ASSERT_TRUE(stateTree.snapshot(buffer.data(), buffer.size()));
+
+    // A tree with a different definition does not accept the snapshot
+    StateTree otherTree;
+    ASSERT_TRUE(createTree(factory, imageB, otherTree, true));
+    EXPECT_FALSE(otherTree.restore(buffer.data(), buffer.size()));
+
+    EXPECT_FALSE(stateTree.restore(buffer.data(), buffer.size() - 1));
+
+    std::vector<uint8_t> corrupt(buffer);
+    reinterpret_cast<StateSnapshotHeader*>(corrupt.data())->magic = 0;
+    EXPECT_FALSE(stateTree.restore(corrupt.data(), corrupt.size()));
+
+    corrupt = buffer;
+    reinterpret_cast<StateSnapshotEntry*>(corrupt.data() + sizeof(StateSnapshotHeader))->offset = buffer.size();
+    reinterpret_cast<StateSnapshotEntry*>(corrupt.data() + sizeof(StateSnapshotHeader))->size = 8;
+    EXPECT_FALSE(stateTree.restore(corrupt.data(), corrupt.size()));
+
+    EXPECT_TRUE(stateTree.restore(buffer.data(), buffer.size()));
+
+    otherTree.onDestroy();
+    stateTree.onDestroy();
+}
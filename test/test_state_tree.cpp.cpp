@@ -14,10 +14,218 @@
 // limitations under the License.
 //
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "state_tree_builder.h"
 #include "state_tree.h"
 #include "game_state.h"
+#include "test_game_system.h"
 #include "gtest/gtest.h"
 
+// Game system whose preparation does not complete until the test allows it to.
+class TestPreparedGameSystem : public ngen::IGameSystem, public ngen::IPreparedGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestPreparedGameSystem)
+
+public:
+    TestPreparedGameSystem() : prepared(false), activatedPrepared(false) {}
+
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onDeactivate() {}
+
+    virtual void onActivate() {
+        activatedPrepared = prepared;
+    }
+
+    virtual void onPrepare() {
+        while (!ready) {
+            std::this_thread::yield();
+        }
+
+        prepared = true;
+    }
+
+    bool prepared;
+    bool activatedPrepared;
+
+    static std::atomic<bool> ready;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestPreparedGameSystem)
+
+std::atomic<bool> TestPreparedGameSystem::ready(true);
+
+// Game system that records the delta time of each update it receives.
+class TestTieredGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestTieredGameSystem)
+
+public:
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+        updates.push_back(updateArgs.deltaTime);
+    }
+
+    std::vector<float> updates;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestTieredGameSystem)
+
+// Game system that records each fixed step along with the interpolation received by each update.
+class TestFixedGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem, public ngen::IFixedUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestFixedGameSystem)
+
+public:
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onFixedUpdate(const ngen::UpdateArgs &updateArgs) {
+        steps.push_back(updateArgs.deltaTime);
+    }
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+        interpolation.push_back(updateArgs.interpolation);
+    }
+
+    std::vector<float> steps;
+    std::vector<float> interpolation;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestFixedGameSystem)
+
+// Game system that records the order in which instances are initialized and destroyed.
+class TestInitGameSystem : public ngen::IGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestInitGameSystem)
+
+public:
+    TestInitGameSystem() : state(nullptr) {}
+
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {
+        state = initArgs.gameState;
+        initOrder.push_back(this);
+    }
+
+    virtual void onDestroy() {
+        destroyOrder.push_back(this);
+    }
+
+    const ngen::StateSystem::GameState *state;
+
+    static std::vector<const TestInitGameSystem*> initOrder;
+    static std::vector<const TestInitGameSystem*> destroyOrder;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestInitGameSystem)
+
+std::vector<const TestInitGameSystem*> TestInitGameSystem::initOrder;
+std::vector<const TestInitGameSystem*> TestInitGameSystem::destroyOrder;
+
+// Game system that counts the lifetime calls it receives, used to observe which systems a reload affects.
+class TestReloadGameSystem : public ngen::IGameSystem, public ngen::IReloadableGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestReloadGameSystem)
+
+public:
+    TestReloadGameSystem() : state(nullptr), initializeCount(0), reloadCount(0), activateCount(0), deactivateCount(0) {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {
+        state = initArgs.gameState;
+        initializeCount++;
+    }
+
+    virtual void onReload(const ngen::InitArgs &initArgs) {
+        state = initArgs.gameState;
+        reloadCount++;
+    }
+
+    virtual void onDestroy() { destroyCount++; }
+    virtual void onActivate() { activateCount++; }
+    virtual void onDeactivate() { deactivateCount++; }
+
+    const ngen::StateSystem::GameState *state;
+    size_t initializeCount;
+    size_t reloadCount;
+    size_t activateCount;
+    size_t deactivateCount;
+
+    static size_t destroyCount;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestReloadGameSystem)
+
+size_t TestReloadGameSystem::destroyCount = 0;
+
+// Game system that may be recycled by the factory between trees.
+class TestPooledGameSystem : public ngen::IGameSystem, public ngen::IRecyclableGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestPooledGameSystem)
+
+public:
+    TestPooledGameSystem() : initialized(false) {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) { initialized = true; }
+    virtual void onDestroy() {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+    virtual void onReset() { initialized = false; }
+
+    bool initialized;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestPooledGameSystem)
+
+// Game system whose activation callbacks take longer than the transition budget used by the tests.
+class TestSlowGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestSlowGameSystem)
+
+public:
+    TestSlowGameSystem() : updateCount(0) {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onDestroy() {}
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) { updateCount++; }
+
+    virtual void onActivate() {
+        wait();
+        callList.push_back(std::make_pair(this, true));
+    }
+
+    virtual void onDeactivate() {
+        wait();
+        callList.push_back(std::make_pair(this, false));
+    }
+
+    static void wait() {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(200);
+
+        while (std::chrono::steady_clock::now() < end) {
+            //
+        }
+    }
+
+    size_t updateCount;
+
+    // Each activation (true) and deactivation (false) in the order they were received
+    static std::vector<std::pair<const TestSlowGameSystem*, bool>> callList;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestSlowGameSystem)
+
+std::vector<std::pair<const TestSlowGameSystem*, bool>> TestSlowGameSystem::callList;
+
 TEST(StateTree, Construction) {
     ngen::StateSystem::StateTree stateTree;
 
@@ -25,6 +233,56 @@ TEST(StateTree, Construction) {
     EXPECT_EQ(0, stateTree.getSystemCount());
 }
 
+TEST(StateTree, findState) {
+    static const size_t kStateCount = 2000;
+
+    ngen::GameSystemFactory factory;
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    for (size_t loop = 1; loop < kStateCount; ++loop) {
+        builder.addState(("state_" + std::to_string(loop)).c_str(), root);
+    }
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    EXPECT_EQ(nullptr, stateTree.findState("root"));
+
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    EXPECT_EQ(stateTree.getState(0), stateTree.findState("root"));
+    EXPECT_EQ(nullptr, stateTree.findState("missing"));
+    EXPECT_EQ(nullptr, stateTree.findState(static_cast<const char*>(nullptr)));
+
+    for (size_t loop = 1; loop < kStateCount; ++loop) {
+        const std::string name = "state_" + std::to_string(loop);
+        const ngen::StateSystem::SystemHash hash = ngen::StateSystem::StateTree::computeHash(name.c_str());
+
+        EXPECT_EQ(stateTree.getState(loop), stateTree.findState(name.c_str()));
+        EXPECT_EQ(stateTree.getState(loop), stateTree.findState(hash));
+    }
+}
+
+TEST(StateTree, findStateDuplicate) {
+    ngen::GameSystemFactory factory;
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    builder.addState("first");
+    builder.addState("duplicate");
+    builder.addState("duplicate");
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    // The first state with a matching identifier should be returned
+    EXPECT_EQ(stateTree.getState(1), stateTree.findState("duplicate"));
+}
+
 TEST(StateTree, findCommonAncestor) {
     ngen::StateSystem::GameState stateA;
 
@@ -69,3 +327,1011 @@ TEST(StateTree, computeHash) {
         }
     }
 }
+
+TEST(StateTree, constexprHash) {
+    using namespace ngen::literals;
+
+    // The hash must be usable as a compile time constant and produce the same values as the runtime path
+    static_assert("main_state"_state != 0, "State literal should be a compile time constant");
+    static_assert(ngen::StateSystem::StateTree::computeHash("") == 0, "Empty names should hash to 0");
+
+    constexpr ngen::StateSystem::SystemHash mainState = "main_state"_state;
+    constexpr ngen::GameSystemHash::Type testSystem = "TestGameSystem"_system;
+
+    const char *runtimeName = "main_state";
+    EXPECT_EQ(ngen::StateSystem::StateTree::computeHash(runtimeName), mainState);
+    EXPECT_EQ(ngen::GameSystemHash::compute(std::string("TestGameSystem").c_str()), testSystem);
+
+    // Characters outside of the ASCII range must hash identically at compile time and runtime
+    constexpr ngen::StateSystem::SystemHash extended = "\xe9tat"_state;
+    EXPECT_EQ(ngen::StateSystem::StateTree::computeHash(std::string("\xe9tat").c_str()), extended);
+
+    static constexpr ngen::GameSystemHash::Type kUniqueSet[] = { "ExampleA"_system, "ExampleB"_system, "ExampleC"_system };
+    static constexpr ngen::GameSystemHash::Type kCollidingSet[] = { "ExampleA"_system, "ExampleB"_system, "ExampleA"_system };
+
+    static_assert(ngen::GameSystemHash::isUnique(kUniqueSet), "Hash set should not contain collisions");
+    static_assert(!ngen::GameSystemHash::isUnique(kCollidingSet), "Hash set should contain a collision");
+}
+
+TEST(StateTree, requestState) {
+    using namespace ngen::literals;
+
+    ngen::GameSystemFactory factory;
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    builder.addState("menu", root);
+    builder.addState("game", root);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    // Only leaf states may become active
+    EXPECT_FALSE(stateTree.requestState("root"));
+    EXPECT_FALSE(stateTree.requestState("missing"));
+    EXPECT_FALSE(stateTree.requestState(nullptr));
+    EXPECT_FALSE(stateTree.requestState(static_cast<ngen::StateSystem::GameState*>(nullptr)));
+
+    EXPECT_TRUE(stateTree.requestStateId("menu"_state));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("menu"), stateTree.getActiveState());
+
+    EXPECT_TRUE(stateTree.requestState("menu"));
+    EXPECT_TRUE(stateTree.requestState("game"));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("game"), stateTree.getActiveState());
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, UpdateInterval) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM_INTERVAL(factory, TestTieredGameSystem, 3);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+    builder.addState("other", root);
+
+    builder.addSystem(root, "TestTieredGameSystem");
+    builder.addSystem(root, "TestTieredGameSystem");
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.addSystem(leaf, "TestTieredGameSystem");
+    builder.addSystem(leaf, "TestTieredGameSystem");
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    TestTieredGameSystem *systems[] = {
+        static_cast<TestTieredGameSystem*>(stateTree.getState(root)->getSystemInstance(0)->gameSystem),
+        static_cast<TestTieredGameSystem*>(stateTree.getState(root)->getSystemInstance(1)->gameSystem),
+        static_cast<TestTieredGameSystem*>(stateTree.getState(leaf)->getSystemInstance(0)->gameSystem),
+        static_cast<TestTieredGameSystem*>(stateTree.getState(leaf)->getSystemInstance(1)->gameSystem),
+    };
+
+    TestUpdateGameSystem::updateOrder.clear();
+
+    TestUpdateArgs updateArgs;
+    updateArgs.deltaTime = 1.0f;
+
+    // The systems are spread across the frames of the interval, no frame updates more than two of them
+    for (size_t frame = 1; frame <= 6; ++frame) {
+        size_t updated = 0;
+        for (auto system : systems) {
+            updated += system->updates.size();
+        }
+
+        stateTree.onUpdate(updateArgs);
+
+        size_t total = 0;
+        for (auto system : systems) {
+            total += system->updates.size();
+        }
+
+        EXPECT_GE(2, total - updated);
+        EXPECT_LE(1, total - updated);
+    }
+
+    // Systems without an interval are unaffected
+    EXPECT_EQ(6, TestUpdateGameSystem::updateOrder.size());
+
+    // Each system updates every third frame, its first update covers the frames since activation
+    EXPECT_EQ(std::vector<float>({ 3.0f, 3.0f }), systems[0]->updates);
+    EXPECT_EQ(std::vector<float>({ 2.0f, 3.0f }), systems[1]->updates);
+    EXPECT_EQ(std::vector<float>({ 1.0f, 3.0f }), systems[2]->updates);
+    EXPECT_EQ(std::vector<float>({ 3.0f, 3.0f }), systems[3]->updates);
+
+    // Time spent while a system is inactive is not passed on once it is activated again
+    stateTree.onUpdate(updateArgs);
+    EXPECT_TRUE(stateTree.requestState("other"));
+    stateTree.onUpdate(updateArgs);
+    stateTree.onUpdate(updateArgs);
+    EXPECT_TRUE(stateTree.requestState("leaf"));
+
+    systems[2]->updates.clear();
+    systems[3]->updates.clear();
+
+    stateTree.onUpdate(updateArgs);
+    EXPECT_EQ(std::vector<float>({ 1.0f }), systems[2]->updates);
+    EXPECT_TRUE(systems[3]->updates.empty());
+
+    stateTree.onUpdate(updateArgs);
+    stateTree.onUpdate(updateArgs);
+    EXPECT_EQ(std::vector<float>({ 1.0f }), systems[2]->updates);
+    EXPECT_EQ(std::vector<float>({ 3.0f }), systems[3]->updates);
+
+    stateTree.onDestroy();
+
+    // The interval belongs to the registration, another factory updates the same type every frame
+    ngen::GameSystemFactory otherFactory;
+    NGEN_REGISTER_GAME_SYSTEM(otherFactory, TestTieredGameSystem);
+    EXPECT_EQ(1u, otherFactory.getUpdateInterval(TestTieredGameSystem::__ngen__hash()));
+    EXPECT_EQ(3u, factory.getUpdateInterval(TestTieredGameSystem::__ngen__hash()));
+}
+
+TEST(StateTree, FixedTimestep) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestFixedGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+
+    builder.addSystem(root, "TestFixedGameSystem");
+    builder.addSystem(leaf, "TestFixedGameSystem");
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    EXPECT_EQ(2, stateTree.getState(leaf)->getBranchFixedUpdateCount());
+
+    TestFixedGameSystem *rootSystem = static_cast<TestFixedGameSystem*>(stateTree.getState(root)->getSystemInstance(0)->gameSystem);
+    TestFixedGameSystem *leafSystem = static_cast<TestFixedGameSystem*>(stateTree.getState(leaf)->getSystemInstance(0)->gameSystem);
+
+    TestUpdateArgs updateArgs;
+
+    // Without a timestep no fixed steps are run
+    updateArgs.deltaTime = 1.0f;
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_TRUE(rootSystem->steps.empty());
+    EXPECT_EQ(std::vector<float>({ 0.0f }), rootSystem->interpolation);
+
+    stateTree.setFixedTimestep(0.25f, 4);
+    EXPECT_EQ(0.25f, stateTree.getFixedTimestep());
+    EXPECT_EQ(4, stateTree.getMaximumFixedSteps());
+
+    // Two whole steps fit within the frame, half a step remains
+    updateArgs.deltaTime = 0.625f;
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(std::vector<float>({ 0.25f, 0.25f }), rootSystem->steps);
+    EXPECT_EQ(std::vector<float>({ 0.25f, 0.25f }), leafSystem->steps);
+    EXPECT_EQ(0.5f, leafSystem->interpolation.back());
+    EXPECT_EQ(0.5f, stateTree.getInterpolation());
+
+    // A long frame is limited to four steps, the surplus is discarded rather than carried forward
+    updateArgs.deltaTime = 2.0f;
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(6, rootSystem->steps.size());
+    EXPECT_EQ(0.5f, leafSystem->interpolation.back());
+
+    // The remainder accumulates across frames that are shorter than a step
+    updateArgs.deltaTime = 0.0625f;
+    stateTree.onUpdate(updateArgs);
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(7, rootSystem->steps.size());
+    EXPECT_EQ(std::vector<float>({ 0.0f, 0.5f, 0.5f, 0.75f, 0.0f }), rootSystem->interpolation);
+
+    stateTree.setFixedTimestep(0.0f);
+    EXPECT_EQ(0.0f, stateTree.getFixedTimestep());
+    EXPECT_EQ(0.0f, stateTree.getInterpolation());
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, DeferredInitialize) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestInitGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t menu = builder.addState("menu", root);
+    const size_t game = builder.addState("game", root);
+    const size_t level = builder.addState("level", game);
+    const size_t unused = builder.addState("unused", root);
+
+    for (size_t state : { root, menu, game, level, unused }) {
+        builder.addSystem(state, "TestInitGameSystem");
+    }
+
+    builder.setDefaultState(menu);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    stateTree.setDeferredInitialize(true);
+    EXPECT_TRUE(stateTree.getDeferredInitialize());
+
+    auto system = [&stateTree](size_t state) {
+        return static_cast<const TestInitGameSystem*>(stateTree.getState(state)->getSystemInstance(0)->gameSystem);
+    };
+
+    TestInitGameSystem::initOrder.clear();
+    TestInitGameSystem::destroyOrder.clear();
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    EXPECT_TRUE(TestInitGameSystem::initOrder.empty());
+    EXPECT_FALSE(stateTree.isInitialized(stateTree.getState(root)));
+
+    // Entering the default state initializes its branch, parents first
+    TestUpdateArgs updateArgs;
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(std::vector<const TestInitGameSystem*>({ system(root), system(menu) }), TestInitGameSystem::initOrder);
+    EXPECT_EQ(stateTree.getState(menu), system(menu)->state);
+    EXPECT_FALSE(stateTree.isInitialized(stateTree.getState(game)));
+
+    // Prefetching initializes the remainder of a branch ahead of time, entering it later does no further work
+    EXPECT_TRUE(stateTree.prefetchState("level"));
+    EXPECT_TRUE(stateTree.isInitialized(stateTree.getState(game)));
+    EXPECT_TRUE(stateTree.isInitialized(stateTree.getState(level)));
+    EXPECT_FALSE(stateTree.prefetchState("missing"));
+
+    EXPECT_TRUE(stateTree.requestState("level"));
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(stateTree.getState(level), stateTree.getActiveState());
+    EXPECT_EQ(std::vector<const TestInitGameSystem*>({ system(root), system(menu), system(game), system(level) }), TestInitGameSystem::initOrder);
+
+    // Systems that were never initialized are not destroyed, children are destroyed before their parents
+    stateTree.onDestroy();
+
+    EXPECT_EQ(4, TestInitGameSystem::destroyOrder.size());
+    EXPECT_EQ(system(root), TestInitGameSystem::destroyOrder.back());
+    EXPECT_EQ(TestInitGameSystem::destroyOrder.end(), std::find(TestInitGameSystem::destroyOrder.begin(), TestInitGameSystem::destroyOrder.end(), system(unused)));
+    EXPECT_LT(std::find(TestInitGameSystem::destroyOrder.begin(), TestInitGameSystem::destroyOrder.end(), system(level)),
+              std::find(TestInitGameSystem::destroyOrder.begin(), TestInitGameSystem::destroyOrder.end(), system(game)));
+}
+
+TEST(StateTree, DeferredDestroyOrder) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestInitGameSystem);
+
+    // The last state is a child of an earlier sibling, so storage order differs from depth first order
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t game = builder.addState("game", root);
+    const size_t level = builder.addState("level", game);
+    builder.addState("unused", root);
+    builder.addState("bonus", game);
+
+    for (size_t state = 0; state < 5; ++state) {
+        builder.addSystem(state, "TestInitGameSystem");
+        builder.addSystem(state, "TestInitGameSystem");
+    }
+
+    builder.setDefaultState(level);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    // Records the state and position of each system destroyed by a session
+    auto destroySession = [&](bool deferred) {
+        ngen::StateSystem::StateTree stateTree;
+        EXPECT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+        stateTree.setDeferredInitialize(deferred);
+
+        ngen::InitArgs initArgs;
+        stateTree.onInitialize(initArgs);
+
+        for (const char *name : { "level", "unused", "bonus" }) {
+            EXPECT_TRUE(stateTree.prefetchState(name));
+        }
+
+        TestInitGameSystem::destroyOrder.clear();
+        stateTree.onDestroy();
+
+        std::vector<std::pair<size_t, size_t>> order;
+
+        for (auto system : TestInitGameSystem::destroyOrder) {
+            const ngen::StateSystem::GameState *state = system->state;
+
+            for (size_t index = 0; index < state->getSystemCount(); ++index) {
+                if (state->getSystemInstance(index)->gameSystem == system) {
+                    order.push_back(std::make_pair(size_t(state - stateTree.getState(0)), index));
+                }
+            }
+        }
+
+        return order;
+    };
+
+    // Every state was initialized, so both paths destroy the same systems in the same order
+    const std::vector<std::pair<size_t, size_t>> immediate = destroySession(false);
+    const std::vector<std::pair<size_t, size_t>> deferred = destroySession(true);
+
+    EXPECT_EQ(10, immediate.size());
+    EXPECT_EQ(immediate, deferred);
+}
+
+TEST(StateTree, Reload) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestReloadGameSystem);
+
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> reloadImage;
+
+    {
+        ngen::StateSystem::StateTreeBuilder builder;
+
+        const size_t root = builder.addState("root");
+        const size_t menu = builder.addState("menu", root);
+        const size_t game = builder.addState("game", root);
+        const size_t level = builder.addState("level", game);
+
+        builder.addSystem(root, "TestReloadGameSystem");
+        builder.addSystem(menu, "TestReloadGameSystem");
+        builder.addSystem(game, "TestReloadGameSystem");
+        builder.addSystem(level, "TestReloadGameSystem");
+        builder.setDefaultState(level);
+
+        ASSERT_TRUE(builder.build(image));
+    }
+
+    {
+        // The menu is removed, a lobby is added and the level gains a second system
+        ngen::StateSystem::StateTreeBuilder builder;
+
+        const size_t root = builder.addState("root");
+        const size_t game = builder.addState("game", root);
+        const size_t level = builder.addState("level", game);
+        const size_t lobby = builder.addState("lobby", root);
+
+        builder.addSystem(root, "TestReloadGameSystem");
+        builder.addSystem(game, "TestReloadGameSystem");
+        builder.addSystem(level, "TestReloadGameSystem");
+        builder.addSystem(level, "TestReloadGameSystem");
+        builder.addSystem(lobby, "TestReloadGameSystem");
+        builder.setDefaultState(lobby);
+
+        ASSERT_TRUE(builder.build(reloadImage));
+    }
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    TestUpdateArgs updateArgs;
+    stateTree.onUpdate(updateArgs);
+
+    auto system = [&stateTree](const char *state, size_t index) {
+        return static_cast<const TestReloadGameSystem*>(stateTree.findState(state)->getSystemInstance(index)->gameSystem);
+    };
+
+    const TestReloadGameSystem *root = system("root", 0);
+    const TestReloadGameSystem *game = system("game", 0);
+    const TestReloadGameSystem *level = system("level", 0);
+
+    TestReloadGameSystem::destroyCount = 0;
+
+    // An image that cannot be used leaves the tree unchanged
+    std::vector<uint8_t> corrupt(reloadImage.begin(), reloadImage.begin() + 16);
+    EXPECT_FALSE(stateTree.reload(corrupt.data(), corrupt.size()));
+    EXPECT_EQ(4, stateTree.getSystemCount());
+
+    const uint32_t generation = ngen::StateSystem::GameState::getGeneration();
+
+    ASSERT_TRUE(stateTree.reload(reloadImage.data(), reloadImage.size()));
+    std::fill(image.begin(), image.end(), 0);
+
+    // Look-ups cached from the previous records are repeated
+    EXPECT_NE(generation, ngen::StateSystem::GameState::getGeneration());
+
+    EXPECT_EQ(5, stateTree.getSystemCount());
+    EXPECT_EQ(nullptr, stateTree.findState("menu"));
+    EXPECT_EQ(stateTree.findState("level"), stateTree.getActiveState());
+    EXPECT_EQ(stateTree.findState("root"), stateTree.getCommonAncestor(stateTree.findState("lobby"), stateTree.findState("level")));
+
+    // Unchanged systems are kept, only the removed system is destroyed
+    EXPECT_EQ(root, system("root", 0));
+    EXPECT_EQ(game, system("game", 0));
+    EXPECT_EQ(level, system("level", 0));
+    EXPECT_EQ(1, TestReloadGameSystem::destroyCount);
+
+    // Only the part of the active branch that changed is activated again
+    EXPECT_EQ(1, root->activateCount);
+    EXPECT_EQ(0, root->deactivateCount);
+    EXPECT_EQ(1, game->activateCount);
+    EXPECT_EQ(2, level->activateCount);
+    EXPECT_EQ(1, level->deactivateCount);
+
+    // Added systems are initialized, and activated if they are within the active branch
+    EXPECT_EQ(1, system("level", 1)->initializeCount);
+    EXPECT_EQ(1, system("level", 1)->activateCount);
+    EXPECT_EQ(1, system("lobby", 0)->initializeCount);
+    EXPECT_EQ(0, system("lobby", 0)->activateCount);
+    EXPECT_EQ(1, level->initializeCount);
+
+    // Kept systems are given their state within the new image rather than initialized again
+    EXPECT_EQ(1, level->reloadCount);
+    EXPECT_EQ(stateTree.findState("level"), level->state);
+    EXPECT_EQ(stateTree.findState("root"), root->state);
+    EXPECT_EQ(0, system("level", 1)->reloadCount);
+    EXPECT_EQ(stateTree.findState("level"), system("level", 1)->state);
+
+    // The reloaded tree continues to process state changes
+    EXPECT_TRUE(stateTree.requestState("lobby"));
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(stateTree.findState("lobby"), stateTree.getActiveState());
+    EXPECT_EQ(1, system("lobby", 0)->activateCount);
+    EXPECT_EQ(1, game->deactivateCount);
+
+    stateTree.onDestroy();
+
+    EXPECT_EQ(6, TestReloadGameSystem::destroyCount);
+}
+
+TEST(StateTree, ReloadPendingRequest) {
+    using namespace ngen::literals;
+
+    ngen::GameSystemFactory factory;
+    std::vector<uint8_t> image;
+    std::vector<uint8_t> reloadImage;
+
+    {
+        ngen::StateSystem::StateTreeBuilder builder;
+
+        const size_t root = builder.addState("root");
+        const size_t menu = builder.addState("menu", root);
+        builder.addState("game", root);
+        builder.setDefaultState(menu);
+
+        ASSERT_TRUE(builder.build(image));
+    }
+
+    {
+        // The game state gains a child, so it can no longer become active
+        ngen::StateSystem::StateTreeBuilder builder;
+
+        const size_t root = builder.addState("root");
+        const size_t menu = builder.addState("menu", root);
+        const size_t game = builder.addState("game", root);
+        builder.addState("level", game);
+        builder.setDefaultState(menu);
+
+        ASSERT_TRUE(builder.build(reloadImage));
+    }
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+
+    EXPECT_TRUE(stateTree.requestStateId("game"_state));
+    ASSERT_TRUE(stateTree.reload(reloadImage.data(), reloadImage.size()));
+
+    // The request is dropped rather than making a parent state active
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("menu"), stateTree.getActiveState());
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, RequestPriority) {
+    using namespace ngen::literals;
+
+    ngen::GameSystemFactory factory;
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    builder.addState("menu", root);
+    builder.addState("game", root);
+    builder.addState("pause", root);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    // A request with a higher priority is not displaced by later requests
+    EXPECT_TRUE(stateTree.requestStateId("pause"_state, 10));
+    EXPECT_TRUE(stateTree.requestStateId("game"_state));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("pause"), stateTree.getActiveState());
+
+    // Between requests of equal priority the last request wins
+    EXPECT_TRUE(stateTree.requestStateId("menu"_state, 5));
+    EXPECT_TRUE(stateTree.requestStateId("game"_state, 5));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("game"), stateTree.getActiveState());
+
+    // Requests beyond the capacity of the queue are accepted and the last request still wins
+    const size_t capacity = ngen::StateSystem::StateRequestQueue::kCapacity;
+
+    for (size_t loop = 0; loop < capacity * 2; ++loop) {
+        EXPECT_TRUE(stateTree.requestStateId("menu"_state));
+    }
+
+    EXPECT_TRUE(stateTree.requestStateId("pause"_state));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("pause"), stateTree.getActiveState());
+
+    // Within the overflow a higher priority request is not displaced by later requests
+    for (size_t loop = 0; loop < capacity; ++loop) {
+        EXPECT_TRUE(stateTree.requestStateId("pause"_state));
+    }
+
+    EXPECT_TRUE(stateTree.requestStateId("game"_state, 1));
+    EXPECT_TRUE(stateTree.requestStateId("menu"_state));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("game"), stateTree.getActiveState());
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, RecycledSystems) {
+    const ngen::GameSystemHash::Type hash = ngen::GameSystemHash::compute("TestPooledGameSystem");
+
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPooledGameSystem);
+    ASSERT_TRUE(factory.setRecycleLimit(hash, 8));
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+
+    builder.addSystem(root, "TestPooledGameSystem");
+    builder.addSystem(root, "TestGameSystem");
+    builder.addSystem(leaf, "TestPooledGameSystem");
+    builder.addSystem(leaf, "TestPooledGameSystem");
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    std::vector<const ngen::IGameSystem*> systemList;
+
+    for (size_t session = 0; session < 3; ++session) {
+        ngen::StateSystem::StateTree stateTree;
+        ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+        // Recycled systems are allocated by the factory, the tree only holds the remaining system
+        EXPECT_EQ(sizeof(TestGameSystem), stateTree.getSystemMemory().getCapacity());
+        EXPECT_EQ(0u, factory.getRecycledCount(hash));
+
+        ngen::InitArgs initArgs;
+        stateTree.onInitialize(initArgs);
+
+        std::vector<const ngen::IGameSystem*> pooled;
+
+        for (const char *name : { "root", "leaf" }) {
+            const ngen::StateSystem::GameState *state = stateTree.findState(name);
+
+            for (size_t index = 0; index < state->getSystemCount(); ++index) {
+                if (hash == state->getSystemInstance(index)->hash) {
+                    EXPECT_TRUE(static_cast<const TestPooledGameSystem*>(state->getSystemInstance(index)->gameSystem)->initialized);
+                    pooled.push_back(state->getSystemInstance(index)->gameSystem);
+                }
+            }
+        }
+
+        std::sort(pooled.begin(), pooled.end());
+        ASSERT_EQ(3u, pooled.size());
+
+        // Each session after the first receives the objects created by the first
+        if (session) {
+            EXPECT_EQ(systemList, pooled);
+        }
+
+        systemList = pooled;
+
+        stateTree.onDestroy();
+        stateTree.unload();
+        EXPECT_EQ(3u, factory.getRecycledCount(hash));
+    }
+}
+
+TEST(StateTree, ConcurrentRequests) {
+    static const size_t kThreadCount = 8;
+
+    ngen::GameSystemFactory factory;
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    for (size_t loop = 0; loop < kThreadCount; ++loop) {
+        builder.addState(("leaf_" + std::to_string(loop)).c_str(), root);
+    }
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    // Every thread races to request its own leaf, the priorities decide the outcome regardless of timing. The
+    // threads make more requests than the queue holds, so some of them are merged into the overflow slot.
+    std::atomic<bool> start(false);
+    std::vector<std::thread> threads;
+
+    for (size_t loop = 0; loop < kThreadCount; ++loop) {
+        threads.emplace_back([&stateTree, &start, loop]() {
+            while (!start) {
+                std::this_thread::yield();
+            }
+
+            for (size_t request = 0; request < ngen::StateSystem::StateRequestQueue::kCapacity; ++request) {
+                EXPECT_TRUE(stateTree.requestState(stateTree.getState(loop + 1), static_cast<int32_t>(loop)));
+            }
+        });
+    }
+
+    start = true;
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.getState(kThreadCount), stateTree.getActiveState());
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, getCommonAncestor) {
+    // The first tree has few enough leaves to use the table of leaf pairs, the second falls back to the sparse table
+    for (size_t stateCount : { size_t(96), size_t(200) }) {
+        ngen::GameSystemFactory factory;
+        ngen::StateSystem::StateTreeBuilder builder;
+
+        // Build a binary tree, whose leaves lie at two different depths, along with a second, unrelated, root
+        builder.addState("root");
+        for (size_t loop = 1; loop < stateCount; ++loop) {
+            builder.addState(("state_" + std::to_string(loop)).c_str(), (loop - 1) / 2);
+        }
+
+        const size_t other = builder.addState("other");
+        builder.addState("other_child", other);
+
+        std::vector<uint8_t> image;
+        ASSERT_TRUE(builder.build(image));
+
+        ngen::StateSystem::StateTree stateTree;
+        ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+        size_t leafCount = 0;
+        for (size_t loop = 0; loop < stateTree.getStateCount(); ++loop) {
+            leafCount += stateTree.getState(loop)->getChildCount() ? 0 : 1;
+        }
+
+        EXPECT_EQ(stateCount < 128, leafCount <= ngen::StateSystem::StateTree::kMaximumTransitionLeaves);
+        EXPECT_EQ(nullptr, stateTree.getCommonAncestor(nullptr, stateTree.getState(0)));
+
+        for (size_t stateA = 0; stateA < stateTree.getStateCount(); ++stateA) {
+            for (size_t stateB = 0; stateB < stateTree.getStateCount(); ++stateB) {
+                ngen::StateSystem::GameState *a = stateTree.getState(stateA);
+                ngen::StateSystem::GameState *b = stateTree.getState(stateB);
+
+                // Walk up from the first state until we find a state that is also a parent of the second
+                ngen::StateSystem::GameState *expected = a;
+                while (expected && !b->checkParentHierarchy(expected)) {
+                    expected = expected->getParent();
+                }
+
+                EXPECT_EQ(expected, stateTree.getCommonAncestor(a, b));
+            }
+        }
+    }
+}
+
+TEST(StateTree, TransitionOrder) {
+    using namespace ngen::literals;
+
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t left = builder.addState("left", root);
+    const size_t leftLeaf = builder.addState("left_leaf", left);
+    const size_t right = builder.addState("right", root);
+    const size_t rightLeaf = builder.addState("right_leaf", right);
+
+    for (auto state : { root, left, leftLeaf, right, rightLeaf }) {
+        builder.addSystem(state, "TestGameSystem");
+        builder.addSystem(state, "TestGameSystem");
+    }
+
+    builder.setDefaultState(leftLeaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    auto system = [&](size_t state, size_t index) {
+        return static_cast<const TestGameSystem*>(stateTree.getState(state)->getSystemInstance(index)->gameSystem);
+    };
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    TestGameSystem::activateOrder.clear();
+    TestGameSystem::deactivateOrder.clear();
+    stateTree.commitStateChange();
+
+    // Parents are activated before their children, systems in forward order
+    const std::vector<const TestGameSystem*> enterAll = {
+            system(root, 0), system(root, 1), system(left, 0), system(left, 1), system(leftLeaf, 0), system(leftLeaf, 1)
+    };
+    EXPECT_EQ(enterAll, TestGameSystem::activateOrder);
+    EXPECT_TRUE(TestGameSystem::deactivateOrder.empty());
+
+    TestGameSystem::activateOrder.clear();
+    EXPECT_TRUE(stateTree.requestStateId("right_leaf"_state));
+    stateTree.commitStateChange();
+
+    // Only the systems below the common ancestor are switched, exiting in reverse order
+    const std::vector<const TestGameSystem*> exitLeft = {
+            system(leftLeaf, 1), system(leftLeaf, 0), system(left, 1), system(left, 0)
+    };
+    const std::vector<const TestGameSystem*> enterRight = {
+            system(right, 0), system(right, 1), system(rightLeaf, 0), system(rightLeaf, 1)
+    };
+    EXPECT_EQ(exitLeft, TestGameSystem::deactivateOrder);
+    EXPECT_EQ(enterRight, TestGameSystem::activateOrder);
+
+    TestGameSystem::deactivateOrder.clear();
+    stateTree.onDestroy();
+
+    const std::vector<const TestGameSystem*> exitAll = {
+            system(rightLeaf, 1), system(rightLeaf, 0), system(right, 1), system(right, 0), system(root, 1), system(root, 0)
+    };
+    EXPECT_EQ(exitAll, TestGameSystem::deactivateOrder);
+}
+
+TEST(StateTree, AsyncTransition) {
+    using namespace ngen::literals;
+
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPreparedGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t menu = builder.addState("menu", root);
+    const size_t level = builder.addState("level", root);
+
+    builder.addSystem(root, "TestPreparedGameSystem");
+    builder.addSystem(menu, "TestGameSystem");
+    builder.addSystem(level, "TestPreparedGameSystem");
+    builder.addSystem(level, "TestPreparedGameSystem");
+    builder.setDefaultState(menu);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    EXPECT_FALSE(stateTree.getAsyncTransitions());
+    stateTree.setAsyncTransitions(true);
+    EXPECT_TRUE(stateTree.getAsyncTransitions());
+
+    auto system = [&](size_t state, size_t index) {
+        return static_cast<const TestPreparedGameSystem*>(stateTree.getState(state)->getSystemInstance(index)->gameSystem);
+    };
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    // Initial activation prepares the root system in the background as well
+    TestPreparedGameSystem::ready = true;
+    stateTree.commitStateChange();
+    while (stateTree.getTransitionState()) {
+        std::this_thread::yield();
+        stateTree.commitStateChange();
+    }
+
+    EXPECT_EQ(stateTree.getState(menu), stateTree.getActiveState());
+    EXPECT_TRUE(system(root, 0)->activatedPrepared);
+
+    // The active state remains in place until the incoming systems are ready
+    TestPreparedGameSystem::ready = false;
+    EXPECT_TRUE(stateTree.requestStateId("level"_state));
+    stateTree.commitStateChange();
+
+    EXPECT_EQ(stateTree.getState(level), stateTree.getTransitionState());
+    EXPECT_EQ(stateTree.getState(menu), stateTree.getActiveState());
+    EXPECT_EQ(0.0f, stateTree.getTransitionProgress());
+
+    // Requests made during the transition are held until it has completed
+    EXPECT_TRUE(stateTree.requestStateId("menu"_state));
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.getState(menu), stateTree.getActiveState());
+
+    TestPreparedGameSystem::ready = true;
+    while (stateTree.getTransitionProgress() < 1.0f) {
+        std::this_thread::yield();
+    }
+
+    EXPECT_TRUE(stateTree.requestStateId("level"_state));
+    stateTree.commitStateChange();
+
+    EXPECT_EQ(nullptr, stateTree.getTransitionState());
+    EXPECT_EQ(stateTree.getState(level), stateTree.getActiveState());
+    EXPECT_TRUE(system(level, 0)->activatedPrepared);
+    EXPECT_TRUE(system(level, 1)->activatedPrepared);
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, SyncTransitionPrepares) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPreparedGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    builder.addSystem(root, "TestPreparedGameSystem");
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    TestPreparedGameSystem::ready = true;
+    stateTree.commitStateChange();
+
+    const TestPreparedGameSystem *system = static_cast<const TestPreparedGameSystem*>(stateTree.getState(root)->getSystemInstance(0)->gameSystem);
+
+    EXPECT_EQ(stateTree.getState(root), stateTree.getActiveState());
+    EXPECT_EQ(1.0f, stateTree.getTransitionProgress());
+    EXPECT_TRUE(system->activatedPrepared);
+
+    stateTree.onDestroy();
+}
+
+TEST(StateTree, IncrementalTransition) {
+    using namespace ngen::literals;
+
+    typedef std::vector<std::pair<const TestSlowGameSystem*, bool>> CallList;
+
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestSlowGameSystem);
+
+    ngen::StateSystem::StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t left = builder.addState("left", root);
+    const size_t leftLeaf = builder.addState("left_leaf", left);
+    const size_t right = builder.addState("right", root);
+    const size_t rightLeaf = builder.addState("right_leaf", right);
+
+    builder.addSystem(root, "TestSlowGameSystem");
+    builder.addSystem(left, "TestSlowGameSystem");
+    builder.addSystem(left, "TestSlowGameSystem");
+    builder.addSystem(leftLeaf, "TestSlowGameSystem");
+    builder.addSystem(right, "TestSlowGameSystem");
+    builder.addSystem(rightLeaf, "TestSlowGameSystem");
+    builder.setDefaultState(leftLeaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    ngen::StateSystem::StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    auto system = [&](size_t state, size_t index) {
+        return static_cast<TestSlowGameSystem*>(stateTree.getState(state)->getSystemInstance(index)->gameSystem);
+    };
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+
+    EXPECT_EQ(0u, stateTree.getTransitionBudget());
+    stateTree.setTransitionBudget(20);
+    EXPECT_EQ(20u, stateTree.getTransitionBudget());
+
+    // Every callback exceeds the budget, so each commit makes a single call
+    TestSlowGameSystem::callList.clear();
+    EXPECT_TRUE(stateTree.requestStateId("right_leaf"_state));
+    stateTree.commitStateChange();
+
+    EXPECT_EQ(CallList({ { system(leftLeaf, 0), false } }), TestSlowGameSystem::callList);
+    EXPECT_EQ(stateTree.getState(leftLeaf), stateTree.getActiveState());
+    EXPECT_EQ(stateTree.getState(rightLeaf), stateTree.getTransitionState());
+    EXPECT_EQ(0.2f, stateTree.getTransitionProgress());
+
+    // Only the systems of the common ancestor are updated during the transition
+    TestUpdateArgs updateArgs;
+    updateArgs.deltaTime = 1.0f;
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(1u, system(root, 0)->updateCount);
+    EXPECT_EQ(0u, system(left, 0)->updateCount);
+    EXPECT_EQ(stateTree.getState(rightLeaf), stateTree.getActiveState());
+
+    // Redirecting to the original state re-activates the systems that were deactivated, in order
+    EXPECT_TRUE(stateTree.requestStateId("left_leaf"_state));
+    for (size_t commit = 0; commit < 2; ++commit) {
+        stateTree.commitStateChange();
+        EXPECT_EQ(stateTree.getState(leftLeaf), stateTree.getTransitionState());
+    }
+
+    stateTree.commitStateChange();
+
+    EXPECT_EQ(nullptr, stateTree.getTransitionState());
+    EXPECT_EQ(stateTree.getState(leftLeaf), stateTree.getActiveState());
+    EXPECT_EQ(1.0f, stateTree.getTransitionProgress());
+
+    const CallList redirected = {
+            { system(leftLeaf, 0), false }, { system(left, 1), false }, { system(left, 0), false },
+            { system(left, 0), true }, { system(left, 1), true }, { system(leftLeaf, 0), true }
+    };
+    EXPECT_EQ(redirected, TestSlowGameSystem::callList);
+
+    // Part way through, onDestroy only deactivates the systems that are active
+    TestSlowGameSystem::callList.clear();
+    EXPECT_TRUE(stateTree.requestStateId("right_leaf"_state));
+    for (size_t commit = 0; commit < 4; ++commit) {
+        stateTree.commitStateChange();
+    }
+
+    stateTree.onDestroy();
+
+    const CallList destroyed = {
+            { system(leftLeaf, 0), false }, { system(left, 1), false }, { system(left, 0), false },
+            { system(right, 0), true },
+            { system(right, 0), false }, { system(root, 0), false }
+    };
+    EXPECT_EQ(destroyed, TestSlowGameSystem::callList);
+    EXPECT_EQ(nullptr, stateTree.getActiveState());
+    EXPECT_EQ(nullptr, stateTree.getTransitionState());
+}
@@ -0,0 +1,358 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <chrono>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "state_tree_builder.h"
+#include "state_tree_group.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+// Game system whose activation outlasts a transition budget, counting the updates and fixed steps it receives.
+class TestGroupSlowSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem, public ngen::IFixedUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestGroupSlowSystem)
+
+public:
+    TestGroupSlowSystem() : updateCount(0), stepCount(0) {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onDestroy() {}
+    virtual void onActivate() { wait(); }
+    virtual void onDeactivate() { wait(); }
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) { updateCount++; }
+    virtual void onFixedUpdate(const ngen::UpdateArgs &updateArgs) { stepCount++; }
+
+    static void wait() {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(50);
+
+        while (std::chrono::steady_clock::now() < end) {
+            //
+        }
+    }
+
+    size_t updateCount;
+    size_t stepCount;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestGroupSlowSystem)
+
+// Game system that requests a state through its update arguments each frame.
+class TestGroupRequestSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestGroupRequestSystem)
+
+public:
+    TestGroupRequestSystem() : target(nullptr) {}
+
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onDestroy() {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) {
+        if (target) {
+            updateArgs.requestState(target);
+        }
+    }
+
+    const char *target;
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestGroupRequestSystem)
+
+TEST(StateTreeGroup, BatchedUpdate) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leafA = builder.addState("leaf_a", root);
+    const size_t leafB = builder.addState("leaf_b", root);
+
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.addSystem(leafA, "TestUpdateGameSystem");
+    builder.addSystem(leafB, "TestUpdateGameSystem");
+    builder.setDefaultState(leafA);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTreeGroup group;
+    EXPECT_EQ(nullptr, group.createInstance());
+    ASSERT_TRUE(group.load(factory, image.data(), image.size()));
+
+    // The group holds a single copy of the image for every instance, so the original is no longer required
+    image.clear();
+
+    StateTree *instances[3];
+    for (auto &instance : instances) {
+        instance = group.createInstance();
+        ASSERT_NE(nullptr, instance);
+
+        ngen::InitArgs initArgs;
+        instance->onInitialize(initArgs);
+    }
+
+    EXPECT_EQ(3, group.getInstanceCount());
+    EXPECT_EQ(instances[1], group.getInstance(1));
+    EXPECT_EQ(nullptr, group.getInstance(3));
+
+    // Each instance owns its own systems, while the state look-up tables are shared
+    EXPECT_NE(instances[0]->getState(0)->getSystemInstance(0)->gameSystem, instances[1]->getState(0)->getSystemInstance(0)->gameSystem);
+    EXPECT_EQ(instances[2]->getState(2), instances[2]->findState("leaf_b"));
+    EXPECT_EQ(instances[2]->getState(0), instances[2]->getCommonAncestor(instances[2]->getState(1), instances[2]->getState(2)));
+
+    ASSERT_TRUE(instances[2]->requestState("leaf_b"));
+
+    TestUpdateGameSystem::updateOrder.clear();
+
+    TestUpdateArgs updateArgs;
+    group.onUpdate(updateArgs);
+    group.onPostUpdate(updateArgs);
+
+    EXPECT_EQ(instances[2]->getState(2), instances[2]->getActiveState());
+
+    // Instances sharing a leaf are updated together, one system at a time
+    auto system = [&instances](size_t instance, size_t state) {
+        return instances[instance]->getState(state)->getSystemInstance(0)->gameSystem;
+    };
+
+    ASSERT_EQ(6, TestUpdateGameSystem::updateOrder.size());
+    EXPECT_EQ(system(0, 0), TestUpdateGameSystem::updateOrder[0]);
+    EXPECT_EQ(system(1, 0), TestUpdateGameSystem::updateOrder[1]);
+    EXPECT_EQ(system(0, 1), TestUpdateGameSystem::updateOrder[2]);
+    EXPECT_EQ(system(1, 1), TestUpdateGameSystem::updateOrder[3]);
+    EXPECT_EQ(system(2, 0), TestUpdateGameSystem::updateOrder[4]);
+    EXPECT_EQ(system(2, 2), TestUpdateGameSystem::updateOrder[5]);
+
+    // Releasing an instance leaves the remaining instances running
+    instances[0]->onDestroy();
+    group.destroyInstance(instances[0]);
+    EXPECT_EQ(2, group.getInstanceCount());
+
+    TestUpdateGameSystem::updateOrder.clear();
+    group.onUpdate(updateArgs);
+    EXPECT_EQ(4, TestUpdateGameSystem::updateOrder.size());
+
+    for (size_t loop = 0; loop < group.getInstanceCount(); ++loop) {
+        group.getInstance(loop)->onDestroy();
+    }
+
+    group.unload();
+    EXPECT_EQ(0, group.getInstanceCount());
+}
+
+TEST(StateTreeGroup, UnbatchedInstances) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGroupSlowSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leafA = builder.addState("leaf_a", root);
+    const size_t leafB = builder.addState("leaf_b", root);
+
+    builder.addSystem(root, "TestGroupSlowSystem");
+    builder.addSystem(leafA, "TestGroupSlowSystem");
+
+    for (size_t loop = 0; loop < 6; ++loop) {
+        builder.addSystem(leafB, "TestGroupSlowSystem");
+    }
+
+    builder.setDefaultState(leafA);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTreeGroup group;
+    ASSERT_TRUE(group.load(factory, image.data(), image.size()));
+
+    StateTree *instances[3];
+    for (auto &instance : instances) {
+        instance = group.createInstance();
+        ASSERT_NE(nullptr, instance);
+
+        ngen::InitArgs initArgs;
+        instance->onInitialize(initArgs);
+        instance->commitStateChange();
+    }
+
+    auto system = [&instances](size_t instance, size_t state, size_t index) {
+        return static_cast<TestGroupSlowSystem*>(instances[instance]->getState(state)->getSystemInstance(index)->gameSystem);
+    };
+
+    // The first instance steps its systems at a fixed rate, the second is part way through an incremental transition
+    instances[0]->setFixedTimestep(0.5f);
+    instances[1]->setTransitionBudget(1);
+    ASSERT_TRUE(instances[1]->requestState("leaf_b"));
+
+    TestUpdateArgs updateArgs;
+    updateArgs.deltaTime = 1.0f;
+    group.onUpdate(updateArgs);
+
+    EXPECT_EQ(2, system(0, root, 0)->stepCount);
+    EXPECT_EQ(1, system(0, leafA, 0)->updateCount);
+    EXPECT_EQ(1, system(2, leafA, 0)->updateCount);
+    EXPECT_EQ(0, system(2, root, 0)->stepCount);
+
+    // Only the systems shared by both branches are updated while the transition is in progress
+    EXPECT_EQ(instances[1]->getState(leafB), instances[1]->getTransitionState());
+    EXPECT_EQ(1, system(1, root, 0)->updateCount);
+    EXPECT_EQ(0, system(1, leafA, 0)->updateCount);
+
+    for (size_t loop = 0; loop < 6; ++loop) {
+        EXPECT_EQ(0, system(1, leafB, loop)->updateCount);
+    }
+
+    // Once the transition completes the instance is batched along with the others
+    instances[1]->setTransitionBudget(0);
+    group.onUpdate(updateArgs);
+
+    EXPECT_EQ(nullptr, instances[1]->getTransitionState());
+    EXPECT_EQ(instances[1]->getState(leafB), instances[1]->getActiveState());
+    EXPECT_EQ(2, system(1, root, 0)->updateCount);
+
+    for (size_t loop = 0; loop < 6; ++loop) {
+        EXPECT_EQ(1, system(1, leafB, loop)->updateCount);
+    }
+
+    for (auto &instance : instances) {
+        instance->onDestroy();
+    }
+}
+
+TEST(StateTreeGroup, InstanceRequests) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGroupRequestSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leafA = builder.addState("leaf_a", root);
+    const size_t leafB = builder.addState("leaf_b", root);
+    const size_t leafC = builder.addState("leaf_c", root);
+
+    builder.addSystem(leafA, "TestGroupRequestSystem");
+    builder.setDefaultState(leafA);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTreeGroup group;
+    ASSERT_TRUE(group.load(factory, image.data(), image.size()));
+
+    StateTree *instances[3];
+    for (auto &instance : instances) {
+        instance = group.createInstance();
+        ASSERT_NE(nullptr, instance);
+
+        ngen::InitArgs initArgs;
+        instance->onInitialize(initArgs);
+        instance->commitStateChange();
+    }
+
+    // Every instance is on the same leaf, the first two are batched while the last is updated through its tree
+    instances[2]->setFixedTimestep(0.5f);
+
+    const char *targets[] = { "leaf_b", "leaf_c", "leaf_b" };
+    for (size_t loop = 0; loop < 3; ++loop) {
+        instances[loop]->getState(leafA)->getSystem<TestGroupRequestSystem>()->target = targets[loop];
+    }
+
+    TestUpdateArgs updateArgs;
+    group.onUpdate(updateArgs);
+
+    // Each request is made on the tree of the instance whose system made it
+    EXPECT_EQ(instances[0]->getState(leafB), instances[0]->getActiveState());
+    EXPECT_EQ(instances[1]->getState(leafC), instances[1]->getActiveState());
+    EXPECT_EQ(instances[2]->getState(leafB), instances[2]->getActiveState());
+
+    for (auto &instance : instances) {
+        instance->onDestroy();
+    }
+}
+
+TEST(StateTreeGroup, ReloadedInstance) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leafA = builder.addState("leaf_a", root);
+
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.addSystem(leafA, "TestUpdateGameSystem");
+    builder.setDefaultState(leafA);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    // The new definition holds more states than the one the group was loaded with
+    const size_t leafB = builder.addState("leaf_b", root);
+    const size_t leafC = builder.addState("leaf_c", root);
+
+    builder.addSystem(leafB, "TestUpdateGameSystem");
+    builder.addSystem(leafC, "TestUpdateGameSystem");
+
+    std::vector<uint8_t> reloadImage;
+    ASSERT_TRUE(builder.build(reloadImage));
+
+    StateTreeGroup group;
+    ASSERT_TRUE(group.load(factory, image.data(), image.size()));
+
+    StateTree *instances[2];
+    for (auto &instance : instances) {
+        instance = group.createInstance();
+        ASSERT_NE(nullptr, instance);
+
+        ngen::InitArgs initArgs;
+        instance->onInitialize(initArgs);
+        instance->commitStateChange();
+    }
+
+    ASSERT_TRUE(instances[1]->reload(reloadImage.data(), reloadImage.size()));
+    ASSERT_TRUE(instances[1]->requestState("leaf_c"));
+
+    TestUpdateArgs updateArgs;
+    TestUpdateGameSystem::updateOrder.clear();
+    group.onUpdate(updateArgs);
+
+    EXPECT_EQ(instances[1]->getState(leafC), instances[1]->getActiveState());
+
+    // The batched instance is updated first, the reloaded instance is then updated through its own tree
+    auto system = [&instances](size_t instance, size_t state) {
+        return instances[instance]->getState(state)->getSystemInstance(0)->gameSystem;
+    };
+
+    ASSERT_EQ(4, TestUpdateGameSystem::updateOrder.size());
+    EXPECT_EQ(system(0, root), TestUpdateGameSystem::updateOrder[0]);
+    EXPECT_EQ(system(0, leafA), TestUpdateGameSystem::updateOrder[1]);
+    EXPECT_EQ(system(1, root), TestUpdateGameSystem::updateOrder[2]);
+    EXPECT_EQ(system(1, leafC), TestUpdateGameSystem::updateOrder[3]);
+
+    for (auto &instance : instances) {
+        instance->onDestroy();
+    }
+}
@@ -0,0 +1,203 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstdio>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "state_tree_builder.h"
+#include "state_tree_image.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+// Builds a small tree containing two roots, the first of which contains two leaf states.
+static void buildTestImage(std::vector<uint8_t> &image) {
+    StateTreeBuilder builder;
+
+    const size_t main = builder.addState("main");
+    const size_t menu = builder.addState("menu", main);
+    const size_t game = builder.addState("game", main);
+    builder.addState("other");
+
+    builder.addSystem(main, "TestGameSystem");
+    builder.addSystem(menu, "TestUpdateGameSystem");
+    builder.addSystem(game, "TestUpdateGameSystem");
+    builder.addSystem(game, "TestPostUpdateGameSystem");
+    builder.setDefaultState(menu);
+
+    ASSERT_TRUE(builder.build(image));
+}
+
+static void registerTestSystems(ngen::GameSystemFactory &factory) {
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPostUpdateGameSystem);
+}
+
+TEST(StateTreeImage, Validate) {
+    std::vector<uint8_t> image;
+    buildTestImage(image);
+
+    EXPECT_TRUE(StateTreeImage::validate(image.data(), image.size()));
+    EXPECT_FALSE(StateTreeImage::validate(nullptr, image.size()));
+    EXPECT_FALSE(StateTreeImage::validate(image.data(), sizeof(StateTreeImageHeader) - 1));
+    EXPECT_FALSE(StateTreeImage::validate(image.data(), image.size() - 8));
+
+    reinterpret_cast<StateTreeImageHeader*>(image.data())->version++;
+    EXPECT_FALSE(StateTreeImage::validate(image.data(), image.size()));
+}
+
+TEST(StateTreeImage, CreateRecords) {
+    std::vector<uint8_t> image;
+    buildTestImage(image);
+
+    const std::vector<uint8_t> original = image;
+
+    StateTreeImage stateImage;
+    ASSERT_TRUE(stateImage.adopt(image.data(), image.size()));
+    ASSERT_TRUE(stateImage.createRecords());
+
+    // The records may only be built once
+    EXPECT_FALSE(stateImage.createRecords());
+
+    GameState *states = stateImage.getStateList();
+    EXPECT_EQ(StateTree::computeHash("main"), states[0].getId());
+    EXPECT_EQ(nullptr, states[0].getParent());
+    EXPECT_EQ(2, states[0].getChildCount());
+    EXPECT_EQ(&states[0], states[1].getParent());
+    EXPECT_EQ(&states[0], states[2].getParent());
+    EXPECT_EQ(nullptr, states[3].getParent());
+    EXPECT_EQ(&states[1], states[0].getChild(0));
+    EXPECT_EQ(&states[2], states[0].getChild(1));
+    EXPECT_EQ(2, states[2].getSystemCount());
+
+    // The system instances hold the hashes of the system section
+    const StateTreeImageHeader &header = *stateImage.getHeader();
+    const ngen::GameSystemHash::Type *hashList = reinterpret_cast<const ngen::GameSystemHash::Type*>(image.data() + header.systemOffset);
+
+    for (uint32_t loop = 0; loop < header.systemCount; ++loop) {
+        EXPECT_EQ(stateImage.getSystemList()[loop].hash, hashList[loop]);
+    }
+
+    // The image is only read
+    EXPECT_EQ(original, image);
+}
+
+TEST(StateTreeImage, RejectCorruptOffsets) {
+    std::vector<uint8_t> image;
+    buildTestImage(image);
+
+    const StateTreeImageHeader &header = *reinterpret_cast<StateTreeImageHeader*>(image.data());
+    StateTreeImageState *recordList = reinterpret_cast<StateTreeImageState*>(image.data() + header.stateOffset);
+    uint32_t *childList = reinterpret_cast<uint32_t*>(image.data() + header.childOffset);
+
+    StateTreeImage stateImage;
+
+    // A state may not be the parent of an earlier state
+    recordList[0].parent = 1;
+    EXPECT_FALSE(stateImage.adopt(image.data(), image.size()));
+    recordList[0].parent = kStateTreeImageNoParent;
+
+    // Child lists must lie within the child section and agree with the parent of each child
+    recordList[0].firstChild = header.childCount;
+    EXPECT_FALSE(stateImage.adopt(image.data(), image.size()));
+    recordList[0].firstChild = 0;
+
+    childList[1] = 3;
+    EXPECT_FALSE(stateImage.adopt(image.data(), image.size()));
+    childList[1] = header.stateCount;
+    EXPECT_FALSE(stateImage.adopt(image.data(), image.size()));
+    childList[1] = 2;
+
+    // The systems of each state must follow those of the previous state
+    recordList[2].systemCount++;
+    EXPECT_FALSE(stateImage.adopt(image.data(), image.size()));
+    recordList[2].systemCount--;
+
+    EXPECT_TRUE(stateImage.adopt(image.data(), image.size()));
+}
+
+TEST(StateTree, Load) {
+    ngen::GameSystemFactory factory;
+    registerTestSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildTestImage(image);
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    EXPECT_EQ(4, stateTree.getStateCount());
+    EXPECT_EQ(4, stateTree.getSystemCount());
+
+    GameState *game = stateTree.findState("game");
+    ASSERT_NE(nullptr, game);
+    EXPECT_EQ(1, game->getUpdateCount());
+    EXPECT_NE(nullptr, game->getSystem(ngen::GameSystemHash::compute("TestGameSystem")));
+    EXPECT_NE(nullptr, game->getSystem(ngen::GameSystemHash::compute("TestPostUpdateGameSystem")));
+    EXPECT_EQ(nullptr, stateTree.findState("missing"));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+    EXPECT_EQ(stateTree.findState("menu"), stateTree.getActiveState());
+
+    stateTree.onDestroy();
+    EXPECT_EQ(nullptr, stateTree.getActiveState());
+}
+
+TEST(StateTree, LoadUnknownSystem) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+
+    std::vector<uint8_t> image;
+    buildTestImage(image);
+
+    StateTree stateTree;
+    EXPECT_FALSE(stateTree.load(factory, image.data(), image.size()));
+    EXPECT_EQ(0, stateTree.getStateCount());
+    EXPECT_EQ(0, stateTree.getSystemCount());
+}
+
+TEST(StateTree, LoadFile) {
+    ngen::GameSystemFactory factory;
+    registerTestSystems(factory);
+
+    std::vector<uint8_t> image;
+    buildTestImage(image);
+
+    const char *path = "test_state_tree_image.bin";
+
+    FILE *file = fopen(path, "wb");
+    ASSERT_NE(nullptr, file);
+    fwrite(image.data(), image.size(), 1, file);
+    fclose(file);
+
+    StateTree stateTree;
+    EXPECT_TRUE(stateTree.loadFile(factory, path));
+    EXPECT_EQ(4, stateTree.getStateCount());
+    EXPECT_NE(nullptr, stateTree.findState("other"));
+
+    stateTree.unload();
+    remove(path);
+
+    EXPECT_FALSE(stateTree.loadFile(factory, path));
+}
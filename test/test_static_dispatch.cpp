@@ -0,0 +1,166 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "static_dispatch.h"
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+// Records the order in which systems of every type below were updated
+static std::vector<const ngen::IGameSystem*> s_updateOrder;
+static std::vector<const ngen::IGameSystem*> s_postUpdateOrder;
+
+class TestBatchGameSystem final : public ngen::IGameSystem, public ngen::IUpdateGameSystem, public ngen::IPostUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestBatchGameSystem)
+
+public:
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) { s_updateOrder.push_back(this); }
+    virtual void onPostUpdate(const ngen::UpdateArgs &updateArgs) { s_postUpdateOrder.push_back(this); }
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestBatchGameSystem)
+
+class TestBatchUpdateGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestBatchUpdateGameSystem)
+
+public:
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) { s_updateOrder.push_back(this); }
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestBatchUpdateGameSystem)
+
+// Not part of the type list, so it is always called through its interface
+class TestVirtualGameSystem : public ngen::IGameSystem, public ngen::IUpdateGameSystem {
+    NGEN_DECLARE_GAME_SYSTEM(TestVirtualGameSystem)
+
+public:
+    virtual void onDestroy() {}
+    virtual void onInitialize(const ngen::InitArgs &initArgs) {}
+    virtual void onActivate() {}
+    virtual void onDeactivate() {}
+
+    virtual void onUpdate(const ngen::UpdateArgs &updateArgs) { s_updateOrder.push_back(this); }
+};
+
+NGEN_IMPLEMENT_GAME_SYSTEM(TestVirtualGameSystem)
+
+TEST(StaticDispatch, Entries) {
+    const StaticDispatch dispatch{ GameSystemTypeList<TestBatchGameSystem, TestBatchUpdateGameSystem>() };
+
+    EXPECT_EQ(2, dispatch.getTypeCount());
+
+    const StaticDispatchEntry *entry = dispatch.find(&TestBatchGameSystem::__ngen__creator);
+    ASSERT_NE(nullptr, entry);
+    EXPECT_NE(nullptr, entry->update);
+    EXPECT_NE(nullptr, entry->postUpdate);
+
+    entry = dispatch.find(&TestBatchUpdateGameSystem::__ngen__creator);
+    ASSERT_NE(nullptr, entry);
+    EXPECT_NE(nullptr, entry->update);
+    EXPECT_EQ(nullptr, entry->postUpdate);
+
+    EXPECT_EQ(nullptr, dispatch.find(&TestVirtualGameSystem::__ngen__creator));
+}
+
+TEST(StaticDispatch, UpdateOrder) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestBatchGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestBatchUpdateGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestVirtualGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+    const size_t other = builder.addState("other", root);
+
+    builder.addSystem(root, "TestBatchGameSystem");
+    builder.addSystem(root, "TestBatchGameSystem");
+    builder.addSystem(root, "TestVirtualGameSystem");
+    builder.addSystem(leaf, "TestBatchUpdateGameSystem");
+    builder.addSystem(leaf, "TestBatchGameSystem");
+    builder.addSystem(other, "TestBatchUpdateGameSystem");
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    // Capture the order produced by calling every system through its interface
+    TestUpdateArgs updateArgs;
+
+    s_updateOrder.clear();
+    s_postUpdateOrder.clear();
+
+    stateTree.onUpdate(updateArgs);
+    stateTree.onPostUpdate(updateArgs);
+
+    const std::vector<const ngen::IGameSystem*> updateOrder = s_updateOrder;
+    const std::vector<const ngen::IGameSystem*> postUpdateOrder = s_postUpdateOrder;
+
+    EXPECT_EQ(5, updateOrder.size());
+    EXPECT_EQ(3, postUpdateOrder.size());
+
+    const StaticDispatch dispatch{ GameSystemTypeList<TestBatchGameSystem, TestBatchUpdateGameSystem>() };
+    stateTree.setStaticDispatch(&dispatch);
+    EXPECT_EQ(&dispatch, stateTree.getStaticDispatch());
+
+    // Batching does not change the order the branch is updated in
+    s_updateOrder.clear();
+    s_postUpdateOrder.clear();
+
+    stateTree.onUpdate(updateArgs);
+    stateTree.onPostUpdate(updateArgs);
+
+    EXPECT_EQ(updateOrder, s_updateOrder);
+    EXPECT_EQ(postUpdateOrder, s_postUpdateOrder);
+
+    // The batches follow the active state
+    EXPECT_TRUE(stateTree.requestState("other"));
+    stateTree.commitStateChange();
+
+    s_updateOrder.clear();
+    stateTree.onUpdate(updateArgs);
+
+    EXPECT_EQ(4, s_updateOrder.size());
+    EXPECT_EQ(stateTree.getState(other)->getSystemInstance(0)->gameSystem, s_updateOrder.back());
+
+    stateTree.setStaticDispatch(nullptr);
+    stateTree.onDestroy();
+}
@@ -0,0 +1,205 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <thread>
+#include <vector>
+
+#include <game_system/game_system.h>
+#include <core/init_args.h>
+#include "state_tree_builder.h"
+#include "state_tree.h"
+#include "game_state.h"
+#include "system_profiler.h"
+#include "test_game_system.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+TEST(SystemProfiler, RecordAndCollect) {
+    SystemProfiler::reset();
+
+    const uint64_t start = SystemProfiler::now();
+    SystemProfiler::record(1, ProfilePhase::Update, start);
+    SystemProfiler::record(2, ProfilePhase::PostUpdate, start);
+
+    // Samples recorded on another thread are held in a separate buffer
+    std::thread worker([start]() { SystemProfiler::record(3, ProfilePhase::Activate, start); });
+    worker.join();
+
+    std::vector<ProfileSample> samples;
+    ASSERT_EQ(3, SystemProfiler::collect(samples));
+
+    EXPECT_EQ(1, samples[0].hash);
+    EXPECT_EQ(ProfilePhase::Update, samples[0].phase);
+    EXPECT_EQ(start, samples[0].start);
+    EXPECT_EQ(2, samples[1].hash);
+    EXPECT_EQ(ProfilePhase::PostUpdate, samples[1].phase);
+    EXPECT_EQ(samples[0].thread, samples[1].thread);
+    EXPECT_EQ(3, samples[2].hash);
+    EXPECT_NE(samples[0].thread, samples[2].thread);
+
+    // Collecting removes the samples from the buffers
+    EXPECT_EQ(0, SystemProfiler::collect(samples));
+}
+
+TEST(SystemProfiler, DropWhenFull) {
+    SystemProfiler::reset();
+
+    for (size_t loop = 0; loop < SystemProfiler::kBufferCapacity + 10; ++loop) {
+        SystemProfiler::record(loop, ProfilePhase::Update, SystemProfiler::now());
+    }
+
+    EXPECT_EQ(10, SystemProfiler::getDroppedCount());
+
+    std::vector<ProfileSample> samples;
+    EXPECT_EQ(SystemProfiler::kBufferCapacity, SystemProfiler::collect(samples));
+    EXPECT_EQ(0, samples.front().hash);
+
+    SystemProfiler::reset();
+    EXPECT_EQ(0, SystemProfiler::getDroppedCount());
+}
+
+TEST(SystemProfiler, StateTreeDispatch) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestUpdateGameSystem);
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestPostUpdateGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t leaf = builder.addState("leaf", root);
+
+    builder.addSystem(root, "TestUpdateGameSystem");
+    builder.addSystem(leaf, "TestPostUpdateGameSystem");
+    builder.setDefaultState(leaf);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+
+    SystemProfiler::reset();
+    SystemProfiler::setEnabled(true);
+    EXPECT_TRUE(SystemProfiler::isEnabled());
+
+    TestUpdateArgs updateArgs;
+    stateTree.onUpdate(updateArgs);
+    stateTree.onPostUpdate(updateArgs);
+    stateTree.onDestroy();
+
+    SystemProfiler::setEnabled(false);
+
+    std::vector<ProfileSample> samples;
+    SystemProfiler::collect(samples);
+
+    if (!SystemProfiler::isCompiled()) {
+        EXPECT_TRUE(samples.empty());
+        return;
+    }
+
+    const ngen::GameSystemHash::Type updateHash = ngen::GameSystemHash::compute("TestUpdateGameSystem");
+    const ngen::GameSystemHash::Type postUpdateHash = ngen::GameSystemHash::compute("TestPostUpdateGameSystem");
+
+    const SystemHash leafId = stateTree.findState("leaf")->getId();
+
+    // Activation of both systems within the initial transition, a single update and post-update each wrapped
+    // within the span of the tree, then deactivation in reverse order
+    ASSERT_EQ(9, samples.size());
+    EXPECT_EQ(updateHash, samples[0].hash);
+    EXPECT_EQ(ProfilePhase::Activate, samples[0].phase);
+    EXPECT_EQ(postUpdateHash, samples[1].hash);
+    EXPECT_EQ(ProfilePhase::Activate, samples[1].phase);
+    EXPECT_EQ(leafId, samples[2].hash);
+    EXPECT_EQ(ProfilePhase::Transition, samples[2].phase);
+    EXPECT_EQ(0, samples[2].source);
+    EXPECT_EQ(0, samples[2].ancestor);
+    EXPECT_EQ(updateHash, samples[3].hash);
+    EXPECT_EQ(ProfilePhase::Update, samples[3].phase);
+    EXPECT_EQ(leafId, samples[4].hash);
+    EXPECT_EQ(ProfilePhase::TreeUpdate, samples[4].phase);
+    EXPECT_EQ(postUpdateHash, samples[5].hash);
+    EXPECT_EQ(ProfilePhase::PostUpdate, samples[5].phase);
+    EXPECT_EQ(leafId, samples[6].hash);
+    EXPECT_EQ(ProfilePhase::TreePostUpdate, samples[6].phase);
+    EXPECT_EQ(postUpdateHash, samples[7].hash);
+    EXPECT_EQ(ProfilePhase::Deactivate, samples[7].phase);
+    EXPECT_EQ(updateHash, samples[8].hash);
+    EXPECT_EQ(ProfilePhase::Deactivate, samples[8].phase);
+
+    // Spans of the tree enclose the system calls made within them
+    EXPECT_LE(samples[4].start, samples[3].start);
+    EXPECT_GE(samples[4].start + samples[4].duration, samples[3].start + samples[3].duration);
+}
+
+TEST(SystemProfiler, IncrementalTransition) {
+    ngen::GameSystemFactory factory;
+    NGEN_REGISTER_GAME_SYSTEM(factory, TestGameSystem);
+
+    StateTreeBuilder builder;
+
+    const size_t root = builder.addState("root");
+    const size_t menu = builder.addState("menu", root);
+    const size_t game = builder.addState("game", root);
+
+    builder.addSystem(root, "TestGameSystem");
+    builder.addSystem(menu, "TestGameSystem");
+    builder.addSystem(game, "TestGameSystem");
+    builder.setDefaultState(menu);
+
+    std::vector<uint8_t> image;
+    ASSERT_TRUE(builder.build(image));
+
+    StateTree stateTree;
+    ASSERT_TRUE(stateTree.load(factory, image.data(), image.size()));
+
+    ngen::InitArgs initArgs;
+    stateTree.onInitialize(initArgs);
+    stateTree.commitStateChange();
+
+    SystemProfiler::reset();
+    SystemProfiler::setEnabled(true);
+
+    // The transition completes within the commit, its sample follows the callbacks it made
+    stateTree.setTransitionBudget(1000000);
+    EXPECT_TRUE(stateTree.requestState("game"));
+    stateTree.commitStateChange();
+
+    SystemProfiler::setEnabled(false);
+
+    std::vector<ProfileSample> samples;
+    SystemProfiler::collect(samples);
+
+    if (!SystemProfiler::isCompiled()) {
+        EXPECT_TRUE(samples.empty());
+        stateTree.onDestroy();
+        return;
+    }
+
+    ASSERT_EQ(3, samples.size());
+    EXPECT_EQ(ProfilePhase::Deactivate, samples[0].phase);
+    EXPECT_EQ(ProfilePhase::Activate, samples[1].phase);
+    EXPECT_EQ(stateTree.getState(game)->getId(), samples[2].hash);
+    EXPECT_EQ(ProfilePhase::Transition, samples[2].phase);
+    EXPECT_EQ(stateTree.getState(menu)->getId(), samples[2].source);
+    EXPECT_EQ(stateTree.getState(root)->getId(), samples[2].ancestor);
+    EXPECT_LE(samples[2].start, samples[0].start);
+
+    stateTree.onDestroy();
+}
@@ -0,0 +1,70 @@
+//
+// Copyright 2017 nfactorial
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "system_profiler.h"
+#include "trace_writer.h"
+#include "gtest/gtest.h"
+
+using namespace ngen::StateSystem;
+
+static std::string readFile(const std::string &path) {
+    std::ifstream file(path);
+    std::stringstream contents;
+
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+TEST(TraceWriter, WriteEvents) {
+    const std::string path = "test_trace_writer.json";
+
+    SystemProfiler::reset();
+
+    TraceWriter writer;
+    EXPECT_FALSE(writer.isOpen());
+    EXPECT_EQ(0, writer.flush());
+
+    ASSERT_TRUE(writer.open(path.c_str()));
+    EXPECT_TRUE(writer.isOpen());
+
+    writer.setName(0x10, "RootState");
+    writer.setName(0x20, "Quote\"State");
+
+    const uint64_t start = SystemProfiler::now();
+    SystemProfiler::record(0x1234, ProfilePhase::Update, start);
+    SystemProfiler::record(0x20, ProfilePhase::Transition, start, 0x30, 0x10);
+
+    EXPECT_EQ(2, writer.flush());
+    EXPECT_EQ(0, writer.flush());
+
+    writer.close();
+    EXPECT_FALSE(writer.isOpen());
+
+    const std::string trace = readFile(path);
+    std::remove(path.c_str());
+
+    EXPECT_EQ(0, trace.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    EXPECT_NE(std::string::npos, trace.find("\"ph\":\"M\""));
+    EXPECT_NE(std::string::npos, trace.find("\"cat\":\"update\",\"name\":\"0x0000000000001234\""));
+    EXPECT_NE(std::string::npos, trace.find("\"cat\":\"transition\",\"name\":\"Quote\\\"State\""));
+    EXPECT_NE(std::string::npos, trace.find("\"from\":\"0x0000000000000030\",\"ancestor\":\"RootState\""));
+    EXPECT_NE(std::string::npos, trace.find("]}"));
+}